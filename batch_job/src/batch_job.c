@@ -13,10 +13,19 @@ See the file COPYING for details.
 #include "stringtools.h"
 #include "xxmalloc.h"
 
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+/* The number of files stat'ed at once by each round of batch_fs_stat_many. */
+#define STAT_MANY_CHUNK 65536
+/* Below this number of files, forking costs more than it saves. */
+#define STAT_MANY_MIN 1024
 
 extern const struct batch_queue_module batch_queue_amazon;
 extern const struct batch_queue_module batch_queue_lambda;
@@ -101,6 +110,7 @@ struct batch_queue *batch_queue_create(batch_queue_type_t type)
 	batch_queue_set_feature(q, "output_directories", "yes");
 	batch_queue_set_feature(q, "batch_log_name", "%s.batchlog");
 	batch_queue_set_feature(q, "gc_size", "yes");
+	batch_queue_set_feature(q, "local_fs", "yes");
 
 	q->module = NULL;
 	for (i = 0; batch_queue_modules[i]->type != BATCH_QUEUE_TYPE_UNKNOWN; i++)
@@ -289,4 +299,100 @@ int batch_fs_unlink (struct batch_queue *q, const char *path)
 	return q->module->fs.unlink(q, path);
 }
 
+struct stat_many_result {
+	int result;
+	struct stat buf;
+};
+
+static void batch_fs_stat_serial (struct batch_queue *q, int count, const char **paths, struct stat *bufs, int *results)
+{
+	struct stat buf;
+	int i;
+	for(i = 0; i < count; i++) {
+		results[i] = batch_fs_stat(q, paths[i], bufs ? &bufs[i] : &buf);
+	}
+}
+
+/*
+Each round forks nprocs children, each of which stats an interleaved
+share of the chunk and writes the results into a shared mapping.
+The calls are independent, so on a shared filesystem the latency of
+each round trip is overlapped with the others.
+*/
+
+static int batch_fs_stat_chunk (struct batch_queue *q, int count, const char **paths, struct stat *bufs, int *results, int nprocs)
+{
+	int i, p;
+	size_t length = count * sizeof(struct stat_many_result);
+
+	struct stat_many_result *shared = mmap(0, length, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED)
+		return 0;
+
+	pid_t *pids = xxmalloc(nprocs * sizeof(pid_t));
+	int started = 0;
+
+	for(p = 0; p < nprocs; p++) {
+		pid_t pid = fork();
+		if(pid == 0) {
+			for(i = p; i < count; i += nprocs) {
+				shared[i].result = batch_fs_stat(q, paths[i], &shared[i].buf);
+			}
+			_exit(0);
+		} else if(pid < 0) {
+			break;
+		}
+		pids[started++] = pid;
+	}
+
+	int ok = started == nprocs;
+	for(p = 0; p < started; p++) {
+		int status;
+		while(waitpid(pids[p], &status, 0) < 0) {
+			if(errno != EINTR) {
+				status = -1;
+				break;
+			}
+		}
+		if(status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ok = 0;
+	}
+
+	free(pids);
+
+	if(ok) {
+		for(i = 0; i < count; i++) {
+			results[i] = shared[i].result;
+			if(bufs)
+				bufs[i] = shared[i].buf;
+		}
+	}
+
+	munmap(shared, length);
+	return ok;
+}
+
+int batch_fs_stat_many (struct batch_queue *q, int count, const char **paths, struct stat *bufs, int *results, int nprocs)
+{
+	int i;
+
+	if(nprocs <= 1 || count < STAT_MANY_MIN || !batch_queue_supports_feature(q, "local_fs")) {
+		batch_fs_stat_serial(q, count, paths, bufs, results);
+		return count;
+	}
+
+	debug(D_BATCH, "checking %d files with %d processes", count, nprocs);
+
+	for(i = 0; i < count; i += STAT_MANY_CHUNK) {
+		int n = count - i < STAT_MANY_CHUNK ? count - i : STAT_MANY_CHUNK;
+		struct stat *b = bufs ? bufs + i : 0;
+		if(!batch_fs_stat_chunk(q, n, paths + i, b, results + i, nprocs)) {
+			debug(D_BATCH, "parallel stat failed, continuing serially: %s", strerror(errno));
+			batch_fs_stat_serial(q, n, paths + i, b, results + i);
+		}
+	}
+
+	return count;
+}
+
 /* vim: set noexpandtab tabstop=4: */
@@ -132,6 +132,21 @@ int batch_fs_mkdir (struct batch_queue *q, const char *path, mode_t mode, int re
 int batch_fs_putfile (struct batch_queue *q, const char *lpath, const char *rpath);
 int batch_fs_rename (struct batch_queue *q, const char *lpath, const char *rpath);
 int batch_fs_stat (struct batch_queue *q, const char *path, struct stat *buf);
+
+/** Stat a number of files at once.
+The result of @ref batch_fs_stat for each of paths[i] is stored in results[i],
+and the file information in bufs[i].  If the queue uses the local filesystem
+(feature "local_fs"), up to nprocs processes make the calls concurrently,
+which hides the latency of each call on a shared filesystem.
+@param q The batch queue.
+@param count The number of paths.
+@param paths An array of count paths.
+@param bufs An array of count stat buffers to fill, or null if only the results are needed.
+@param results An array of count results to fill.
+@param nprocs The largest number of processes to use.
+@return The number of paths checked.
+*/
+int batch_fs_stat_many (struct batch_queue *q, int count, const char **paths, struct stat *bufs, int *results, int nprocs);
 int batch_fs_unlink (struct batch_queue *q, const char *path);
 
 /** Converts a string into a batch queue type.
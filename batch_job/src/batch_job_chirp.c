@@ -258,6 +258,7 @@ static int batch_queue_chirp_create (struct batch_queue *q)
 	batch_queue_set_option(q, "tag", buffer_tostring(B));
 	batch_queue_set_feature(q, "local_job_queue", NULL);
 	batch_queue_set_feature(q, "gc_size", NULL);
+	batch_queue_set_feature(q, "local_fs", NULL);
 	return 0;
 }
 
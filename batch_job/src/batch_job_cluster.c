@@ -13,12 +13,17 @@ See the file COPYING for details.
 #include "xxmalloc.h"
 #include "jx.h"
 #include "jx_match.h"
+#include "buffer.h"
+#include "copy_stream.h"
+#include "list.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
 
 #include <sys/stat.h>
 
@@ -28,6 +33,9 @@ static char * cluster_remove_cmd = NULL;
 static char * cluster_options = NULL;
 static char * cluster_jobname_var = NULL;
 
+/* Jobs whose status files showed them finished, not yet returned by wait. */
+static struct list * cluster_finished_jobs = NULL;
+
 /*
 Principle of operation:
 Each batch job that we submit uses a wrapper file.
@@ -38,66 +46,105 @@ The command line to run is passed as the environment
 variable BATCH_JOB_COMMAND, because not all batch systems
 support precise passing of command line arguments.
 
-The wrapper then writes a status file, which indicates the
-starting and ending time of the task to a known log file,
-which batch_job_cluster_wait then periodically polls to observe completion.
+When the job is done, the wrapper writes a status file, which
+indicates the starting and ending time of the task, into a status
+directory, which batch_job_cluster_wait then periodically reads
+to observe completion.  The file is written under a hidden name
+and renamed into place, so that it is never seen half-written.
+Since a job's file only appears once it has finished, each poll
+costs one directory read, proportional to the number of jobs that
+finished since the last one, rather than one open per job.
 While this is not particularly elegant, there is no widely
 portable API for querying the state of a batch job in PBS-like systems.
 This method is simple, cheap, and reasonably effective.
 */
 
 /*
-setup_batch_wrapper creates the wrapper file if necessary,
-returning true on success and false on failure.
+setup_batch_wrapper creates the wrapper file and the status
+directory if necessary, returning true on success and false on failure.
+A wrapper left by an older version is replaced, as it would write
+its status files where they would never be seen.
 */
 
 static int setup_batch_wrapper(struct batch_queue *q, const char *sysname )
 {
+	static int wrapper_checked = 0;
+
 	char wrapperfile[PATH_MAX];
 	snprintf(wrapperfile, PATH_MAX, "%s.wrapper", sysname);
 
-	if(access(wrapperfile, R_OK | X_OK) == 0) return 1;
+	char statusdir[PATH_MAX];
+	snprintf(statusdir, PATH_MAX, "%s.status", sysname);
 
-	FILE *file = fopen(wrapperfile, "w");
-	if(!file) {
+	if(wrapper_checked && access(wrapperfile, R_OK | X_OK) == 0) return 1;
+
+	if(mkdir(statusdir, 0755) < 0 && errno != EEXIST) {
 		return 0;
 	}
-	fchmod(fileno(file), 0755);
 
 	char *path = getenv("PWD");
 
-	fprintf(file, "#!/bin/sh\n");
-	fprintf(file, "#$ -S /bin/sh\n");
+	buffer_t b;
+	buffer_init(&b);
+	buffer_abortonfailure(&b, 1);
+
+	buffer_putfstring(&b, "#!/bin/sh\n");
+	buffer_putfstring(&b, "#$ -S /bin/sh\n");
 
 	if(q->type == BATCH_QUEUE_TYPE_SLURM){
-		fprintf(file, "[ -n \"${SLURM_JOB_ID}\" ] && JOB_ID=`echo ${SLURM_JOB_ID} | cut -d . -f 1`\n");
+		buffer_putfstring(&b, "[ -n \"${SLURM_JOB_ID}\" ] && JOB_ID=`echo ${SLURM_JOB_ID} | cut -d . -f 1`\n");
 	} else {
 		// Some systems set PBS_JOBID, some set JOBID.
-		fprintf(file, "[ -n \"${PBS_JOBID}\" ] && JOB_ID=`echo ${PBS_JOBID} | cut -d . -f 1`\n");
+		buffer_putfstring(&b, "[ -n \"${PBS_JOBID}\" ] && JOB_ID=`echo ${PBS_JOBID} | cut -d . -f 1`\n");
 	}
 
 	if(q->type == BATCH_QUEUE_TYPE_TORQUE || q->type == BATCH_QUEUE_TYPE_PBS){
-		fprintf(file, "cd %s\n", path);
+		buffer_putfstring(&b, "cd %s\n", path);
 	}
 
-	// Each job writes out to its own log file.
-	fprintf(file, "logfile=%s.status.${JOB_ID}\n", sysname);
-	fprintf(file, "starttime=`date +%%s`\n");
-	fprintf(file, "cat > $logfile <<EOF\n");
-	fprintf(file, "start $starttime\n");
-	fprintf(file, "EOF\n\n");
+	buffer_putfstring(&b, "starttime=`date +%%s`\n\n");
 	// The command to run is taken from the environment.
-	fprintf(file, "eval \"$BATCH_JOB_COMMAND\"\n\n");
+	buffer_putfstring(&b, "eval \"$BATCH_JOB_COMMAND\"\n\n");
+
+	// When done, write the status and times to the job's file in the status directory.
+	buffer_putfstring(&b, "status=$?\n");
+	buffer_putfstring(&b, "stoptime=`date +%%s`\n");
+	buffer_putfstring(&b, "cat > %s/.${JOB_ID} <<EOF\n", statusdir);
+	buffer_putfstring(&b, "start $starttime\n");
+	buffer_putfstring(&b, "stop $status $stoptime\n");
+	buffer_putfstring(&b, "EOF\n");
+	buffer_putfstring(&b, "mv %s/.${JOB_ID} %s/${JOB_ID}\n", statusdir, statusdir);
+
+	size_t length;
+	const char *wrapper = buffer_tolstring(&b, &length);
+
+	char *existing = NULL;
+	size_t existing_length = 0;
+	int result = 1;
+
+	if(copy_file_to_buffer(wrapperfile, &existing, &existing_length) < 0 || existing_length != length || memcmp(existing, wrapper, length)) {
+		char tmpfile[PATH_MAX];
+		snprintf(tmpfile, PATH_MAX, "%s.wrapper.tmp", sysname);
+
+		FILE *file = fopen(tmpfile, "w");
+		if(file) {
+			fchmod(fileno(file), 0755);
+			fwrite(wrapper, 1, length, file);
+			if(fclose(file) != 0 || rename(tmpfile, wrapperfile) < 0) {
+				unlink(tmpfile);
+				result = 0;
+			}
+		} else {
+			result = 0;
+		}
+	}
 
-	// When done, write the status and time to the logfile.
-	fprintf(file, "status=$?\n");
-	fprintf(file, "stoptime=`date +%%s`\n");
-	fprintf(file, "cat >> $logfile <<EOF\n");
-	fprintf(file, "stop $status $stoptime\n");
-	fprintf(file, "EOF\n");
-	fclose(file);
+	free(existing);
+	buffer_free(&b);
 
-	return 1;
+	wrapper_checked = result;
+
+	return result;
 }
 
 static char *cluster_set_resource_string(struct batch_queue *q, const struct rmsummary *resources)
@@ -229,48 +276,91 @@ static batch_job_id_t batch_job_cluster_submit (struct batch_queue * q, const ch
 	return -1;
 }
 
+/*
+Read the status directory once, moving every job of ours that has
+finished onto cluster_finished_jobs.  Files of jobs that are not in
+the job table belong to another queue sharing the directory, and are
+left alone.
+*/
+
+static void batch_job_cluster_read_status(struct batch_queue *q)
+{
+	char statusdir[PATH_MAX];
+	snprintf(statusdir, PATH_MAX, "%s.status", cluster_name);
+
+	DIR *dir = opendir(statusdir);
+	if(!dir) {
+		debug(D_BATCH, "could not open status directory \"%s\": %s", statusdir, strerror(errno));
+		return;
+	}
+
+	struct dirent *d;
+	while((d = readdir(dir))) {
+		if(d->d_name[0] == '.')
+			continue;
+
+		char *end;
+		batch_job_id_t jobid = strtoll(d->d_name, &end, 10);
+		if(*end)
+			continue;
+
+		struct batch_job_info *info = itable_lookup(q->job_table, jobid);
+		if(!info)
+			continue;
+
+		char *statusfile = string_format("%s/%s", statusdir, d->d_name);
+		FILE *file = fopen(statusfile, "r");
+		if(file) {
+			int t, c;
+			char line[BATCH_JOB_LINE_MAX];
+			while(fgets(line, sizeof(line), file)) {
+				if(sscanf(line, "start %d", &t)) {
+					info->started = t;
+				} else if(sscanf(line, "stop %d %d", &c, &t) == 2) {
+					debug(D_BATCH, "job %" PRIbjid " complete", jobid);
+					if(!info->started)
+						info->started = t;
+					info->finished = t;
+					info->exited_normally = 1;
+					info->exit_code = c;
+				}
+			}
+			fclose(file);
+
+			if(info->finished != 0) {
+				unlink(statusfile);
+				list_push_tail(cluster_finished_jobs, (void *) (uintptr_t) jobid);
+			}
+		} else {
+			debug(D_BATCH, "could not open status file \"%s\"", statusfile);
+		}
+
+		free(statusfile);
+	}
+
+	closedir(dir);
+}
+
 static batch_job_id_t batch_job_cluster_wait (struct batch_queue * q, struct batch_job_info * info_out, time_t stoptime)
 {
 	struct batch_job_info *info;
 	batch_job_id_t jobid;
-	int t, c;
+
+	if(!cluster_finished_jobs)
+		cluster_finished_jobs = list_create();
 
 	while(1) {
-		UINT64_T ujobid;
-		itable_firstkey(q->job_table);
-		while(itable_nextkey(q->job_table, &ujobid, (void **) &info)) {
-			jobid = ujobid;
-			char *statusfile = string_format("%s.status.%" PRIbjid, cluster_name, jobid);
-			FILE *file = fopen(statusfile, "r");
-			if(file) {
-				char line[BATCH_JOB_LINE_MAX];
-				while(fgets(line, sizeof(line), file)) {
-					if(sscanf(line, "start %d", &t)) {
-						info->started = t;
-					} else if(sscanf(line, "stop %d %d", &c, &t) == 2) {
-						debug(D_BATCH, "job %" PRIbjid " complete", jobid);
-						if(!info->started)
-							info->started = t;
-						info->finished = t;
-						info->exited_normally = 1;
-						info->exit_code = c;
-					}
-				}
-				fclose(file);
-
-				if(info->finished != 0) {
-					unlink(statusfile);
-					info = itable_remove(q->job_table, jobid);
-					*info_out = *info;
-					free(info);
-					free(statusfile);
-					return jobid;
-				}
-			} else {
-				debug(D_BATCH, "could not open status file \"%s\"", statusfile);
+		if(list_size(cluster_finished_jobs) < 1)
+			batch_job_cluster_read_status(q);
+
+		while(list_size(cluster_finished_jobs) > 0) {
+			jobid = (uintptr_t) list_pop_head(cluster_finished_jobs);
+			info = itable_remove(q->job_table, jobid);
+			if(info) {
+				*info_out = *info;
+				free(info);
+				return jobid;
 			}
-
-			free(statusfile);
 		}
 
 		if(itable_size(q->job_table) <= 0)
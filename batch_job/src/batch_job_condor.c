@@ -176,6 +176,10 @@ static batch_job_id_t batch_job_condor_submit (struct batch_queue *q, const char
 			fprintf(file, "request_disk = %" PRId64 "\n", disk);
 	}
 
+	const char *priority = batch_queue_get_option(q, "task-priority");
+	if(priority)
+		fprintf(file, "priority = %s\n", priority);
+
 	if(options)
 		fprintf(file, "%s\n", options);
 
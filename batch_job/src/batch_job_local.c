@@ -11,19 +11,188 @@ See the file COPYING for details.
 #include "macros.h"
 #include "stringtools.h"
 
+#include "xxmalloc.h"
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <signal.h>
+#include <ctype.h>
+#include <spawn.h>
+
+extern char **environ;
+
+/*
+Jobs are started with posix_spawn rather than fork and exec.
+A forked child copies the page tables of its parent, which makes
+launching a job slow when the parent is large, such as a makeflow
+holding a big workflow in memory.  posix_spawn avoids the copy,
+(glibc implements it with clone(CLONE_VM|CLONE_VFORK)) so the job
+environment is built as an array here, rather than by calling
+setenv in the child.
+*/
+
+static char **batch_job_local_environment(struct jx *envlist)
+{
+	int count = 0;
+	char **e;
+
+	for(e = environ; *e; e++)
+		count++;
+
+	struct jx_pair *p;
+	if(envlist && jx_istype(envlist, JX_OBJECT)) {
+		for(p = envlist->u.pairs; p; p = p->next)
+			count++;
+	}
+
+	char **env = xxmalloc((count + 1) * sizeof(char *));
+	int n = 0;
+
+	/* The variables in envlist replace those of the same name, the last one winning, as with jx_export. */
+	if(envlist && jx_istype(envlist, JX_OBJECT)) {
+		for(p = envlist->u.pairs; p; p = p->next) {
+			if(p->key->type != JX_STRING || p->value->type != JX_STRING)
+				continue;
+
+			const char *name = p->key->u.string_value;
+			size_t length = strlen(name);
+			char *var = string_format("%s=%s", name, p->value->u.string_value);
+
+			int i;
+			for(i = 0; i < n; i++) {
+				if(!strncmp(env[i], name, length) && env[i][length] == '=')
+					break;
+			}
+
+			if(i < n) {
+				free(env[i]);
+				env[i] = var;
+			} else {
+				env[n++] = var;
+			}
+		}
+	}
+
+	int overrides = n;
+
+	for(e = environ; *e; e++) {
+		size_t length = strcspn(*e, "=");
+
+		int i;
+		for(i = 0; i < overrides; i++) {
+			if(!strncmp(env[i], *e, length) && env[i][length] == '=')
+				break;
+		}
+
+		if(i == overrides)
+			env[n++] = xxstrdup(*e);
+	}
+
+	env[n] = 0;
+
+	return env;
+}
+
+static void batch_job_local_free_strings(char **strings)
+{
+	char **s;
+	for(s = strings; *s; s++)
+		free(*s);
+	free(strings);
+}
+
+/*
+A command made only of words of plain characters can be run
+directly, saving the start of a shell.  Anything the shell would
+interpret, such as quotes, variables, globs, redirection, or a
+leading assignment, goes through sh -c as before, as do commands
+that the shell implements itself, which may differ from a program
+of the same name.  Returns the words of the command, or null if
+it needs the shell.
+*/
+
+static const char *shell_builtins[] = {
+	"cd", "command", "echo", "eval", "exec", "exit", "export", "kill", "printf", "pwd",
+	"read", "set", "test", "time", "type", "ulimit", "umask", "unset", "wait", 0
+};
+
+static char **batch_job_local_direct_argv(const char *cmd)
+{
+	const char *c;
+	int words = 0;
+	int in_word = 0;
+
+	for(c = cmd; *c; c++) {
+		if(*c == ' ' || *c == '\t') {
+			in_word = 0;
+		} else if(isalnum((int) *c) || strchr("_-./,:+@%", *c) || (*c == '=' && words > 1)) {
+			if(!in_word)
+				words++;
+			in_word = 1;
+		} else {
+			return 0;
+		}
+	}
+
+	if(words < 1)
+		return 0;
+
+	char **argv = xxmalloc((words + 1) * sizeof(char *));
+	char *copy = xxstrdup(cmd);
+	char *saveptr;
+	int n = 0;
+
+	char *word;
+	for(word = strtok_r(copy, " \t", &saveptr); word; word = strtok_r(0, " \t", &saveptr)) {
+		argv[n++] = xxstrdup(word);
+	}
+	argv[n] = 0;
+
+	free(copy);
+
+	const char **b;
+	for(b = shell_builtins; *b; b++) {
+		if(!strcmp(argv[0], *b)) {
+			batch_job_local_free_strings(argv);
+			return 0;
+		}
+	}
+
+	return argv;
+}
 
 static batch_job_id_t batch_job_local_submit (struct batch_queue *q, const char *cmd, const char *extra_input_files, const char *extra_output_files, struct jx *envlist, const struct rmsummary *resources )
 {
-	batch_job_id_t jobid;
+	pid_t pid;
+	int result = -1;
+
+	char **env = batch_job_local_environment(envlist);
+
+	/* The search for the program uses our PATH, so a job given its own PATH goes through the shell. */
+	char **argv = 0;
+	if(!envlist || !jx_lookup_string(envlist, "PATH"))
+		argv = batch_job_local_direct_argv(cmd);
 
-	fflush(NULL);
-	jobid = fork();
-	if(jobid > 0) {
+	if(argv) {
+		result = posix_spawnp(&pid, argv[0], 0, 0, argv, env);
+		batch_job_local_free_strings(argv);
+
+		/* Let the shell report a missing program, or run a script without #!, as before. */
+		if(result != 0)
+			debug(D_BATCH, "couldn't run %s directly, using the shell: %s", cmd, strerror(result));
+	}
+
+	if(result != 0) {
+		char *shell_argv[] = { "sh", "-c", (char *) cmd, 0 };
+		result = posix_spawnp(&pid, "sh", 0, 0, shell_argv, env);
+	}
+
+	batch_job_local_free_strings(env);
+
+	if(result == 0) {
+		batch_job_id_t jobid = pid;
 		debug(D_BATCH, "started process %" PRIbjid ": %s", jobid, cmd);
 		struct batch_job_info *info = malloc(sizeof(*info));
 		memset(info, 0, sizeof(*info));
@@ -31,37 +200,10 @@ static batch_job_id_t batch_job_local_submit (struct batch_queue *q, const char
 		info->started = time(0);
 		itable_insert(q->job_table, jobid, info);
 		return jobid;
-	} else if(jobid < 0) {
-		debug(D_BATCH, "couldn't create new process: %s\n", strerror(errno));
-		return -1;
 	} else {
-		/** The following code works but would duplicates the current process because of the system() function.
-		int result = system(cmd);
-		if(WIFEXITED(result)) {
-			_exit(WEXITSTATUS(result));
-		} else {
-			_exit(1);
-		}*/
-
-		if(envlist) {
-			jx_export(envlist);
-		}
-
-		/** A note from "man system 3" as of Jan 2012:
-		 * Do not use system() from a program with set-user-ID or set-group-ID
-		 * privileges, because strange values for some environment variables
-		 * might be used to subvert system integrity. Use the exec(3) family of
-		 * functions instead, but not execlp(3) or execvp(3). system() will
-		 * not, in fact, work properly from programs with set-user-ID or
-		 * set-group-ID privileges on systems on which /bin/sh is bash version
-		 * 2, since bash 2 drops privileges on startup. (Debian uses a modified
-		 * bash which does not do this when invoked as sh.)
-		 */
-
-		execlp("sh", "sh", "-c", cmd, (char *) 0);
-		_exit(127);	// Failed to execute the cmd.
+		debug(D_BATCH, "couldn't create new process: %s\n", strerror(result));
+		return -1;
 	}
-	return -1;
 }
 
 static batch_job_id_t batch_job_local_wait (struct batch_queue * q, struct batch_job_info * info_out, time_t stoptime)
@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Measure the rate at which the local batch queue starts jobs, while
+the calling process holds a given amount of memory, as makeflow does
+when it holds a large workflow.  A few jobs are kept running at once.
+Each size is run once with a command that is started directly, and
+once with one that needs the shell.
+
+Example use:
+	batch_job_local_benchmark 1000 0 1024 4096
+*/
+
+#include "batch_job.h"
+#include "timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JOBS_RUNNING 8
+
+static void benchmark(struct batch_queue *q, const char *cmd, int count, size_t megabytes)
+{
+	struct batch_job_info info;
+	int i;
+
+	timestamp_t start = timestamp_get();
+	for(i = 0; i < count; i++) {
+		if(batch_job_submit(q, cmd, 0, 0, 0, 0) < 0) {
+			fprintf(stderr, "couldn't submit %s\n", cmd);
+			exit(1);
+		}
+		if(i >= JOBS_RUNNING)
+			batch_job_wait(q, &info);
+	}
+	while(batch_job_wait(q, &info) > 0) {
+	}
+	timestamp_t elapsed = timestamp_get() - start;
+
+	printf("%8zu MB %-20s %8d jobs %10.3fs %10.0f jobs/s\n",
+		megabytes, cmd, count, elapsed / 1000000.0,
+		elapsed ? count / (elapsed / 1000000.0) : 0);
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc < 3) {
+		fprintf(stderr, "use: %s <jobs> <megabytes> [megabytes ...]\n", argv[0]);
+		return 1;
+	}
+
+	int count = atoi(argv[1]);
+	struct batch_queue *q = batch_queue_create(BATCH_QUEUE_TYPE_LOCAL);
+
+	int i;
+	for(i = 2; i < argc; i++) {
+		size_t megabytes = strtoull(argv[i], 0, 10);
+
+		/* Touch every page, so that it is really part of the process. */
+		char *memory = malloc(megabytes * 1024 * 1024 + 1);
+		if(!memory) {
+			fprintf(stderr, "couldn't allocate %zu MB\n", megabytes);
+			return 1;
+		}
+		memset(memory, 1, megabytes * 1024 * 1024 + 1);
+
+		benchmark(q, "true", count, megabytes);
+		benchmark(q, "true > /dev/null", count, megabytes);
+
+		free(memory);
+	}
+
+	batch_queue_delete(q);
+
+	return 0;
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -0,0 +1,277 @@
+/*
+Copyright (C) 2018- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Convert the text logs of a DeltaDB history directory into
+archives, and optionally compare the space and scan time of each.
+*/
+
+#include "jx_archive.h"
+#include "jx_parse.h"
+
+#include "cctools.h"
+#include "getopt.h"
+#include "stringtools.h"
+#include "timestamp.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_LINE_MAX 65536
+
+static int remove_logs = 0;
+static int benchmark = 0;
+
+static INT64_T total_log_bytes = 0;
+static INT64_T total_archive_bytes = 0;
+static timestamp_t total_log_time = 0;
+static timestamp_t total_archive_time = 0;
+static INT64_T total_records = 0;
+
+static INT64_T file_size( const char *filename )
+{
+	struct stat info;
+	if(stat(filename,&info)<0) return 0;
+	return info.st_size;
+}
+
+/* Parse each record of a text log in the same way as deltadb_query. */
+
+static INT64_T scan_log( const char *filename )
+{
+	char line[LOG_LINE_MAX];
+	char value[LOG_LINE_MAX];
+	char name[LOG_LINE_MAX];
+	char key[LOG_LINE_MAX];
+	long long current;
+	INT64_T records = 0;
+
+	FILE *file = fopen(filename,"r");
+	if(!file) return -1;
+
+	while(fgets(line,sizeof(line),file)) {
+		if(line[0]=='C' && sscanf(line,"C %s %[^\n]",key,value)==2) {
+			jx_delete(jx_parse_string(value));
+		} else if(line[0]=='U' && sscanf(line,"U %s %s %[^\n]",key,name,value)==3) {
+			struct jx *j = jx_parse_string(value);
+			if(!j) continue;
+			jx_delete(j);
+		} else if(line[0]=='D' && sscanf(line,"D %s",key)==1) {
+		} else if(line[0]=='R' && sscanf(line,"R %s %s",key,name)==2) {
+		} else if(line[0]=='T' && sscanf(line,"T %lld",&current)==1) {
+		} else {
+			continue;
+		}
+		records++;
+	}
+
+	fclose(file);
+	return records;
+}
+
+static INT64_T scan_archive( const char *filename )
+{
+	struct jx_archive_record r;
+	INT64_T records = 0;
+
+	struct jx_archive *a = jx_archive_open(filename);
+	if(!a) return -1;
+
+	while(jx_archive_read(a,&r)) {
+		jx_delete(r.value);
+		records++;
+	}
+
+	jx_archive_close(a);
+	return records;
+}
+
+static void benchmark_day( const char *logname, const char *archivename, const char *label )
+{
+	INT64_T log_bytes = file_size(logname);
+	INT64_T archive_bytes = file_size(archivename);
+
+	timestamp_t start = timestamp_get();
+	INT64_T log_records = scan_log(logname);
+	timestamp_t log_time = timestamp_get() - start;
+
+	start = timestamp_get();
+	INT64_T archive_records = scan_archive(archivename);
+	timestamp_t archive_time = timestamp_get() - start;
+
+	if(log_records!=archive_records) {
+		fprintf(stderr,"deltadb_archive: %s has %lld records but %s has %lld\n",logname,(long long)log_records,archivename,(long long)archive_records);
+	}
+
+	printf("%-12s %14lld %14lld %7.1fx %11.3fs %11.3fs\n",
+		label,
+		(long long)log_bytes,
+		(long long)archive_bytes,
+		archive_bytes ? (double)log_bytes/archive_bytes : 0,
+		log_time/1000000.0,
+		archive_time/1000000.0);
+
+	total_log_bytes += log_bytes;
+	total_archive_bytes += archive_bytes;
+	total_log_time += log_time;
+	total_archive_time += archive_time;
+	total_records += log_records;
+}
+
+static int archive_day( const char *dbdir, int year, int day )
+{
+	char *logname = string_format("%s/%d/%d.log",dbdir,year,day);
+	char *indexname = string_format("%s/%d/%d.index",dbdir,year,day);
+	char *archivename = string_format("%s/%d/%d.jxa",dbdir,year,day);
+	char *label = string_format("%d/%d",year,day);
+	int result = 1;
+
+	if(access(archivename,F_OK)!=0) {
+		if(jx_archive_convert(logname,indexname,archivename)) {
+			printf("archived %s\n",logname);
+		} else {
+			fprintf(stderr,"deltadb_archive: couldn't archive %s\n",logname);
+			result = 0;
+		}
+	}
+
+	if(result && benchmark) benchmark_day(logname,archivename,label);
+
+	if(result && remove_logs) {
+		unlink(logname);
+		unlink(indexname);
+	}
+
+	free(logname);
+	free(indexname);
+	free(archivename);
+	free(label);
+
+	return result;
+}
+
+/*
+Archive every log in the directory of one year, except for
+the log of the current day, which may still be written.
+The current day is reckoned in UTC, as by jx_database.
+*/
+
+static int archive_year( const char *dbdir, int year )
+{
+	time_t current = time(0);
+	struct tm *t = gmtime(&current);
+	int result = 1;
+
+	char *dirname = string_format("%s/%d",dbdir,year);
+	DIR *dir = opendir(dirname);
+	free(dirname);
+	if(!dir) return 0;
+
+	struct dirent *d;
+	while((d=readdir(dir))) {
+		int day;
+		char suffix[8];
+		if(sscanf(d->d_name,"%d.%7s",&day,suffix)!=2 || strcmp(suffix,"log")) continue;
+		if(year==t->tm_year+1900 && day==t->tm_yday) continue;
+		if(!archive_day(dbdir,year,day)) result = 0;
+	}
+
+	closedir(dir);
+	return result;
+}
+
+static void show_help( const char *cmd )
+{
+	printf("use: %s [options] <dbdir>\n",cmd);
+	printf("Where options are:\n");
+	printf("  --benchmark         Compare the size and scan time of each log and its archive.\n");
+	printf("  --remove            Remove each text log and index once it is archived.\n");
+	printf("  --version           Show software version.\n");
+	printf("  --help              Show this help text.\n");
+}
+
+static struct option long_options[] =
+{
+	{"benchmark", no_argument, 0, 'b'},
+	{"remove", no_argument, 0, 'r'},
+	{"version", no_argument, 0, 'v'},
+	{"help", no_argument, 0, 'h'},
+	{0,0,0,0}
+};
+
+int main( int argc, char *argv[] )
+{
+	int c;
+
+	while((c=getopt_long(argc,argv,"brvh",long_options,0))!=-1) {
+		switch(c) {
+		case 'b':
+			benchmark = 1;
+			break;
+		case 'r':
+			remove_logs = 1;
+			break;
+		case 'v':
+			cctools_version_print(stdout,"deltadb_archive");
+			return 0;
+		case 'h':
+		default:
+			show_help(argv[0]);
+			return 1;
+		}
+	}
+
+	if(argc-optind!=1) {
+		show_help(argv[0]);
+		return 1;
+	}
+
+	const char *dbdir = argv[optind];
+
+	DIR *dir = opendir(dbdir);
+	if(!dir) {
+		fprintf(stderr,"deltadb_archive: couldn't open %s: %s\n",dbdir,strerror(errno));
+		return 1;
+	}
+
+	if(benchmark) {
+		printf("%-12s %14s %14s %8s %12s %12s\n","day","log bytes","archive bytes","ratio","log scan","archive scan");
+	}
+
+	int result = 1;
+	struct dirent *d;
+	while((d=readdir(dir))) {
+		int year;
+		char extra;
+		if(sscanf(d->d_name,"%d%c",&year,&extra)!=1) continue;
+		if(!archive_year(dbdir,year)) result = 0;
+	}
+
+	closedir(dir);
+
+	if(benchmark && total_archive_bytes>0) {
+		printf("%-12s %14lld %14lld %7.1fx %11.3fs %11.3fs\n",
+			"total",
+			(long long)total_log_bytes,
+			(long long)total_archive_bytes,
+			(double)total_log_bytes/total_archive_bytes,
+			total_log_time/1000000.0,
+			total_archive_time/1000000.0);
+		printf("scan rate: %.0f records/s from logs, %.0f records/s from archives\n",
+			total_log_time ? total_records/(total_log_time/1000000.0) : 0,
+			total_archive_time ? total_records/(total_archive_time/1000000.0) : 0);
+	}
+
+	return result ? 0 : 1;
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -13,6 +13,7 @@ See the file COPYING for details.
 #include "jx_parse.h"
 
 #include "hash_table.h"
+#include "copy_stream.h"
 #include "debug.h"
 #include "getopt.h"
 #include "cctools.h"
@@ -28,8 +29,13 @@ See the file COPYING for details.
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <unistd.h>
+
+#define LOG_LINE_MAX 65536
 
 struct deltadb {
 	struct hash_table *table;
@@ -43,6 +49,7 @@ struct deltadb {
 	time_t display_every;
 	time_t last_display;
 	time_t deferred_time;
+	int started;
 };
 
 enum { MODE_STREAM, MODE_OBJECT, MODE_REDUCE } display_mode = MODE_REDUCE;
@@ -138,6 +145,35 @@ static int checkpoint_read( struct deltadb *db, const char *filename )
 	return 1;
 }
 
+static int compare_keys( const void *a, const void *b )
+{
+	return strcmp(*(const char **)a,*(const char **)b);
+}
+
+/*
+Return the keys of the table in sorted order, so that objects are
+visited in the same order no matter how the table was constructed,
+whether by replaying the log from one checkpoint or another.
+*/
+
+static char ** sorted_keys( struct deltadb *db, int *count )
+{
+	char **keys = malloc(sizeof(char*)*(hash_table_size(db->table)+1));
+	char *key;
+	void *value;
+	int n = 0;
+
+	hash_table_firstkey(db->table);
+	while(hash_table_nextkey(db->table,&key,&value)) {
+		keys[n++] = key;
+	}
+
+	qsort(keys,n,sizeof(char*),compare_keys);
+
+	*count = n;
+	return keys;
+}
+
 static void display_reduce_exprs( struct deltadb *db, time_t current )
 {
 	/* Reset all reductions. */
@@ -148,10 +184,10 @@ static void display_reduce_exprs( struct deltadb *db, time_t current )
 
 	/* For each item in the hash table: */
 
-	char *key;
-	struct jx *jobject;
-	hash_table_firstkey(db->table);
-	while(hash_table_nextkey(db->table,&key,(void**)&jobject)) {
+	int nkeys;
+	char **keys = sorted_keys(db,&nkeys);
+	for(int i=0;i<nkeys;i++) {
+		struct jx *jobject = hash_table_lookup(db->table,keys[i]);
 
 		/* Skip if the where expression doesn't match */
 		if(!deltadb_boolean_expr(db->where_expr,jobject)) continue;
@@ -175,6 +211,8 @@ static void display_reduce_exprs( struct deltadb *db, time_t current )
 		}
 	}
 
+	free(keys);
+
 	/* Emit the current time */
 
 	if(db->epoch_mode) {
@@ -199,10 +237,10 @@ static void display_output_exprs( struct deltadb *db, time_t current )
 {
 	/* For each item in the table... */
 
-	char *key;
-	struct jx *jobject;
-	hash_table_firstkey(db->table);
-	while(hash_table_nextkey(db->table,&key,(void**)&jobject)) {
+	int nkeys;
+	char **keys = sorted_keys(db,&nkeys);
+	for(int i=0;i<nkeys;i++) {
+		struct jx *jobject = hash_table_lookup(db->table,keys[i]);
 
 		/* Skip if the where expression doesn't match */
 
@@ -230,6 +268,8 @@ static void display_output_exprs( struct deltadb *db, time_t current )
 
 		printf("\n");
 	}
+
+	free(keys);
 }
 
 /*
@@ -255,7 +295,7 @@ int deltadb_create_event( struct deltadb *db, const char *key, struct jx *jobjec
 
 	hash_table_insert(db->table,key,jobject);
 
-	if(display_mode==MODE_STREAM) {
+	if(display_mode==MODE_STREAM && db->started) {
 		display_deferred_time(db);
 		printf("C %s ",key);
 		jx_print_stream(jobject,stdout);
@@ -271,7 +311,7 @@ int deltadb_delete_event( struct deltadb *db, const char *key )
 	if(jobject) {
 		jx_delete(jobject);
 
-		if(display_mode==MODE_STREAM) {
+		if(display_mode==MODE_STREAM && db->started) {
 			display_deferred_time(db);
 			printf("D %s\n",key);
 		}
@@ -291,7 +331,7 @@ int deltadb_update_event( struct deltadb *db, const char *key, const char *name,
 	jx_delete(jx_remove(jobject,jname));
 	jx_insert(jobject,jname,jvalue);
 
-	if(display_mode==MODE_STREAM) {
+	if(display_mode==MODE_STREAM && db->started) {
 		display_deferred_time(db);
 		char *str = jx_print_string(jvalue);
 		printf("U %s %s %s\n",key,name,str);
@@ -310,7 +350,7 @@ int deltadb_remove_event( struct deltadb *db, const char *key, const char *name
 	jx_delete(jx_remove(jobject,jname));
 	jx_delete(jname);
 
-	if(display_mode==MODE_STREAM) {
+	if(display_mode==MODE_STREAM && db->started) {
 		display_deferred_time(db);
 		printf("R %s %s\n",key,name);
 		return 1;
@@ -323,6 +363,11 @@ int deltadb_time_event( struct deltadb *db, time_t starttime, time_t stoptime, t
 {
 	if(current>stoptime) return 0;
 
+	/* Events before the start time update the state but are not displayed. */
+	if(current<starttime) return 1;
+
+	db->started = 1;
+
 	if(current < (db->last_display + db->display_every)) return 1;
 
 	db->last_display = current;
@@ -358,6 +403,135 @@ static int days_in_year( int y )
 	}
 }
 
+/* Advance year and day to the following day. */
+
+static void next_day( int *year, int *day )
+{
+	(*day)++;
+	if(*day>=days_in_year(*year)) {
+		(*year)++;
+		*day = 0;
+	}
+}
+
+static int day_after( int year, int day, int stopyear, int stopday )
+{
+	return year>stopyear || (year==stopyear && day>stopday);
+}
+
+/*
+Load the state of the table as of starttime on the given day.
+If the day has an index of intra-day checkpoints, start from the
+nearest one and return the corresponding offset in the log, or
+the record number in the archive if the day has been archived.
+Otherwise, start from the daily checkpoint and return zero.
+*/
+
+static long log_checkpoint_read( struct deltadb *db, int year, int day, time_t starttime )
+{
+	time_t indextime;
+	long offset = 0;
+	int found;
+
+	/* An archived day keeps its index as record numbers within the archive. */
+	char *filename = string_format("%s/%d/%d.jxa",db->logdir,year,day);
+	if(access(filename,F_OK)==0) {
+		INT64_T record = 0;
+		found = jx_archive_mark_lookup(filename,starttime,&indextime,&record);
+		offset = record;
+	} else {
+		free(filename);
+		filename = string_format("%s/%d/%d.index",db->logdir,year,day);
+		found = jx_database_index_lookup(filename,starttime,&indextime,&offset);
+	}
+
+	if(found && offset>0) {
+		free(filename);
+		filename = string_format("%s/%d/%d.%lld.ckpt",db->logdir,year,day,(long long)indextime);
+		if(!checkpoint_read(db,filename)) offset = 0;
+	}
+	free(filename);
+
+	if(offset==0) {
+		filename = string_format("%s/%d/%d.ckpt",db->logdir,year,day);
+		checkpoint_read(db,filename);
+		free(filename);
+	}
+
+	return offset;
+}
+
+/* Open the archive of a day, if the day has been archived. */
+
+static struct jx_archive * log_archive_open( struct deltadb *db, int year, int day )
+{
+	char *filename = string_format("%s/%d/%d.jxa",db->logdir,year,day);
+	struct jx_archive *archive = jx_archive_open(filename);
+	free(filename);
+	return archive;
+}
+
+/*
+Play the log files from year/day through stopyear/stopday,
+beginning at offset in the first file that can be opened.
+Each day is read from its archive if it has one, or its text log otherwise.
+*/
+
+static void log_play_days( struct deltadb *db, int year, int day, int stopyear, int stopday, long offset, time_t starttime, time_t stoptime )
+{
+	int file_errors = 0;
+
+	while(1) {
+		struct jx_archive *archive = log_archive_open(db,year,day);
+		if(archive) {
+			if(offset>0) {
+				jx_archive_skip(archive,offset);
+				offset = 0;
+			}
+
+			int keepgoing = deltadb_process_archive(db,archive,starttime,stoptime);
+			starttime = 0;
+
+			jx_archive_close(archive);
+
+			// If we reached the endtime in the archive, stop.
+			if(!keepgoing) break;
+
+		} else {
+			char *filename = string_format("%s/%d/%d.log",db->logdir,year,day);
+			FILE *file = fopen(filename,"r");
+			if(!file) {
+				file_errors += 1;
+				fprintf(stderr,"couldn't open %s: %s\n",filename,strerror(errno));
+				free(filename);
+				if (file_errors>5)
+					break;
+
+			} else {
+				free(filename);
+
+				if(offset>0) {
+					fseek(file,offset,SEEK_SET);
+					offset = 0;
+				}
+
+				int keepgoing = deltadb_process_stream(db,file,starttime,stoptime);
+				starttime = 0;
+
+				fclose(file);
+
+				// If we reached the endtime in the file, stop.
+				if(!keepgoing) break;
+			}
+		}
+
+		next_day(&year,&day);
+
+		// If we have passed the file, stop.
+		if(day_after(year,day,stopyear,stopday)) break;
+	}
+}
+
 /*
 Play the log from starttime to stoptime by opening the appropriate
 checkpoint file and working ahead in the various log files.
@@ -365,8 +539,6 @@ checkpoint file and working ahead in the various log files.
 
 static int log_play_time( struct deltadb *db, time_t starttime, time_t stoptime )
 {
-	int file_errors = 0;
-
 	struct tm *starttm = localtime(&starttime);
 
 	int year = starttm->tm_year + 1900;
@@ -377,42 +549,321 @@ static int log_play_time( struct deltadb *db, time_t starttime, time_t stoptime
 	int stopyear = stoptm->tm_year + 1900;
 	int stopday = stoptm->tm_yday;
 
-	char *filename = string_format("%s/%d/%d.ckpt",db->logdir,year,day);
-	checkpoint_read(db,filename);
+	long offset = log_checkpoint_read(db,year,day,starttime);
+
+	log_play_days(db,year,day,stopyear,stopday,offset,starttime,stoptime);
+
+	return 1;
+}
+
+/*
+Scan only the T records of one log file, following the times at
+which deltadb_time_event would display output, without the cost of
+parsing and applying the other records.  Returns false if the file
+could not be opened.
+*/
+
+static int log_scan_times( struct deltadb *db, int year, int day, long offset, time_t starttime, time_t stoptime, time_t *last_display )
+{
+	char line[LOG_LINE_MAX];
+	long long current;
+
+	struct jx_archive *archive = log_archive_open(db,year,day);
+	if(archive) {
+		struct jx_archive_record r;
+		if(offset>0) jx_archive_skip(archive,offset);
+		while(jx_archive_read(archive,&r)) {
+			jx_delete(r.value);
+			if(r.type!='T') continue;
+			if(r.time>stoptime) break;
+			if(r.time<starttime) continue;
+			if(r.time < (*last_display + db->display_every)) continue;
+			*last_display = r.time;
+		}
+		jx_archive_close(archive);
+		return 1;
+	}
+
+	char *filename = string_format("%s/%d/%d.log",db->logdir,year,day);
+	FILE *file = fopen(filename,"r");
 	free(filename);
+	if(!file) return 0;
+
+	if(offset>0) fseek(file,offset,SEEK_SET);
+
+	while(fgets(line,sizeof(line),file)) {
+		if(line[0]=='C') {
+			/* An old style create record is followed by an nvpair block. */
+			char *s = line+1;
+			while(isspace(*s)) s++;
+			while(*s && !isspace(*s)) s++;
+			while(isspace(*s)) s++;
+			if(*s) continue;
+
+			int pairs = 0;
+			while(fgets(line,sizeof(line),file)) {
+				if(line[0]=='\n') {
+					if(pairs) break;
+				} else {
+					pairs++;
+				}
+			}
+		} else if(line[0]=='T') {
+			if(sscanf(line,"T %lld",&current)!=1) continue;
+			if(current>stoptime) break;
+			if(current<starttime) continue;
+			if(current < (*last_display + db->display_every)) continue;
+			*last_display = current;
+		}
+	}
+
+	fclose(file);
+	return 1;
+}
+
+/*
+A range of consecutive days of history to be played by one process.
+*/
+
+struct log_segment {
+	int year;
+	int day;
+	int stopyear;
+	int stopday;
+	time_t last_display;
+	FILE *output;
+	pid_t pid;
+};
+
+struct log_day {
+	int year;
+	int day;
+	int64_t size;
+	int exists;
+	int checkpoint;
+};
+
+/*
+Stop the processes started for the first count segments,
+and discard their output.
+*/
+
+static void log_segments_abort( struct log_segment *segments, int count )
+{
+	for(int i=0;i<count;i++) {
+		struct log_segment *s = &segments[i];
+		if(s->pid>0) {
+			kill(s->pid,SIGKILL);
+			waitpid(s->pid,0,0);
+		}
+		if(s->output) fclose(s->output);
+	}
+	free(segments);
+}
+
+/*
+Play the log from starttime to stoptime using up to nprocs processes.
+Each display is computed from the state of the table at that moment,
+so consecutive ranges of days can be played independently, provided
+that each range after the first begins at a daily checkpoint that
+is identical to the state the sequential replay would have reached.
+That is only assured while the history has a checkpoint for every
+day since the start of the query: a day without one means that the
+catalog server restarted without its state, so the days after it are
+left in the preceding range.  A --filter is applied to a checkpoint
+as it stands on that day, rather than to each object as it was created,
+so the caller must not play filtered queries in parallel.  Each process
+writes into a temporary file, and the files are concatenated in order,
+so the output is the same as that of log_play_time.
+*/
+
+static int log_play_parallel( struct deltadb *db, time_t starttime, time_t stoptime, int nprocs )
+{
+	struct tm *starttm = localtime(&starttime);
+
+	int year = starttm->tm_year + 1900;
+	int day = starttm->tm_yday;
+
+	struct tm *stoptm = localtime(&stoptime);
+
+	int stopyear = stoptm->tm_year + 1900;
+	int stopday = stoptm->tm_yday;
+
+	/* Find the days that the sequential replay would visit. */
+
+	int ndays = 0;
+	int maxdays = 64;
+	struct log_day *days = malloc(sizeof(*days)*maxdays);
+	int64_t total = 0;
+	int file_errors = 0;
 
 	while(1) {
-		char *filename = string_format("%s/%d/%d.log",db->logdir,year,day);
-		FILE *file = fopen(filename,"r");
-		if(!file) {
-			file_errors += 1;
-			fprintf(stderr,"couldn't open %s: %s\n",filename,strerror(errno));
-			free(filename);
-			if (file_errors>5)
-				break;
+		struct stat info;
 
-		} else {
+		if(ndays>=maxdays) {
+			maxdays *= 2;
+			days = realloc(days,sizeof(*days)*maxdays);
+		}
+
+		struct log_day *d = &days[ndays++];
+		d->year = year;
+		d->day = day;
+
+		char *filename = string_format("%s/%d/%d.jxa",db->logdir,year,day);
+		d->exists = stat(filename,&info)==0;
+		free(filename);
+
+		if(!d->exists) {
+			filename = string_format("%s/%d/%d.log",db->logdir,year,day);
+			d->exists = stat(filename,&info)==0;
 			free(filename);
-			int keepgoing = deltadb_process_stream(db,file,starttime,stoptime);
-			starttime = 0;
+		}
 
-			fclose(file);
+		d->size = d->exists ? info.st_size : 0;
 
-			// If we reached the endtime in the file, stop.
-			if(!keepgoing) break;
+		filename = string_format("%s/%d/%d.ckpt",db->logdir,year,day);
+		d->checkpoint = stat(filename,&info)==0;
+		free(filename);
+
+		total += d->size;
+
+		if(!d->exists && ++file_errors>5) break;
+
+		next_day(&year,&day);
+		if(day_after(year,day,stopyear,stopday)) break;
+	}
+
+	/* Divide the days into ranges of similar amounts of log data. */
+
+	struct log_segment *segments = malloc(sizeof(*segments)*nprocs);
+	int nsegments = 1;
+	int64_t size = days[0].size;
+	int seen_log = days[0].exists;
+
+	segments[0].year = days[0].year;
+	segments[0].day = days[0].day;
+
+	for(int i=1;i<ndays;i++) {
+		if(!days[i].checkpoint) break;
+
+		if(seen_log && nsegments<nprocs && size >= total*nsegments/nprocs) {
+			segments[nsegments-1].stopyear = days[i-1].year;
+			segments[nsegments-1].stopday = days[i-1].day;
+			segments[nsegments].year = days[i].year;
+			segments[nsegments].day = days[i].day;
+			nsegments++;
+		}
+
+		size += days[i].size;
+		seen_log |= days[i].exists;
+	}
+
+	segments[nsegments-1].stopyear = stopyear;
+	segments[nsegments-1].stopday = stopday;
+
+	free(days);
+
+	if(nsegments<2) {
+		free(segments);
+		return log_play_time(db,starttime,stoptime);
+	}
+
+	debug(D_DEBUG,"playing history in %d segments",nsegments);
+
+	/*
+	With --every, the times displayed in each range depend on the
+	last time displayed before it, so follow the T records up to
+	the start of each range.
+	*/
+
+	time_t last_display = 0;
+	time_t scan_starttime = starttime;
+	long offset = 0;
+
+	if(db->display_every>0) {
+		time_t indextime;
+		char *filename = string_format("%s/%d/%d.index",db->logdir,segments[0].year,segments[0].day);
+		jx_database_index_lookup(filename,starttime,&indextime,&offset);
+		free(filename);
+	}
+
+	for(int i=0;i<nsegments;i++) {
+		struct log_segment *s = &segments[i];
+
+		s->last_display = last_display;
+
+		if(db->display_every>0 && i<nsegments-1) {
+			year = s->year;
+			day = s->day;
+			while(!day_after(year,day,s->stopyear,s->stopday)) {
+				if(log_scan_times(db,year,day,offset,scan_starttime,stoptime,&last_display)) {
+					offset = 0;
+					scan_starttime = 0;
+				}
+				next_day(&year,&day);
+			}
 		}
+	}
+
+	/* Start one process for each range. */
+
+	fflush(stdout);
+
+	for(int i=0;i<nsegments;i++) {
+		struct log_segment *s = &segments[i];
 
-		day++;
-		if(day>=days_in_year(year)) {
-			year++;
-			day = 0;
+		s->pid = 0;
+		s->output = tmpfile();
+		if(!s->output) {
+			fprintf(stderr,"deltadb_query: couldn't create temporary file: %s\n",strerror(errno));
+			log_segments_abort(segments,i+1);
+			return 0;
 		}
 
-		// If we have passed the file, stop.
-		if(year>=stopyear && day>stopday) break;
+		s->pid = fork();
+		if(s->pid<0) {
+			fprintf(stderr,"deltadb_query: couldn't fork: %s\n",strerror(errno));
+			log_segments_abort(segments,i+1);
+			return 0;
+		} else if(s->pid==0) {
+			dup2(fileno(s->output),STDOUT_FILENO);
+			db->last_display = s->last_display;
+			if(i==0) {
+				long offset = log_checkpoint_read(db,s->year,s->day,starttime);
+				log_play_days(db,s->year,s->day,s->stopyear,s->stopday,offset,starttime,stoptime);
+			} else {
+				log_checkpoint_read(db,s->year,s->day,0);
+				log_play_days(db,s->year,s->day,s->stopyear,s->stopday,0,0,stoptime);
+			}
+			fflush(stdout);
+			_exit(0);
+		}
 	}
 
-	return 1;
+	/* Collect the output of each range in order. */
+
+	int result = 1;
+
+	for(int i=0;i<nsegments;i++) {
+		struct log_segment *s = &segments[i];
+		int status;
+
+		if(waitpid(s->pid,&status,0)!=s->pid || !WIFEXITED(status) || WEXITSTATUS(status)!=0) {
+			fprintf(stderr,"deltadb_query: process for %d/%d failed\n",s->year,s->day);
+			result = 0;
+		}
+
+		if(result) {
+			rewind(s->output);
+			copy_stream_to_stream(s->output,stdout);
+		}
+
+		fclose(s->output);
+	}
+
+	free(segments);
+
+	return result;
 }
 
 int suffix_to_multiplier( char suffix )
@@ -483,6 +934,7 @@ static struct option long_options[] =
 	{"at", required_argument, 0, 'A'},
 	{"every", required_argument, 0, 'e'},
 	{"epoch", no_argument, 0, 't'},
+	{"parallel", required_argument, 0, 'p'},
 	{"version", no_argument, 0, 'v'},
 	{"help", no_argument, 0, 'h'},
 	{0,0,0,0}
@@ -501,6 +953,7 @@ void show_help()
 	printf("  --to <time>         End query at this absolute time.\n");
 	printf("  --every <interval>  Compute output at this time interval.\n");
 	printf("  --epoch             Display time column in Unix epoch format.\n");
+	printf("  --parallel <n>      Play ranges of days in up to n processes.\n");
 	printf("  --version           Show software version.\n");
 	printf("  --help              Show this help text.\n");
 }
@@ -517,6 +970,7 @@ int main( int argc, char *argv[] )
 	time_t stop_time = 0;
 	int display_every = 0;
 	int epoch_mode = 0;
+	int nprocs = 1;
 
 	char reduce_name[1024];
 	char reduce_attr[1024];
@@ -525,7 +979,7 @@ int main( int argc, char *argv[] )
 
 	int c;
 
-	while((c=getopt_long(argc,argv,"D:L:o:w:f:F:T:e:tvh",long_options,0))!=-1) {
+	while((c=getopt_long(argc,argv,"D:L:o:w:f:F:T:e:tp:vh",long_options,0))!=-1) {
 		switch(c) {
 		case 'D':
 			dbdir = optarg;
@@ -591,6 +1045,9 @@ int main( int argc, char *argv[] )
 		case 't':
 			epoch_mode = 1;
 			break;
+		case 'p':
+			nprocs = atoi(optarg);
+			break;
 		case 'v':
 			cctools_version_print(stdout,"deltadb_query");
 			break;
@@ -638,7 +1095,12 @@ int main( int argc, char *argv[] )
 		display_mode = MODE_STREAM;
 	}
 
-	if(dbfile) {
+	struct jx_archive *archive = dbfile ? jx_archive_open(dbfile) : 0;
+
+	if(archive) {
+		deltadb_process_archive(db,archive,start_time,stop_time);
+		jx_archive_close(archive);
+	} else if(dbfile) {
 		FILE *file = fopen(dbfile,"r");
 		if(!file) {
 			fprintf(stderr,"deltadb_query: couldn't open %s: %s\n",dbfile,strerror(errno));
@@ -646,6 +1108,12 @@ int main( int argc, char *argv[] )
 		}
 		deltadb_process_stream(db,file,start_time,stop_time);
 		fclose(file);
+	} else if(nprocs>1 && display_mode!=MODE_STREAM && !filter_expr) {
+		/*
+		Streaming output depends on events across day boundaries, and a
+		filter on the objects as they were created, so both are sequential.
+		*/
+		if(!log_play_parallel(db,start_time,stop_time,nprocs)) return 1;
 	} else {
 		log_play_time(db,start_time,stop_time);
 	}
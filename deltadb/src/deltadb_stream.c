@@ -109,3 +109,29 @@ int deltadb_process_stream( struct deltadb *db, FILE *stream, time_t starttime,
 
 	return 1;
 }
+
+/*
+Play the records of an archive through the same events as a text stream.
+The archive has already been parsed and checked, so there is no corrupt data to report.
+*/
+
+int deltadb_process_archive( struct deltadb *db, struct jx_archive *archive, time_t starttime, time_t stoptime )
+{
+	struct jx_archive_record r;
+
+	while(jx_archive_read(archive,&r)) {
+		if(r.type=='C') {
+			if(!deltadb_create_event(db,r.key,r.value)) break;
+		} else if(r.type=='D') {
+			if(!deltadb_delete_event(db,r.key)) break;
+		} else if(r.type=='U') {
+			if(!deltadb_update_event(db,r.key,r.name,r.value)) break;
+		} else if(r.type=='R') {
+			if(!deltadb_remove_event(db,r.key,r.name)) break;
+		} else if(r.type=='T') {
+			if(!deltadb_time_event(db,starttime,stoptime,r.time)) break;
+		}
+	}
+
+	return 1;
+}
@@ -8,6 +8,7 @@ See the file COPYING for details.
 #define DELTADB_STREAM_H
 
 #include "jx.h"
+#include "jx_archive.h"
 
 #include <stdio.h>
 #include <time.h>
@@ -22,5 +23,6 @@ int deltadb_time_event( struct deltadb *db, time_t starttime, time_t stoptime, t
 int deltadb_post_event( struct deltadb *db, const char *line );
 
 int deltadb_process_stream( struct deltadb *db, FILE *stream, time_t starttime, time_t stoptime );
+int deltadb_process_archive( struct deltadb *db, struct jx_archive *archive, time_t starttime, time_t stoptime );
 
 #endif
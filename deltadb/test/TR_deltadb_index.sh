@@ -0,0 +1,90 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+# Days of history are named by local time.
+export TZ=UTC
+
+db=deltadb_index.db
+indexed=deltadb_index.indexed
+full=deltadb_index.full
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	# One day of history, with a checkpoint indexed every six hours,
+	# holding the state of the table at the offset of the T record for that hour.
+	python3 - $db <<EOF
+import json, os, sys
+
+state = {}
+os.makedirs(sys.argv[1] + "/2020")
+path = sys.argv[1] + "/2020/0"
+json.dump(state, open(path + ".ckpt", "w"))
+log = open(path + ".log", "w")
+index = open(path + ".index", "w")
+for hour in range(24):
+	t = 1577836800 + hour * 3600
+	if hour > 0 and hour % 6 == 0:
+		index.write("%d %d\n" % (t, log.tell()))
+		json.dump(state, open("%s.%d.ckpt" % (path, t), "w"))
+	log.write("T %d\n" % t)
+	if hour == 0:
+		for key in "abc":
+			state[key] = {"name": key, "load": 0}
+			log.write("C %s %s\n" % (key, json.dumps(state[key])))
+	if hour == 8:
+		del state["c"]
+		log.write("D c\n")
+	if hour == 10:
+		del state["b"]["load"]
+		log.write("R b load\n")
+	for key in sorted(state):
+		state[key]["load"] = hour * ord(key) % 5
+		log.write("U %s load %d\n" % (key, state[key]["load"]))
+EOF
+}
+
+query()
+{
+	../src/deltadb_query --db $db --to "2020-01-01 23:00:00" "$@"
+}
+
+# Compare a query played from the indexed checkpoints with the same query played from midnight.
+compare()
+{
+	query "$@" > $indexed || return 1
+	mv $db/2020/0.index $db/2020/0.index.hidden
+	query "$@" > $full
+	mv $db/2020/0.index.hidden $db/2020/0.index
+	[ -s $indexed ] || return 1
+	cmp $indexed $full
+}
+
+run()
+{
+	# Starting at, between, and before the checkpoints.
+	for from in "2020-01-01 12:00:00" "2020-01-01 13:20:00" "2020-01-01 05:00:00"; do
+		compare --from "$from" --output name --output load || return 1
+		compare --from "$from" --output 'SUM(load)' --output 'COUNT(name)' --every 2h || return 1
+		compare --from "$from" || return 1
+	done
+
+	# Output begins at the start time, whichever checkpoint the query starts from.
+	query --from "2020-01-01 13:20:00" --output name > $indexed || return 1
+	[ "$(head -1 $indexed | cut -f1)" = "2020-01-01 14:00:00" ] || return 1
+	return 0
+}
+
+clean()
+{
+	rm -rf $db $indexed $full
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -0,0 +1,78 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+# Days of history are named by local time.
+export TZ=UTC
+
+db=deltadb_parallel.db
+sequential=deltadb_parallel.sequential
+parallel=deltadb_parallel.parallel
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	# Four days of history, with a daily checkpoint of the state at midnight.
+	# Object b is created with type y, and becomes type x on the second day.
+	python3 - $db <<EOF
+import json, os, sys
+
+state = {}
+os.makedirs(sys.argv[1] + "/2020")
+for day in range(4):
+	path = "%s/2020/%d" % (sys.argv[1], day)
+	json.dump(state, open(path + ".ckpt", "w"))
+	log = open(path + ".log", "w")
+	for hour in range(24):
+		log.write("T %d\n" % (1577836800 + day * 86400 + hour * 3600))
+		if day == 0 and hour == 0:
+			for key, type in (("a", "x"), ("b", "y")):
+				state[key] = {"name": key, "type": type, "load": 0}
+				log.write("C %s %s\n" % (key, json.dumps(state[key])))
+		if day == 1 and hour == 6:
+			state["b"]["type"] = "x"
+			log.write('U b type "x"\n')
+		for key in sorted(state):
+			state[key]["load"] = (day * 24 + hour) * ord(key) % 7
+			log.write("U %s load %d\n" % (key, state[key]["load"]))
+EOF
+}
+
+query()
+{
+	../src/deltadb_query --db $db --from "2020-01-01 00:00:00" --to "2020-01-04 23:00:00" "$@"
+}
+
+compare()
+{
+	query "$@" > $sequential || return 1
+	query --parallel 4 "$@" > $parallel || return 1
+	[ -s $sequential ] || return 1
+	cmp $sequential $parallel
+}
+
+run()
+{
+	# Parallel playback gives the same output as sequential playback.
+	compare --output name --output load || return 1
+	compare --output 'MAX(load)' --output 'COUNT(name)' --every 3h || return 1
+
+	# Including with a filter, which sees objects as they were created.
+	compare --filter 'type=="x"' --output name --output load || return 1
+	grep -q '"b"' $parallel && return 1
+	compare --filter 'type=="x"' --output 'COUNT(name)' --every 3h || return 1
+	return 0
+}
+
+clean()
+{
+	rm -rf $db $sequential $parallel
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -38,9 +38,11 @@ overwriting another service's record.
 SECTION(OPTIONS)
 
 OPTIONS_BEGIN
+OPTION_ITEM(`-A, --archive-history')Replace the history log of each completed day with a compact columnar archive, which is read by BOLD(deltadb_query).
 OPTION_ITEM(`-b, --background')Run as a daemon.
 OPTION_TRIPLET(-B, pid-file,file)Write process identifier (PID) to file.
 OPTION_TRIPLET(-d, debug, flag)Enable debugging for this subsystem
+OPTION_ITEM(`-E, --event-loop')Serve all updates and queries from a single event-driven process, with HTTP keep-alive and cached views of the catalog. (Linux only.)
 OPTION_ITEM(`-h, --help')Show this help screen
 OPTION_TRIPLET(-H, history,file) Store catalog history in this directory.  Enables fast data recovery after a failure or restart, and enables historical queries via deltadb_query.
 OPTION_TRIPLET(-l, lifetime, secs)Lifetime of data, in seconds (default is 1800)
@@ -0,0 +1,54 @@
+include(manual.h)dnl
+HEADER(deltadb_archive)
+
+SECTION(NAME)
+BOLD(deltadb_archive) - convert catalog history logs into compact archives.
+
+SECTION(SYNOPSIS)
+CODE(BOLD(deltadb_archive [options] [source_directory]))
+
+SECTION(DESCRIPTION)
+
+BOLD(deltadb_archive) converts the text log of each completed day in a
+history directory recorded by the catalog server into an archive named
+DAY.jxa in the same directory.  An archive holds exactly the same records
+as the log, in a columnar format with a dictionary of keys and names,
+integer properties stored as the difference from their previous value,
+and each column compressed.  An archive is typically several times smaller
+than the log, and is read by BOLD(deltadb_query) without parsing JSON text.
+If both exist for a day, BOLD(deltadb_query) reads the archive.
+
+The log of the current day is not converted, since the catalog server may
+still be writing it.  Days that already have an archive are not converted again.
+The catalog server can archive each day itself when given the --archive-history option.
+
+SECTION(ARGUMENTS)
+OPTIONS_BEGIN
+OPTION_ITEM(--benchmark) For each day, report the size of the log and the archive, and the time to scan every record of each.
+OPTION_ITEM(--remove) Remove each text log and its index once it has been archived.
+OPTION_ITEM(--version) Show software version.
+OPTION_ITEM(--help) Show this help text.
+OPTIONS_END
+
+SECTION(EXAMPLES)
+
+To archive the history of a catalog server, and compare the space and scan time of the logs and archives:
+
+LONGCODE_BEGIN
+% deltadb_archive --benchmark /data/catalog.history
+LONGCODE_END
+
+To then reclaim the space used by the logs:
+
+LONGCODE_BEGIN
+% deltadb_archive --remove /data/catalog.history
+LONGCODE_END
+
+SECTION(COPYRIGHT)
+
+COPYRIGHT_BOILERPLATE
+
+SECTION(SEE ALSO)
+SEE_ALSO_CATALOG
+
+FOOTER
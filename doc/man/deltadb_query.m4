@@ -17,16 +17,24 @@ or as summaries of properties across all records over time.
 This is useful for reporting, for example, the total resources and clients
 served by a large collection of servers over the course of a year.
 
+The catalog server writes up to hourly checkpoints of its state
+along with an index into each day's log, so a query beginning in
+the middle of a day starts from the nearest preceding checkpoint
+rather than replaying the day from midnight.  Output begins at the
+--from time, whichever checkpoint the query starts from.
+Days that have been converted by BOLD(deltadb_archive) are read from the archive instead of the text log.
+
 A paper entitled DeltaDB describes the operation of the tools in detail (see reference below).
 
 SECTION(ARGUMENTS)
 OPTIONS_BEGIN
 OPTION_ITEM(--db path) Query this database directory.
-OPTION_ITEM(--file path) Query the data stream in this file.
+OPTION_ITEM(--file path) Query the data stream in this file, which may be a text log or an archive.
 OPTION_ITEM(--from time) (required) The starting date and time of the query in an absolute time like "YYYY-MM-DD HH:MM:SS" or "YYYY-MM-DD" or a relative time like 5s, 5m, 5h, 5d to indicate five seconds, minutes, hours, or days ago, respectively.
 OPTION_ITEM(--to time) The ending time of the query, in the same format as the --from option.  If omitted, the current time is assumed.
 OPTION_ITEM(--every interval) The intervals at which output should be produced, like 5s, 5m, 5h, 5d to indicate five seconds, minutes, hours, or days ago, respectively.
 OPTION_ITEM(--epoch) Causes the output to be expressed in integer Unix epoch time, instead of a formatted time.
+OPTION_ITEM(--parallel n) Divide the days of the query into ranges that begin at a daily checkpoint, and play them in up to n processes at once.  The output is the same as that of a sequential query.  Days following a gap in the checkpoints, such as when the catalog server was not running at midnight, are played sequentially.  Applies only to queries with --output expressions and without --filter.
 OPTION_ITEM(--filter expr) (multiple) If given, only records matching this expression will be processed.  Use --filter to apply expressions that do not change over time, such as the name or type of a record.
 OPTION_ITEM(--where expr)  (multiple) If given, only records matching this expression will be displayed.  Use --where to apply expressions that may change over time, such as load average or storage space consumed.
 OPTION_ITEM(--output expr) (multiple) Display this expression on the output.
@@ -58,6 +66,12 @@ LONGCODE_BEGIN
 % deltadb_query --db /data/catalog.history --from 2013-03-01 --filter 'owner=="fred"' --output 'AVERAGE(load5)' --every 1h
 LONGCODE_END
 
+To compute the same over a whole year using eight processes:
+
+LONGCODE_BEGIN
+% deltadb_query --db /data/catalog.history --from 2013-01-01 --to 2014-01-01 --where 'owner=="fred"' --output 'AVERAGE(load5)' --every 1h --parallel 8
+LONGCODE_END
+
 The raw event output of a query can be saved to a file, and then queried using the --file option, which can accelerate operations on reduced data.  For example:
 
 LONGCODE_BEGIN
@@ -48,9 +48,11 @@ OPTIONS_END
 SUBSECTION(Batch Options)
 OPTIONS_BEGIN
 OPTION_TRIPLET(-B, batch-options, options)Add these options to all batch submit files.
+OPTION_PAIR(--dispatch-order,order)Order in which to submit ready jobs. PARAM(fifo) submits them in the order they become ready. PARAM(critical-path) first submits the jobs with the longest chain of rules depending on them, and passes that priority on to Work Queue and HTCondor. PARAM(critical-path-runtime) does the same, weighting each rule by the runtimes observed for its category. (default is fifo)
 OPTION_TRIPLET(-j, max-local, #)Max number of local jobs to run at once. (default is # of cores)
 OPTION_TRIPLET(-J, max-remote, #)Max number of remote jobs to run at once. (default is 1000 for -Twq, 100 otherwise)
 OPTION_TRIPLET(-l, makeflow-log, logfile)Use this file for the makeflow log. (default is X.makeflowlog)
+OPTION_PAIR(--snapshot-interval,secs)Every PARAM(secs) seconds, save the state of the workflow in X.makeflowlog.snapshot, so that a restart only replays the log written since then. Zero disables snapshots. (default is 300)
 OPTION_TRIPLET(-L, batch-log, logfile)Use this file for the batch system log. (default is X.PARAM(type)log)
 OPTION_ITEM(`-R, --retry')Automatically retry failed batch jobs up to 100 times.
 OPTION_TRIPLET(-r, retry-count, n)Automatically retry failed batch jobs up to n times.
@@ -162,6 +164,7 @@ OPTIONS_BEGIN
 OPTION_PAIR(--archive,path)Archive results of workflow at the specified path (by default /tmp/makeflow.archive.$UID) and use outputs of any archived jobs instead of re-executing job
 OPTION_PAIR(--archive-read,path)Only check to see if jobs have been cached and use outputs if it has been
 OPTION_PAIR(--archive-write,path)Write only results of each job to the archiving directory at the specified path
+OPTION_PAIR(--memoize,dir)Before running a rule, look for its outputs in the cache directory BOLD(dir), keyed by the rule's command, environment, input contents and output names. If they are found, put them in place instead of running the rule; otherwise, store the outputs of the rule in BOLD(dir) when it succeeds. The directory may be shared by many workflows and machines. Outputs are placed by copy-on-write clone where the filesystem supports it, and copied otherwise, so that the outputs of the workflow never share storage with the read-only files of the cache. The hashes of files are remembered in BOLD(makeflowfile.makeflowhashes) and recomputed only when a file changes.
 OPTIONS_END
 
 SUBSECTION(Other Options)
@@ -177,6 +180,7 @@ OPTION_PAIR(--wrapper-output,file) Wrapper command requires this output file. Th
 OPTION_ITEM(`--enforcement')Use Parrot to restrict access to the given inputs/outputs.
 OPTION_PAIR(--parrot,path)Path to parrot_run executable on the host system.
 OPTION_PAIR(--shared-fs,dir)Assume the given directory is a shared filesystem accessible at all execution sites.
+OPTION_PAIR(--stat-procs,n)Check for the existence of files at startup with up to PARAM(n) processes at once, which hides the latency of a shared filesystem. (default is 16)
 OPTIONS_END
 
 SECTION(DRYRUN MODE)
@@ -14,6 +14,7 @@ SECTION(OPTIONS)
 OPTIONS_BEGIN
 OPTION_ITEM(`-p, --package-path')The path of the package.
 OPTION_ITEM(`-e, --env-list')The path of the environment file, each line is in the format of <key>=<value>. (Default: package-path/env_list)
+OPTION_ITEM(`-P, --prefetch-list')The list of remote files, such as those under CODE(/cvmfs), to fetch in parallel when the package starts, rewritten with the files opened by each run. (Default: package-path/prefetch_list, if the package is writable)
 OPTION_ITEM(`-h, --help')Show this help message.
 OPTIONS_END
 
@@ -29,11 +29,13 @@ OPTION_ITEM(-f, --no-follow-symlinks)Disable following symlinks.
 OPTION_TRIPLET(-G,gid,num)Fake this gid; Real gid stays the same.
 OPTION_ITEM(-h, --help)Show this screen.
 OPTION_ITEM(--helper)Enable use of helper library.
+OPTION_PAIR(--io-threads, num)Read remote files on this many threads, so that a process waiting for a slow read does not hold up the others.  Applies to HTTP, with or without --sparse-cache (PARROT_IO_THREADS).
 OPTION_TRIPLET(-i, tickets, files)Comma-delimited list of tickets to use for authentication.
 OPTION_TRIPLET(-I, debug-level-irods, num)Set the iRODS driver internal debug level.
 OPTION_ITEM(-K, --with-checksums)Checksum files where available.
 OPTION_ITEM(-k, --no-checksums)Do not checksum files.
 OPTION_TRIPLET(-l, ld-path, path)Path to ld.so to use.
+OPTION_PAIR(--metadata-cache, [service:]secs)Remember the results of stat, lstat, readlink, and lookups of missing files on remote services for this many seconds, so that repeated probes of the same names do not go back to the service.  Changes made through Parrot are seen at once.  Give a service name to set the time for that service alone, e.g. --metadata-cache=http:600 (PARROT_METADATA_CACHE).
 OPTION_TRIPLET(-m, ftab-file, file)Use this file as a mountlist.
 OPTION_TRIPLET(-M, mount, /foo=/bar)Mount (redirect) /foo to /bar.
 OPTION_TRIPLET(-e, env-list, path)Record the environment variables.
@@ -43,12 +45,20 @@ OPTION_TRIPLET(-N, hostname, name)Pretend that this is my hostname.
 OPTION_TRIPLET(-o,debug-file,file)Write debugging output to this file. By default, debugging is sent to stderr (":stderr"). You may specify logs be sent to stdout (":stdout"), to the system syslog (":syslog"), or to the systemd journal (":journal").
 OPTION_TRIPLET(-O, debug-rotate-max, bytes)Rotate debug files of this size.
 OPTION_TRIPLET(-p, proxy, host:port)Use this proxy server for HTTP requests.
+OPTION_PAIR(--prefetch-list, file)Before starting the program, fetch the remote files named in this file, one per line, into the cache with several processes at once, so that the program does not wait for them one at a time.  As the program runs, record the remote files it opens for reading, in the order first opened, and replace the file with them at exit.  Helps the services whose caches are shared on disk, such as HTTP and CVMFS with the alien cache, and Chirp and XRootD with -F (PARROT_PREFETCH_LIST).
+OPTION_PAIR(--prefetch-jobs, num)Number of processes fetching the files in --prefetch-list (default 8).
+OPTION_PAIR(--profile, file)Count the system calls that Parrot traces, with the bytes moved and a histogram of the time each took, by system call and by the service that handled it, and write them to this file as JSON at exit, or when Parrot receives SIGUSR2.  The summary fields at the top are those read by the resource monitor tools (PARROT_PROFILE).
 OPTION_ITEM(-Q, --no-chirp-catalog)Inhibit catalog queries to list /chirp.
 OPTION_TRIPLET(-r, cvmfs-repos, repos)CVMFS repositories to enable (PARROT_CVMFS_REPO).
 OPTION_ITEM(--cvmfs-repo-switching) Allow repository switching with CVMFS.
 OPTION_TRIPLET(-R, root-checksum, cksum)Enforce this root filesystem checksum, where available.
 OPTION_ITEM(-s, --stream-no-cache)Use streaming protocols without caching.
 OPTION_ITEM(-S, --session-caching)Enable whole session caching for all protocols.
+OPTION_ITEM(--seccomp)Install a seccomp filter so that the program stops only for the system calls Parrot needs to see, and runs the rest (memory, signals, scheduling, and the like) at native speed.  Requires Linux 4.8 or later, and sets the no-new-privileges flag on the program (PARROT_SECCOMP).
+OPTION_ITEM(--sparse-cache)Cache remote files that are opened for reading block by block, so that only the parts of a file that are actually read are fetched and stored, in sparse files under the temporary directory.  Applies to the services that are otherwise cached whole, such as HTTP, and with -F to Chirp and XRootD (PARROT_SPARSE_CACHE).
+OPTION_PAIR(--sparse-cache-block-size, bytes)Size of the blocks fetched and cached by --sparse-cache (default 1M).
+OPTION_PAIR(--sparse-cache-limit, bytes)Evict the least recently fetched files from the sparse cache when it holds more than this many bytes (default unlimited).
+OPTION_PAIR(--sparse-cache-readahead, num)Blocks to fetch beyond a read that misses the sparse cache (default 2).
 OPTION_ITEM(--syscall-disable-debug)Disable tracee access to the Parrot debug syscall.
 OPTION_TRIPLET(-t, tempdir, dir)Where to store temporary files.
 OPTION_TRIPLET(-T, timeout, time)Maximum amount of time to retry failures.
@@ -62,6 +72,9 @@ OPTION_ITEM(--valgrind)Enable valgrind support for Parrot.
 OPTION_ITEM(-v, --version)Display version number.
 OPTION_ITEM(--is-running)Test is Parrot is already running.
 OPTION_TRIPLET(-w, work-dir, dir)Initial working directory.
+OPTION_ITEM(--write-back)Store remote files written through the cache, such as with FTP and Chirp, in the background, so that close returns without waiting for the upload.  A file is uploaded before it is used again, when it is synced, and before Parrot exits; if any upload fails, Parrot reports it and exits with an error.  Services that can write at an offset are sent only the part of a file that changed (PARROT_WRITE_BACK).
+OPTION_PAIR(--write-back-jobs, num)Number of processes storing files for --write-back (default 4).
+OPTION_PAIR(--write-back-queue, num)Make close wait when this many uploads are outstanding (default 32).
 OPTION_ITEM(-W, --syscall-table)Display table of system calls trapped.
 OPTION_ITEM(-Y, --sync-write)Force synchronous disk writes.
 OPTION_ITEM(-Z, --auto-decompress)Enable automatic decompression on .gz files.
@@ -76,6 +89,7 @@ when CODE(parrot_run) is enabled.
 SECTION(EXIT STATUS)
 CODE(parrot_run) returns the exit status of the process that it runs.
 If CODE(parrot_run) is unable to start the process, it will return non-zero.
+With --write-back, it also returns non-zero if the process succeeded but a file it wrote could not be stored.
 
 SECTION(EXAMPLES)
 To access a single remote file using CODE(vi):
@@ -106,6 +120,12 @@ LONGCODE_BEGIN
 % /usr/bin/ls|stat
 LONGCODE_END
 
+To see which system calls and services a program spends its time in:
+LONGCODE_BEGIN
+% parrot_run --profile profile.json make
+LONGCODE_END
+Each entry of the BOLD(syscalls) and BOLD(services) lists in BOLD(profile.json) gives the number of calls, the bytes read or written, the total and the 50th, 90th, and 99th percentile times in microseconds, and a histogram whose bin i counts calls that took at least 2^(i-1) and less than 2^i microseconds.
+
 SECTION(NOTES ON DOCKER)
 
 Docker by default blocks ptrace, the system call on which parrot relies. To
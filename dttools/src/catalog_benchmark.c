@@ -0,0 +1,343 @@
+/*
+Copyright (C) 2018- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Generate a query load against a catalog server and report
+the achieved queries per second and the latency distribution.
+A number of concurrent clients are multiplexed in one process,
+each issuing its next query as soon as the previous one completes.
+
+Example use:
+	catalog_benchmark -c 64 -n 100000 -k localhost 9097
+*/
+
+#include "link.h"
+#include "domain_name_cache.h"
+#include "timestamp.h"
+#include "debug.h"
+#include "xxmalloc.h"
+#include "getopt.h"
+#include "cctools.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define RESPONSE_HEADER_MAX 8192
+
+struct client {
+	struct link *link;
+	char header[RESPONSE_HEADER_MAX];
+	size_t header_length;
+	long long body_expected;
+	long long body_received;
+	int header_done;
+	int connection_close;
+	timestamp_t start;
+	int busy;
+};
+
+static const char *host = 0;
+static char address[DOMAIN_NAME_MAX];
+static int port = 0;
+static const char *path = "/query.json";
+static int keepalive = 0;
+static int concurrency = 16;
+static int total_queries = 1000;
+static int timeout = 30;
+
+static timestamp_t *latencies = 0;
+static int queries_issued = 0;
+static int queries_done = 0;
+static int queries_failed = 0;
+static long long bytes_received = 0;
+
+static void show_help(const char *cmd)
+{
+	fprintf(stdout, "Use: %s [options] <host> <port>\n", cmd);
+	fprintf(stdout, "where options are:\n");
+	fprintf(stdout, " %-30s Number of concurrent clients. (default is %d)\n", "-c,--clients=<n>", concurrency);
+	fprintf(stdout, " %-30s Enable debugging for this subsystem\n", "-d,--debug=<subsystem>");
+	fprintf(stdout, " %-30s Show this help screen\n", "-h,--help");
+	fprintf(stdout, " %-30s Reuse connections with HTTP keep-alive.\n", "-k,--keepalive");
+	fprintf(stdout, " %-30s Total number of queries to issue. (default is %d)\n", "-n,--queries=<n>", total_queries);
+	fprintf(stdout, " %-30s Path to query. (default is %s)\n", "-p,--path=<path>", path);
+	fprintf(stdout, " %-30s Timeout for each query, in seconds. (default is %d)\n", "-t,--timeout=<secs>", timeout);
+	fprintf(stdout, " %-30s Show version string\n", "-v,--version");
+}
+
+static int compare_timestamp(const void *a, const void *b)
+{
+	timestamp_t x = *(const timestamp_t *) a;
+	timestamp_t y = *(const timestamp_t *) b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void client_disconnect(struct client *c)
+{
+	if(c->link) {
+		link_close(c->link);
+		c->link = 0;
+	}
+}
+
+static void client_finish(struct client *c, int success)
+{
+	if(success) {
+		latencies[queries_done++] = timestamp_get() - c->start;
+	} else {
+		queries_failed++;
+	}
+
+	if(!success || !keepalive || c->connection_close)
+		client_disconnect(c);
+
+	c->busy = 0;
+}
+
+static void client_start(struct client *c)
+{
+	char request[1024];
+	time_t stoptime = time(0) + timeout;
+
+	c->start = timestamp_get();
+	c->header_length = 0;
+	c->header_done = 0;
+	c->body_expected = -1;
+	c->body_received = 0;
+	c->connection_close = !keepalive;
+	c->busy = 1;
+	queries_issued++;
+
+	if(!c->link) {
+		c->link = link_connect(address, port, stoptime);
+		if(!c->link) {
+			client_finish(c, 0);
+			return;
+		}
+	}
+
+	int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n\r\n", path, host, keepalive ? "keep-alive" : "close");
+
+	if(link_write(c->link, request, length, stoptime) != length)
+		client_finish(c, 0);
+}
+
+/* Examine a complete response header for the length and connection mode. */
+
+static void client_parse_header(struct client *c)
+{
+	char *line = c->header;
+
+	while(line && *line) {
+		if(!strncasecmp(line, "Content-length:", 15)) {
+			c->body_expected = atoll(line + 15);
+		} else if(!strncasecmp(line, "Connection:", 11)) {
+			if(strcasestr(line, "close"))
+				c->connection_close = 1;
+		}
+		line = strchr(line, '\n');
+		if(line)
+			line++;
+	}
+
+	c->header_done = 1;
+}
+
+static void client_receive(struct client *c)
+{
+	char buffer[65536];
+
+	ssize_t result = read(link_fd(c->link), buffer, sizeof(buffer));
+	if(result < 0) {
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return;
+		client_finish(c, 0);
+		return;
+	}
+
+	if(result == 0) {
+		/* Without a content length, end of stream ends the response. */
+		client_finish(c, c->header_done && c->body_expected < 0);
+		return;
+	}
+
+	bytes_received += result;
+
+	char *data = buffer;
+	size_t length = result;
+
+	if(!c->header_done) {
+		size_t space = sizeof(c->header) - c->header_length - 1;
+		size_t n = length < space ? length : space;
+		memcpy(c->header + c->header_length, data, n);
+		c->header_length += n;
+		c->header[c->header_length] = 0;
+
+		char *end = strstr(c->header, "\r\n\r\n");
+		size_t endlength = 4;
+		if(!end) {
+			end = strstr(c->header, "\n\n");
+			endlength = 2;
+		}
+
+		if(!end) {
+			if(c->header_length >= sizeof(c->header) - 1)
+				client_finish(c, 0);
+			return;
+		}
+
+		size_t consumed = (end + endlength) - c->header;
+		*end = 0;
+		client_parse_header(c);
+
+		/* Whatever followed the header in this read is body. */
+		size_t before = c->header_length - n;
+		data += consumed - before;
+		length -= consumed - before;
+	}
+
+	c->body_received += length;
+
+	if(c->body_expected >= 0 && c->body_received >= c->body_expected)
+		client_finish(c, 1);
+}
+
+int main(int argc, char *argv[])
+{
+	signed char ch;
+	int i;
+
+	debug_config(argv[0]);
+
+	static const struct option long_options[] = {
+		{"clients", required_argument, 0, 'c'},
+		{"debug", required_argument, 0, 'd'},
+		{"help", no_argument, 0, 'h'},
+		{"keepalive", no_argument, 0, 'k'},
+		{"queries", required_argument, 0, 'n'},
+		{"path", required_argument, 0, 'p'},
+		{"timeout", required_argument, 0, 't'},
+		{"version", no_argument, 0, 'v'},
+		{0,0,0,0}};
+
+	while((ch = getopt_long(argc, argv, "c:d:hkn:p:t:v", long_options, NULL)) > -1) {
+		switch (ch) {
+			case 'c':
+				concurrency = atoi(optarg);
+				break;
+			case 'd':
+				debug_flags_set(optarg);
+				break;
+			case 'k':
+				keepalive = 1;
+				break;
+			case 'n':
+				total_queries = atoi(optarg);
+				break;
+			case 'p':
+				path = optarg;
+				break;
+			case 't':
+				timeout = atoi(optarg);
+				break;
+			case 'v':
+				cctools_version_print(stdout, argv[0]);
+				return 0;
+			case 'h':
+			default:
+				show_help(argv[0]);
+				return 1;
+		}
+	}
+
+	if((argc - optind) != 2 || concurrency < 1 || total_queries < 1) {
+		show_help(argv[0]);
+		return 1;
+	}
+
+	host = argv[optind];
+	port = atoi(argv[optind + 1]);
+
+	if(!domain_name_cache_lookup(host, address))
+		fatal("couldn't look up host name %s", host);
+
+	latencies = xxmalloc(sizeof(*latencies) * total_queries);
+
+	struct client *clients = xxcalloc(concurrency, sizeof(*clients));
+	struct pollfd *pfds = xxcalloc(concurrency, sizeof(*pfds));
+	int *pindex = xxcalloc(concurrency, sizeof(*pindex));
+
+	timestamp_t begin = timestamp_get();
+
+	while(queries_done + queries_failed < total_queries) {
+		int npfds = 0;
+
+		for(i = 0; i < concurrency; i++) {
+			struct client *c = &clients[i];
+			if(!c->busy && queries_issued < total_queries)
+				client_start(c);
+			if(c->busy) {
+				pfds[npfds].fd = link_fd(c->link);
+				pfds[npfds].events = POLLIN;
+				pfds[npfds].revents = 0;
+				pindex[npfds] = i;
+				npfds++;
+			}
+		}
+
+		if(npfds == 0)
+			continue;
+
+		int result = poll(pfds, npfds, timeout * 1000);
+		if(result < 0) {
+			if(errno == EINTR)
+				continue;
+			fatal("poll failed: %s", strerror(errno));
+		} else if(result == 0) {
+			for(i = 0; i < npfds; i++)
+				client_finish(&clients[pindex[i]], 0);
+			continue;
+		}
+
+		for(i = 0; i < npfds; i++) {
+			if(pfds[i].revents)
+				client_receive(&clients[pindex[i]]);
+		}
+	}
+
+	double elapsed = (timestamp_get() - begin) / 1000000.0;
+
+	for(i = 0; i < concurrency; i++)
+		client_disconnect(&clients[i]);
+
+	qsort(latencies, queries_done, sizeof(*latencies), compare_timestamp);
+
+	printf("queries:    %d ok, %d failed\n", queries_done, queries_failed);
+	printf("clients:    %d (%s)\n", concurrency, keepalive ? "keep-alive" : "connection per query");
+	printf("elapsed:    %.3f s\n", elapsed);
+	printf("throughput: %.1f queries/s, %.1f MB/s\n", queries_done / elapsed, bytes_received / elapsed / 1000000.0);
+
+	if(queries_done > 0) {
+		printf("latency:    p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+			latencies[queries_done / 2] / 1000.0,
+			latencies[(int) (queries_done * 0.99)] / 1000.0,
+			latencies[queries_done - 1] / 1000.0);
+	}
+
+	free(pindex);
+	free(pfds);
+	free(clients);
+	free(latencies);
+
+	return queries_failed ? 1 : 0;
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -27,6 +27,8 @@ See the file COPYING for details.
 #include "daemon.h"
 #include "getopt_aux.h"
 #include "change_process_title.h"
+#include "buffer.h"
+#include "itable.h"
 #include "zlib.h"
 
 #include <stdlib.h>
@@ -37,6 +39,12 @@ See the file COPYING for details.
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifdef CCTOOLS_OPSYS_LINUX
+#include <sys/epoll.h>
+#endif
 
 #ifndef LINE_MAX
 #define LINE_MAX 1024
@@ -53,6 +61,12 @@ See the file COPYING for details.
 /* Maximum size of a JX record arriving via TCP is 1MB. */
 #define TCP_PAYLOAD_MAX 1024*1024
 
+/* Maximum size of the request line and headers of an HTTP query. */
+#define QUERY_REQUEST_MAX 8192
+
+/* Maximum number of events returned by one call to epoll_wait. */
+#define EVENT_LOOP_MAX_EVENTS 256
+
 /* The table of record, hashed on address:port */
 static struct jx_database *table = 0;
 
@@ -98,6 +112,12 @@ static int child_procs_count = 0;
 /* Maximum time to allow a child process to run. */
 static int child_procs_timeout = 60;
 
+/* If true, serve all queries from a single non-blocking event loop. */
+static int event_mode = 0;
+
+/* Incremented whenever the table changes, to invalidate the cached views. */
+static int table_version = 0;
+
 /* The maximum size of a server that will actually be believed. */
 static INT64_T max_server_size = 0;
 
@@ -108,6 +128,9 @@ static char *logfilename = 0;
 /* Location of the history file. Default is in the current dir. */
 static const char * history_dir = "catalog.history";
 
+/* If true, compress each completed day of history into an archive. */
+static int archive_history = 0;
+
 /* Settings for the master catalog that we will report *to* */
 static int outgoing_alarm = 0;
 static int outgoing_timeout = 300;
@@ -181,6 +204,7 @@ static void remove_expired_records()
 		if( (current-lastheardfrom) > this_lifetime ) {
 				j = jx_database_remove(table,key);
 			if(j) jx_delete(j);
+			table_version++;
 		}
 	}
 
@@ -311,6 +335,7 @@ static void handle_update( const char *addr, int port, const char *raw_data, int
 		}
 
 		jx_database_insert(table, key, j);
+		table_version++;
 
 		debug(D_DEBUG, "received %s update from %s",protocol,key);
 }
@@ -377,129 +402,122 @@ static struct jx_table html_headers[] = {
 	{0,0,0,0,0}
 };
 
-static void handle_query(struct link *query_link)
-{
-	FILE *stream;
-	char line[LINE_MAX];
-	char url[LINE_MAX];
-	char path[LINE_MAX];
-	char action[LINE_MAX];
-	char version[LINE_MAX];
-	char hostport[LINE_MAX];
-	char addr[LINK_ADDRESS_MAX];
-	char key[LINE_MAX];
-	int port;
-	time_t current;
-
-	char *hkey;
-	struct jx *j;
-	int i, n;
-
-	link_address_remote(query_link, addr, &port);
-	debug(D_DEBUG, "www query from %s:%d", addr, port);
-
-	if(link_readline(query_link, line, LINE_MAX, time(0) + HANDLE_QUERY_TIMEOUT)) {
-		string_chomp(line);
-		if(sscanf(line, "%s %s %s", action, url, version) != 3) {
-			return;
-		}
+/*
+A serialized response body.  Snapshots of the full table views are
+kept in the view cache and shared by reference with every connection
+still sending them, so a view may be rebuilt while an older copy is
+still in flight.
+*/
 
-		// Consume the rest of the query
-		while(1) {
-			if(!link_readline(query_link, line, LINE_MAX, time(0) + HANDLE_QUERY_TIMEOUT)) {
-				return;
-			}
+struct catalog_snapshot {
+	char *data;
+	size_t length;
+	const char *content_type;
+	int refcount;
+};
 
-			if(line[0] == 0) {
-				break;
-			}
-		}
-	} else {
-		return;
-	}
+/*
+The views of the entire table, each rebuilt only when a query
+arrives after the table has changed.  Any unrecognized path
+is served the html index.
+*/
 
-	// Output response
-	stream = fdopen(link_fd(query_link), "w");
-	if(!stream) {
-		return;
-	}
-	link_nonblocking(query_link, 0);
+struct catalog_view {
+	const char *path;
+	struct catalog_snapshot *snapshot;
+	int version;
+};
 
-	current = time(0);
-	fprintf(stream, "HTTP/1.1 200 OK\n");
-	fprintf(stream, "Date: %s", ctime(&current));
-	fprintf(stream, "Server: catalog_server\n");
-	fprintf(stream, "Connection: close\n");
-	fprintf(stream, "Access-Control-Allow-Origin: *\n");
+static struct catalog_view views[] = {
+	{"/query.text", 0, 0},
+	{"/query.json", 0, 0},
+	{"/query.xml", 0, 0},
+	{"/query.oldclassads", 0, 0},
+	{"/query.newclassads", 0, 0},
+	{"/", 0, 0},
+	{0, 0, 0}
+};
 
-	if(sscanf(url, "http://%[^/]%s", hostport, path) == 2) {
-		// continue on
-	} else {
-		strcpy(path, url);
-	}
+/* Load the hash table entries into one big array, sorted by name. */
 
-	/* load the hash table entries into one big array */
+static int load_sorted_array()
+{
+	char *hkey;
+	struct jx *j;
+	int n = 0;
 
-	n = 0;
 	jx_database_firstkey(table);
 	while(jx_database_nextkey(table, &hkey, &j)) {
 		array[n] = j;
 		n++;
 	}
 
-	/* sort the array by name before displaying */
-
 	qsort(array, n, sizeof(struct jx *), compare_jx);
 
+	return n;
+}
+
+/* Write the body of the response to path, and return its content type. */
+
+static const char * write_query_body(FILE *stream, const char *path)
+{
+	char url[LINE_MAX];
+	char key[LINE_MAX];
+	struct jx *j;
+	int i, n;
+
+	if(sscanf(path, "/detail/%s", key) == 1) {
+		j = jx_database_lookup(table, key);
+		if(j) {
+			const char *name = jx_lookup_string(j, "name");
+			if(!name)
+				name = "unknown";
+			fprintf(stream, "<title>%s catalog server: %s</title>\n", preferred_hostname, name);
+			fprintf(stream, "<center>\n");
+			fprintf(stream, "<h1>%s catalog server</h1>\n", preferred_hostname);
+			fprintf(stream, "<h2>%s</h2>\n", name);
+			fprintf(stream, "<p><a href=/>return to catalog view</a><p>\n");
+			jx_export_html_solo(j, stream);
+			fprintf(stream, "</center>\n");
+		} else {
+			fprintf(stream, "<title>%s catalog server</title>\n", preferred_hostname);
+			fprintf(stream, "<center>\n");
+			fprintf(stream, "<h1>%s catalog server</h1>\n", preferred_hostname);
+			fprintf(stream, "<h2>Unknown Item!</h2>\n");
+			fprintf(stream, "</center>\n");
+		}
+		return "text/html";
+	}
+
+	n = load_sorted_array();
+
 	if(!strcmp(path, "/query.text")) {
-		fprintf(stream, "Content-type: text/plain\n\n");
 		for(i = 0; i < n; i++)
 			jx_export_nvpair(array[i], stream);
+		return "text/plain";
 	} else if(!strcmp(path, "/query.json")) {
-		fprintf(stream, "Content-type: text/plain\n\n");
 		fprintf(stream,"[\n");
 		for(i = 0; i < n; i++) {
 			jx_print_stream(array[i],stream);
 			if(i<(n-1)) fprintf(stream,",\n");
 		}
 		fprintf(stream,"\n]\n");
+		return "text/plain";
 	} else if(!strcmp(path, "/query.oldclassads")) {
-		fprintf(stream, "Content-type: text/plain\n\n");
 		for(i = 0; i < n; i++)
 			jx_export_old_classads(array[i], stream);
+		return "text/plain";
 	} else if(!strcmp(path, "/query.newclassads")) {
-		fprintf(stream, "Content-type: text/plain\n\n");
 		for(i = 0; i < n; i++)
 			jx_export_new_classads(array[i], stream);
+		return "text/plain";
 	} else if(!strcmp(path, "/query.xml")) {
-		fprintf(stream, "Content-type: text/xml\n\n");
 		fprintf(stream, "<?xml version=\"1.0\" standalone=\"yes\"?>\n");
 		fprintf(stream, "<catalog>\n");
 		for(i = 0; i < n; i++)
 			jx_export_xml(array[i], stream);
 		fprintf(stream, "</catalog>\n");
-	} else if(sscanf(path, "/detail/%s", key) == 1) {
-		struct jx *j;
-		fprintf(stream, "Content-type: text/html\n\n");
-		j = jx_database_lookup(table, key);
-		if(j) {
-			const char *name = jx_lookup_string(j, "name");
-			if(!name)
-				name = "unknown";
-			fprintf(stream, "<title>%s catalog server: %s</title>\n", preferred_hostname, name);
-			fprintf(stream, "<center>\n");
-			fprintf(stream, "<h1>%s catalog server</h1>\n", preferred_hostname);
-			fprintf(stream, "<h2>%s</h2>\n", name);
-			fprintf(stream, "<p><a href=/>return to catalog view</a><p>\n");
-			jx_export_html_solo(j, stream);
-			fprintf(stream, "</center>\n");
-		} else {
-			fprintf(stream, "<title>%s catalog server</title>\n", preferred_hostname);
-			fprintf(stream, "<center>\n");
-			fprintf(stream, "<h1>%s catalog server</h1>\n", preferred_hostname);
-			fprintf(stream, "<h2>Unknown Item!</h2>\n");
-			fprintf(stream, "</center>\n");
-		}
+		return "text/xml";
 	} else {
 		char avail_line[LINE_MAX];
 		char total_line[LINE_MAX];
@@ -507,7 +525,6 @@ static void handle_query(struct link *query_link)
 		INT64_T sum_avail = 0;
 		INT64_T sum_devices = 0;
 
-		fprintf(stream, "Content-type: text/html\n\n");
 		fprintf(stream, "<title>%s catalog server</title>\n", preferred_hostname);
 		fprintf(stream, "<center>\n");
 		fprintf(stream, "<h1>%s catalog server</h1>\n", preferred_hostname);
@@ -539,17 +556,555 @@ static void handle_query(struct link *query_link)
 		}
 		jx_export_html_footer(stream, html_headers);
 		fprintf(stream, "</center>\n");
+		return "text/html";
 	}
+}
+
+static struct catalog_snapshot * snapshot_create(const char *path)
+{
+	struct catalog_snapshot *s = xxmalloc(sizeof(*s));
+
+	s->data = 0;
+	s->length = 0;
+	s->refcount = 1;
+
+	FILE *stream = open_memstream(&s->data, &s->length);
+	if(!stream)
+		fatal("couldn't allocate memory stream: %s", strerror(errno));
+	s->content_type = write_query_body(stream, path);
 	fclose(stream);
+
+	return s;
+}
+
+static void snapshot_release(struct catalog_snapshot *s)
+{
+	if(!s)
+		return;
+
+	s->refcount--;
+	if(s->refcount == 0) {
+		free(s->data);
+		free(s);
+	}
+}
+
+/*
+Return a reference to the serialized response for path,
+re-serializing the view only if the table has changed since
+it was last built.  Detail pages are small and generated per query.
+*/
+
+static struct catalog_snapshot * query_snapshot(const char *path)
+{
+	struct catalog_view *v;
+
+	if(!strncmp(path, "/detail/", 8))
+		return snapshot_create(path);
+
+	for(v = views; v->path; v++) {
+		if(!strcmp(v->path, path))
+			break;
+	}
+
+	if(!v->path) {
+		for(v = views; strcmp(v->path, "/"); v++) {}
+	}
+
+	if(!v->snapshot || v->version != table_version) {
+		snapshot_release(v->snapshot);
+		v->snapshot = snapshot_create(v->path);
+		v->version = table_version;
+		debug(D_DEBUG, "rebuilt view %s (%lu bytes)", v->path, (unsigned long) v->snapshot->length);
+	}
+
+	v->snapshot->refcount++;
+	return v->snapshot;
+}
+
+/* Extract the path from a url that may or may not carry a host:port. */
+
+static void url_to_path(const char *url, char *path)
+{
+	char hostport[LINE_MAX];
+
+	if(sscanf(url, "http://%[^/]%s", hostport, path) == 2) {
+		// continue on
+	} else {
+		strcpy(path, url);
+	}
 }
 
+/* Fill in the HTTP response header that precedes snapshot s. */
+
+static void write_response_header(buffer_t *b, struct catalog_snapshot *s, int keepalive)
+{
+	char date[LINE_MAX];
+	time_t current = time(0);
+
+	strcpy(date, ctime(&current));
+	string_chomp(date);
+
+	buffer_putfstring(b, "HTTP/1.1 200 OK\r\n");
+	buffer_putfstring(b, "Date: %s\r\n", date);
+	buffer_putfstring(b, "Server: catalog_server\r\n");
+	buffer_putfstring(b, "Connection: %s\r\n", keepalive ? "keep-alive" : "close");
+	buffer_putfstring(b, "Access-Control-Allow-Origin: *\r\n");
+	buffer_putfstring(b, "Content-type: %s\r\n", s->content_type);
+	buffer_putfstring(b, "Content-length: %lu\r\n", (unsigned long) s->length);
+	buffer_putfstring(b, "\r\n");
+}
+
+static void handle_query(struct link *query_link)
+{
+	char line[LINE_MAX];
+	char url[LINE_MAX];
+	char path[LINE_MAX];
+	char action[LINE_MAX];
+	char version[LINE_MAX];
+	char addr[LINK_ADDRESS_MAX];
+	int port;
+	time_t stoptime = time(0) + HANDLE_QUERY_TIMEOUT;
+
+	link_address_remote(query_link, addr, &port);
+	debug(D_DEBUG, "www query from %s:%d", addr, port);
+
+	if(link_readline(query_link, line, LINE_MAX, stoptime)) {
+		string_chomp(line);
+		if(sscanf(line, "%s %s %s", action, url, version) != 3) {
+			return;
+		}
+
+		// Consume the rest of the query
+		while(1) {
+			if(!link_readline(query_link, line, LINE_MAX, stoptime)) {
+				return;
+			}
+
+			if(line[0] == 0) {
+				break;
+			}
+		}
+	} else {
+		return;
+	}
+
+	url_to_path(url, path);
+
+	struct catalog_snapshot *s = query_snapshot(path);
+
+	buffer_t header;
+	buffer_init(&header);
+	write_response_header(&header, s, 0);
+
+	size_t length;
+	const char *data = buffer_tolstring(&header, &length);
+	if(link_write(query_link, data, length, stoptime) == (ssize_t) length) {
+		link_write(query_link, s->data, s->length, stoptime);
+	}
+
+	buffer_free(&header);
+	snapshot_release(s);
+}
+
+#ifdef CCTOOLS_OPSYS_LINUX
+
+/*
+State of one HTTP connection in the event loop.  A connection
+is either accumulating a request (waiting for EPOLLIN) or sending
+a response (waiting for EPOLLOUT), never both at once.  A TCP
+update is kept here too, accumulating its payload until the
+client closes the connection.
+*/
+
+struct query_connection {
+	struct link *link;
+	char request[QUERY_REQUEST_MAX];
+	size_t request_length;
+	buffer_t header;
+	size_t header_length;
+	struct catalog_snapshot *snapshot;
+	size_t sent;
+	int keepalive;
+	time_t last_active;
+	int update;
+	buffer_t payload;
+};
+
+static int epoll_fd = -1;
+
+/* All open query connections, indexed by file descriptor. */
+static struct itable *query_connections = 0;
+
+static void connection_watch(struct query_connection *c, int op, uint32_t events)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = link_fd(c->link);
+	epoll_ctl(epoll_fd, op, ev.data.fd, &ev);
+}
+
+static void connection_accept(struct link *port, int update)
+{
+	struct link *l = link_accept(port, time(0) + 1);
+	if(!l)
+		return;
+
+	struct query_connection *c = xxmalloc(sizeof(*c));
+	c->link = l;
+	c->request_length = 0;
+	buffer_init(&c->header);
+	c->header_length = 0;
+	c->snapshot = 0;
+	c->sent = 0;
+	c->keepalive = 0;
+	c->last_active = time(0);
+	c->update = update;
+	buffer_init(&c->payload);
+
+	itable_insert(query_connections, link_fd(l), c);
+	connection_watch(c, EPOLL_CTL_ADD, EPOLLIN);
+
+	char addr[LINK_ADDRESS_MAX];
+	int remote_port;
+	link_address_remote(l, addr, &remote_port);
+	debug(D_DEBUG, "%s connection from %s:%d", update ? "tcp update" : "www", addr, remote_port);
+}
+
+static void connection_close(struct query_connection *c)
+{
+	int fd = link_fd(c->link);
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, 0);
+	itable_remove(query_connections, fd);
+
+	snapshot_release(c->snapshot);
+	buffer_free(&c->header);
+	buffer_free(&c->payload);
+	link_close(c->link);
+	free(c);
+}
+
+/*
+If a complete request has arrived, prepare the response and
+return true.  Sets *error if the request cannot be parsed.
+Any bytes following the request (pipelined queries) are kept.
+*/
+
+static int connection_parse(struct query_connection *c, int *error)
+{
+	char action[LINE_MAX];
+	char url[LINE_MAX];
+	char path[LINE_MAX];
+	char version[LINE_MAX];
+
+	*error = 0;
+
+	char *end = memmem(c->request, c->request_length, "\r\n\r\n", 4);
+	size_t endlength = 4;
+	if(!end) {
+		end = memmem(c->request, c->request_length, "\n\n", 2);
+		endlength = 2;
+	}
+	if(!end)
+		return 0;
+
+	*end = 0;
+
+	char *line = c->request;
+	char *next = strchr(line, '\n');
+	if(next)
+		*next++ = 0;
+	string_chomp(line);
+
+	if(strlen(line) >= LINE_MAX || sscanf(line, "%s %s %s", action, url, version) != 3) {
+		*error = 1;
+		return 0;
+	}
+
+	/* HTTP/1.1 defaults to keep-alive, earlier versions do not. */
+	c->keepalive = !strcmp(version, "HTTP/1.1");
+
+	while(next && *next) {
+		line = next;
+		next = strchr(line, '\n');
+		if(next)
+			*next++ = 0;
+		string_chomp(line);
+		if(!strncasecmp(line, "Connection:", 11)) {
+			if(strcasestr(line, "close")) {
+				c->keepalive = 0;
+			} else if(strcasestr(line, "keep-alive")) {
+				c->keepalive = 1;
+			}
+		}
+	}
+
+	size_t consumed = (end - c->request) + endlength;
+	c->request_length -= consumed;
+	memmove(c->request, c->request + consumed, c->request_length);
+
+	url_to_path(url, path);
+	debug(D_DEBUG, "www query %s", path);
+
+	c->snapshot = query_snapshot(path);
+	buffer_rewind(&c->header, 0);
+	write_response_header(&c->header, c->snapshot, c->keepalive);
+	buffer_tolstring(&c->header, &c->header_length);
+	c->sent = 0;
+
+	return 1;
+}
+
+/*
+Send as much of the pending response as the socket will take.
+Returns false if the connection should be closed.
+*/
+
+static int connection_send(struct query_connection *c)
+{
+	while(c->snapshot) {
+		struct iovec iov[2];
+		int iovcnt = 0;
+		const char *header = buffer_tostring(&c->header);
+
+		if(c->sent < c->header_length) {
+			iov[iovcnt].iov_base = (char *) header + c->sent;
+			iov[iovcnt].iov_len = c->header_length - c->sent;
+			iovcnt++;
+			iov[iovcnt].iov_base = c->snapshot->data;
+			iov[iovcnt].iov_len = c->snapshot->length;
+			iovcnt++;
+		} else {
+			size_t offset = c->sent - c->header_length;
+			iov[iovcnt].iov_base = c->snapshot->data + offset;
+			iov[iovcnt].iov_len = c->snapshot->length - offset;
+			iovcnt++;
+		}
+
+		ssize_t result = writev(link_fd(c->link), iov, iovcnt);
+		if(result < 0) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				connection_watch(c, EPOLL_CTL_MOD, EPOLLOUT);
+				return 1;
+			}
+			return 0;
+		}
+
+		c->sent += result;
+		c->last_active = time(0);
+
+		if(c->sent < c->header_length + c->snapshot->length)
+			continue;
+
+		snapshot_release(c->snapshot);
+		c->snapshot = 0;
+
+		if(!c->keepalive)
+			return 0;
+
+		int error;
+		if(!connection_parse(c, &error)) {
+			if(error)
+				return 0;
+			connection_watch(c, EPOLL_CTL_MOD, EPOLLIN);
+		}
+	}
+
+	return 1;
+}
+
+/*
+Read whatever has arrived on the connection and respond to
+any complete request.  Returns false if the connection should be closed.
+*/
+
+static int connection_receive(struct query_connection *c)
+{
+	size_t space = sizeof(c->request) - c->request_length;
+	if(space == 0)
+		return 0;
+
+	ssize_t result = read(link_fd(c->link), c->request + c->request_length, space);
+	if(result == 0) {
+		return 0;
+	} else if(result < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+
+	c->request_length += result;
+	c->last_active = time(0);
+
+	int error;
+	if(connection_parse(c, &error)) {
+		return connection_send(c);
+	} else {
+		return !error;
+	}
+}
+
+/*
+Read whatever has arrived of a TCP update.  Once the client closes
+the connection, or the payload reaches its limit, apply the update.
+Returns false if the connection should be closed.
+*/
+
+static int update_receive(struct query_connection *c)
+{
+	char data[65536];
+	size_t length;
+
+	buffer_tolstring(&c->payload, &length);
+	size_t space = MIN(sizeof(data), TCP_PAYLOAD_MAX - 1 - length);
+
+	ssize_t result = space ? read(link_fd(c->link), data, space) : 0;
+	if(result < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	} else if(result > 0) {
+		buffer_putlstring(&c->payload, data, result);
+		if(length + result < TCP_PAYLOAD_MAX - 1)
+			return 1;
+	}
+
+	char addr[LINK_ADDRESS_MAX];
+	int port;
+	link_address_remote(c->link, addr, &port);
+
+	const char *payload = buffer_tolstring(&c->payload, &length);
+	if(length > 0)
+		handle_update(addr, port, payload, length, "tcp");
+
+	return 0;
+}
+
+/*
+Close connections that have been idle for longer than the query timeout,
+and updates that have not arrived in full within the update timeout.
+*/
+
+static void remove_idle_connections()
+{
+	UINT64_T fd;
+	struct query_connection *c;
+	struct list *idle = list_create();
+	time_t current = time(0);
+
+	itable_firstkey(query_connections);
+	while(itable_nextkey(query_connections, &fd, (void **) &c)) {
+		if((current - c->last_active) > (c->update ? HANDLE_TCP_UPDATE_TIMEOUT : HANDLE_QUERY_TIMEOUT)) {
+			list_push_head(idle, c);
+		}
+	}
+
+	while((c = list_pop_head(idle))) {
+		connection_close(c);
+	}
+
+	list_delete(idle);
+}
+
+/*
+Serve UDP updates, TCP updates, and HTTP queries from a single
+process.  TCP updates and queries are read and written without
+blocking, so one slow client cannot stall the others, and the
+serialized views are shared among all clients between table changes.
+*/
+
+static void event_loop(struct link *query_port)
+{
+	struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+	struct epoll_event ev;
+	int dfd = datagram_fd(update_dgram);
+	int lfd = link_fd(query_port);
+	int ufd = link_fd(update_port);
+	int i;
+
+	epoll_fd = epoll_create(EVENT_LOOP_MAX_EVENTS);
+	if(epoll_fd < 0)
+		fatal("couldn't create epoll descriptor: %s", strerror(errno));
+
+	query_connections = itable_create(0);
+
+	/*
+	link_serve_address uses a very short listen queue, which drops
+	connections when many clients arrive at once.  Lengthen it,
+	since every pending client is accepted as soon as possible.
+	*/
+	listen(lfd, SOMAXCONN);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = dfd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dfd, &ev);
+	ev.data.fd = lfd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, lfd, &ev);
+	ev.data.fd = ufd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ufd, &ev);
+
+	while(1) {
+		remove_expired_records();
+
+		if(time(0) > outgoing_alarm) {
+			update_all_catalogs();
+			outgoing_alarm = time(0) + outgoing_timeout;
+		}
+
+		remove_idle_connections();
+
+		int n = epoll_wait(epoll_fd, events, EVENT_LOOP_MAX_EVENTS, 1000);
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			fatal("epoll_wait failed: %s", strerror(errno));
+		}
+
+		for(i = 0; i < n; i++) {
+			int fd = events[i].data.fd;
+
+			if(fd == dfd) {
+				handle_udp_updates(update_dgram);
+			} else if(fd == ufd) {
+				connection_accept(update_port, 1);
+			} else if(fd == lfd) {
+				connection_accept(query_port, 0);
+			} else {
+				struct query_connection *c = itable_lookup(query_connections, fd);
+				if(!c)
+					continue;
+
+				int ok;
+				if(events[i].events & EPOLLERR) {
+					ok = 0;
+				} else if(c->update) {
+					/* A hangup may follow the last of the payload. */
+					ok = update_receive(c);
+				} else if(events[i].events & EPOLLHUP) {
+					ok = 0;
+				} else if(c->snapshot) {
+					ok = connection_send(c);
+				} else {
+					ok = connection_receive(c);
+				}
+
+				if(!ok)
+					connection_close(c);
+			}
+		}
+	}
+}
+
+#endif
+
 static void show_help(const char *cmd)
 {
 	fprintf(stdout, "Use: %s [options]\n", cmd);
 	fprintf(stdout, "where options are:\n");
+	fprintf(stdout, " %-30s Replace each completed day of history with a compact archive.\n", "-A,--archive-history");
 	fprintf(stdout, " %-30s Run as a daemon.\n", "-b,--background");
 	fprintf(stdout, " %-30s Write process identifier (PID) to file.\n", "-B,--pid-file=<file>");
 	fprintf(stdout, " %-30s Enable debugging for this subsystem\n", "-d,--debug=<subsystem>");
+	fprintf(stdout, " %-30s Serve all queries from a single event-driven process.\n", "-E,--event-loop");
 	fprintf(stdout, " %-30s Show this help screen\n", "-h,--help");
 	fprintf(stdout, " %-30s Record catalog history to this directory.\n", "-H,--history=<directory>");
 	fprintf(stdout, " %-30s Listen only on this network interface.\n", "-I,--interface=<addr>");
@@ -587,9 +1142,11 @@ int main(int argc, char *argv[])
 	debug_config(argv[0]);
 
 	static const struct option long_options[] = {
+		{"archive-history", no_argument, 0, 'A'},
 		{"background", no_argument, 0, 'b'},
 		{"pid-file", required_argument, 0, 'B'},
 		{"debug", required_argument, 0, 'd'},
+		{"event-loop", no_argument, 0, 'E'},
 		{"help", no_argument, 0, 'h'},
 		{"history", required_argument, 0, 'H'},
 		{"lifetime", required_argument, 0, 'l'},
@@ -610,8 +1167,11 @@ int main(int argc, char *argv[])
 		{0,0,0,0}};
 
 
-	while((ch = getopt_long(argc, argv, "bB:d:hH:I:l:L:m:M:n:o:O:p:ST:u:U:vZ:", long_options, NULL)) > -1) {
+	while((ch = getopt_long(argc, argv, "AbB:d:EhH:I:l:L:m:M:n:o:O:p:ST:u:U:vZ:", long_options, NULL)) > -1) {
 		switch (ch) {
+			case 'A':
+				archive_history = 1;
+				break;
 			case 'b':
 				is_daemon = 1;
 				break;
@@ -622,6 +1182,13 @@ int main(int argc, char *argv[])
 			case 'd':
 				debug_flags_set(optarg);
 				break;
+			case 'E':
+#ifdef CCTOOLS_OPSYS_LINUX
+				event_mode = 1;
+#else
+				fatal("the event loop (-E) is only supported on Linux");
+#endif
+				break;
 			case 'h':
 			default:
 				show_help(argv[0]);
@@ -714,6 +1281,7 @@ int main(int argc, char *argv[])
 	table = jx_database_create(history_dir);
 	if(!table)
 		fatal("couldn't create directory %s: %s\n",history_dir,strerror(errno));
+	jx_database_archive(table, archive_history);
 
 	query_port = link_serve_address(interface, port);
 	if(query_port) {
@@ -753,6 +1321,13 @@ int main(int argc, char *argv[])
 
 	opts_write_port_file(port_file,port);
 
+#ifdef CCTOOLS_OPSYS_LINUX
+	if(event_mode) {
+		event_loop(query_port);
+		return 1;
+	}
+#endif
+
 	while(1) {
 		fd_set rfds;
 		int dfd = datagram_fd(update_dgram);
@@ -10,26 +10,51 @@ See the file COPYING for details.
 #include <stdlib.h>
 #include <string.h>
 
-#define DEFAULT_SIZE 127
-#define DEFAULT_LOAD 0.75
+#define DEFAULT_SIZE 128
 #define DEFAULT_FUNC hash_string
 
+/* The table grows when more than 7/8 of the slots are full. */
+#define LOAD_NUMERATOR 7
+#define LOAD_DENOMINATOR 8
+
+/*
+The table is a single array of slots, using open addressing with
+Robin Hood linear probing: each entry records its distance from
+its home slot, and an entry being inserted takes the place of any
+entry closer to home, so that probe sequences stay short and a
+lookup can stop as soon as it meets an entry closer to home than
+the key it seeks.  Removal shifts the following entries back by one,
+so there are no tombstones.  The hash of each key is kept in its slot
+so that most mismatches are rejected without touching the key string.
+An empty slot has a null key.
+
+The slots are not allocated until the first insert, since many tables
+(such as those kept for each rule of a workflow) are never used.
+*/
+
 struct entry {
 	char *key;
 	void *value;
 	unsigned hash;
-	struct entry *next;
+	unsigned distance;
 };
 
 struct hash_table {
 	hash_func_t hash_func;
 	int bucket_count;
 	int size;
-	struct entry **buckets;
-	int ibucket;
-	struct entry *ientry;
+	struct entry *buckets;
+	struct hash_table_iterator iterator;
 };
 
+static int round_up_power_of_two(int n)
+{
+	int result = 8;
+	while(result < n)
+		result *= 2;
+	return result;
+}
+
 struct hash_table *hash_table_create(int bucket_count, hash_func_t func)
 {
 	struct hash_table *h;
@@ -45,36 +70,29 @@ struct hash_table *hash_table_create(int bucket_count, hash_func_t func)
 
 	h->size = 0;
 	h->hash_func = func;
-	h->bucket_count = bucket_count;
-	h->buckets = (struct entry **) calloc(bucket_count, sizeof(struct entry *));
-	if(!h->buckets) {
-		free(h);
-		return 0;
-	}
+	h->bucket_count = round_up_power_of_two(bucket_count);
+	h->buckets = 0;
+
+	h->iterator.index = 0;
+	h->iterator.remaining = 0;
 
 	return h;
 }
 
 void hash_table_clear(struct hash_table *h)
 {
-	struct entry *e, *f;
 	int i;
 
-	for(i = 0; i < h->bucket_count; i++) {
-		e = h->buckets[i];
-		while(e) {
-			f = e->next;
-			free(e->key);
-			free(e);
-			e = f;
-		}
-	}
+	if(!h->buckets)
+		return;
 
 	for(i = 0; i < h->bucket_count; i++) {
-		h->buckets[i] = 0;
+		free(h->buckets[i].key);
 	}
-}
 
+	memset(h->buckets, 0, h->bucket_count * sizeof(struct entry));
+	h->size = 0;
+}
 
 void hash_table_delete(struct hash_table *h)
 {
@@ -83,23 +101,30 @@ void hash_table_delete(struct hash_table *h)
 	free(h);
 }
 
-void *hash_table_lookup(struct hash_table *h, const char *key)
+static struct entry *hash_table_find(struct hash_table *h, const char *key, unsigned hash)
 {
-	struct entry *e;
-	unsigned hash, index;
+	unsigned mask = h->bucket_count - 1;
+	unsigned index = hash & mask;
+	unsigned distance = 0;
 
-	hash = h->hash_func(key);
-	index = hash % h->bucket_count;
-	e = h->buckets[index];
+	if(!h->buckets)
+		return 0;
 
-	while(e) {
-		if(hash == e->hash && !strcmp(key, e->key)) {
-			return e->value;
-		}
-		e = e->next;
+	while(1) {
+		struct entry *e = &h->buckets[index];
+		if(!e->key || e->distance < distance)
+			return 0;
+		if(e->hash == hash && !strcmp(key, e->key))
+			return e;
+		index = (index + 1) & mask;
+		distance++;
 	}
+}
 
-	return 0;
+void *hash_table_lookup(struct hash_table *h, const char *key)
+{
+	struct entry *e = hash_table_find(h, key, h->hash_func(key));
+	return e ? e->value : 0;
 }
 
 int hash_table_size(struct hash_table *h)
@@ -107,81 +132,81 @@ int hash_table_size(struct hash_table *h)
 	return h->size;
 }
 
-static int hash_table_double_buckets(struct hash_table *h)
+/* Place an entry known not to be in the table, displacing entries closer to home. */
+
+static void hash_table_place(struct hash_table *h, struct entry e)
 {
-	struct hash_table *hn = hash_table_create(2 * h->bucket_count, h->hash_func);
+	unsigned mask = h->bucket_count - 1;
+	unsigned index = e.hash & mask;
 
-	if(!hn)
-		return 0;
+	e.distance = 0;
 
-	/* Move pairs to new hash */
-	char *key;
-	void *value;
-	hash_table_firstkey(h);
-	while(hash_table_nextkey(h, &key, &value))
-		if(!hash_table_insert(hn, key, value))
-		{
-			hash_table_delete(hn);
-			return 0;
+	while(1) {
+		struct entry *slot = &h->buckets[index];
+		if(!slot->key) {
+			*slot = e;
+			return;
 		}
-
-	/* Delete all old pairs */
-	struct entry *e, *f;
-	int i;
-	for(i = 0; i < h->bucket_count; i++) {
-		e = h->buckets[i];
-		while(e) {
-			f = e->next;
-			free(e->key);
-			free(e);
-			e = f;
+		if(slot->distance < e.distance) {
+			struct entry displaced = *slot;
+			*slot = e;
+			e = displaced;
 		}
+		index = (index + 1) & mask;
+		e.distance++;
 	}
+}
 
-	/* Make the old point to the new */
-	free(h->buckets);
-	h->buckets      = hn->buckets;
-	h->bucket_count = hn->bucket_count;
-	h->size         = hn->size;
+static int hash_table_double_buckets(struct hash_table *h)
+{
+	struct entry *old = h->buckets;
+	int old_count = h->bucket_count;
+	int i;
+
+	struct entry *buckets = (struct entry *) calloc(2 * old_count, sizeof(struct entry));
+	if(!buckets)
+		return 0;
 
-	/* Delete reference to new, so old is safe */
-	free(hn);
+	h->buckets = buckets;
+	h->bucket_count = 2 * old_count;
+
+	/* Move the entries over without copying the keys. */
+	for(i = 0; i < old_count; i++) {
+		if(old[i].key)
+			hash_table_place(h, old[i]);
+	}
+
+	free(old);
 
 	return 1;
 }
 
 int hash_table_insert(struct hash_table *h, const char *key, const void *value)
 {
-	struct entry *e;
-	unsigned hash, index;
+	struct entry e;
 
-	if( ((float) h->size / h->bucket_count) > DEFAULT_LOAD )
-		hash_table_double_buckets(h);
+	e.hash = h->hash_func(key);
 
-	hash = h->hash_func(key);
-	index = hash % h->bucket_count;
-	e = h->buckets[index];
+	if(hash_table_find(h, key, e.hash))
+		return 0;
 
-	while(e) {
-		if(hash == e->hash && !strcmp(key, e->key))
+	if(!h->buckets) {
+		h->buckets = (struct entry *) calloc(h->bucket_count, sizeof(struct entry));
+		if(!h->buckets)
 			return 0;
-		e = e->next;
 	}
 
-	e = (struct entry *) malloc(sizeof(struct entry));
-	if(!e)
-		return 0;
+	if((h->size + 1) * LOAD_DENOMINATOR > h->bucket_count * LOAD_NUMERATOR) {
+		if(!hash_table_double_buckets(h))
+			return 0;
+	}
 
-	e->key = strdup(key);
-	if(!e->key) {
-		free(e);
+	e.key = strdup(key);
+	if(!e.key)
 		return 0;
-	}
 
-	e->value = (void *) value;
-	e->hash = hash;
-	e->next = h->buckets[index];
-	h->buckets[index] = e;
+	e.value = (void *) value;
+	hash_table_place(h, e);
 	h->size++;
 
 	return 1;
@@ -189,30 +214,73 @@ int hash_table_insert(struct hash_table *h, const char *key, const void *value)
 
 void *hash_table_remove(struct hash_table *h, const char *key)
 {
-	struct entry *e, *f;
+	unsigned mask = h->bucket_count - 1;
 	void *value;
-	unsigned hash, index;
-
-	hash = h->hash_func(key);
-	index = hash % h->bucket_count;
-	e = h->buckets[index];
-	f = 0;
-
-	while(e) {
-		if(hash == e->hash && !strcmp(key, e->key)) {
-			if(f) {
-				f->next = e->next;
-			} else {
-				h->buckets[index] = e->next;
-			}
-			value = e->value;
-			free(e->key);
-			free(e);
-			h->size--;
-			return value;
+
+	struct entry *e = hash_table_find(h, key, h->hash_func(key));
+	if(!e)
+		return 0;
+
+	value = e->value;
+	free(e->key);
+	h->size--;
+
+	/* Shift the rest of the probe sequence back into the gap. */
+	unsigned index = e - h->buckets;
+	while(1) {
+		unsigned next = (index + 1) & mask;
+		struct entry *n = &h->buckets[next];
+		if(!n->key || n->distance == 0)
+			break;
+		h->buckets[index] = *n;
+		h->buckets[index].distance--;
+		index = next;
+	}
+
+	h->buckets[index].key = 0;
+	h->buckets[index].value = 0;
+	h->buckets[index].distance = 0;
+
+	return value;
+}
+
+/*
+Iteration proceeds downward from the slot just below an empty one.
+Since removal only shifts entries downward, and stops at an empty
+slot, removing the entry just visited moves only entries that have
+already been visited, so the remainder of the iteration is unaffected.
+*/
+
+void hash_table_iterator_first(struct hash_table *h, struct hash_table_iterator *i)
+{
+	int empty = 0;
+
+	if(!h->buckets) {
+		i->index = 0;
+		i->remaining = 0;
+		return;
+	}
+
+	while(h->buckets[empty].key)
+		empty++;
+
+	i->index = (empty + h->bucket_count - 1) & (h->bucket_count - 1);
+	i->remaining = h->bucket_count - 1;
+}
+
+int hash_table_iterator_next(struct hash_table *h, struct hash_table_iterator *i, char **key, void **value)
+{
+	while(i->remaining > 0) {
+		struct entry *e = &h->buckets[i->index];
+
+		i->index = (i->index + h->bucket_count - 1) & (h->bucket_count - 1);
+		i->remaining--;
+
+		if(e->key) {
+			*key = e->key;
+			*value = e->value;
+			return 1;
 		}
-		f = e;
-		e = e->next;
 	}
 
 	return 0;
@@ -220,33 +288,12 @@ void *hash_table_remove(struct hash_table *h, const char *key)
 
 void hash_table_firstkey(struct hash_table *h)
 {
-	h->ientry = 0;
-	for(h->ibucket = 0; h->ibucket < h->bucket_count; h->ibucket++) {
-		h->ientry = h->buckets[h->ibucket];
-		if(h->ientry)
-			break;
-	}
+	hash_table_iterator_first(h, &h->iterator);
 }
 
 int hash_table_nextkey(struct hash_table *h, char **key, void **value)
 {
-	if(h->ientry) {
-		*key = h->ientry->key;
-		*value = h->ientry->value;
-
-		h->ientry = h->ientry->next;
-		if(!h->ientry) {
-			h->ibucket++;
-			for(; h->ibucket < h->bucket_count; h->ibucket++) {
-				h->ientry = h->buckets[h->ibucket];
-				if(h->ientry)
-					break;
-			}
-		}
-		return 1;
-	} else {
-		return 0;
-	}
+	return hash_table_iterator_next(h, &h->iterator, key, value);
 }
 
 typedef unsigned long int ub4;	/* unsigned 4-byte quantities */
@@ -35,8 +35,34 @@ while(hash_table_nextkey(h,&key,&value)) {
 }
 </pre>
 
+Because the iteration state of @ref hash_table_firstkey is kept in the table,
+only one such iteration may be in progress at a time.  To iterate independently,
+for example in nested loops, use a @ref hash_table_iterator instead:
+
+<pre>
+struct hash_table_iterator i;
+
+hash_table_iterator_first(h,&i);
+
+while(hash_table_iterator_next(h,&i,&key,&value)) {
+	printf("table contains: %s\n",key);
+}
+</pre>
+
+The table is stored with open addressing, so that a lookup touches
+few cache lines.  During any iteration, the key most recently visited
+may be removed; inserting into the table ends the iteration.
+
 */
 
+/** The state of an iteration over a hash table.
+Allocate one of these anywhere, and pass it to @ref hash_table_iterator_first. */
+
+struct hash_table_iterator {
+	int index;
+	int remaining;
+};
+
 /** The type signature for a hash function given to @ref hash_table_create */
 
 typedef unsigned (*hash_func_t) (const char *key);
@@ -118,6 +144,23 @@ This function returns the next key and value in the iteration.
 
 int hash_table_nextkey(struct hash_table *h, char **key, void **value);
 
+/** Begin an independent iteration over all keys.
+@param h A pointer to a hash table.
+@param i A pointer to an iterator, which will be initialized.
+*/
+
+void hash_table_iterator_first(struct hash_table *h, struct hash_table_iterator *i);
+
+/** Continue an independent iteration over all keys.
+@param h A pointer to a hash table.
+@param i A pointer to an iterator begun by @ref hash_table_iterator_first.
+@param key A pointer to a key pointer.
+@param value A pointer to a value pointer.
+@return Zero if there are no more elements to visit, one otherwise.
+*/
+
+int hash_table_iterator_next(struct hash_table *h, struct hash_table_iterator *i, char **key, void **value);
+
 /** A default hash function.
 @param s A string to hash.
 @return An integer hash of the string.
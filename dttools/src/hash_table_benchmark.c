@@ -0,0 +1,166 @@
+/*
+Copyright (C) 2018- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Measure the time taken to insert, look up, iterate over, and remove
+a number of entries in a hash_table and an itable, reporting the
+rate of each operation.  Lookups are made in a shuffled order,
+half of them for keys that are present, and half for keys that are not.
+
+Example use:
+	hash_table_benchmark 1000000
+*/
+
+#include "hash_table.h"
+#include "itable.h"
+#include "timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_MAX 32
+
+static void report(const char *table, const char *op, int count, timestamp_t elapsed)
+{
+	printf("%-12s %-10s %10d ops %10.3fs %12.0f ops/s\n",
+		table, op, count, elapsed / 1000000.0,
+		elapsed ? count / (elapsed / 1000000.0) : 0);
+}
+
+static void shuffle(int *order, int count)
+{
+	int i;
+	for(i = count - 1; i > 0; i--) {
+		int j = random() % (i + 1);
+		int t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+}
+
+static int benchmark_hash_table(int count, const int *order)
+{
+	char key[KEY_MAX];
+	char *k;
+	void *v;
+	int i, found = 0, visited = 0;
+	timestamp_t start;
+
+	struct hash_table *h = hash_table_create(0, 0);
+
+	start = timestamp_get();
+	for(i = 0; i < count; i++) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		hash_table_insert(h, key, (void *) (long) (i + 1));
+	}
+	report("hash_table", "insert", count, timestamp_get() - start);
+
+	start = timestamp_get();
+	for(i = 0; i < count; i++) {
+		snprintf(key, sizeof(key), "key.%d", order[i]);
+		if(hash_table_lookup(h, key))
+			found++;
+	}
+	report("hash_table", "lookup", count, timestamp_get() - start);
+
+	start = timestamp_get();
+	hash_table_firstkey(h);
+	while(hash_table_nextkey(h, &k, &v))
+		visited++;
+	report("hash_table", "iterate", visited, timestamp_get() - start);
+
+	start = timestamp_get();
+	for(i = 0; i < count; i++) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		hash_table_remove(h, key);
+	}
+	report("hash_table", "remove", count, timestamp_get() - start);
+
+	int result = found == count / 2 && visited == count && hash_table_size(h) == 0;
+	hash_table_delete(h);
+	return result;
+}
+
+static int benchmark_itable(int count, const int *order)
+{
+	UINT64_T k;
+	void *v;
+	int i, found = 0, visited = 0;
+	timestamp_t start;
+
+	struct itable *t = itable_create(0);
+
+	start = timestamp_get();
+	for(i = 0; i < count; i++) {
+		itable_insert(t, i, (void *) (long) (i + 1));
+	}
+	report("itable", "insert", count, timestamp_get() - start);
+
+	start = timestamp_get();
+	for(i = 0; i < count; i++) {
+		if(itable_lookup(t, order[i]))
+			found++;
+	}
+	report("itable", "lookup", count, timestamp_get() - start);
+
+	start = timestamp_get();
+	itable_firstkey(t);
+	while(itable_nextkey(t, &k, &v))
+		visited++;
+	report("itable", "iterate", visited, timestamp_get() - start);
+
+	start = timestamp_get();
+	for(i = 0; i < count; i++) {
+		itable_remove(t, i);
+	}
+	report("itable", "remove", count, timestamp_get() - start);
+
+	int result = found == count / 2 && visited == count && itable_size(t) == 0;
+	itable_delete(t);
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	int count = 1000000;
+	int i;
+
+	if(argc > 2) {
+		printf("use: %s [entries]\n", argv[0]);
+		return 1;
+	}
+
+	if(argc == 2)
+		count = atoi(argv[1]);
+
+	if(count < 2) {
+		fprintf(stderr, "%s: the number of entries must be at least two\n", argv[0]);
+		return 1;
+	}
+
+	/* Half of the lookups are for keys that were never inserted. */
+	int *order = malloc(sizeof(int) * count);
+	for(i = 0; i < count; i++) {
+		order[i] = (i % 2) ? i : count + i;
+	}
+	srandom(count);
+	shuffle(order, count);
+
+	int ok = benchmark_hash_table(count, order);
+	ok = benchmark_itable(count, order) && ok;
+
+	free(order);
+
+	if(!ok) {
+		fprintf(stderr, "%s: tables returned inconsistent results\n", argv[0]);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -12,6 +12,10 @@ See the file COPYING for details.
 #include "debug.h"
 #include "domain_name_cache.h"
 #include "url_encode.h"
+#include "hash_table.h"
+#include "itable.h"
+#include "list.h"
+#include "macros.h"
 
 #include <errno.h>
 #include <string.h>
@@ -19,9 +23,16 @@ See the file COPYING for details.
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <strings.h>
 
 #define HTTP_LINE_MAX 4096
+/* A pool key is a host, a colon, and a port. */
+#define HTTP_KEY_MAX (HTTP_LINE_MAX+16)
 #define HTTP_PORT 80
+#define HTTP_IDLE_MAX 4
 
 static int http_response_to_errno(int response)
 {
@@ -84,17 +95,117 @@ struct link *http_query_size(const char *url, const char *action, INT64_T * size
 	}
 }
 
-struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, const char *action, INT64_T * size, time_t stoptime, int cache_reload)
+/*
+Connections to servers that allow it are kept open after a query made by
+http_query_range, in a pool of idle links for each host and port, so that
+later queries to the same server need not connect again.  Links that are
+in use are remembered with the pool they return to.  Parrot queries from
+more than one thread, so the pool has a lock.
+*/
+
+struct http_connection {
+	char key[HTTP_KEY_MAX];
+	int reusable;
+};
+
+static struct hash_table *idle_connections = 0;
+static struct itable *busy_connections = 0;
+static pthread_mutex_t connections_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct link *http_connect(const char *key, const char *host, int port, int persistent, int *reused, time_t stoptime)
+{
+	char addr[LINK_ADDRESS_MAX];
+	struct link *link;
+
+	*reused = 0;
+
+	if(persistent) {
+		struct list *idle;
+
+		pthread_mutex_lock(&connections_mutex);
+		idle = idle_connections ? hash_table_lookup(idle_connections, key) : 0;
+		link = idle ? list_pop_head(idle) : 0;
+		pthread_mutex_unlock(&connections_mutex);
+
+		while(link) {
+			/* An idle connection with anything to read has been closed by the server. */
+			if(!link_usleep(link, 0, 1, 0)) {
+				debug(D_HTTP, "reuse connection to %s", key);
+				*reused = 1;
+				return link;
+			}
+			link_close(link);
+
+			pthread_mutex_lock(&connections_mutex);
+			link = list_pop_head(idle);
+			pthread_mutex_unlock(&connections_mutex);
+		}
+	}
+
+	debug(D_HTTP, "connect %s port %d", host, port);
+	if(!domain_name_cache_lookup(host, addr))
+		return 0;
+
+	link = link_connect(addr, port, stoptime);
+	if(!link) {
+		errno = ECONNRESET;
+		return 0;
+	}
+
+	return link;
+}
+
+void http_query_release(struct link *link, int reuse)
+{
+	struct http_connection *c = 0;
+
+	if(!link)
+		return;
+
+	pthread_mutex_lock(&connections_mutex);
+
+	if(busy_connections)
+		c = itable_remove(busy_connections, (uintptr_t) link);
+
+	if(c && c->reusable && reuse && link_buffer_empty(link)) {
+		struct list *idle;
+
+		if(!idle_connections)
+			idle_connections = hash_table_create(0, 0);
+
+		idle = hash_table_lookup(idle_connections, c->key);
+		if(!idle) {
+			idle = list_create();
+			hash_table_insert(idle_connections, c->key, idle);
+		}
+
+		if(list_size(idle) < HTTP_IDLE_MAX) {
+			list_push_head(idle, link);
+			link = 0;
+		}
+	}
+
+	pthread_mutex_unlock(&connections_mutex);
+
+	free(c);
+	if(link)
+		link_close(link);
+}
+
+static struct link *http_query_range_via_proxy(const char *proxy, const char *urlin, const char *action, INT64_T offset, INT64_T length, INT64_T * size, INT64_T * total, time_t stoptime, int cache_reload, int persistent, char *location)
 {
 	char url[HTTP_LINE_MAX];
 	char newurl[HTTP_LINE_MAX];
 	char line[HTTP_LINE_MAX];
-	char addr[LINK_ADDRESS_MAX];
+	char key[HTTP_KEY_MAX];
 	struct link *link;
 	int save_errno;
 	int response;
+	int reused;
+	int reusable;
 	char actual_host[HTTP_LINE_MAX];
 	int actual_port;
+	INT64_T range_total;
 	*size = 0;
 
 	url_encode(urlin, url, sizeof(url));
@@ -134,16 +245,13 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 		memmove(url, url + delta, strlen(url) - delta + 1); /* 1: copy the terminating null character */
 	}
 
-	debug(D_HTTP, "connect %s port %d", actual_host, actual_port);
-	if(!domain_name_cache_lookup(actual_host, addr))
-		return 0;
+	snprintf(key, sizeof(key), "%s:%d", actual_host, actual_port);
 
-	link = link_connect(addr, actual_port, stoptime);
-	if(!link) {
-		errno = ECONNRESET;
-		return 0;
-	}
+	retry:
 
+	link = http_connect(key, actual_host, actual_port, persistent, &reused, stoptime);
+	if(!link)
+		return 0;
 
 	{
 		buffer_t B;
@@ -154,7 +262,14 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 		buffer_printf(&B, "%s %s HTTP/1.1\r\n", action, url);
 		if(cache_reload)
 			buffer_putliteral(&B, "Cache-Control: max-age=0\r\n");
-		buffer_putliteral(&B, "Connection: close\r\n");
+		if(offset >= 0 && length > 0)
+			buffer_printf(&B, "Range: bytes=%" PRId64 "-%" PRId64 "\r\n", offset, offset + length - 1);
+		else if(offset > 0)
+			buffer_printf(&B, "Range: bytes=%" PRId64 "-\r\n", offset);
+		if(persistent)
+			buffer_putliteral(&B, "Connection: keep-alive\r\n");
+		else
+			buffer_putliteral(&B, "Connection: close\r\n");
 		buffer_printf(&B, "Host: %s\r\n", actual_host);
 		if(getenv("HTTP_USER_AGENT"))
 			buffer_printf(&B, "User-Agent: Mozilla/5.0 (compatible; CCTools %s Parrot; http://ccl.cse.nd.edu/ %s)\r\n", CCTOOLS_VERSION, getenv("HTTP_USER_AGENT"));
@@ -172,19 +287,84 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 		string_chomp(line);
 		debug(D_HTTP, "%s", line);
 		if(sscanf(line, "HTTP/%*d.%*d %d", &response) == 1) {
+			int has_length = 0;
+			int chunked = 0;
+			reusable = persistent && strncmp(line, "HTTP/1.0", 8);
+			range_total = -1;
 			newurl[0] = 0;
 			while(link_readline(link, line, HTTP_LINE_MAX, stoptime)) {
 				string_chomp(line);
 				debug(D_HTTP, "%s", line);
 				sscanf(line, "Location: %s", newurl);
-				sscanf(line, "Content-Length: %" SCNd64, size);
+				if(sscanf(line, "Content-Length: %" SCNd64, size) == 1)
+					has_length = 1;
+				if(!strncasecmp(line, "Content-Range:", 14)) {
+					if(sscanf(line + 14, " bytes %*d-%*d/%" SCNd64, &range_total) != 1)
+						sscanf(line + 14, " bytes */%" SCNd64, &range_total);
+				}
+				if(!strncasecmp(line, "Transfer-Encoding:", 18) && strstr(line + 18, "chunked"))
+					chunked = 1;
+				if(!strncasecmp(line, "Connection:", 11)) {
+					if(strstr(line + 11, "close"))
+						reusable = 0;
+					else if(persistent && strstr(line + 11, "keep-alive"))
+						reusable = 1;
+				}
 				if(strlen(line) <= 2) {
 					break;
 				}
 			}
 
+			/*
+			Without a length, a chunked body ends with an empty chunk,
+			which the caller must read to reuse the connection.
+			Otherwise, the body ends only when the connection does.
+			*/
+			if(!has_length && strcmp(action, "HEAD")) {
+				if(chunked && persistent)
+					*size = -1;
+				else
+					reusable = 0;
+			}
+
 			switch (response) {
 			case 200:
+				if(total)
+					*total = *size;
+				if(offset > 0 || length > 0) {
+					/* The server ignored the range, so skip to the offset ourselves. */
+					debug(D_HTTP, "server does not support ranges, skipping %" PRId64 " bytes", offset);
+					reusable = 0;
+					if(offset > 0) {
+						if(link_soak(link, offset, stoptime) != offset) {
+							link_close(link);
+							errno = ECONNRESET;
+							return 0;
+						}
+						*size = MAX(*size - offset, 0);
+					}
+				}
+				/* fall through */
+			case 206:
+			case 416:
+				if(response != 200 && total)
+					*total = range_total;
+				if(response == 416) {
+					/* The range starts at or past the end, as any range of an empty file does. */
+					if(link_soak(link, *size, stoptime) != *size)
+						reusable = 0;
+					*size = 0;
+				}
+				if(persistent) {
+					struct http_connection *c = malloc(sizeof(*c));
+					strcpy(c->key, key);
+					c->reusable = reusable;
+					pthread_mutex_lock(&connections_mutex);
+					if(!busy_connections)
+						busy_connections = itable_create(0);
+					itable_insert(busy_connections, (uintptr_t) link, c);
+					pthread_mutex_unlock(&connections_mutex);
+				}
 				return link;
 				break;
 			case 301:
@@ -192,13 +372,28 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 			case 303:
 			case 307:
 				link_close(link);
+				if(newurl[0] == '/') {
+					/* A relative location is on the same server. */
+					const char *host = strstr(urlin, "://");
+					const char *path = host ? strchr(host + 3, '/') : 0;
+					int n = path ? (int) (path - urlin) : (int) strlen(urlin);
+					char absurl[HTTP_LINE_MAX];
+					if(snprintf(absurl, sizeof(absurl), "%.*s%s", n, urlin, newurl) >= (int) sizeof(absurl)) {
+						debug(D_HTTP, "error: redirect from %s to %s is too long", urlin, newurl);
+						errno = ENAMETOOLONG;
+						return 0;
+					}
+					strcpy(newurl, absurl);
+				}
 				if(newurl[0]) {
-					if(!strcmp(url, newurl)) {
+					if(!strcmp(url, newurl) || !strcmp(urlin, newurl)) {
 						debug(D_HTTP, "error: server gave %d redirect from %s back to the same url!", response, url);
 						errno = EIO;
 						return 0;
 					} else {
-						return http_query_size_via_proxy(proxy,newurl,action,size,stoptime,cache_reload);
+						if(location)
+							strcpy(location, newurl);
+						return http_query_range_via_proxy(proxy,newurl,action,offset,length,size,total,stoptime,cache_reload,persistent,location);
 					}
 				} else {
 					errno = ENOENT;
@@ -216,6 +411,12 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 			save_errno = ECONNRESET;
 		}
 	} else {
+		/* The server may have closed an idle connection just as we used it. */
+		if(reused) {
+			debug(D_HTTP, "connection to %s was closed, retrying", key);
+			link_close(link);
+			goto retry;
+		}
 		debug(D_HTTP, "malformed response");
 		save_errno = ECONNRESET;
 	}
@@ -225,6 +426,35 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 	return 0;
 }
 
+struct link *http_query_size_via_proxy(const char *proxy, const char *url, const char *action, INT64_T * size, time_t stoptime, int cache_reload)
+{
+	return http_query_range_via_proxy(proxy, url, action, -1, -1, size, 0, stoptime, cache_reload, 0, 0);
+}
+
+struct link *http_query_range(const char *url, const char *action, INT64_T offset, INT64_T length, INT64_T * size, INT64_T * total, time_t stoptime, int cache_reload, char *location)
+{
+	if(location)
+		location[0] = 0;
+	if(!getenv("HTTP_PROXY")) {
+		return http_query_range_via_proxy(0, url, action, offset, length, size, total, stoptime, cache_reload, 1, location);
+	} else {
+		char proxies[HTTP_LINE_MAX];
+		char *proxy, *saveptr;
+
+		strcpy(proxies, getenv("HTTP_PROXY"));
+		proxy = strtok_r(proxies, ";", &saveptr);
+
+		while(proxy) {
+			struct link *result;
+			result = http_query_range_via_proxy(proxy, url, action, offset, length, size, total, stoptime, cache_reload, 1, location);
+			if(result)
+				return result;
+			proxy = strtok_r(0, ";", &saveptr);
+		}
+		return 0;
+	}
+}
+
 INT64_T http_fetch_to_file(const char *url, const char *filename, time_t stoptime)
 {
 	FILE *file;
@@ -16,6 +16,23 @@ struct link *http_query_no_cache(const char *url, const char *action, time_t sto
 struct link *http_query_size(const char *url, const char *action, INT64_T * size, time_t stoptime, int cache_reload);
 struct link *http_query_size_via_proxy(const char *proxy, const char *url, const char *action, INT64_T * size, time_t stoptime, int cache_reload);
 
+/*
+Query length bytes of url starting at offset, over a connection kept
+open for later queries to the same server.  A negative offset or
+length asks for the whole document.  On return, size is the number of
+bytes that follow on the link, or -1 if the body is sent in chunks,
+ending with an empty one, or is left unchanged if the body runs until
+the connection closes, and, if not null, total is the size of
+the whole document, or -1 if the server did not say.  If location is
+not null, it is set to the url finally redirected to, or to the empty
+string if there was no redirect.  A link returned by http_query_range
+must be given back with http_query_release, with reuse set only if the
+body was read completely.
+*/
+
+struct link *http_query_range(const char *url, const char *action, INT64_T offset, INT64_T length, INT64_T * size, INT64_T * total, time_t stoptime, int cache_reload, char *location);
+void http_query_release(struct link *link, int reuse);
+
 INT64_T http_fetch_to_file(const char *url, const char *filename, time_t stoptime);
 
 #endif
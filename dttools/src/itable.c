@@ -10,23 +10,59 @@ See the file COPYING for details.
 #include <stdlib.h>
 #include <string.h>
 
-#define DEFAULT_SIZE 127
-#define DEFAULT_LOAD 0.75
+#define DEFAULT_SIZE 128
+
+/* The table grows when more than 7/8 of the slots are full. */
+#define LOAD_NUMERATOR 7
+#define LOAD_DENOMINATOR 8
+
+/*
+Like hash_table, this is a single array of slots using Robin Hood
+linear probing with backward-shift removal.  Since the key zero is
+valid, an empty slot is marked by a zero distance, and the distance
+of a full slot is one more than its distance from home.
+As in hash_table, the slots are not allocated until the first insert.
+*/
 
 struct entry {
 	UINT64_T key;
 	void *value;
-	struct entry *next;
+	unsigned distance;
 };
 
 struct itable {
 	int size;
 	int bucket_count;
-	struct entry **buckets;
-	int ibucket;
-	struct entry *ientry;
+	int bucket_bits;
+	struct entry *buckets;
+	struct itable_iterator iterator;
 };
 
+/*
+Keys are often small consecutive integers, such as file descriptors,
+process or task ids, and it is best to keep those in consecutive slots.
+So, the low bits of the key select the slot directly, and the bits
+above them are mixed by Fibonacci hashing and folded in by exclusive-or,
+which spreads out keys that differ only in their high bits, such as the
+bit patterns of floating point numbers, without making any two keys
+with the same high bits collide.
+*/
+
+static unsigned itable_hash(struct itable *h, UINT64_T key)
+{
+	UINT64_T high = key >> h->bucket_bits;
+	UINT64_T mixed = high ? (high * 0x9E3779B97F4A7C15ULL) >> (64 - h->bucket_bits) : 0;
+	return (unsigned) (key ^ mixed) & (h->bucket_count - 1);
+}
+
+static int bits_for(int n)
+{
+	int bits = 3;
+	while((1 << bits) < n)
+		bits++;
+	return bits;
+}
+
 struct itable *itable_create(int bucket_count)
 {
 	struct itable *h;
@@ -35,43 +71,29 @@ struct itable *itable_create(int bucket_count)
 	if(!h)
 		return 0;
 
-	if(bucket_count == 0)
+	if(bucket_count < 1)
 		bucket_count = DEFAULT_SIZE;
 
-	h->bucket_count = bucket_count;
-	h->buckets = (struct entry **) calloc(bucket_count, sizeof(struct entry *));
-	if(!h->buckets) {
-		free(h);
-		return 0;
-	}
+	h->bucket_bits = bits_for(bucket_count);
+	h->bucket_count = 1 << h->bucket_bits;
+	h->buckets = 0;
 
 	h->size = 0;
+	h->iterator.index = 0;
+	h->iterator.remaining = 0;
 
 	return h;
 }
 
 void itable_clear(struct itable *h)
 {
-	struct entry *e, *f;
-	int i;
-
-	for(i = 0; i < h->bucket_count; i++) {
-		e = h->buckets[i];
-		while(e) {
-			f = e->next;
-			free(e);
-			e = f;
-		}
-	}
-
-	for(i = 0; i < h->bucket_count; i++) {
-		h->buckets[i] = 0;
-	}
+	if(h->buckets)
+		memset(h->buckets, 0, h->bucket_count * sizeof(struct entry));
+	h->size = 0;
 }
 
 void itable_delete(struct itable *h)
 {
-	itable_clear(h);
 	free(h->buckets);
 	free(h);
 }
@@ -81,93 +103,105 @@ int itable_size(struct itable *h)
 	return h->size;
 }
 
+static struct entry *itable_find(struct itable *h, UINT64_T key)
+{
+	unsigned mask = h->bucket_count - 1;
+	unsigned index = itable_hash(h, key);
+	unsigned distance = 1;
+
+	if(!h->buckets)
+		return 0;
+
+	while(1) {
+		struct entry *e = &h->buckets[index];
+		if(e->distance < distance)
+			return 0;
+		if(e->key == key)
+			return e;
+		index = (index + 1) & mask;
+		distance++;
+	}
+}
+
 void *itable_lookup(struct itable *h, UINT64_T key)
 {
-	struct entry *e;
-	UINT64_T index;
+	struct entry *e = itable_find(h, key);
+	return e ? e->value : 0;
+}
+
+/* Place an entry known not to be in the table, displacing entries closer to home. */
+
+static void itable_place(struct itable *h, struct entry e)
+{
+	unsigned mask = h->bucket_count - 1;
+	unsigned index = itable_hash(h, e.key);
 
-	index = key % h->bucket_count;
-	e = h->buckets[index];
+	e.distance = 1;
 
-	while(e) {
-		if(key == e->key) {
-			return e->value;
+	while(1) {
+		struct entry *slot = &h->buckets[index];
+		if(!slot->distance) {
+			*slot = e;
+			return;
+		}
+		if(slot->distance < e.distance) {
+			struct entry displaced = *slot;
+			*slot = e;
+			e = displaced;
 		}
-		e = e->next;
+		index = (index + 1) & mask;
+		e.distance++;
 	}
-
-	return 0;
 }
 
 static int itable_double_buckets(struct itable *h)
 {
-	struct itable *hn = itable_create(2 * h->bucket_count);
+	struct entry *old = h->buckets;
+	int old_count = h->bucket_count;
+	int i;
 
-	if(!hn)
+	struct entry *buckets = (struct entry *) calloc(2 * old_count, sizeof(struct entry));
+	if(!buckets)
 		return 0;
 
-	/* Move pairs to new hash */
-	uint64_t key;
-	void *value;
-	itable_firstkey(h);
-	while(itable_nextkey(h, &key, &value))
-		if(!itable_insert(hn, key, value))
-		{
-			itable_delete(hn);
-			return 0;
-		}
+	h->buckets = buckets;
+	h->bucket_count = 2 * old_count;
+	h->bucket_bits++;
 
-	/* Delete all old pairs */
-	struct entry *e, *f;
-	int i;
-	for(i = 0; i < h->bucket_count; i++) {
-		e = h->buckets[i];
-		while(e) {
-			f = e->next;
-			free(e);
-			e = f;
-		}
+	for(i = 0; i < old_count; i++) {
+		if(old[i].distance)
+			itable_place(h, old[i]);
 	}
 
-	/* Make the old point to the new */
-	free(h->buckets);
-	h->buckets      = hn->buckets;
-	h->bucket_count = hn->bucket_count;
-	h->size         = hn->size;
-
-	/* Delete reference to new, so old is safe */
-	free(hn);
+	free(old);
 
 	return 1;
 }
 
 int itable_insert(struct itable *h, UINT64_T key, const void *value)
 {
-	struct entry *e;
-	UINT64_T index;
-
-	if( ((float) h->size / h->bucket_count) > DEFAULT_LOAD )
-		itable_double_buckets(h);
+	struct entry e;
 
-	index = key % h->bucket_count;
-	e = h->buckets[index];
+	struct entry *found = itable_find(h, key);
+	if(found) {
+		found->value = (void *) value;
+		return 1;
+	}
 
-	while(e) {
-		if(key == e->key) {
-			e->value = (void *) value;
-			return 1;
-		}
-		e = e->next;
+	if(!h->buckets) {
+		h->buckets = (struct entry *) calloc(h->bucket_count, sizeof(struct entry));
+		if(!h->buckets)
+			return 0;
 	}
 
-	e = (struct entry *) malloc(sizeof(struct entry));
-	if(!e)
-		return 0;
+	if((h->size + 1) * LOAD_DENOMINATOR > h->bucket_count * LOAD_NUMERATOR) {
+		if(!itable_double_buckets(h))
+			return 0;
+	}
 
-	e->key = key;
-	e->value = (void *) value;
-	e->next = h->buckets[index];
-	h->buckets[index] = e;
+	e.key = key;
+	e.value = (void *) value;
+	itable_place(h, e);
 	h->size++;
 
 	return 1;
@@ -175,28 +209,68 @@ int itable_insert(struct itable *h, UINT64_T key, const void *value)
 
 void *itable_remove(struct itable *h, UINT64_T key)
 {
-	struct entry *e, *f;
+	unsigned mask = h->bucket_count - 1;
 	void *value;
-	UINT64_T index;
-
-	index = key % h->bucket_count;
-	e = h->buckets[index];
-	f = 0;
-
-	while(e) {
-		if(key == e->key) {
-			if(f) {
-				f->next = e->next;
-			} else {
-				h->buckets[index] = e->next;
-			}
-			value = e->value;
-			free(e);
-			h->size--;
-			return value;
+
+	struct entry *e = itable_find(h, key);
+	if(!e)
+		return 0;
+
+	value = e->value;
+	h->size--;
+
+	/* Shift the rest of the probe sequence back into the gap. */
+	unsigned index = e - h->buckets;
+	while(1) {
+		unsigned next = (index + 1) & mask;
+		struct entry *n = &h->buckets[next];
+		if(n->distance <= 1)
+			break;
+		h->buckets[index] = *n;
+		h->buckets[index].distance--;
+		index = next;
+	}
+
+	h->buckets[index].key = 0;
+	h->buckets[index].value = 0;
+	h->buckets[index].distance = 0;
+
+	return value;
+}
+
+/* As in hash_table, iterate downward from just below an empty slot, so that removal is safe. */
+
+void itable_iterator_first(struct itable *h, struct itable_iterator *i)
+{
+	int empty = 0;
+
+	if(!h->buckets) {
+		i->index = 0;
+		i->remaining = 0;
+		return;
+	}
+
+	while(h->buckets[empty].distance)
+		empty++;
+
+	i->index = (empty + h->bucket_count - 1) & (h->bucket_count - 1);
+	i->remaining = h->bucket_count - 1;
+}
+
+int itable_iterator_next(struct itable *h, struct itable_iterator *i, UINT64_T * key, void **value)
+{
+	while(i->remaining > 0) {
+		struct entry *e = &h->buckets[i->index];
+
+		i->index = (i->index + h->bucket_count - 1) & (h->bucket_count - 1);
+		i->remaining--;
+
+		if(e->distance) {
+			*key = e->key;
+			if(value)
+				*value = e->value;
+			return 1;
 		}
-		f = e;
-		e = e->next;
 	}
 
 	return 0;
@@ -204,35 +278,12 @@ void *itable_remove(struct itable *h, UINT64_T key)
 
 void itable_firstkey(struct itable *h)
 {
-	h->ientry = 0;
-	for(h->ibucket = 0; h->ibucket < h->bucket_count; h->ibucket++) {
-		h->ientry = h->buckets[h->ibucket];
-		if(h->ientry)
-			break;
-	}
+	itable_iterator_first(h, &h->iterator);
 }
 
 int itable_nextkey(struct itable *h, UINT64_T * key, void **value)
 {
-	if(h->ientry) {
-		*key = h->ientry->key;
-		if(value)
-			*value = h->ientry->value;
-
-		h->ientry = h->ientry->next;
-		if(!h->ientry) {
-			h->ibucket++;
-			for(; h->ibucket < h->bucket_count; h->ibucket++) {
-				h->ientry = h->buckets[h->ibucket];
-				if(h->ientry)
-					break;
-			}
-		}
-
-		return 1;
-	} else {
-		return 0;
-	}
+	return itable_iterator_next(h, &h->iterator, key, value);
 }
 
 /* vim: set noexpandtab tabstop=4: */
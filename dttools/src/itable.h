@@ -37,8 +37,31 @@ while(itable_nextkey(h,&key,&value)) {
 }
 </pre>
 
+To iterate independently of any other iteration, use an @ref itable_iterator:
+
+<pre>
+struct itable_iterator i;
+
+itable_iterator_first(h,&i);
+
+while(itable_iterator_next(h,&i,&key,&value)) {
+	printf("table contains: %d\n",key);
+}
+</pre>
+
+During any iteration, the key most recently visited may be removed;
+inserting into the table ends the iteration.
+
 */
 
+/** The state of an iteration over an integer table.
+Allocate one of these anywhere, and pass it to @ref itable_iterator_first. */
+
+struct itable_iterator {
+	int index;
+	int remaining;
+};
+
 /** Create a new integer table.
 @param buckets The number of buckets in the table.  If zero, a default value will be used.
 @return A pointer to a new integer table.
@@ -68,8 +91,7 @@ void itable_delete(struct itable *h);
 int itable_size(struct itable *h);
 
 /** Insert a key and value.
-This call will fail if the table already contains the same key.
-You must call @ref itable_remove to remove it.
+If the table already contains the same key, its value is replaced.
 Also note that you cannot insert a null value into the table.
 @param h A pointer to an integer table.
 @param key An integer key
@@ -114,4 +136,21 @@ This function returns the next key and value in the iteration.
 
 int itable_nextkey(struct itable *h, UINT64_T * key, void **value);
 
+/** Begin an independent iteration over all keys.
+@param h A pointer to an integer table.
+@param i A pointer to an iterator, which will be initialized.
+*/
+
+void itable_iterator_first(struct itable *h, struct itable_iterator *i);
+
+/** Continue an independent iteration over all keys.
+@param h A pointer to an integer table.
+@param i A pointer to an iterator begun by @ref itable_iterator_first.
+@param key A pointer to a key integer.
+@param value A pointer to a value pointer. (can be NULL)
+@return Zero if there are no more elements to visit, one otherwise.
+*/
+
+int itable_iterator_next(struct itable *h, struct itable_iterator *i, UINT64_T * key, void **value);
+
 #endif
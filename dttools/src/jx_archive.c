@@ -0,0 +1,913 @@
+/*
+Copyright (C) 2018- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "jx_archive.h"
+#include "jx_parse.h"
+#include "jx_print.h"
+
+#include "buffer.h"
+#include "hash_table.h"
+#include "itable.h"
+#include "debug.h"
+#include "nvpair.h"
+#include "nvpair_jx.h"
+#include "stringtools.h"
+
+#include <zlib.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define JX_ARCHIVE_MAGIC "JXARCH1\n"
+#define JX_ARCHIVE_MAGIC_LENGTH 8
+
+#define LOG_LINE_MAX 65536
+
+enum {
+	SECTION_MARKS,
+	SECTION_STRINGS,
+	SECTION_TYPES,
+	SECTION_TIMES,
+	SECTION_KEYS,
+	SECTION_NAMES,
+	SECTION_VALUES,
+	SECTION_COUNT
+};
+
+enum {
+	TAG_NULL,
+	TAG_TRUE,
+	TAG_FALSE,
+	TAG_INTEGER,
+	TAG_DOUBLE,
+	TAG_STRING,
+	TAG_OBJECT,
+	TAG_ARRAY,
+	TAG_JSON
+};
+
+/*
+An integer property is delta encoded against the previous value
+of the same key and name, identified by the pair of string numbers.
+FIELD_NONE is used for nested values, which are stored as is.
+*/
+
+#define FIELD_NONE 0
+#define FIELD(key,name) ((((UINT64_T)(key)+1)<<32) | ((UINT64_T)(name)+1))
+
+struct jx_archive_writer {
+	buffer_t sections[SECTION_COUNT];
+	struct hash_table *strings;
+	UINT64_T nstrings;
+	UINT64_T nmarks;
+	UINT64_T nrecords;
+	struct itable *fields;
+	INT64_T last_time;
+};
+
+struct section {
+	unsigned char *data;
+	size_t length;
+	size_t pos;
+};
+
+struct jx_archive {
+	struct section sections[SECTION_COUNT];
+	char **strings;
+	UINT64_T nstrings;
+	struct itable *fields;
+	INT64_T time;
+};
+
+static INT64_T field_base( struct itable *fields, UINT64_T field )
+{
+	if(field==FIELD_NONE) return 0;
+	return (INT64_T)(intptr_t) itable_lookup(fields,field);
+}
+
+static void field_update( struct itable *fields, UINT64_T field, INT64_T value )
+{
+	if(field==FIELD_NONE) return;
+	itable_insert(fields,field,(void*)(intptr_t)value);
+}
+
+static void put_byte( buffer_t *b, int c )
+{
+	char byte = c;
+	buffer_putlstring(b,&byte,1);
+}
+
+static void put_varint( buffer_t *b, UINT64_T v )
+{
+	char bytes[10];
+	int n = 0;
+
+	do {
+		unsigned char c = v & 0x7f;
+		v >>= 7;
+		if(v) c |= 0x80;
+		bytes[n++] = c;
+	} while(v);
+
+	buffer_putlstring(b,bytes,n);
+}
+
+static void put_signed( buffer_t *b, INT64_T v )
+{
+	put_varint(b,((UINT64_T)v<<1) ^ (UINT64_T)(v>>63));
+}
+
+static int get_byte( struct section *s, int *c )
+{
+	if(s->pos>=s->length) return 0;
+	*c = s->data[s->pos++];
+	return 1;
+}
+
+static int get_varint( struct section *s, UINT64_T *v )
+{
+	UINT64_T result = 0;
+	int shift = 0;
+
+	while(s->pos<s->length && shift<64) {
+		unsigned char c = s->data[s->pos++];
+		result |= ((UINT64_T)(c&0x7f))<<shift;
+		if(!(c&0x80)) {
+			*v = result;
+			return 1;
+		}
+		shift += 7;
+	}
+
+	return 0;
+}
+
+static int get_signed( struct section *s, INT64_T *v )
+{
+	UINT64_T u;
+	if(!get_varint(s,&u)) return 0;
+	*v = (INT64_T)(u>>1) ^ -(INT64_T)(u&1);
+	return 1;
+}
+
+static int get_bytes( struct section *s, size_t length, const unsigned char **data )
+{
+	if(length>s->length-s->pos) return 0;
+	*data = s->data+s->pos;
+	s->pos += length;
+	return 1;
+}
+
+static struct jx_archive_writer * writer_create()
+{
+	struct jx_archive_writer *w = malloc(sizeof(*w));
+	memset(w,0,sizeof(*w));
+
+	for(int i=0;i<SECTION_COUNT;i++) {
+		buffer_init(&w->sections[i]);
+		buffer_abortonfailure(&w->sections[i],1);
+	}
+
+	w->strings = hash_table_create(0,0);
+	w->fields = itable_create(0);
+	return w;
+}
+
+static void writer_delete( struct jx_archive_writer *w )
+{
+	for(int i=0;i<SECTION_COUNT;i++) {
+		buffer_free(&w->sections[i]);
+	}
+	hash_table_delete(w->strings);
+	itable_delete(w->fields);
+	free(w);
+}
+
+/* Return the number of a string in the dictionary, adding it if necessary. */
+
+static UINT64_T writer_string( struct jx_archive_writer *w, const char *str )
+{
+	void *value = hash_table_lookup(w->strings,str);
+	if(value) return (UINT64_T)(uintptr_t)value - 1;
+
+	size_t length = strlen(str);
+	put_varint(&w->sections[SECTION_STRINGS],length);
+	buffer_putlstring(&w->sections[SECTION_STRINGS],str,length);
+
+	UINT64_T n = w->nstrings++;
+	hash_table_insert(w->strings,str,(void*)(uintptr_t)(n+1));
+	return n;
+}
+
+static void writer_value( struct jx_archive_writer *w, struct jx *j, UINT64_T field )
+{
+	buffer_t *b = &w->sections[SECTION_VALUES];
+
+	switch(j->type) {
+		case JX_NULL:
+			put_byte(b,TAG_NULL);
+			break;
+		case JX_BOOLEAN:
+			put_byte(b,j->u.boolean_value ? TAG_TRUE : TAG_FALSE);
+			break;
+		case JX_INTEGER:
+			put_byte(b,TAG_INTEGER);
+			put_signed(b,(INT64_T)((UINT64_T)j->u.integer_value - (UINT64_T)field_base(w->fields,field)));
+			field_update(w->fields,field,j->u.integer_value);
+			break;
+		case JX_DOUBLE: {
+			UINT64_T bits;
+			char bytes[8];
+			memcpy(&bits,&j->u.double_value,sizeof(bits));
+			for(int i=0;i<8;i++) bytes[i] = (bits>>(i*8)) & 0xff;
+			put_byte(b,TAG_DOUBLE);
+			buffer_putlstring(b,bytes,8);
+			break;
+		}
+		case JX_STRING:
+			put_byte(b,TAG_STRING);
+			put_varint(b,writer_string(w,j->u.string_value));
+			break;
+		case JX_OBJECT: {
+			UINT64_T count = 0;
+			struct jx_pair *p;
+			for(p=j->u.pairs;p;p=p->next) {
+				if(p->key->type!=JX_STRING) break;
+				count++;
+			}
+			if(p) goto json;
+			put_byte(b,TAG_OBJECT);
+			put_varint(b,count);
+			for(p=j->u.pairs;p;p=p->next) {
+				put_varint(b,writer_string(w,p->key->u.string_value));
+				writer_value(w,p->value,FIELD_NONE);
+			}
+			break;
+		}
+		case JX_ARRAY: {
+			UINT64_T count = 0;
+			struct jx_item *i;
+			for(i=j->u.items;i;i=i->next) count++;
+			put_byte(b,TAG_ARRAY);
+			put_varint(b,count);
+			for(i=j->u.items;i;i=i->next) {
+				writer_value(w,i->value,FIELD_NONE);
+			}
+			break;
+		}
+		default:
+		json: {
+			/* Anything else is kept in its text form. */
+			char *str = jx_print_string(j);
+			size_t length = strlen(str);
+			put_byte(b,TAG_JSON);
+			put_varint(b,length);
+			buffer_putlstring(b,str,length);
+			free(str);
+			break;
+		}
+	}
+}
+
+/* The properties of a created object are the base for later updates. */
+
+static void writer_object( struct jx_archive_writer *w, UINT64_T key, struct jx *j )
+{
+	buffer_t *b = &w->sections[SECTION_VALUES];
+	struct jx_pair *p;
+	UINT64_T count = 0;
+
+	if(j->type==JX_OBJECT) {
+		for(p=j->u.pairs;p;p=p->next) {
+			if(p->key->type!=JX_STRING) break;
+			count++;
+		}
+	}
+
+	if(j->type!=JX_OBJECT || p) {
+		writer_value(w,j,FIELD_NONE);
+		return;
+	}
+
+	put_byte(b,TAG_OBJECT);
+	put_varint(b,count);
+	for(p=j->u.pairs;p;p=p->next) {
+		UINT64_T name = writer_string(w,p->key->u.string_value);
+		put_varint(b,name);
+		writer_value(w,p->value,FIELD(key,name));
+	}
+}
+
+static void writer_record( struct jx_archive_writer *w, char type )
+{
+	put_byte(&w->sections[SECTION_TYPES],type);
+	w->nrecords++;
+}
+
+static void writer_time( struct jx_archive_writer *w, INT64_T current )
+{
+	writer_record(w,'T');
+	put_signed(&w->sections[SECTION_TIMES],current-w->last_time);
+	w->last_time = current;
+}
+
+static void writer_create_event( struct jx_archive_writer *w, const char *key, struct jx *j )
+{
+	UINT64_T k = writer_string(w,key);
+	writer_record(w,'C');
+	put_varint(&w->sections[SECTION_KEYS],k);
+	writer_object(w,k,j);
+}
+
+static void writer_delete_event( struct jx_archive_writer *w, const char *key )
+{
+	writer_record(w,'D');
+	put_varint(&w->sections[SECTION_KEYS],writer_string(w,key));
+}
+
+static void writer_update_event( struct jx_archive_writer *w, const char *key, const char *name, struct jx *j )
+{
+	UINT64_T k = writer_string(w,key);
+	UINT64_T n = writer_string(w,name);
+	writer_record(w,'U');
+	put_varint(&w->sections[SECTION_KEYS],k);
+	put_varint(&w->sections[SECTION_NAMES],n);
+	writer_value(w,j,FIELD(k,n));
+}
+
+static void writer_remove_event( struct jx_archive_writer *w, const char *key, const char *name )
+{
+	writer_record(w,'R');
+	put_varint(&w->sections[SECTION_KEYS],writer_string(w,key));
+	put_varint(&w->sections[SECTION_NAMES],writer_string(w,name));
+}
+
+static void writer_mark( struct jx_archive_writer *w, INT64_T marktime )
+{
+	put_varint(&w->sections[SECTION_MARKS],marktime);
+	put_varint(&w->sections[SECTION_MARKS],w->nrecords);
+	w->nmarks++;
+}
+
+static int write_varint( FILE *file, UINT64_T v )
+{
+	buffer_t b;
+	buffer_init(&b);
+	put_varint(&b,v);
+	size_t length;
+	const char *data = buffer_tolstring(&b,&length);
+	int result = fwrite(data,1,length,file)==length;
+	buffer_free(&b);
+	return result;
+}
+
+static int write_section( FILE *file, const char *data, size_t length )
+{
+	uLongf clength = compressBound(length);
+	Bytef *cdata = malloc(clength);
+	if(!cdata) return 0;
+
+	int result = compress2(cdata,&clength,(const Bytef *)data,length,Z_BEST_COMPRESSION)==Z_OK
+		&& write_varint(file,length)
+		&& write_varint(file,clength)
+		&& fwrite(cdata,1,clength,file)==clength;
+
+	free(cdata);
+	return result;
+}
+
+/* Sections that begin with a count are assembled with the count first. */
+
+static int write_counted_section( FILE *file, UINT64_T count, buffer_t *b )
+{
+	buffer_t counted;
+	buffer_init(&counted);
+	buffer_abortonfailure(&counted,1);
+	put_varint(&counted,count);
+
+	size_t length;
+	const char *data = buffer_tolstring(b,&length);
+	buffer_putlstring(&counted,data,length);
+
+	data = buffer_tolstring(&counted,&length);
+	int result = write_section(file,data,length);
+	buffer_free(&counted);
+	return result;
+}
+
+static int writer_write( struct jx_archive_writer *w, const char *filename )
+{
+	char *tmpname = string_format("%s.tmp",filename);
+
+	FILE *file = fopen(tmpname,"w");
+	if(!file) {
+		debug(D_NOTICE,"couldn't create %s: %s",tmpname,strerror(errno));
+		free(tmpname);
+		return 0;
+	}
+
+	int result = fwrite(JX_ARCHIVE_MAGIC,1,JX_ARCHIVE_MAGIC_LENGTH,file)==JX_ARCHIVE_MAGIC_LENGTH;
+
+	for(int i=0;result && i<SECTION_COUNT;i++) {
+		if(i==SECTION_MARKS) {
+			result = write_counted_section(file,w->nmarks,&w->sections[i]);
+		} else if(i==SECTION_STRINGS) {
+			result = write_counted_section(file,w->nstrings,&w->sections[i]);
+		} else {
+			size_t length;
+			const char *data = buffer_tolstring(&w->sections[i],&length);
+			result = write_section(file,data,length);
+		}
+	}
+
+	if(fclose(file)!=0) result = 0;
+
+	if(result && rename(tmpname,filename)==0) {
+		result = 1;
+	} else {
+		debug(D_NOTICE,"couldn't write %s: %s",filename,strerror(errno));
+		unlink(tmpname);
+		result = 0;
+	}
+
+	free(tmpname);
+	return result;
+}
+
+/* Load the intra-day checkpoints listed in an index, which are in order of time and offset. */
+
+static int index_read( const char *indexfile, long long **times, long **offsets )
+{
+	long long t;
+	long o;
+	int n = 0;
+	int max = 0;
+
+	*times = 0;
+	*offsets = 0;
+
+	if(!indexfile) return 0;
+
+	FILE *file = fopen(indexfile,"r");
+	if(!file) return 0;
+
+	while(fscanf(file,"%lld %ld",&t,&o)==2) {
+		if(n>=max) {
+			max = max ? max*2 : 32;
+			*times = realloc(*times,sizeof(**times)*max);
+			*offsets = realloc(*offsets,sizeof(**offsets)*max);
+		}
+		(*times)[n] = t;
+		(*offsets)[n] = o;
+		n++;
+	}
+
+	fclose(file);
+	return n;
+}
+
+static void corrupt_data( const char *filename, const char *line )
+{
+	debug(D_NOTICE,"corrupt data in %s: %s",filename,line);
+}
+
+/*
+Parse the text log in the same manner as deltadb_process_stream,
+so that the archive yields the same events as the original log.
+*/
+
+int jx_archive_convert( const char *logfile, const char *indexfile, const char *filename )
+{
+	char line[LOG_LINE_MAX];
+	char value[LOG_LINE_MAX];
+	char name[LOG_LINE_MAX];
+	char key[LOG_LINE_MAX];
+	long long current;
+	struct jx *jvalue;
+	int n;
+
+	FILE *log = fopen(logfile,"r");
+	if(!log) {
+		debug(D_NOTICE,"couldn't open %s: %s",logfile,strerror(errno));
+		return 0;
+	}
+
+	long long *marktimes;
+	long *markoffsets;
+	int nmarks = index_read(indexfile,&marktimes,&markoffsets);
+	int mark = 0;
+	long offset = 0;
+
+	struct jx_archive_writer *w = writer_create();
+
+	while(1) {
+		while(mark<nmarks && markoffsets[mark]<=offset) {
+			writer_mark(w,marktimes[mark++]);
+		}
+
+		if(!fgets(line,sizeof(line),log)) break;
+		offset += strlen(line);
+
+		if(line[0]=='C') {
+			n = sscanf(line,"C %s %[^\n]",key,value);
+			if(n==1) {
+				/* backwards compatibility with old log format */
+				struct nvpair *nv = nvpair_create();
+				nvpair_parse_stream(nv,log);
+				jvalue = nvpair_to_jx(nv);
+				nvpair_delete(nv);
+				offset = ftell(log);
+			} else if(n==2) {
+				jvalue = jx_parse_string(value);
+				if(!jvalue) jvalue = jx_string(value);
+			} else {
+				corrupt_data(logfile,line);
+				continue;
+			}
+			writer_create_event(w,key,jvalue);
+			jx_delete(jvalue);
+
+		} else if(line[0]=='D') {
+			n = sscanf(line,"D %s\n",key);
+			if(n!=1) {
+				corrupt_data(logfile,line);
+				continue;
+			}
+			writer_delete_event(w,key);
+
+		} else if(line[0]=='U') {
+			n = sscanf(line,"U %s %s %[^\n],",key,name,value);
+			if(n!=3) {
+				corrupt_data(logfile,line);
+				continue;
+			}
+			jvalue = jx_parse_string(value);
+			if(!jvalue) {
+				corrupt_data(logfile,line);
+				continue;
+			}
+			writer_update_event(w,key,name,jvalue);
+			jx_delete(jvalue);
+
+		} else if(line[0]=='R') {
+			n = sscanf(line,"R %s %s",key,name);
+			if(n!=2) {
+				corrupt_data(logfile,line);
+				continue;
+			}
+			writer_remove_event(w,key,name);
+
+		} else if(line[0]=='T') {
+			n = sscanf(line,"T %lld",&current);
+			if(n!=1) {
+				corrupt_data(logfile,line);
+				continue;
+			}
+			writer_time(w,current);
+
+		} else if(line[0]=='\n') {
+			continue;
+		} else {
+			corrupt_data(logfile,line);
+		}
+	}
+
+	fclose(log);
+
+	int result = writer_write(w,filename);
+
+	writer_delete(w);
+	free(marktimes);
+	free(markoffsets);
+
+	return result;
+}
+
+static int read_varint( FILE *file, UINT64_T *v )
+{
+	UINT64_T result = 0;
+	int shift = 0;
+	int c;
+
+	while(shift<64 && (c=getc(file))!=EOF) {
+		result |= ((UINT64_T)(c&0x7f))<<shift;
+		if(!(c&0x80)) {
+			*v = result;
+			return 1;
+		}
+		shift += 7;
+	}
+
+	return 0;
+}
+
+static int read_section( FILE *file, struct section *s )
+{
+	UINT64_T length, clength;
+
+	s->data = 0;
+	s->length = 0;
+	s->pos = 0;
+
+	if(!read_varint(file,&length) || !read_varint(file,&clength)) return 0;
+
+	Bytef *cdata = malloc(clength ? clength : 1);
+	s->data = malloc(length ? length : 1);
+	if(!cdata || !s->data) {
+		free(cdata);
+		return 0;
+	}
+
+	uLongf ulength = length;
+	int result = fread(cdata,1,clength,file)==clength
+		&& uncompress(s->data,&ulength,cdata,clength)==Z_OK
+		&& ulength==length;
+
+	free(cdata);
+
+	s->length = length;
+	return result;
+}
+
+static int read_magic( FILE *file )
+{
+	char magic[JX_ARCHIVE_MAGIC_LENGTH];
+	return fread(magic,1,sizeof(magic),file)==sizeof(magic) && !memcmp(magic,JX_ARCHIVE_MAGIC,sizeof(magic));
+}
+
+int jx_archive_mark_lookup( const char *filename, time_t time, time_t *marktime, INT64_T *record )
+{
+	struct section s;
+	UINT64_T count, t, r;
+	int found = 0;
+
+	s.data = 0;
+
+	FILE *file = fopen(filename,"r");
+	if(!file) return 0;
+
+	if(read_magic(file) && read_section(file,&s) && get_varint(&s,&count)) {
+		for(UINT64_T i=0;i<count;i++) {
+			if(!get_varint(&s,&t) || !get_varint(&s,&r)) break;
+			if((time_t)t>time) break;
+			*marktime = t;
+			*record = r;
+			found = 1;
+		}
+	}
+
+	free(s.data);
+	fclose(file);
+	return found;
+}
+
+void jx_archive_close( struct jx_archive *a )
+{
+	if(!a) return;
+
+	for(int i=0;i<SECTION_COUNT;i++) {
+		free(a->sections[i].data);
+	}
+
+	for(UINT64_T i=0;i<a->nstrings;i++) {
+		free(a->strings[i]);
+	}
+	free(a->strings);
+
+	if(a->fields) itable_delete(a->fields);
+	free(a);
+}
+
+struct jx_archive * jx_archive_open( const char *filename )
+{
+	FILE *file = fopen(filename,"r");
+	if(!file) return 0;
+
+	if(!read_magic(file)) {
+		fclose(file);
+		return 0;
+	}
+
+	struct jx_archive *a = malloc(sizeof(*a));
+	memset(a,0,sizeof(*a));
+	a->fields = itable_create(0);
+
+	for(int i=0;i<SECTION_COUNT;i++) {
+		if(!read_section(file,&a->sections[i])) goto failure;
+	}
+
+	fclose(file);
+	file = 0;
+
+	/* Unpack the dictionary, so that records can refer directly to its strings. */
+
+	struct section *s = &a->sections[SECTION_STRINGS];
+	UINT64_T count;
+	if(!get_varint(s,&count) || count>s->length) goto failure;
+
+	a->strings = malloc(sizeof(char*)*(count ? count : 1));
+
+	for(a->nstrings=0;a->nstrings<count;a->nstrings++) {
+		UINT64_T length;
+		const unsigned char *data;
+		if(!get_varint(s,&length) || !get_bytes(s,length,&data)) goto failure;
+		char *str = malloc(length+1);
+		memcpy(str,data,length);
+		str[length] = 0;
+		a->strings[a->nstrings] = str;
+	}
+
+	return a;
+
+	failure:
+	debug(D_NOTICE,"corrupt archive: %s",filename);
+	if(file) fclose(file);
+	jx_archive_close(a);
+	return 0;
+}
+
+static int read_string( struct jx_archive *a, int section, const char **str, UINT64_T *n )
+{
+	if(!get_varint(&a->sections[section],n) || *n>=a->nstrings) return 0;
+	*str = a->strings[*n];
+	return 1;
+}
+
+static struct jx * read_value( struct jx_archive *a, UINT64_T field )
+{
+	struct section *s = &a->sections[SECTION_VALUES];
+	int tag;
+
+	if(!get_byte(s,&tag)) return 0;
+
+	switch(tag) {
+		case TAG_NULL:
+			return jx_null();
+		case TAG_TRUE:
+			return jx_boolean(1);
+		case TAG_FALSE:
+			return jx_boolean(0);
+		case TAG_INTEGER: {
+			INT64_T delta;
+			if(!get_signed(s,&delta)) return 0;
+			INT64_T value = (INT64_T)((UINT64_T)field_base(a->fields,field) + (UINT64_T)delta);
+			field_update(a->fields,field,value);
+			return jx_integer(value);
+		}
+		case TAG_DOUBLE: {
+			const unsigned char *bytes;
+			UINT64_T bits = 0;
+			double value;
+			if(!get_bytes(s,8,&bytes)) return 0;
+			for(int i=0;i<8;i++) bits |= ((UINT64_T)bytes[i])<<(i*8);
+			memcpy(&value,&bits,sizeof(value));
+			return jx_double(value);
+		}
+		case TAG_STRING: {
+			const char *str;
+			UINT64_T n;
+			if(!read_string(a,SECTION_VALUES,&str,&n)) return 0;
+			return jx_string(str);
+		}
+		case TAG_OBJECT: {
+			UINT64_T count;
+			if(!get_varint(s,&count)) return 0;
+			struct jx *j = jx_object(0);
+			struct jx_pair **tail = &j->u.pairs;
+			for(UINT64_T i=0;i<count;i++) {
+				const char *name;
+				UINT64_T n;
+				struct jx *value;
+				if(!read_string(a,SECTION_VALUES,&name,&n) || !(value=read_value(a,FIELD_NONE))) {
+					jx_delete(j);
+					return 0;
+				}
+				*tail = jx_pair(jx_string(name),value,0);
+				tail = &(*tail)->next;
+			}
+			return j;
+		}
+		case TAG_ARRAY: {
+			UINT64_T count;
+			if(!get_varint(s,&count)) return 0;
+			struct jx *j = jx_array(0);
+			struct jx_item **tail = &j->u.items;
+			for(UINT64_T i=0;i<count;i++) {
+				struct jx *value = read_value(a,FIELD_NONE);
+				if(!value) {
+					jx_delete(j);
+					return 0;
+				}
+				*tail = jx_item(value,0);
+				tail = &(*tail)->next;
+			}
+			return j;
+		}
+		case TAG_JSON: {
+			UINT64_T length;
+			const unsigned char *data;
+			if(!get_varint(s,&length) || !get_bytes(s,length,&data)) return 0;
+			char *str = malloc(length+1);
+			memcpy(str,data,length);
+			str[length] = 0;
+			struct jx *j = jx_parse_string(str);
+			free(str);
+			return j;
+		}
+		default:
+			return 0;
+	}
+}
+
+static struct jx * read_object( struct jx_archive *a, UINT64_T key )
+{
+	struct section *s = &a->sections[SECTION_VALUES];
+
+	if(s->pos>=s->length || s->data[s->pos]!=TAG_OBJECT) return read_value(a,FIELD_NONE);
+
+	UINT64_T count;
+	s->pos++;
+	if(!get_varint(s,&count)) return 0;
+
+	struct jx *j = jx_object(0);
+	struct jx_pair **tail = &j->u.pairs;
+	for(UINT64_T i=0;i<count;i++) {
+		const char *name;
+		UINT64_T n;
+		struct jx *value;
+		if(!read_string(a,SECTION_VALUES,&name,&n) || !(value=read_value(a,FIELD(key,n)))) {
+			jx_delete(j);
+			return 0;
+		}
+		*tail = jx_pair(jx_string(name),value,0);
+		tail = &(*tail)->next;
+	}
+	return j;
+}
+
+int jx_archive_read( struct jx_archive *a, struct jx_archive_record *r )
+{
+	UINT64_T k, n;
+	int type;
+	INT64_T delta;
+
+	if(!get_byte(&a->sections[SECTION_TYPES],&type)) return 0;
+
+	r->type = type;
+	r->key = 0;
+	r->name = 0;
+	r->value = 0;
+
+	switch(type) {
+		case 'T':
+			if(!get_signed(&a->sections[SECTION_TIMES],&delta)) goto corrupt;
+			a->time += delta;
+			break;
+		case 'C':
+			if(!read_string(a,SECTION_KEYS,&r->key,&k)) goto corrupt;
+			if(!(r->value=read_object(a,k))) goto corrupt;
+			break;
+		case 'D':
+			if(!read_string(a,SECTION_KEYS,&r->key,&k)) goto corrupt;
+			break;
+		case 'U':
+			if(!read_string(a,SECTION_KEYS,&r->key,&k)) goto corrupt;
+			if(!read_string(a,SECTION_NAMES,&r->name,&n)) goto corrupt;
+			if(!(r->value=read_value(a,FIELD(k,n)))) goto corrupt;
+			break;
+		case 'R':
+			if(!read_string(a,SECTION_KEYS,&r->key,&k)) goto corrupt;
+			if(!read_string(a,SECTION_NAMES,&r->name,&n)) goto corrupt;
+			break;
+		default:
+			goto corrupt;
+	}
+
+	r->time = a->time;
+	return 1;
+
+	corrupt:
+	debug(D_NOTICE,"corrupt archive data in record of type %c",type);
+	return 0;
+}
+
+int jx_archive_skip( struct jx_archive *a, INT64_T nrecords )
+{
+	struct jx_archive_record r;
+
+	while(nrecords-->0) {
+		if(!jx_archive_read(a,&r)) return 0;
+		jx_delete(r.value);
+	}
+
+	return 1;
+}
+
+/* vim: set noexpandtab tabstop=4: */
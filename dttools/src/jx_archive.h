@@ -0,0 +1,112 @@
+/*
+Copyright (C) 2018- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef JX_ARCHIVE_H
+#define JX_ARCHIVE_H
+
+/** @file jx_archive.h
+
+A jx_archive is a compact, columnar encoding of one day of the
+history recorded by @ref jx_database.  The text log of a completed
+day can be converted into an archive named DIR/YEAR/DAY.jxa,
+which holds exactly the same sequence of records in a fraction
+of the space, and can be read back without parsing JSON text.
+
+An archive consists of a magic string followed by a series of
+sections.  Each section is stored as its uncompressed length,
+its compressed length, and the zlib compressed data:
+
+<pre>
+MARKS   - Count, then the time and record number of each intra-day checkpoint.
+STRINGS - Count, then the length and bytes of each distinct string.
+TYPES   - One byte per record: T, C, D, U, or R.
+TIMES   - For each T record, the difference from the previous time.
+KEYS    - For each C, D, U, or R record, the string number of the key.
+NAMES   - For each U or R record, the string number of the property name.
+VALUES  - For each C or U record, the tagged value.
+</pre>
+
+All integers are variable length, seven bits per byte, and signed
+integers are zigzag encoded.  Keys, names, and string values are
+replaced by their number in the string dictionary.  An integer
+property of an object is stored as the difference from the previous
+value of the same property of the same key, so slowly changing
+counters take only a byte or two.  Objects and arrays are stored
+structurally, and doubles are stored exactly, so reading an archive
+yields the same values as parsing the original log.
+
+The MARKS section replaces the byte offsets of the day's index
+(see @ref jx_database.h): a mark of TIME and RECORD means that
+the checkpoint DAY.TIME.ckpt holds the state of the table
+after the first RECORD records of the archive.
+*/
+
+#include "jx.h"
+#include "int_sizes.h"
+
+#include <time.h>
+
+/** A single record read from an archive. */
+
+struct jx_archive_record {
+	char type;          /**< One of T, C, D, U, or R. */
+	time_t time;        /**< The time of the most recent T record. */
+	const char *key;    /**< The key of a C, D, U, or R record. */
+	const char *name;   /**< The property name of a U or R record. */
+	struct jx *value;   /**< The object of a C record or the value of a U record, which the caller must delete. */
+};
+
+/** Convert a text log into an archive.
+The archive is written to a temporary file and renamed into place only if complete.
+@param logfile The text log of one day.
+@param indexfile The index of intra-day checkpoints of the same day, or null.
+@param filename The archive file to create.
+@return True on success, false otherwise.
+*/
+
+int jx_archive_convert( const char *logfile, const char *indexfile, const char *filename );
+
+/** Open an archive for reading.
+@param filename The archive file to open.
+@return A pointer to an open archive, or null if the file could not be opened or is not an archive.
+*/
+
+struct jx_archive * jx_archive_open( const char *filename );
+
+/** Read the next record from an archive.
+@param a The archive to read.
+@param r The record to fill in.  The key and name remain valid until the archive is closed.
+@return True if a record was read, false at the end of the archive or on corrupt data.
+*/
+
+int jx_archive_read( struct jx_archive *a, struct jx_archive_record *r );
+
+/** Skip over records in an archive.
+@param a The archive to read.
+@param nrecords The number of records to skip.
+@return True if all records were skipped, false otherwise.
+*/
+
+int jx_archive_skip( struct jx_archive *a, INT64_T nrecords );
+
+/** Close an archive.
+@param a The archive to close.
+*/
+
+void jx_archive_close( struct jx_archive *a );
+
+/** Find the latest intra-day checkpoint of an archive that does not follow a given time.
+Only the MARKS section of the archive is read.
+@param filename The archive file to examine.
+@param time The desired time.
+@param marktime Filled in with the time of the checkpoint.
+@param record Filled in with the number of records preceding the checkpoint.
+@return True if a checkpoint was found, false otherwise.
+*/
+
+int jx_archive_mark_lookup( const char *filename, time_t time, time_t *marktime, INT64_T *record );
+
+#endif
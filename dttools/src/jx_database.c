@@ -5,11 +5,13 @@ See the file COPYING for details.
 */
 
 #include "jx_database.h"
+#include "jx_archive.h"
 #include "jx_print.h"
 #include "jx_parse.h"
 
 #include "hash_table.h"
 #include "debug.h"
+#include "fd.h"
 #include "nvpair.h"
 #include "nvpair_jx.h"
 
@@ -20,7 +22,12 @@ See the file COPYING for details.
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <stdarg.h>
+#include <unistd.h>
+
+/* By default, write an intra-day checkpoint once per hour. */
+#define JX_DATABASE_CHECKPOINT_INTERVAL_DEFAULT 3600
 
 struct jx_database {
 	struct hash_table *table;
@@ -28,19 +35,28 @@ struct jx_database {
 	int logyear;
 	int logday;
 	FILE *logfile;
+	FILE *indexfile;
 	time_t last_log_time;
+	time_t last_checkpoint_time;
+	long last_checkpoint_offset;
+	long last_checkpoint_size;
+	int checkpoint_interval;
+	int archive;
 };
 
-/* Take the current state of the table and write it out verbatim to a checkpoint file. */
+/*
+Take the current state of the table and write it out verbatim to a checkpoint file.
+Returns the size of the checkpoint in bytes, or -1 on failure.
+*/
 
-static int checkpoint_write( struct jx_database *db, const char *filename )
+static long checkpoint_write( struct jx_database *db, const char *filename )
 {
 	char *key;
 	struct jx *jobject;
 	int first = 1;
 
 	FILE *file = fopen(filename,"w");
-	if(!file) return 0;
+	if(!file) return -1;
 
 	fprintf(file,"{\n");
 
@@ -57,9 +73,10 @@ static int checkpoint_write( struct jx_database *db, const char *filename )
 
 	fprintf(file,"}\n");
 
-	fclose(file);
+	long size = ftell(file);
+	if(fclose(file)!=0) return -1;
 
-	return 1;
+	return size;
 }
 
 /*
@@ -126,6 +143,46 @@ static int checkpoint_read( struct jx_database *db, const char *filename )
 	return 1;
 }
 
+/*
+Convert the log of a completed day into an archive.
+The text log and its index are removed only once the archive is in place,
+so that a failure leaves the day in its original form.
+
+Converting a whole day takes a while, so it is done by a grandchild
+process, and the caller goes on handling updates and queries in the
+meantime.  The intermediate child exits at once, so that the caller
+never has a child of ours to reap or to mistake for one of its own.
+*/
+
+static void log_archive( struct jx_database *db, int year, int day )
+{
+	char logname[PATH_MAX];
+	char indexname[PATH_MAX];
+	char archivename[PATH_MAX];
+
+	sprintf(logname,"%s/%d/%d.log",db->logdir,year,day);
+	sprintf(indexname,"%s/%d/%d.index",db->logdir,year,day);
+	sprintf(archivename,"%s/%d/%d.jxa",db->logdir,year,day);
+
+	pid_t pid = fork();
+	if(pid==0) {
+		if(fork()==0) {
+			/* Don't hold on to the caller's sockets and files. */
+			fd_nonstd_close();
+			if(jx_archive_convert(logname,indexname,archivename)) {
+				unlink(logname);
+				unlink(indexname);
+			}
+		}
+		_exit(0);
+	} else if(pid>0) {
+		waitpid(pid,0,0);
+		debug(D_DEBUG,"archiving %s in the background",logname);
+	} else {
+		debug(D_NOTICE,"could not archive %s, leaving it in place: %s",logname,strerror(errno));
+	}
+}
+
 /* Ensure that the history is writing to the correct log file for the current time. */
 
 static void log_select( struct jx_database *db )
@@ -137,14 +194,24 @@ static void log_select( struct jx_database *db )
 	// If the file is open to the right file, continue as before.
 	if(db->logfile && (t->tm_year+1900)==db->logyear && t->tm_yday==db->logday) return;
 
+	int lastyear = db->logyear;
+	int lastday = db->logday;
+
 	// If a log file is already open, close it.
 	if(db->logfile) {
 		fclose(db->logfile);
 		write_checkpoint_file = 1;
 	}
 
+	if(db->indexfile) {
+		fclose(db->indexfile);
+		db->indexfile = 0;
+	}
+
 	db->logyear = t->tm_year + 1900;
 	db->logday = t->tm_yday;
+	db->last_checkpoint_offset = 0;
+	db->last_checkpoint_size = 0;
 
 	// Ensure that we have a directory.
 	char filename[PATH_MAX];
@@ -159,9 +226,70 @@ static void log_select( struct jx_database *db )
 	// If we switched from one log to another, write an intermediate checkpoint.
 	if(write_checkpoint_file) {
 		sprintf(filename,"%s/%d/%d.ckpt",db->logdir,db->logyear,db->logday);
-		checkpoint_write(db,filename);
+		db->last_checkpoint_size = checkpoint_write(db,filename);
+		db->last_checkpoint_time = current;
 	}
 
+	// The index is optional: if it cannot be written, readers fall back to a full replay.
+	sprintf(filename,"%s/%d/%d.index",db->logdir,db->logyear,db->logday);
+	db->indexfile = fopen(filename,"a");
+	if(!db->indexfile) debug(D_NOTICE,"could not open index file %s: %s",filename,strerror(errno));
+
+	if(write_checkpoint_file && db->archive) log_archive(db,lastyear,lastday);
+}
+
+/*
+Periodically write an intra-day checkpoint, so that readers
+need not replay the whole day's log to reach a given time.
+The checkpoint is written before the table is modified,
+so it reflects exactly the log contents up to the current offset.
+
+Each checkpoint holds the whole table, so a new one is written only
+once the log has grown by at least the size of the last one.  So the
+intra-day checkpoints of a day take no more space than its log, and
+a reader never replays more of the log than it would read of a
+checkpoint, plus one interval.
+
+Each checkpoint is recorded in the day's index as a line:
+
+TIME OFFSET
+
+where every T record at or after TIME appears at or after
+byte OFFSET of the log, and the state of the table at OFFSET
+is found in the checkpoint file DAY.TIME.ckpt.
+*/
+
+static void checkpoint_periodic( struct jx_database *db )
+{
+	char filename[PATH_MAX];
+	time_t current = time(0);
+
+	log_select(db);
+
+	if(!db->indexfile) return;
+	if(db->checkpoint_interval<=0) return;
+	if((current-db->last_checkpoint_time)<db->checkpoint_interval) return;
+
+	db->last_checkpoint_time = current;
+
+	// If a T record for this second was already logged, it precedes the offset.
+	time_t indextime = (db->last_log_time==current) ? current+1 : current;
+
+	fflush(db->logfile);
+	fseek(db->logfile,0,SEEK_END);
+	long offset = ftell(db->logfile);
+	if(offset<0) return;
+	if(offset-db->last_checkpoint_offset<db->last_checkpoint_size) return;
+
+	sprintf(filename,"%s/%d/%d.%lld.ckpt",db->logdir,db->logyear,db->logday,(long long)indextime);
+	long size = checkpoint_write(db,filename);
+	if(size<0) return;
+
+	db->last_checkpoint_offset = offset;
+	db->last_checkpoint_size = size;
+
+	fprintf(db->indexfile,"%lld %ld\n",(long long)indextime,offset);
+	fflush(db->indexfile);
 }
 
 /* If time has advanced since the last event, log a time record. */
@@ -273,13 +401,14 @@ static void corrupt_data( const char *filename, const char *line )
 }
 
 /*
-Replay a given log file into the hash table, up to the given snapshot time.
+Replay a given log file into the hash table, starting from the given
+byte offset and continuing up to the given snapshot time.
 Returns true if file could be open and played, false otherwise.
 */
 
 #define LOG_LINE_MAX 65536
 
-static int log_replay( struct jx_database *db, const char *filename, time_t snapshot)
+static int log_replay( struct jx_database *db, const char *filename, long offset, time_t snapshot)
 {
 	char line[LOG_LINE_MAX];
 	char value[LOG_LINE_MAX];
@@ -293,6 +422,11 @@ static int log_replay( struct jx_database *db, const char *filename, time_t snap
 	FILE *file = fopen(filename,"r");
 	if(!file) return 0;
 
+	if(offset>0 && fseek(file,offset,SEEK_SET)<0) {
+		fclose(file);
+		return 0;
+	}
+
 	while(fgets(line,sizeof(line),file)) {
 		if(line[0]=='C') {
 			n = sscanf(line,"C %s %[^\n]",key,value);
@@ -369,6 +503,26 @@ static int log_replay( struct jx_database *db, const char *filename, time_t snap
 	return 1;
 }
 
+int jx_database_index_lookup( const char *filename, time_t snapshot, time_t *indextime, long *offset )
+{
+	long long t;
+	long o;
+	int found = 0;
+
+	FILE *file = fopen(filename,"r");
+	if(!file) return 0;
+
+	while(fscanf(file,"%lld %ld",&t,&o)==2) {
+		if(t>snapshot) break;
+		*indextime = t;
+		*offset = o;
+		found = 1;
+	}
+
+	fclose(file);
+	return found;
+}
+
 /*
 Recover the state of the table by loading the appropriate checkpoint
 file, then playing the corresponding log until the snapshot time is reached.
@@ -378,17 +532,27 @@ Returns true if successful, false if files could not be played.
 static int log_recover( struct jx_database *db, time_t snapshot )
 {
 	char filename[PATH_MAX];
+	time_t indextime;
+	long offset = 0;
 
 	struct tm *t = gmtime(&snapshot);
 
 	int year = t->tm_year + 1900;
 	int day = t->tm_yday;
 
-	sprintf(filename,"%s/%d/%d.ckpt",db->logdir,year,day);
-	checkpoint_read(db,filename);
+	sprintf(filename,"%s/%d/%d.index",db->logdir,year,day);
+	if(jx_database_index_lookup(filename,snapshot,&indextime,&offset)) {
+		sprintf(filename,"%s/%d/%d.%lld.ckpt",db->logdir,year,day,(long long)indextime);
+		if(!checkpoint_read(db,filename)) offset = 0;
+	}
+
+	if(offset==0) {
+		sprintf(filename,"%s/%d/%d.ckpt",db->logdir,year,day);
+		checkpoint_read(db,filename);
+	}
 
 	sprintf(filename,"%s/%d/%d.log",db->logdir,year,day);
-	log_replay(db,filename,snapshot);
+	log_replay(db,filename,offset,snapshot);
 
 	return 1;
 }
@@ -405,7 +569,13 @@ struct jx_database * jx_database_create( const char *logdir )
 	db->logyear = 0;
 	db->logday = 0;
 	db->logfile = 0;
+	db->indexfile = 0;
 	db->last_log_time = 0;
+	db->last_checkpoint_time = 0;
+	db->last_checkpoint_offset = 0;
+	db->last_checkpoint_size = 0;
+	db->checkpoint_interval = JX_DATABASE_CHECKPOINT_INTERVAL_DEFAULT;
+	db->archive = 0;
 	db->logdir = 0;
 
 	if(logdir) {
@@ -416,8 +586,20 @@ struct jx_database * jx_database_create( const char *logdir )
 	return db;
 }
 
+void jx_database_checkpoint_interval( struct jx_database *db, int interval )
+{
+	db->checkpoint_interval = interval;
+}
+
+void jx_database_archive( struct jx_database *db, int enable )
+{
+	db->archive = enable;
+}
+
 void jx_database_insert( struct jx_database *db, const char *key, struct jx *nv )
 {
+	if(db->logdir) checkpoint_periodic(db);
+
 	struct jx *old = hash_table_remove(db->table,key);
 
 	hash_table_insert(db->table,key,nv);
@@ -444,6 +626,8 @@ struct jx * jx_database_remove( struct jx_database *db, const char *key )
 {
 	const char *nkey = strdup(key);
 
+	if(db->logdir) checkpoint_periodic(db);
+
 	struct jx *j = hash_table_remove(db->table,key);
 	if(db->logdir && j) {
 		log_delete(db,nkey);
@@ -39,6 +39,26 @@ log file is named DIR/YEAR/DAY.log
 The checkpoint file is simply a json object containing
 the keys and values of all the objects in the database.
 
+So that a point late in the day can be reached without replaying
+the whole log, additional checkpoints are written periodically
+during the day named DIR/YEAR/DAY.TIME.ckpt, and recorded in an index
+file DIR/YEAR/DAY.index.  One is written at most hourly by default, and
+only once the log has grown by the size of the previous one, so that
+they take no more space than the log itself.  Each line of the
+index has the form "TIME OFFSET", meaning that the intra-day checkpoint
+holds the state of the table at byte OFFSET of the log, and that all
+T records at or after TIME appear after OFFSET.  To reconstruct the
+state at a given time, load the last checkpoint in the index whose
+TIME is not after the desired time, seek the log to OFFSET, and
+play forward from there.  If the index is missing, fall back
+to the daily checkpoint and the log from the beginning.
+
+If archiving is enabled with @ref jx_database_archive, the log of each
+completed day is converted, by a background process, into the compact
+format described in @ref jx_archive.h, named DIR/YEAR/DAY.jxa, and the
+text log and index of that day are removed.  Readers should use the archive
+of a day if it exists, and the text log otherwise.
+
 The log file consists of a series of entries,
 each one a json array in the following formats:
 
@@ -61,6 +81,8 @@ totalling under 8GB data per year.
 
 #include "jx.h"
 
+#include <time.h>
+
 /** Create a new database, recovering state from disk if available.
 @param logdir A directory to contain the database on disk.  If it does not exist, it will be created.  If null, no disk storage will be used.
 @return A pointer to a newly created history table.
@@ -68,6 +90,21 @@ totalling under 8GB data per year.
 
 struct jx_database * jx_database_create( const char *logdir );
 
+/** Set the interval between intra-day checkpoints.
+@param db The database to modify.
+@param interval The minimum time between checkpoints, in seconds.  If zero, only daily checkpoints are written.
+Whatever the interval, a checkpoint is not written until the log has grown by the size of the previous one.
+*/
+
+void jx_database_checkpoint_interval( struct jx_database *db, int interval );
+
+/** Convert the log of each completed day into a compact archive.
+@param db The database to modify.
+@param enable If true, each day's log is replaced by a DAY.jxa archive once the day is complete.
+*/
+
+void jx_database_archive( struct jx_database *db, int enable );
+
 /** Insert or update an object into the database.
 If an object with the same primary key exists in the database, it will generate update (U) records in the log, otherwise a create (C) record is generated against the original object.
 @param db The database to access.
@@ -113,4 +150,16 @@ This function returns the next primary key and object in the iteration.
 
 int  jx_database_nextkey( struct jx_database *db, char **key, struct jx **j );
 
+/** Find the latest intra-day checkpoint in a day's index file.
+Finds the last checkpoint in the index whose time is not after the given time,
+from which the state of the table at that time may be reconstructed.
+@param filename The index file DIR/YEAR/DAY.index.
+@param time The time of interest, in Unix epoch format.
+@param indextime Filled in with the time of the checkpoint found.
+@param offset Filled in with the offset in the day's log at which the checkpoint was taken.
+@return True if a checkpoint was found, false if none precedes the time or the index cannot be read.
+*/
+
+int jx_database_index_lookup( const char *filename, time_t time, time_t *indextime, long *offset );
+
 #endif
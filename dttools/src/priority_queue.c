@@ -0,0 +1,135 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "priority_queue.h"
+
+#include <stdlib.h>
+
+#define DEFAULT_CAPACITY 127
+
+/*
+The queue is a binary max-heap stored in an array:
+the children of entry i are entries 2i+1 and 2i+2.
+*/
+
+struct entry {
+	void *data;
+	double priority;
+};
+
+struct priority_queue {
+	int size;
+	int capacity;
+	struct entry *entries;
+};
+
+struct priority_queue *priority_queue_create(int capacity)
+{
+	struct priority_queue *q;
+
+	q = (struct priority_queue *) malloc(sizeof(struct priority_queue));
+	if(!q)
+		return 0;
+
+	if(capacity < 1)
+		capacity = DEFAULT_CAPACITY;
+
+	q->entries = (struct entry *) malloc(sizeof(struct entry) * capacity);
+	if(!q->entries) {
+		free(q);
+		return 0;
+	}
+
+	q->size = 0;
+	q->capacity = capacity;
+
+	return q;
+}
+
+void priority_queue_delete(struct priority_queue *q)
+{
+	if(!q)
+		return;
+
+	free(q->entries);
+	free(q);
+}
+
+int priority_queue_size(struct priority_queue *q)
+{
+	return q->size;
+}
+
+int priority_queue_push(struct priority_queue *q, void *data, double priority)
+{
+	if(q->size == q->capacity) {
+		struct entry *entries = realloc(q->entries, sizeof(struct entry) * q->capacity * 2);
+		if(!entries)
+			return 0;
+		q->entries = entries;
+		q->capacity *= 2;
+	}
+
+	/* Move the new entry up past its lower priority parents. */
+	int i = q->size++;
+	while(i > 0) {
+		int parent = (i - 1) / 2;
+		if(q->entries[parent].priority >= priority)
+			break;
+		q->entries[i] = q->entries[parent];
+		i = parent;
+	}
+
+	q->entries[i].data = data;
+	q->entries[i].priority = priority;
+
+	return 1;
+}
+
+void *priority_queue_pop(struct priority_queue *q)
+{
+	if(q->size < 1)
+		return 0;
+
+	void *data = q->entries[0].data;
+	struct entry last = q->entries[--q->size];
+
+	/* Move the last entry down from the root past its higher priority children. */
+	int i = 0;
+	while(1) {
+		int child = 2 * i + 1;
+		if(child >= q->size)
+			break;
+		if(child + 1 < q->size && q->entries[child + 1].priority > q->entries[child].priority)
+			child++;
+		if(last.priority >= q->entries[child].priority)
+			break;
+		q->entries[i] = q->entries[child];
+		i = child;
+	}
+
+	q->entries[i] = last;
+
+	return data;
+}
+
+void *priority_queue_peek_top(struct priority_queue *q)
+{
+	if(q->size < 1)
+		return 0;
+
+	return q->entries[0].data;
+}
+
+double priority_queue_get_top_priority(struct priority_queue *q)
+{
+	if(q->size < 1)
+		return 0;
+
+	return q->entries[0].priority;
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -0,0 +1,79 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef PRIORITY_QUEUE_H
+#define PRIORITY_QUEUE_H
+
+/** @file priority_queue.h A priority queue of arbitrary objects.
+Objects are pushed with a numeric priority, and popped highest priority first.
+Push and pop take O(log n) time, so this is the structure to use in place of
+@ref list_push_priority when the queue can grow large.
+Objects of equal priority are popped in no particular order.
+For example:
+<pre>
+struct priority_queue *q = priority_queue_create(0);
+
+priority_queue_push(q, job_a, 10);
+priority_queue_push(q, job_b, 20);
+
+assert(priority_queue_pop(q) == job_b);
+assert(priority_queue_pop(q) == job_a);
+</pre>
+*/
+
+/** Create a new priority queue.
+@param capacity The number of objects to make room for.  If zero, a default will be used. Increases dynamically as needed.
+@return A pointer to a new priority queue.
+*/
+
+struct priority_queue *priority_queue_create(int capacity);
+
+/** Delete a priority queue.
+Note that this function will not free the objects contained within the queue.
+@param q A pointer to a priority queue.
+*/
+
+void priority_queue_delete(struct priority_queue *q);
+
+/** Count the objects in a priority queue.
+@param q A pointer to a priority queue.
+@return The number of objects in the queue.
+*/
+
+int priority_queue_size(struct priority_queue *q);
+
+/** Add an object to a priority queue.
+The same object may be pushed more than once.
+@param q A pointer to a priority queue.
+@param data A pointer to store in the queue.
+@param priority The priority of the object.  Higher priorities are popped first.
+@return One on success, zero on failure to allocate memory.
+*/
+
+int priority_queue_push(struct priority_queue *q, void *data, double priority);
+
+/** Remove the highest priority object from a priority queue.
+@param q A pointer to a priority queue.
+@return The object with the highest priority, or null if the queue is empty.
+*/
+
+void *priority_queue_pop(struct priority_queue *q);
+
+/** Look at the highest priority object without removing it.
+@param q A pointer to a priority queue.
+@return The object with the highest priority, or null if the queue is empty.
+*/
+
+void *priority_queue_peek_top(struct priority_queue *q);
+
+/** Get the priority of the highest priority object.
+@param q A pointer to a priority queue.
+@return The priority of the object that @ref priority_queue_pop would return, or zero if the queue is empty.
+*/
+
+double priority_queue_get_top_priority(struct priority_queue *q);
+
+#endif
@@ -38,12 +38,9 @@ struct set *set_create(int bucket_count)
 	if(bucket_count == 0)
 		bucket_count = DEFAULT_SIZE;
 
+	/* The buckets are not allocated until the first insert. */
 	s->bucket_count = bucket_count;
-	s->buckets = (struct entry **) calloc(bucket_count, sizeof(struct entry *));
-	if(!s->buckets) {
-		free(s);
-		return 0;
-	}
+	s->buckets = 0;
 
 	s->size = 0;
 
@@ -83,6 +80,9 @@ void set_clear(struct set *s)
 	struct entry *e, *f;
 	int i;
 
+	if(!s->buckets)
+		return;
+
 	for(i = 0; i < s->bucket_count; i++) {
 		e = s->buckets[i];
 		while(e) {
@@ -116,6 +116,9 @@ int set_lookup(struct set *s, void *element)
 
 	uintptr_t key = (uintptr_t) element;
 
+	if(!s->buckets)
+		return 0;
+
 	index = key % s->bucket_count;
 	e = s->buckets[index];
 
@@ -177,6 +180,12 @@ int set_insert(struct set *s, const void *element)
 
 	uintptr_t key = (uintptr_t) element;
 
+	if(!s->buckets) {
+		s->buckets = (struct entry **) calloc(s->bucket_count, sizeof(struct entry *));
+		if(!s->buckets)
+			return 0;
+	}
+
 	if( ((float) s->size / s->bucket_count) > DEFAULT_LOAD )
 		set_double_buckets(s);
 
@@ -238,6 +247,9 @@ int set_remove(struct set *s, const void *element)
 
 	uintptr_t key = (uintptr_t) element;
 
+	if(!s->buckets)
+		return 0;
+
 	index = key % s->bucket_count;
 	e = s->buckets[index];
 	f = 0;
@@ -278,6 +290,10 @@ void *set_pop(struct set *s)
 void set_first_element(struct set *s)
 {
 	s->ientry = 0;
+	if(!s->buckets) {
+		s->ibucket = s->bucket_count;
+		return;
+	}
 	for(s->ibucket = 0; s->ibucket < s->bucket_count; s->ibucket++) {
 		s->ientry = s->buckets[s->ibucket];
 		if(s->ientry)
@@ -0,0 +1,134 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+exe="data_struct_hash_table.test"
+
+prepare()
+{
+	gcc -g $CCTOOLS_TEST_CCFLAGS -o "$exe" -I ../src/ -x c - -x none ../src/libdttools.a -lm <<EOF
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+#include "itable.h"
+
+#define N 10000
+
+int main(int argc, char **argv)
+{
+  char key[32];
+  char *k, *k2;
+  void *v, *v2;
+  UINT64_T ik, ik2;
+  uintptr_t i;
+  int count;
+
+  struct hash_table *h = hash_table_create(0, 0);
+  struct itable *t = itable_create(0);
+
+  for(i = 0; i < N; i++) {
+	sprintf(key, "%lu", (unsigned long) i);
+	assert( hash_table_insert(h, key, (void *) (i + 1)) );
+	assert( itable_insert(t, i << 20, (void *) (i + 1)) );
+  }
+
+  /* Duplicates are rejected by hash_table, and replace the value in itable. */
+  assert( !hash_table_insert(h, "0", (void *) 5) );
+  assert( itable_insert(t, 0, (void *) 5) );
+  assert( itable_lookup(t, 0) == (void *) 5 );
+  itable_insert(t, 0, (void *) 1);
+
+  assert( hash_table_size(h) == N );
+  assert( itable_size(t) == N );
+
+  for(i = 0; i < N; i++) {
+	sprintf(key, "%lu", (unsigned long) i);
+	assert( hash_table_lookup(h, key) == (void *) (i + 1) );
+	assert( itable_lookup(t, i << 20) == (void *) (i + 1) );
+  }
+  assert( !hash_table_lookup(h, "absent") );
+  assert( !itable_lookup(t, 1) );
+
+  /* Independent iterators may be nested. */
+  struct hash_table_iterator outer, inner;
+  count = 0;
+  hash_table_iterator_first(h, &outer);
+  while(hash_table_iterator_next(h, &outer, &k, &v)) {
+	if(count++ > 2) continue;
+	int inner_count = 0;
+	hash_table_iterator_first(h, &inner);
+	while(hash_table_iterator_next(h, &inner, &k2, &v2)) inner_count++;
+	assert( inner_count == N );
+  }
+  assert( count == N );
+
+  struct itable_iterator iouter, iinner;
+  count = 0;
+  itable_iterator_first(t, &iouter);
+  while(itable_iterator_next(t, &iouter, &ik, &v)) {
+	if(count++ > 2) continue;
+	int inner_count = 0;
+	itable_iterator_first(t, &iinner);
+	while(itable_iterator_next(t, &iinner, &ik2, 0)) inner_count++;
+	assert( inner_count == N );
+  }
+  assert( count == N );
+
+  /* The key just visited may be removed during iteration, without skipping any others. */
+  uintptr_t sum = 0;
+  count = 0;
+  hash_table_firstkey(h);
+  while(hash_table_nextkey(h, &k, &v)) {
+	sum += (uintptr_t) v;
+	count++;
+	if(count % 2) assert( hash_table_remove(h, k) == v );
+  }
+  assert( count == N );
+  assert( sum == (uintptr_t) N * (N + 1) / 2 );
+  assert( hash_table_size(h) == N / 2 );
+
+  sum = 0;
+  count = 0;
+  itable_firstkey(t);
+  while(itable_nextkey(t, &ik, &v)) {
+	sum += (uintptr_t) v;
+	count++;
+	if(count % 2) assert( itable_remove(t, ik) == v );
+  }
+  assert( count == N );
+  assert( sum == (uintptr_t) N * (N + 1) / 2 );
+  assert( itable_size(t) == N / 2 );
+
+  hash_table_clear(h);
+  itable_clear(t);
+  assert( hash_table_size(h) == 0 );
+  assert( itable_size(t) == 0 );
+
+  hash_table_delete(h);
+  itable_delete(t);
+
+  return 0;
+}
+EOF
+	return $?
+}
+
+run()
+{
+	./"$exe"
+	return $?
+}
+
+clean()
+{
+	rm -f "$exe"
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
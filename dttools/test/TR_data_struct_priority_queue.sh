@@ -0,0 +1,77 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+exe="data_struct_priority_queue.test"
+
+prepare()
+{
+	gcc -g $CCTOOLS_TEST_CCFLAGS -o "$exe" -I ../src/ -x c - -x none ../src/libdttools.a -lm <<EOF
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "priority_queue.h"
+
+int main(int argc, char **argv)
+{
+  uintptr_t N = 1000;
+  uintptr_t i;
+
+  /* Start small so that the queue has to grow. */
+  struct priority_queue *q = priority_queue_create(1);
+
+  assert( priority_queue_size(q) == 0 );
+  assert( priority_queue_pop(q) == NULL );
+  assert( priority_queue_peek_top(q) == NULL );
+
+  /* Push in a scrambled order, priority equal to the value. */
+  for(i = 0; i < N; i++) {
+	uintptr_t v = (i * 7919) % N + 1;
+	assert( priority_queue_push(q, (void *) v, (double) v) );
+  }
+  assert( priority_queue_size(q) == (int) N );
+  assert( priority_queue_peek_top(q) == (void *) N );
+  assert( priority_queue_get_top_priority(q) == (double) N );
+
+  /* Values come out from highest to lowest. */
+  for(i = N; i > N / 2; i--) {
+	assert( priority_queue_pop(q) == (void *) i );
+  }
+
+  /* Interleave pushes with the remaining pops. */
+  priority_queue_push(q, (void *) (N + 1), (double) (N + 1));
+  priority_queue_push(q, (void *) (N + 2), -1.0);
+  assert( priority_queue_pop(q) == (void *) (N + 1) );
+
+  for(i = N / 2; i > 0; i--) {
+	assert( priority_queue_pop(q) == (void *) i );
+  }
+
+  assert( priority_queue_pop(q) == (void *) (N + 2) );
+  assert( priority_queue_size(q) == 0 );
+
+  priority_queue_delete(q);
+
+  return 0;
+}
+EOF
+	return $?
+}
+
+run()
+{
+	./"$exe"
+	return $?
+}
+
+clean()
+{
+	rm -f "$exe"
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
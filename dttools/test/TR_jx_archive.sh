@@ -0,0 +1,149 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+exe="jx_archive.test"
+
+prepare()
+{
+	gcc -g $CCTOOLS_TEST_CCFLAGS -o "$exe" -I ../src/ -x c - -x none ../src/libdttools.a -lz -lm <<EOF
+#include "jx_archive.h"
+#include "jx_parse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGFILE "jx_archive.test.log"
+#define INDEXFILE "jx_archive.test.index"
+#define ARCHIVEFILE "jx_archive.test.jxa"
+#define TRUNCATEDFILE "jx_archive.test.truncated.jxa"
+
+static const char *records[][4] = {
+	{"T", 0, 0, "1500000000"},
+	{"C", "a", 0, "{\"name\":\"a\",\"n\":5,\"x\":0.123456789012,\"nest\":{\"k\":[1,2,3.5,\"s\",null,true]},\"s\":\"str\"}"},
+	{"U", "a", "n", "7"},
+	{"U", "a", "n", "3"},
+	{"U", "a", "x", "2.5"},
+	{"T", 0, 0, "1500000003"},
+	{"C", "b", 0, "{\"n\":1}"},
+	{"U", "b", "s", "\"hello\""},
+	{"R", "a", "s", 0},
+	{"D", "b", 0, 0},
+	{"T", 0, 0, "1500000010"},
+	{"U", "a", "n", "9223372036854775807"},
+	{"U", "a", "n", "0"},
+	{"U", "a", "nest", "{\"deep\":[[],{}]}"},
+};
+
+#define NRECORDS (sizeof(records)/sizeof(records[0]))
+#define MARK 5
+
+static void check( int condition, int i, const char *what )
+{
+	if(!condition) {
+		fprintf(stderr,"record %d: %s\n",i,what);
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	FILE *log = fopen(LOGFILE,"w");
+	long offset = 0;
+
+	for(unsigned i=0;i<NRECORDS;i++) {
+		if(i==MARK) offset = ftell(log);
+		const char **r = records[i];
+		if(r[0][0]=='T') {
+			fprintf(log,"T %s\n",r[3]);
+		} else if(r[0][0]=='C') {
+			fprintf(log,"C %s %s\n",r[1],r[3]);
+		} else if(r[0][0]=='U') {
+			fprintf(log,"U %s %s %s\n",r[1],r[2],r[3]);
+		} else if(r[0][0]=='R') {
+			fprintf(log,"R %s %s\n",r[1],r[2]);
+		} else {
+			fprintf(log,"D %s\n",r[1]);
+		}
+	}
+	fclose(log);
+
+	FILE *index = fopen(INDEXFILE,"w");
+	fprintf(index,"1500000003 %ld\n",offset);
+	fclose(index);
+
+	if(!jx_archive_convert(LOGFILE,INDEXFILE,ARCHIVEFILE)) {
+		fprintf(stderr,"couldn't convert log\n");
+		return 1;
+	}
+
+	struct jx_archive *a = jx_archive_open(ARCHIVEFILE);
+	if(!a) {
+		fprintf(stderr,"couldn't open archive\n");
+		return 1;
+	}
+
+	struct jx_archive_record r;
+	for(unsigned i=0;i<NRECORDS;i++) {
+		const char **e = records[i];
+		check(jx_archive_read(a,&r),i,"missing");
+		check(r.type==e[0][0],i,"wrong type");
+		if(r.type=='T') check(r.time==atoll(e[3]),i,"wrong time");
+		if(e[1]) check(!strcmp(r.key,e[1]),i,"wrong key");
+		if(e[2]) check(!strcmp(r.name,e[2]),i,"wrong name");
+		if(e[3] && r.type!='T') {
+			struct jx *expected = jx_parse_string(e[3]);
+			check(r.value && jx_equals(r.value,expected),i,"wrong value");
+			jx_delete(expected);
+		}
+		jx_delete(r.value);
+	}
+	check(!jx_archive_read(a,&r),NRECORDS,"extra record");
+	jx_archive_close(a);
+
+	time_t marktime;
+	INT64_T record;
+	check(!jx_archive_mark_lookup(ARCHIVEFILE,1500000002,&marktime,&record),MARK,"mark found too early");
+	check(jx_archive_mark_lookup(ARCHIVEFILE,1500000004,&marktime,&record),MARK,"mark not found");
+	check(marktime==1500000003 && record==MARK,MARK,"wrong mark");
+
+	a = jx_archive_open(ARCHIVEFILE);
+	check(jx_archive_skip(a,record),MARK,"couldn't skip");
+	check(jx_archive_read(a,&r) && r.type=='T' && r.time==1500000003,MARK,"wrong record after skip");
+	jx_archive_close(a);
+
+	/* A log or a truncated archive is refused, not misread. */
+	check(!jx_archive_mark_lookup(LOGFILE,1500000004,&marktime,&record),MARK,"mark found in a log");
+	check(!jx_archive_open(LOGFILE),0,"log opened as an archive");
+	FILE *full = fopen(ARCHIVEFILE,"r");
+	char buffer[12];
+	size_t length = fread(buffer,1,sizeof(buffer),full);
+	fclose(full);
+	FILE *truncated = fopen(TRUNCATEDFILE,"w");
+	fwrite(buffer,1,length,truncated);
+	fclose(truncated);
+	check(!jx_archive_mark_lookup(TRUNCATEDFILE,1500000004,&marktime,&record),MARK,"mark found in a truncated archive");
+	check(!jx_archive_open(TRUNCATEDFILE),0,"truncated archive opened");
+
+	return 0;
+}
+EOF
+	return $?
+}
+
+run()
+{
+	./"$exe"
+	return $?
+}
+
+clean()
+{
+	rm -f "$exe" jx_archive.test.log jx_archive.test.index jx_archive.test.jxa jx_archive.test.truncated.jxa
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
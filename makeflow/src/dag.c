@@ -43,6 +43,7 @@ struct dag *dag_create()
 	d->special_vars = string_set_create(0, 0);
 	d->completed_files = 0;
 	d->deleted_files = 0;
+	d->runtimes = hash_table_create(0, 0);
 	d->total_file_size = 0;
 
 	d->categories   = hash_table_create(0, 0);
@@ -189,6 +190,249 @@ void dag_count_states(struct dag *d)
 	}
 }
 
+/*
+Rather than checking every source file of every node on each pass
+of the dispatch loop, each node keeps a count of its source files
+that do not yet exist, which is updated as files change state.
+A waiting node joins d->ready_nodes when its count reaches zero,
+so that dispatch only has to consider the nodes in that queue.
+Rules with prefix LOCAL wait in d->ready_local_nodes instead, so
+that when only one kind of job slot is free the nodes waiting for
+the other kind need not be looked at.
+
+The queue pops the node with the highest n->priority first.
+By default that is the order in which nodes became ready.
+Otherwise the priority of a node is its bottom level: the weight
+of the node plus the largest priority among its descendants, so
+that the rules on the critical path of the workflow go first.
+*/
+
+struct dag_runtime {
+	int count;
+	double total;
+};
+
+/* Rules of a category not seen yet weigh as the average of all rules seen. */
+
+static double dag_default_weight(struct dag *d)
+{
+	struct dag_runtime *r;
+	double total = 0;
+	char *name;
+
+	if(d->dispatch_order != DAG_DISPATCH_CRITICAL_PATH_RUNTIME || d->runtimes_observed < 1)
+		return 1;
+
+	hash_table_firstkey(d->runtimes);
+	while(hash_table_nextkey(d->runtimes, &name, (void **) &r)) {
+		total += r->total;
+	}
+
+	return total / d->runtimes_observed;
+}
+
+static double dag_node_weight(struct dag *d, struct dag_node *n, double default_weight)
+{
+	struct dag_runtime *r = NULL;
+
+	if(d->dispatch_order == DAG_DISPATCH_CRITICAL_PATH_RUNTIME && n->category)
+		r = hash_table_lookup(d->runtimes, n->category->name);
+
+	if(r)
+		return r->total / r->count;
+
+	return default_weight;
+}
+
+static void dag_compute_priorities(struct dag *d)
+{
+	struct dag_node *n, *m;
+	double default_weight = dag_default_weight(d);
+
+	/* Visit the nodes from the sinks up, so that every descendant
+	of a node has its priority before the node itself. */
+	int *remaining = xxmalloc(sizeof(int) * (d->nodeid_counter + 1));
+	struct list *visit = list_create();
+
+	for(n = d->nodes; n; n = n->next) {
+		remaining[n->nodeid] = set_size(n->descendants);
+		if(remaining[n->nodeid] == 0)
+			list_push_tail(visit, n);
+	}
+
+	while((n = list_pop_head(visit))) {
+		double longest = 0;
+		set_first_element(n->descendants);
+		while((m = set_next_element(n->descendants))) {
+			if(m->priority > longest)
+				longest = m->priority;
+		}
+
+		n->priority = dag_node_weight(d, n, default_weight) + longest;
+
+		set_first_element(n->ancestors);
+		while((m = set_next_element(n->ancestors))) {
+			if(--remaining[m->nodeid] == 0)
+				list_push_tail(visit, m);
+		}
+	}
+
+	list_delete(visit);
+	free(remaining);
+
+	d->runtimes_at_last_priority = d->runtimes_observed;
+}
+
+static void dag_ready_push(struct dag *d, struct dag_node *n)
+{
+	if(n->state == DAG_NODE_STATE_WAITING && n->sources_missing == 0 && !n->ready) {
+		n->ready = 1;
+		if(d->dispatch_order == DAG_DISPATCH_FIFO)
+			n->priority = -(double) d->ready_count;
+		d->ready_count++;
+		priority_queue_push(n->local_job ? d->ready_local_nodes : d->ready_nodes, n, n->priority);
+	}
+}
+
+void dag_ready_init(struct dag *d)
+{
+	struct dag_node *n;
+	struct dag_file *f;
+
+	if(d->ready_nodes) {
+		priority_queue_delete(d->ready_nodes);
+		priority_queue_delete(d->ready_local_nodes);
+	}
+	d->ready_nodes = priority_queue_create(0);
+	d->ready_local_nodes = priority_queue_create(0);
+	d->ready_count = 0;
+
+	if(d->dispatch_order != DAG_DISPATCH_FIFO)
+		dag_compute_priorities(d);
+
+	for(n = d->nodes; n; n = n->next) {
+		n->sources_missing = 0;
+		n->ready = 0;
+
+		list_first_item(n->source_files);
+		while((f = list_next_item(n->source_files))) {
+			if(!dag_file_should_exist(f))
+				n->sources_missing++;
+		}
+
+		dag_ready_push(d, n);
+	}
+}
+
+void dag_ready_file_change(struct dag *d, struct dag_file *f, int existed)
+{
+	struct dag_node *n;
+
+	if(!d->ready_nodes)
+		return;
+
+	int exists = dag_file_should_exist(f);
+	if(exists == existed)
+		return;
+
+	list_first_item(f->needed_by);
+	while((n = list_next_item(f->needed_by))) {
+		if(exists) {
+			n->sources_missing--;
+			dag_ready_push(d, n);
+		} else {
+			n->sources_missing++;
+		}
+	}
+}
+
+void dag_ready_node_change(struct dag *d, struct dag_node *n)
+{
+	if(!d->ready_nodes)
+		return;
+
+	dag_ready_push(d, n);
+}
+
+struct dag_node *dag_ready_pop(struct dag *d, int remote, int local)
+{
+	struct priority_queue *q = NULL;
+
+	if(!d->ready_nodes)
+		return NULL;
+
+	if(remote && priority_queue_size(d->ready_nodes) > 0)
+		q = d->ready_nodes;
+
+	if(local && priority_queue_size(d->ready_local_nodes) > 0) {
+		if(!q || priority_queue_get_top_priority(d->ready_local_nodes) > priority_queue_get_top_priority(q))
+			q = d->ready_local_nodes;
+	}
+
+	if(!q)
+		return NULL;
+
+	struct dag_node *n = priority_queue_pop(q);
+	n->ready = 0;
+
+	return n;
+}
+
+void dag_ready_requeue(struct dag *d, struct dag_node *n)
+{
+	if(n->ready)
+		return;
+
+	n->ready = 1;
+	priority_queue_push(n->local_job ? d->ready_local_nodes : d->ready_nodes, n, n->priority);
+}
+
+void dag_ready_observe_runtime(struct dag *d, struct dag_node *n, double seconds)
+{
+	if(d->dispatch_order != DAG_DISPATCH_CRITICAL_PATH_RUNTIME || !n->category)
+		return;
+
+	/* Runtimes are only known to the second. */
+	if(seconds < 1)
+		seconds = 1;
+
+	struct dag_runtime *r = hash_table_lookup(d->runtimes, n->category->name);
+	if(!r) {
+		r = xxmalloc(sizeof(*r));
+		r->count = 0;
+		r->total = 0;
+		hash_table_insert(d->runtimes, n->category->name, r);
+	}
+
+	r->count++;
+	r->total += seconds;
+	d->runtimes_observed++;
+
+	/*
+	Recomputing visits the whole workflow, so only do it each time
+	the number of runtimes observed doubles. The estimates settle
+	early, and the total cost stays proportional to the size of the
+	workflow times the log of the number of jobs.
+	*/
+	if(!d->ready_nodes || d->runtimes_observed < 2 * d->runtimes_at_last_priority)
+		return;
+
+	debug(D_MAKEFLOW_RUN, "recomputing priorities after %d runtimes observed", d->runtimes_observed);
+	dag_compute_priorities(d);
+
+	struct priority_queue *old[] = { d->ready_nodes, d->ready_local_nodes };
+	d->ready_nodes = priority_queue_create(priority_queue_size(old[0]));
+	d->ready_local_nodes = priority_queue_create(priority_queue_size(old[1]));
+
+	int i;
+	for(i = 0; i < 2; i++) {
+		while((n = priority_queue_pop(old[i]))) {
+			priority_queue_push(n->local_job ? d->ready_local_nodes : d->ready_nodes, n, n->priority);
+		}
+		priority_queue_delete(old[i]);
+	}
+}
+
 /**
  * If the return value is x, a positive integer, that means at least x tasks
  * can be run in parallel during a certain point of the execution of the
@@ -17,9 +17,16 @@ See the file COPYING for details.
 #include "timestamp.h"
 #include "batch_job.h"
 #include "category.h"
+#include "priority_queue.h"
 
 #include <stdio.h>
 
+typedef enum {
+	DAG_DISPATCH_FIFO = 0,               /* Dispatch rules in the order they become ready. */
+	DAG_DISPATCH_CRITICAL_PATH,          /* Dispatch rules with the longest chain of rules after them first. */
+	DAG_DISPATCH_CRITICAL_PATH_RUNTIME   /* As above, weighting each rule by the observed runtime of its category. */
+} dag_dispatch_order_t;
+
 struct dag {
 	/* Static properties of the DAG */
 	char *filename;                    /* Source makeflow file path. */
@@ -48,8 +55,17 @@ struct dag {
 	char *cache_dir;                    /* The dirname of the cache storing all the deps specified in the mountfile */
 
 	uint64_t total_file_size;           /* Keeps cumulative size of existing files. */
+	struct priority_queue *ready_nodes; /* Waiting nodes whose source files all exist, by dag_node->priority. */
+	struct priority_queue *ready_local_nodes; /* As ready_nodes, for the rules with prefix LOCAL. */
+	int64_t ready_count;                /* Keeps a count of the nodes queued as ready, used for FIFO priorities. */
+	dag_dispatch_order_t dispatch_order;/* How priorities are assigned to the nodes in ready_nodes. */
+	struct hash_table *runtimes;        /* Mapping from category names to the runtimes observed for that category. */
+	int runtimes_observed;              /* Number of runtimes observed, over all categories. */
+	int runtimes_at_last_priority;      /* Value of runtimes_observed when priorities were last computed. */
 };
 
+struct dag_file;
+
 struct dag *dag_create();
 
 struct list *dag_input_files( struct dag *d );
@@ -58,6 +74,19 @@ void dag_compile_ancestors(struct dag *d);
 void dag_find_ancestor_depth(struct dag *d);
 void dag_count_states(struct dag *d);
 
+/* Count the missing source files of every node, and queue the waiting nodes that have none. */
+void dag_ready_init(struct dag *d);
+/* Update the ready queue after a file changes state. existed is dag_file_should_exist(f) before the change. */
+void dag_ready_file_change(struct dag *d, struct dag_file *f, int existed);
+/* Update the ready queue after a node changes state. */
+void dag_ready_node_change(struct dag *d, struct dag_node *n);
+/* Remove and return the ready node with the highest priority among the remote and/or local rules, or NULL if there are none. */
+struct dag_node *dag_ready_pop(struct dag *d, int remote, int local);
+/* Return a node taken with dag_ready_pop that could not be dispatched, keeping its priority. */
+void dag_ready_requeue(struct dag *d, struct dag_node *n);
+/* Record the runtime of a completed node, which may recompute priorities. */
+void dag_ready_observe_runtime(struct dag *d, struct dag_node *n, double seconds);
+
 struct dag_file *dag_file_lookup_or_create(struct dag *d, const char *filename);
 struct dag_file *dag_file_from_name(struct dag *d, const char *filename);
 
@@ -24,6 +24,16 @@ See the file COPYING for details.
 
 extern char **environ; 
 
+/*
+A workflow may have millions of nodes, and most of the tables of a node
+hold only a handful of entries, if any.  So, they are created with room for
+a few entries (which is not allocated until the first insert), and grow as
+needed, rather than starting at the default size.
+*/
+
+#define DAG_NODE_TABLE_SIZE 8
+#define DAG_NODE_SET_SIZE 7
+
 struct dag_node *dag_node_create(struct dag *d, int linenum)
 {
 	struct dag_node *n = calloc(1, sizeof(*n));
@@ -32,16 +42,16 @@ struct dag_node *dag_node_create(struct dag *d, int linenum)
 	n->linenum = linenum;
 	n->state = DAG_NODE_STATE_WAITING;
 	n->nodeid = d->nodeid_counter++;
-	n->variables = hash_table_create(0, 0);
+	n->variables = hash_table_create(DAG_NODE_TABLE_SIZE, 0);
 
 	n->source_files = list_create();
 	n->target_files = list_create();
 
-	n->remote_names = itable_create(0);
-	n->remote_names_inv = hash_table_create(0, 0);
+	n->remote_names = itable_create(DAG_NODE_TABLE_SIZE);
+	n->remote_names_inv = hash_table_create(DAG_NODE_TABLE_SIZE, 0);
 
-	n->descendants = set_create(0);
-	n->ancestors = set_create(0);
+	n->descendants = set_create(DAG_NODE_SET_SIZE);
+	n->ancestors = set_create(DAG_NODE_SET_SIZE);
 
 	n->ancestor_depth = -1;
 
@@ -49,8 +59,9 @@ struct dag_node *dag_node_create(struct dag *d, int linenum)
 	// PROBABLY not what you want. Most likely you want dag_node_dynamic_label(n)
 	n->resources_requested = rmsummary_create(-1);
 
-	// the value of dag_node_dynamic_label(n) when this node was submitted.
-	n->resources_allocated  = rmsummary_create(-1);
+	// the value of dag_node_dynamic_label(n) when this node was submitted,
+	// created on submission.
+	n->resources_allocated  = NULL;
 
 	// resources used by the node, as measured by the resource_monitor (if
 	// using monitoring).
@@ -65,7 +65,7 @@ struct dag_node {
                                                 into account its category. Use dag_node_dynamic_label(n) for the
                                                 resources this node requests, taking into account categories,
                                                 dynamic resources, etc.  */
-    struct rmsummary *resources_allocated;   /* resources allocated to this node when submitted */
+    struct rmsummary *resources_allocated;   /* resources allocated to this node when submitted, or NULL if never submitted. */
 	struct rmsummary *resources_measured;    /* resources measured on completion. */
 
 	/* Variables used in dag_width, dag_width_uniform_task, and dag_depth
@@ -80,6 +80,9 @@ struct dag_node {
 	batch_job_id_t jobid;               /* The id this node get, either from the local or remote batch system. */
 	dag_node_state_t state;             /* Enum: DAG_NODE_STATE_{WAITING,RUNNING,...} */
 	int failure_count;                  /* How many times has this rule failed? (see -R and -r) */
+	int sources_missing;                /* Number of source files that do not exist yet. (see dag_ready_init) */
+	int ready;                          /* Flag: is this node in dag->ready_nodes? */
+	double priority;                    /* Dispatch priority, higher first. (see dag->dispatch_order) */
 	time_t previous_completion;
 
 	const char *umbrella_spec;          /* the umbrella spec file for executing this job */
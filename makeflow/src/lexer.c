@@ -1263,16 +1263,24 @@ struct lexer *lexer_create(int type, void *data, int line_number, int column_num
 
 	lx->depth = 0;
 
-	lx->lexeme = calloc(BUFFER_CHUNK_SIZE, sizeof(char));
+	/*
+	A lexer is created for every variable substitution, so the buffers
+	are not cleared: only the bytes read before being loaded are set.
+	*/
+	lx->lexeme = malloc(BUFFER_CHUNK_SIZE);
 	lx->lexeme_size = 0;
 	lx->lexeme_max = BUFFER_CHUNK_SIZE;
 
 	lx->token_queue = list_create();
 
-	lx->buffer = calloc(2 * BUFFER_CHUNK_SIZE, sizeof(char));
-	if(!lx->buffer)
+	lx->buffer = malloc(2 * BUFFER_CHUNK_SIZE);
+	if(!lx->buffer || !lx->lexeme)
 		fatal("Could not allocate memory for input buffer.\n");
 
+	*(lx->buffer + BUFFER_CHUNK_SIZE - 1) = '\0';
+	*(lx->buffer + 2 * BUFFER_CHUNK_SIZE - 2) = '\0';
+	*(lx->buffer + 2 * BUFFER_CHUNK_SIZE - 1) = '\0';
+
 	lx->lexeme_end = (lx->buffer + 2 * BUFFER_CHUNK_SIZE - 2);
 
 	if(type == STREAM) {
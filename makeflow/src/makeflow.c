@@ -141,6 +141,7 @@ static char *project = NULL;
 static int port = 0;
 static int output_len_check = 0;
 static int skip_file_check = 0;
+static int stat_procs = 16;
 
 static int cache_mode = 1;
 
@@ -343,8 +344,6 @@ void makeflow_node_force_rerun(struct itable *rerun_table, struct dag *d, struct
 	struct dag_node *p;
 	struct batch_file *bf;
 	struct dag_file *f1;
-	struct dag_file *f2;
-	int child_node_found;
 
 	if(itable_lookup(rerun_table, n->nodeid))
 		return;
@@ -392,25 +391,6 @@ void makeflow_node_force_rerun(struct itable *rerun_table, struct dag *d, struct
 			f1->reference_count += 1;
 		}
 	}
-
-	// For each child node, rerun it
-	list_first_item(n->target_files);
-	while((f1 = list_next_item(n->target_files))) {
-		for(p = d->nodes; p; p = p->next) {
-			child_node_found = 0;
-
-			list_first_item(p->source_files);
-			while((f2 = list_next_item(n->source_files))) {
-				if(!strcmp(f1->filename, f2->filename)) {
-					child_node_found = 1;
-					break;
-				}
-			}
-			if(child_node_found) {
-				makeflow_node_force_rerun(rerun_table, d, p);
-			}
-		}
-	}
 }
 
 /*
@@ -534,6 +514,10 @@ static void makeflow_node_submit(struct dag *d, struct dag_node *n, const struct
 	struct batch_task *task = dag_node_to_batch_task(n, queue, should_send_all_local_environment);
 	batch_queue_set_int_option(queue, "task-id", task->taskid);
 
+	/* Let the batch system order queued jobs by the same priority. */
+	if(d->dispatch_order != DAG_DISPATCH_FIFO)
+		batch_queue_set_int_option(queue, "task-priority", (int) n->priority);
+
 	/* This augments the task struct, should be replaced with node_submit in future. */
 	makeflow_node_expand(n, queue, task);
 	n->task = task;
@@ -553,6 +537,8 @@ static void makeflow_node_submit(struct dag *d, struct dag_node *n, const struct
 	if(submitted == 1) {
 		n->jobid = task->jobid;
 		/* Not sure if this is necessary/what it does. */
+		if(!n->resources_allocated)
+			n->resources_allocated = rmsummary_create(-1);
 		memcpy(n->resources_allocated, task->resources, sizeof(struct rmsummary));
 		makeflow_log_state_change(d, n, DAG_NODE_STATE_RUNNING);
 
@@ -587,8 +573,6 @@ static void makeflow_node_submit(struct dag *d, struct dag_node *n, const struct
 
 static int makeflow_node_ready(struct dag *d, struct dag_node *n, const struct rmsummary *resources)
 {
-	struct dag_file *f;
-
 	if(n->state != DAG_NODE_STATE_WAITING)
 		return 0;
 
@@ -605,14 +589,8 @@ static int makeflow_node_ready(struct dag *d, struct dag_node *n, const struct r
 			return 0;
 	}
 
-	list_first_item(n->source_files);
-	while((f = list_next_item(n->source_files))) {
-		if(dag_file_should_exist(f)) {
-			continue;
-		} else {
-			return 0;
-		}
-	}
+	if(n->sources_missing > 0)
+		return 0;
 
 	/* If all makeflow checks pass for this node we will 
 	return the result of the hooks, which will be 1 if all pass
@@ -639,22 +617,43 @@ int makeflow_nodes_local_waiting_count(const struct dag *d) {
 
 /*
 Find all jobs ready to be run, then submit them.
+Only the nodes in the ready queues have all of their source files,
+so those are the only ones considered, highest priority first, and
+only while there are job slots for them.  A node that cannot be
+submitted yet, for lack of resources, goes back into its queue.
 */
 
 static void makeflow_dispatch_ready_jobs(struct dag *d)
 {
 	struct dag_node *n;
+	struct list *deferred = list_create();
 
-	for(n = d->nodes; n; n = n->next) {
-		if(dag_remote_jobs_running(d) >= remote_jobs_max && dag_local_jobs_running(d) >= local_jobs_max) {
+	while(1) {
+		int remote_slots = dag_remote_jobs_running(d) < remote_jobs_max;
+		int local_slots = local_queue ? dag_local_jobs_running(d) < local_jobs_max : remote_slots;
+
+		n = dag_ready_pop(d, remote_slots, local_slots);
+		if(!n)
 			break;
+
+		/* The node may have been rerun or lost an input since it was queued. */
+		if(n->state != DAG_NODE_STATE_WAITING || n->sources_missing > 0) {
+			continue;
 		}
 
 		const struct rmsummary *resources = dag_node_dynamic_label(n);
 		if(makeflow_node_ready(d, n, resources)) {
 			makeflow_node_submit(d, n, resources);
+		} else {
+			list_push_tail(deferred, n);
 		}
 	}
+
+	while((n = list_pop_head(deferred))) {
+		dag_ready_requeue(d, n);
+	}
+
+	list_delete(deferred);
 }
 
 /*
@@ -710,6 +709,9 @@ static void makeflow_node_complete(struct dag *d, struct dag_node *n, struct bat
 	struct dag_file *f;
 	int job_failed = 0;
 
+	/* A job run in place of the batch system by a hook never took local resources. */
+	int was_submitted = n->state == DAG_NODE_STATE_RUNNING;
+
 	/* This is intended for changes to the batch_task that need no
 		no context from dag_node/dag, such as shared_fs. */
 	int rc = makeflow_hook_batch_retrieve(task);
@@ -724,7 +726,7 @@ static void makeflow_node_complete(struct dag *d, struct dag_node *n, struct bat
 	if(n->state != DAG_NODE_STATE_RUNNING)
 		return;
 
-	if(is_local_job(n)) {
+	if(is_local_job(n) && was_submitted) {
 		makeflow_local_resources_add(local_resources,n);
 	}
 
@@ -790,6 +792,10 @@ static void makeflow_node_complete(struct dag *d, struct dag_node *n, struct bat
 		}
 	} else {
 
+		if(task->info->started > 0 && task->info->finished >= task->info->started) {
+			dag_ready_observe_runtime(d, n, task->info->finished - task->info->started);
+		}
+
 		/* Mark source files that have been used by this node */
 		list_first_item(task->input_files);
 		while((bf = list_next_item(task->input_files))) {
@@ -830,33 +836,54 @@ Check the dag for consistency, and emit errors if input dependencies, etc are mi
 
 static int makeflow_check(struct dag *d)
 {
-	struct stat buf;
-	struct dag_node *n;
 	struct dag_file *f;
+	char *name;
 	int error = 0;
+	int count = 0;
+	int i;
 
 	debug(D_MAKEFLOW_RUN, "checking rules for consistency...\n");
 
-	for(n = d->nodes; n; n = n->next) {
-		list_first_item(n->source_files);
-		while((f = list_next_item(n->source_files))) {
-			if(f->created_by) {
-				continue;
-			}
+	if(skip_file_check)
+		return 1;
 
-			if(skip_file_check || batch_fs_stat(remote_queue, f->filename, &buf) >= 0) {
-				continue;
-			}
+	/* Each input file is checked once, however many rules use it. */
+	int size = hash_table_size(d->files) + 1;
+	struct dag_file **files = xxmalloc(size * sizeof(*files));
+	const char **paths = xxmalloc(size * sizeof(*paths));
+	int *results = xxmalloc(size * sizeof(*results));
 
-			if(f->source) {
-				continue;
-			}
+	hash_table_firstkey(d->files);
+	while(hash_table_nextkey(d->files, &name, (void **) &f)) {
+		if(f->created_by || list_size(f->needed_by) == 0) {
+			continue;
+		}
+		files[count] = f;
+		paths[count] = f->filename;
+		count++;
+	}
+
+	batch_fs_stat_many(remote_queue, count, paths, 0, results, stat_procs);
 
-			fprintf(stderr, "makeflow: %s does not exist, and is not created by any rule.\n", f->filename);
-			error++;
+	for(i = 0; i < count; i++) {
+		f = files[i];
+
+		if(results[i] >= 0) {
+			continue;
+		}
+
+		if(f->source) {
+			continue;
 		}
+
+		fprintf(stderr, "makeflow: %s does not exist, and is not created by any rule.\n", f->filename);
+		error++;
 	}
 
+	free(files);
+	free(paths);
+	free(results);
+
 	if(error) {
 		fprintf(stderr, "makeflow: found %d errors during consistency check.\n", error);
 		return 0;
@@ -900,15 +927,53 @@ static int makeflow_check_batch_consistency(struct dag *d)
 	}
 }
 
+/*
+Collect every job that has finished in the given queue, waiting until
+stoptime for the first one, and then taking the rest without blocking.
+The log is flushed once for the whole batch, rather than once per event.
+Returns the number of jobs collected.
+*/
+
+static int makeflow_reap_jobs(struct dag *d, struct batch_queue *queue, struct itable *job_table, time_t stoptime)
+{
+	struct batch_job_info info;
+	batch_job_id_t jobid;
+	struct dag_node *n;
+	int count = 0;
+
+	makeflow_log_defer_sync(d, 1);
+
+	while((jobid = batch_job_wait_timeout(queue, &info, stoptime)) > 0) {
+		if(queue == remote_queue) {
+			printf("job %"PRIbjid" completed\n",jobid);
+		}
+		debug(D_MAKEFLOW_RUN, "Job %" PRIbjid " has returned.\n", jobid);
+		n = itable_remove(job_table, jobid);
+		if(n){
+			// Stop gap until batch_job_wait returns task struct
+			batch_task_set_info(n->task, &info);
+			makeflow_node_complete(d, n, queue, n->task);
+		}
+		count++;
+
+		if(itable_size(job_table) == 0)
+			break;
+
+		/* Only wait for the first job, then take those already done. */
+		stoptime = time(0);
+	}
+
+	makeflow_log_defer_sync(d, 0);
+
+	return count;
+}
+
 /*
 Main loop for running a makeflow: submit jobs, wait for completion, keep going until everything done.
 */
 
 static void makeflow_run( struct dag *d )
 {
-	struct dag_node *n;
-	batch_job_id_t jobid;
-	struct batch_job_info info;
 	// Start Catalog at current time
 	timestamp_t start = timestamp_get();
 	// Last Report is created stall for first reporting.
@@ -933,41 +998,24 @@ static void makeflow_run( struct dag *d )
 			(makeflow_hook_dag_loop(d) == MAKEFLOW_HOOK_END))
 			break;
 
+		int completed = 0;
+
 		if(dag_remote_jobs_running(d)) {
 			int tmp_timeout = 5;
-			jobid = batch_job_wait_timeout(remote_queue, &info, time(0) + tmp_timeout);
-			if(jobid > 0) {
-				printf("job %"PRIbjid" completed\n",jobid);
-				debug(D_MAKEFLOW_RUN, "Job %" PRIbjid " has returned.\n", jobid);
-				n = itable_remove(d->remote_job_table, jobid);
-				if(n){
-					// Stop gap until batch_job_wait returns task struct
-					batch_task_set_info(n->task, &info);
-					makeflow_node_complete(d, n, remote_queue, n->task);
-				}
-			}
+			completed += makeflow_reap_jobs(d, remote_queue, d->remote_job_table, time(0) + tmp_timeout);
 		}
 
 		if(dag_local_jobs_running(d)) {
 			time_t stoptime;
 			int tmp_timeout = 5;
 
-			if(dag_remote_jobs_running(d)) {
+			if(dag_remote_jobs_running(d) || completed) {
 				stoptime = time(0);
 			} else {
 				stoptime = time(0) + tmp_timeout;
 			}
 
-			jobid = batch_job_wait_timeout(local_queue, &info, stoptime);
-			if(jobid > 0) {
-				debug(D_MAKEFLOW_RUN, "Job %" PRIbjid " has returned.\n", jobid);
-				n = itable_remove(d->local_job_table, jobid);
-				if(n){
-					// Stop gap until batch_job_wait returns task struct
-					batch_task_set_info(n->task, &info);
-					makeflow_node_complete(d, n, local_queue, n->task);
-				}
-			}
+			completed += makeflow_reap_jobs(d, local_queue, d->local_job_table, stoptime);
 		}
 
 		/* Report to catalog */
@@ -981,8 +1029,8 @@ static void makeflow_run( struct dag *d )
 		/* Rather than try to garbage collect after each time in this
 		 * wait loop, perform garbage collection after a proportional
 		 * amount of tasks have passed. */
-		makeflow_gc_barrier--;
-		if(makeflow_gc_method != MAKEFLOW_GC_NONE && makeflow_gc_barrier == 0) {
+		makeflow_gc_barrier -= MAX(completed, 1);
+		if(makeflow_gc_method != MAKEFLOW_GC_NONE && makeflow_gc_barrier <= 0) {
 			makeflow_gc(d, remote_queue, makeflow_gc_method, makeflow_gc_size, makeflow_gc_count);
 			makeflow_gc_barrier = MAX(d->nodeid_counter * makeflow_gc_task_ratio, 1);
 		}
@@ -1043,9 +1091,11 @@ static void show_help_run(const char *cmd)
 	printf("    --jx-context=<file>         Deprecated. Equivalent to --jx-args.\n");
 	printf("    --jx-define=<VAR>=<EXPR>	Set the JX variable VAR to the JX expression EXPR.\n");
 	printf("    --log-verbose               Add node id symbol tags in the makeflow log.\n");
+	printf("    --dispatch-order=<order>    Order to submit ready jobs: fifo, critical-path, or critical-path-runtime. (default is fifo)\n");
 	printf(" -j,--max-local=<#>             Max number of local jobs to run at once.\n");
 	printf(" -J,--max-remote=<#>            Max number of remote jobs to run at once.\n");
 	printf(" -l,--makeflow-log=<logfile>    Use this file for the makeflow log.\n");
+	printf("    --snapshot-interval=<secs>  Snapshot the makeflow log every <secs> seconds. (default is 300, 0 disables)\n");
 	printf(" -R,--retry                     Retry failed batch jobs up to 5 times.\n");
 	printf(" -r,--retry-count=<n>           Retry failed batch jobs up to n times.\n");
 	printf("    --send-environment          Send all local environment variables in remote execution.\n");
@@ -1068,8 +1118,10 @@ static void show_help_run(const char *cmd)
 	printf(" -g,--gc=<type>                 Enable garbage collection. (ref_cnt|on_demand|all)\n");
 	printf("    --gc-size=<int>             Set disk size to trigger GC. (on_demand only)\n");
 	printf(" -G,--gc-count=<int>            Set number of files to trigger GC. (ref_cnt only)\n");
+	printf("    --memoize=<dir>             Skip rules whose results are cached in <dir>, and cache new results there.\n");
 	printf("    --mounts=<mountfile>        Use this file as a mountlist.\n");
 	printf("    --skip-file-check           Do not check for file existence before running.\n");
+	printf("    --stat-procs=<n>            Check for files at startup with up to <n> processes. (default is %d)\n", stat_procs);
 	printf("    --do-not-save-failed-output Disables moving output of failed nodes to directory.\n"); 
 	printf("    --shared-fs=<dir>           Assume that <dir> is in a shared filesystem.\n");
 	printf("    --storage-limit=<int>       Set storage limit for Makeflow (default is off)\n");
@@ -1184,6 +1236,7 @@ int main(int argc, char *argv[])
 	int safe_submit = 0;
 	int ignore_mem_spec = 0;
 	category_mode_t allocation_mode = CATEGORY_ALLOCATION_MODE_FIXED;
+	dag_dispatch_order_t dispatch_order = DAG_DISPATCH_FIFO;
 	char *mesos_master = "127.0.0.1:5050/";
 	char *mesos_path = NULL;
 	char *mesos_preload = NULL;
@@ -1195,6 +1248,7 @@ int main(int argc, char *argv[])
 	extern struct makeflow_hook makeflow_hook_docker;
 	extern struct makeflow_hook makeflow_hook_example;
 	extern struct makeflow_hook makeflow_hook_fail_dir;
+	extern struct makeflow_hook makeflow_hook_memoize;
 	/* Using fail directories is on by default */
 	int save_failure = 1;
 	extern struct makeflow_hook makeflow_hook_resource_monitor;
@@ -1257,6 +1311,7 @@ int main(int argc, char *argv[])
 		LONG_OPT_MONITOR_MEASURE_DIR,
 		LONG_OPT_MONITOR_OPENED_FILES,
 		LONG_OPT_MONITOR_TIME_SERIES,
+		LONG_OPT_MEMOIZE,
 		LONG_OPT_MOUNTS,
 		LONG_OPT_SAFE_SUBMIT,
 		LONG_OPT_SANDBOX,
@@ -1289,6 +1344,9 @@ int main(int argc, char *argv[])
 		LONG_OPT_JX_ARGS,
 		LONG_OPT_JX_DEFINE,
 		LONG_OPT_SKIP_FILE_CHECK,
+		LONG_OPT_DISPATCH_ORDER,
+		LONG_OPT_SNAPSHOT_INTERVAL,
+		LONG_OPT_STAT_PROCS,
 		LONG_OPT_UMBRELLA_BINARY,
 		LONG_OPT_UMBRELLA_LOG_PREFIX,
 		LONG_OPT_UMBRELLA_MODE,
@@ -1352,6 +1410,7 @@ int main(int argc, char *argv[])
 		{"monitor-measure-dir", no_argument, 0, LONG_OPT_MONITOR_MEASURE_DIR},
 		{"monitor-with-opened-files", no_argument, 0, LONG_OPT_MONITOR_OPENED_FILES},
 		{"monitor-with-time-series",  no_argument, 0, LONG_OPT_MONITOR_TIME_SERIES},
+		{"memoize", required_argument, 0, LONG_OPT_MEMOIZE},
 		{"mounts",  required_argument, 0, LONG_OPT_MOUNTS},
 		{"password", required_argument, 0, LONG_OPT_PASSWORD},
 		{"port", required_argument, 0, 'p'},
@@ -1380,6 +1439,9 @@ int main(int argc, char *argv[])
 		{"log-verbose", no_argument, 0, LONG_OPT_LOG_VERBOSE_MODE},
 		{"working-dir", required_argument, 0, LONG_OPT_WORKING_DIR},
 		{"skip-file-check", no_argument, 0, LONG_OPT_SKIP_FILE_CHECK},
+		{"snapshot-interval", required_argument, 0, LONG_OPT_SNAPSHOT_INTERVAL},
+		{"dispatch-order", required_argument, 0, LONG_OPT_DISPATCH_ORDER},
+		{"stat-procs", required_argument, 0, LONG_OPT_STAT_PROCS},
 		{"umbrella-binary", required_argument, 0, LONG_OPT_UMBRELLA_BINARY},
 		{"umbrella-log-prefix", required_argument, 0, LONG_OPT_UMBRELLA_LOG_PREFIX},
 		{"umbrella-mode", required_argument, 0, LONG_OPT_UMBRELLA_MODE},
@@ -1576,6 +1638,11 @@ int main(int argc, char *argv[])
 			case LONG_OPT_MOUNTS:
 				mountfile = xxstrdup(optarg);
 				break;
+			case LONG_OPT_MEMOIZE:
+				if (makeflow_hook_register(&makeflow_hook_memoize, &hook_args) == MAKEFLOW_HOOK_FAILURE)
+					goto EXIT_WITH_FAILURE;
+				jx_insert(hook_args, jx_string("memoize_dir"), jx_string(optarg));
+				break;
 			case LONG_OPT_AMAZON_CONFIG:
 				amazon_config = xxstrdup(optarg);
 				break;
@@ -1727,6 +1794,23 @@ int main(int argc, char *argv[])
 			case LONG_OPT_SKIP_FILE_CHECK:
 				skip_file_check = 1;
 				break;
+			case LONG_OPT_STAT_PROCS:
+				stat_procs = atoi(optarg);
+				break;
+			case LONG_OPT_SNAPSHOT_INTERVAL:
+				makeflow_log_set_snapshot_interval(atoi(optarg));
+				break;
+			case LONG_OPT_DISPATCH_ORDER:
+				if(!strcmp(optarg, "fifo")) {
+					dispatch_order = DAG_DISPATCH_FIFO;
+				} else if(!strcmp(optarg, "critical-path")) {
+					dispatch_order = DAG_DISPATCH_CRITICAL_PATH;
+				} else if(!strcmp(optarg, "critical-path-runtime")) {
+					dispatch_order = DAG_DISPATCH_CRITICAL_PATH_RUNTIME;
+				} else {
+					fatal("Dispatch order '%s' is not valid. Use one of: fifo critical-path critical-path-runtime", optarg);
+				}
+				break;
 			case LONG_OPT_DOCKER_TAR:
 				if (makeflow_hook_register(&makeflow_hook_docker, &hook_args) == MAKEFLOW_HOOK_FAILURE)
 					goto EXIT_WITH_FAILURE;
@@ -1999,6 +2083,7 @@ int main(int argc, char *argv[])
 	}
 
 	d->allocation_mode = allocation_mode;
+	d->dispatch_order = dispatch_order;
 
 	/* Measure resources available for local job execution. */
 	local_resources = rmsummary_create(-1);
@@ -2236,7 +2321,7 @@ int main(int argc, char *argv[])
 	/* In case when the user uses --cache option to specify the mount cache dir and the log file also has
 	 * a cache dir logged, these two dirs must be the same. Otherwise exit.
 	 */
-	if(makeflow_log_recover(d, logfilename, log_verbose_mode, remote_queue, clean_mode, skip_file_check )) {
+	if(makeflow_log_recover(d, logfilename, log_verbose_mode, remote_queue, clean_mode, skip_file_check, stat_procs )) {
 		goto EXIT_WITH_FAILURE;
 	}
 
@@ -2279,6 +2364,7 @@ int main(int argc, char *argv[])
 
 		if(clean_mode == MAKEFLOW_CLEAN_ALL) {
 			unlink(logfilename);
+			makeflow_log_snapshot_discard();
 		}
 
 		goto EXIT_WITH_SUCCESS;
@@ -2305,6 +2391,8 @@ int main(int argc, char *argv[])
 
 	runtime = timestamp_get();
 
+	dag_ready_init(d);
+
 	makeflow_run(d);
 
 	if(makeflow_failed_flag == 0 && makeflow_nodes_local_waiting_count(d) > 0) {
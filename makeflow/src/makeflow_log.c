@@ -8,14 +8,19 @@ See the file COPYING for details.
 #include "makeflow_log.h"
 #include "makeflow_gc.h"
 #include "dag.h"
-#include "get_line.h"
 #include "makeflow_mounts.h"
 
 #include "timestamp.h"
 #include "list.h"
 #include "debug.h"
 #include "xxmalloc.h"
+#include "macros.h"
+#include "sha1.h"
+#include "stringtools.h"
 
+#include <sys/stat.h>
+#include <ctype.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -23,8 +28,6 @@ See the file COPYING for details.
 #include <string.h>
 #include <errno.h>
 
-#define MAX_BUFFER_SIZE 4096
-
 /*
 The makeflow log file records every essential event in the execution of a workflow,
 so that after a failure, the workflow can either be continued or aborted cleanly,
@@ -107,15 +110,87 @@ These event types indicate that the workflow as a whole has started or completed
 
 void makeflow_node_decide_rerun(struct itable *rerun_table, struct dag *d, struct dag_node *n, int silent );
 
+/*
+Replaying the whole log on every restart takes time in proportion to the age
+of the workflow, not its size.  So, every few minutes (and when the log is closed)
+the recovered state is also written to a binary snapshot beside the log:
+
+Header: magic, version, dag_hash, tail_length, log_offset, log_tail,
+        completed_files, deleted_files, node_count, file_count
+Then node_count node records: nodeid, state, jobid, previous_completion
+Then file_count file records: name_length, state, creation_logged, name
+
+log_offset is the length of the log when the snapshot was taken, so
+the snapshot holds exactly the state obtained by replaying the log up to
+that offset.  Upon recovery, the snapshot is used only if the sha1 of the
+dag (dag_hash) still matches, and the log still ends its first log_offset
+bytes with log_tail.  Then, only the records after log_offset are replayed.
+Otherwise, the snapshot is ignored and the log is replayed from the start.
+
+The snapshot is written in host byte order, and is replaced atomically by
+writing to a temporary file and renaming it.  The fields are arranged so
+that the records contain no padding.
+*/
+
+#define MAKEFLOW_SNAPSHOT_MAGIC 0x4d46534e
+#define MAKEFLOW_SNAPSHOT_VERSION 1
+#define MAKEFLOW_SNAPSHOT_TAIL 64
+
+struct makeflow_snapshot_header {
+	uint32_t magic;
+	uint32_t version;
+	unsigned char dag_hash[SHA1_DIGEST_LENGTH];
+	uint32_t tail_length;
+	uint64_t log_offset;
+	char log_tail[MAKEFLOW_SNAPSHOT_TAIL];
+	int64_t completed_files;
+	int64_t deleted_files;
+	uint64_t node_count;
+	uint64_t file_count;
+};
+
+struct makeflow_snapshot_node {
+	int32_t nodeid;
+	int32_t state;
+	int64_t jobid;
+	int64_t previous_completion;
+};
+
+struct makeflow_snapshot_file {
+	uint32_t name_length;
+	int32_t state;
+	int64_t creation_logged;
+};
+
+static char *makeflow_snapshot_filename = 0;
+static int makeflow_snapshot_interval = 300;
+static time_t makeflow_snapshot_last = 0;
+static unsigned char makeflow_snapshot_dag_hash[SHA1_DIGEST_LENGTH];
+
+/*
+The file counts of the dag may also be changed outside of the log,
+so the snapshot records only the part of them that comes from the log.
+*/
+
+static int makeflow_log_completed_files = 0;
+static int makeflow_log_deleted_files = 0;
+
+static void makeflow_log_snapshot_write( struct dag *d );
+
 /*
 To balance between performance and consistency, we sync the log every 60 seconds
 on ordinary events, but sync immediately on important events like a makeflow restart.
 */
 
+static int makeflow_log_deferred = 0;
+
 static void makeflow_log_sync( struct dag *d, int force )
 {
 	static time_t last_fsync = 0;
 
+	if(makeflow_log_deferred && !force)
+		return;
+
 	/* Force buffered data to the kernel. */
 	fflush(d->logfile);
 
@@ -123,15 +198,29 @@ static void makeflow_log_sync( struct dag *d, int force )
 	if(force || (time(NULL)-last_fsync) > 60) {
 		fsync(fileno(d->logfile));
 		last_fsync = time(NULL);
+
+		/* The snapshot must only refer to data that is already on disk. */
+		if(makeflow_snapshot_interval > 0 && (last_fsync - makeflow_snapshot_last) >= makeflow_snapshot_interval) {
+			makeflow_log_snapshot_write(d);
+		}
 	}
 }
 
+void makeflow_log_defer_sync( struct dag *d, int defer )
+{
+	makeflow_log_deferred = defer;
+	if(!defer && d->logfile)
+		makeflow_log_sync(d,0);
+}
+
 void makeflow_log_close( struct dag *d )
 {
 	/* In the case where Makeflow exits prior to creating the DAG or opening log. */
 	if(!d || !d->logfile) return;
 
 	makeflow_log_sync(d,1);
+	if(makeflow_snapshot_interval > 0)
+		makeflow_log_snapshot_write(d);
 	fclose(d->logfile);
 	d->logfile = 0;
 }
@@ -195,7 +284,13 @@ void makeflow_log_state_change( struct dag *d, struct dag_node *n, int newstate
 	n->state = newstate;
 	d->node_states[n->state]++;
 
-	fprintf(d->logfile, "%" PRIu64 " %d %d %" PRIbjid " %d %d %d %d %d %d\n", timestamp_get(), n->nodeid, newstate, n->jobid, d->node_states[0], d->node_states[1], d->node_states[2], d->node_states[3], d->node_states[4], d->nodeid_counter);
+	dag_ready_node_change(d, n);
+
+	/* Keep previous_completion as it would be recovered from this record. */
+	timestamp_t time = timestamp_get();
+	n->previous_completion = (time_t) (time / 1000000);
+
+	fprintf(d->logfile, "%" PRIu64 " %d %d %" PRIbjid " %d %d %d %d %d %d\n", time, n->nodeid, newstate, n->jobid, d->node_states[0], d->node_states[1], d->node_states[2], d->node_states[3], d->node_states[4], d->nodeid_counter);
 
 	makeflow_log_sync(d,0);
 }
@@ -204,7 +299,9 @@ void makeflow_log_file_state_change( struct dag *d, struct dag_file *f, int news
 {
 	debug(D_MAKEFLOW_RUN, "file %s %s -> %s\n", f->filename, dag_file_state_name(f->state), dag_file_state_name(newstate));
 
+	int existed = dag_file_should_exist(f);
 	f->state = newstate;
+	dag_ready_file_change(d, f, existed);
 
 	/* If a file is a wrapper global file do not log to avoid cleaning floating global files. */
 	if(f->type == DAG_FILE_TYPE_GLOBAL) return;
@@ -213,9 +310,11 @@ void makeflow_log_file_state_change( struct dag *d, struct dag_file *f, int news
 	fprintf(d->logfile, "# FILE %" PRIu64 " %s %d %" PRIu64 "\n", time, f->filename, f->state, dag_file_size(f));
 	if(f->state == DAG_FILE_STATE_EXISTS){
 		d->completed_files += 1;
+		makeflow_log_completed_files += 1;
 		f->creation_logged = (time_t) (time / 1000000);
 	} else if(f->state == DAG_FILE_STATE_DELETE) {
 		d->deleted_files += 1;
+		makeflow_log_deleted_files += 1;
 	}
 	makeflow_log_sync(d,0);
 }
@@ -262,104 +361,441 @@ void makeflow_log_gc_event( struct dag *d, int collected, timestamp_t elapsed, i
 	makeflow_log_sync(d,0);
 }
 
+/*
+Parse the fields of a file state record, after the leading "# FILE ".
+Returns true if all of the fields are present.
+*/
+
+static int makeflow_log_parse_file( char *line, uint64_t *time, char **file, int *state )
+{
+	char *end;
+
+	*time = strtoull(line, &end, 10);
+	if(end == line || !isspace((int) *end))
+		return 0;
+
+	line = end;
+	while(isspace((int) *line))
+		line++;
+	if(!*line)
+		return 0;
+
+	*file = line;
+	while(*line && !isspace((int) *line))
+		line++;
+	if(!*line)
+		return 0;
+	*line++ = 0;
+
+	*state = strtol(line, &end, 10);
+	if(end == line)
+		return 0;
+
+	/* The size of the file follows, but is not needed to recover. */
+	line = end;
+	strtoull(line, &end, 10);
+	return end != line;
+}
+
+/*
+Parse the fields of a node state record, which begins with a timestamp.
+Returns true if the leading timestamp, nodeid, state, and jobid are present.
+*/
+
+static int makeflow_log_parse_node( char *line, uint64_t *time, int *nodeid, int *state, int *jobid )
+{
+	char *end;
+
+	*time = strtoull(line, &end, 10);
+	if(end == line)
+		return 0;
+	line = end;
+
+	*nodeid = strtol(line, &end, 10);
+	if(end == line)
+		return 0;
+	line = end;
+
+	*state = strtol(line, &end, 10);
+	if(end == line)
+		return 0;
+	line = end;
+
+	*jobid = strtol(line, &end, 10);
+	return end != line;
+}
+
+/*
+Compute the hash that identifies the dag of a snapshot, from the
+command and the names of the files of each rule, after expansion.
+*/
+
+static void makeflow_log_dag_hash( struct dag *d, unsigned char digest[SHA1_DIGEST_LENGTH] )
+{
+	sha1_context_t context;
+	struct dag_node *n;
+	struct dag_file *f;
+	char nodeid[32];
+
+	sha1_init(&context);
+	for(n = d->nodes; n; n = n->next) {
+		snprintf(nodeid, sizeof(nodeid), "%d", n->nodeid);
+		sha1_update(&context, nodeid, strlen(nodeid) + 1);
+		sha1_update(&context, n->command, strlen(n->command) + 1);
+
+		list_first_item(n->source_files);
+		while((f = list_next_item(n->source_files)))
+			sha1_update(&context, f->filename, strlen(f->filename) + 1);
+		sha1_update(&context, "<", 1);
+
+		list_first_item(n->target_files);
+		while((f = list_next_item(n->target_files)))
+			sha1_update(&context, f->filename, strlen(f->filename) + 1);
+		sha1_update(&context, ">", 1);
+	}
+	sha1_final(digest, &context);
+}
+
+/*
+Write a snapshot of the state recovered so far, which must
+correspond to the whole log as it is now on disk.  Mount records
+are not part of the snapshot, so no snapshot is taken of a workflow
+using a mount cache.
+*/
+
+static void makeflow_log_snapshot_write( struct dag *d )
+{
+	struct makeflow_snapshot_header header;
+	struct makeflow_snapshot_node node;
+	struct makeflow_snapshot_file file;
+	struct dag_node *n;
+	struct dag_file *f;
+	struct stat info;
+	char *name;
+
+	makeflow_snapshot_last = time(0);
+
+	if(!makeflow_snapshot_filename || d->cache_dir)
+		return;
+
+	fflush(d->logfile);
+	if(fstat(fileno(d->logfile), &info) < 0) {
+		debug(D_MAKEFLOW_RUN, "couldn't write snapshot %s: %s", makeflow_snapshot_filename, strerror(errno));
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = MAKEFLOW_SNAPSHOT_MAGIC;
+	header.version = MAKEFLOW_SNAPSHOT_VERSION;
+	memcpy(header.dag_hash, makeflow_snapshot_dag_hash, SHA1_DIGEST_LENGTH);
+	header.log_offset = info.st_size;
+	header.tail_length = MIN((uint64_t) MAKEFLOW_SNAPSHOT_TAIL, header.log_offset);
+	if(pread(fileno(d->logfile), header.log_tail, header.tail_length, header.log_offset - header.tail_length) != (ssize_t) header.tail_length) {
+		debug(D_MAKEFLOW_RUN, "couldn't write snapshot %s: %s", makeflow_snapshot_filename, strerror(errno));
+		return;
+	}
+	header.completed_files = makeflow_log_completed_files;
+	header.deleted_files = makeflow_log_deleted_files;
+
+	for(n = d->nodes; n; n = n->next)
+		header.node_count++;
+
+	hash_table_firstkey(d->files);
+	while(hash_table_nextkey(d->files, &name, (void **) &f)) {
+		if(f->type != DAG_FILE_TYPE_GLOBAL)
+			header.file_count++;
+	}
+
+	char *tmpname = string_format("%s.tmp", makeflow_snapshot_filename);
+	FILE *stream = fopen(tmpname, "w");
+	if(!stream) {
+		debug(D_MAKEFLOW_RUN, "couldn't write snapshot %s: %s", tmpname, strerror(errno));
+		free(tmpname);
+		return;
+	}
+
+	fwrite(&header, sizeof(header), 1, stream);
+
+	for(n = d->nodes; n; n = n->next) {
+		node.nodeid = n->nodeid;
+		node.state = n->state;
+		node.jobid = n->jobid;
+		node.previous_completion = n->previous_completion;
+		fwrite(&node, sizeof(node), 1, stream);
+	}
+
+	hash_table_firstkey(d->files);
+	while(hash_table_nextkey(d->files, &name, (void **) &f)) {
+		if(f->type == DAG_FILE_TYPE_GLOBAL)
+			continue;
+		file.name_length = strlen(f->filename);
+		file.state = f->state;
+		file.creation_logged = f->creation_logged;
+		fwrite(&file, sizeof(file), 1, stream);
+		fwrite(f->filename, file.name_length, 1, stream);
+	}
+
+	int ok = !ferror(stream);
+	ok = (fflush(stream) == 0) && ok;
+	ok = (fsync(fileno(stream)) == 0) && ok;
+	ok = (fclose(stream) == 0) && ok;
+
+	if(ok && rename(tmpname, makeflow_snapshot_filename) == 0) {
+		debug(D_MAKEFLOW_RUN, "wrote snapshot %s at log offset %" PRIu64, makeflow_snapshot_filename, header.log_offset);
+	} else {
+		debug(D_MAKEFLOW_RUN, "couldn't write snapshot %s: %s", makeflow_snapshot_filename, strerror(errno));
+		unlink(tmpname);
+	}
+
+	free(tmpname);
+}
+
+/*
+Load the snapshot of the log, if it is valid for this dag and log.
+The snapshot is read and checked in full before any state is changed.
+Returns the offset of the log at which replay should continue,
+or zero if the snapshot cannot be used.
+*/
+
+static uint64_t makeflow_log_snapshot_load( struct dag *d )
+{
+	struct makeflow_snapshot_header header;
+	struct makeflow_snapshot_node *nodes = 0;
+	char *files = 0;
+	char tail[MAKEFLOW_SNAPSHOT_TAIL];
+	struct stat info;
+	uint64_t offset = 0;
+	uint64_t i;
+	size_t files_size;
+
+	FILE *stream = fopen(makeflow_snapshot_filename, "r");
+	if(!stream)
+		return 0;
+
+	if(fstat(fileno(d->logfile), &info) < 0)
+		goto out;
+
+	if(fread(&header, sizeof(header), 1, stream) != 1
+		|| header.magic != MAKEFLOW_SNAPSHOT_MAGIC
+		|| header.version != MAKEFLOW_SNAPSHOT_VERSION
+		|| memcmp(header.dag_hash, makeflow_snapshot_dag_hash, SHA1_DIGEST_LENGTH)
+		|| header.tail_length > MAKEFLOW_SNAPSHOT_TAIL
+		|| header.tail_length > header.log_offset
+		|| header.log_offset > (uint64_t) info.st_size) {
+		debug(D_MAKEFLOW_RUN, "snapshot %s does not match this workflow", makeflow_snapshot_filename);
+		goto out;
+	}
+
+	if(pread(fileno(d->logfile), tail, header.tail_length, header.log_offset - header.tail_length) != (ssize_t) header.tail_length
+		|| memcmp(tail, header.log_tail, header.tail_length)) {
+		debug(D_MAKEFLOW_RUN, "snapshot %s does not match log", makeflow_snapshot_filename);
+		goto out;
+	}
+
+	if(fstat(fileno(stream), &info) < 0 || header.node_count > (uint64_t) info.st_size / sizeof(*nodes))
+		goto out;
+
+	nodes = xxmalloc(header.node_count * sizeof(*nodes) + 1);
+	if(fread(nodes, sizeof(*nodes), header.node_count, stream) != header.node_count)
+		goto out;
+
+	for(i = 0; i < header.node_count; i++) {
+		if(!itable_lookup(d->node_table, nodes[i].nodeid))
+			goto out;
+	}
+
+	files_size = info.st_size - sizeof(header) - header.node_count * sizeof(*nodes);
+	files = xxmalloc(files_size + 1);
+	if(fread(files, 1, files_size, stream) != files_size)
+		goto out;
+
+	/* Check that the file records exactly fill the rest of the snapshot. */
+	size_t pos = 0;
+	for(i = 0; i < header.file_count; i++) {
+		struct makeflow_snapshot_file *file = (struct makeflow_snapshot_file *) (files + pos);
+		if(files_size - pos < sizeof(*file) || files_size - pos - sizeof(*file) < file->name_length)
+			goto out;
+		pos += sizeof(*file) + file->name_length;
+	}
+	if(pos != files_size)
+		goto out;
+
+	/* The snapshot is complete, so now apply it. */
+
+	for(i = 0; i < header.node_count; i++) {
+		struct dag_node *n = itable_lookup(d->node_table, nodes[i].nodeid);
+		n->state = nodes[i].state;
+		n->jobid = nodes[i].jobid;
+		n->previous_completion = nodes[i].previous_completion;
+	}
+
+	pos = 0;
+	for(i = 0; i < header.file_count; i++) {
+		struct makeflow_snapshot_file file;
+		memcpy(&file, files + pos, sizeof(file));
+		pos += sizeof(file);
+
+		char *name = xxmalloc(file.name_length + 1);
+		memcpy(name, files + pos, file.name_length);
+		name[file.name_length] = 0;
+		pos += file.name_length;
+
+		struct dag_file *f = dag_file_lookup_or_create(d, name);
+		f->state = file.state;
+		f->creation_logged = file.creation_logged;
+		free(name);
+	}
+
+	d->completed_files += header.completed_files;
+	d->deleted_files += header.deleted_files;
+	makeflow_log_completed_files = header.completed_files;
+	makeflow_log_deleted_files = header.deleted_files;
+
+	offset = header.log_offset;
+
+out:
+	free(nodes);
+	free(files);
+	fclose(stream);
+	return offset;
+}
+
+void makeflow_log_set_snapshot_interval( int interval )
+{
+	makeflow_snapshot_interval = interval;
+}
+
+void makeflow_log_snapshot_discard()
+{
+	if(makeflow_snapshot_filename)
+		unlink(makeflow_snapshot_filename);
+	makeflow_snapshot_interval = 0;
+}
+
 /** The clean_mode variable was added so that we could better print out error messages
  * apply in the situation. Currently only used to silence node rerun checking.
  */
-int makeflow_log_recover(struct dag *d, const char *filename, int verbose_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode, int skip_file_check)
+int makeflow_log_recover(struct dag *d, const char *filename, int verbose_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode, int skip_file_check, int stat_procs)
 {
-	char *line, *name, file[MAX_BUFFER_SIZE];
+	char *line = 0, *name, *file;
+	size_t line_size = 0;
 	int nodeid, state, jobid, file_state;
 	int first_run = 1;
 	struct dag_node *n;
 	struct dag_file *f;
-	struct stat buf;
 	timestamp_t previous_completion_time;
-	uint64_t size;
+
+	makeflow_snapshot_filename = string_format("%s.snapshot", filename);
+	makeflow_log_dag_hash(d, makeflow_snapshot_dag_hash);
+	makeflow_snapshot_last = time(0);
 
 	d->logfile = fopen(filename, "r");
 	if(d->logfile) {
 		int linenum = 0;
 		first_run = 0;
 
-		printf("recovering from log file %s...\n",filename);
+		uint64_t offset = makeflow_log_snapshot_load(d);
+		if(offset > 0) {
+			printf("recovering from snapshot %s and log file %s...\n", makeflow_snapshot_filename, filename);
+			if(fseeko(d->logfile, offset, SEEK_SET) < 0) {
+				fprintf(stderr, "makeflow: couldn't seek in logfile %s: %s\n", filename, strerror(errno));
+				exit(1);
+			}
+		} else {
+			printf("recovering from log file %s...\n",filename);
+		}
+
+		/*
+		The log is read in a single pass, looking at the first characters
+		of each record to decide how to parse it.  Node and file records,
+		which make up nearly all of a long log, are parsed in place.
+		*/
 
-		while((line = get_line(d->logfile))) {
-			char source[PATH_MAX], cache_dir[NAME_MAX], cache_name[NAME_MAX];
+		while(getline(&line, &line_size, d->logfile) >= 0) {
+			char source[PATH_MAX], cache_dir[NAME_MAX], cache_name[NAME_MAX], mount_file[PATH_MAX];
 			int type;
 			linenum++;
 
-			if(sscanf(line, "# FILE %" SCNu64 " %s %d %" SCNu64 "", &previous_completion_time, file, &file_state, &size) == 4) {
-				f = dag_file_lookup_or_create(d, file);
-				f->state = file_state;
-				if(file_state == DAG_FILE_STATE_EXISTS){
-					d->completed_files += 1;
-					f->creation_logged = (time_t) (previous_completion_time / 1000000);
-				} else if(file_state == DAG_FILE_STATE_DELETE){
-					d->deleted_files += 1;
-				}
-				free(line);
-				continue;
-			}
-			if(sscanf(line, "# CACHE %" SCNu64 " %s", &previous_completion_time, cache_dir) == 2) {
-				/* if the user specifies a cache dir using --cache dir, ignore the info from the log file */
-				if(!d->cache_dir) {
-					d->cache_dir = xxstrdup(cache_dir);
-				} else {
-					/* There are two possible reasons for the inconsistency:
-					 * 1) the cache dir specified via the --cache opt and in the log file mismatch;
-					 * 2) the log file includes multiple different CACHE entries.
-					 */
-					if(strcmp(cache_dir, d->cache_dir)) {
-						fprintf(stderr, "The --cache option (%s) does not match the cache dir (%s) in the log file!\n", d->cache_dir, cache_dir);
-						free(line);
-						return -1;
+			if(line[0] == '#') {
+				if(!strncmp(line, "# FILE ", 7)) {
+					if(makeflow_log_parse_file(line + 7, &previous_completion_time, &file, &file_state)) {
+						f = dag_file_lookup_or_create(d, file);
+						f->state = file_state;
+						if(file_state == DAG_FILE_STATE_EXISTS){
+							d->completed_files += 1;
+							makeflow_log_completed_files += 1;
+							f->creation_logged = (time_t) (previous_completion_time / 1000000);
+						} else if(file_state == DAG_FILE_STATE_DELETE){
+							d->deleted_files += 1;
+							makeflow_log_deleted_files += 1;
+						}
 					}
-				}
-				free(line);
-				continue;
-			}
-			if(sscanf(line, "# MOUNT %" SCNu64 " %s %s %s %d", &previous_completion_time, file, source, cache_name, &type) == 5) {
-				f = dag_file_lookup_or_create(d, file);
-
-				if(!f->source) {
-					f->source = xxstrdup(source);
-					f->cache_name = xxstrdup(cache_name);
-					f->type = type;
-				} else {
-					/* If a mount entry is specified in the mountfile and logged in a log file at the same time, they must not conflict with each other. */
-					/* If a mount entry is logged in a log file multiple times deliberately or not, they must not conflict with each other. */
-					if(makeflow_mount_check_consistency(file, f->source, source, d->cache_dir, cache_name)) {
-						free(line);
-						return -1;
+				} else if(!strncmp(line, "# CACHE ", 8)) {
+					if(sscanf(line, "# CACHE %" SCNu64 " %s", &previous_completion_time, cache_dir) == 2) {
+						/* if the user specifies a cache dir using --cache dir, ignore the info from the log file */
+						if(!d->cache_dir) {
+							d->cache_dir = xxstrdup(cache_dir);
+						} else {
+							/* There are two possible reasons for the inconsistency:
+							 * 1) the cache dir specified via the --cache opt and in the log file mismatch;
+							 * 2) the log file includes multiple different CACHE entries.
+							 */
+							if(strcmp(cache_dir, d->cache_dir)) {
+								fprintf(stderr, "The --cache option (%s) does not match the cache dir (%s) in the log file!\n", d->cache_dir, cache_dir);
+								free(line);
+								return -1;
+							}
+						}
+					}
+				} else if(!strncmp(line, "# MOUNT ", 8)) {
+					if(sscanf(line, "# MOUNT %" SCNu64 " %s %s %s %d", &previous_completion_time, mount_file, source, cache_name, &type) == 5) {
+						f = dag_file_lookup_or_create(d, mount_file);
+
+						if(!f->source) {
+							f->source = xxstrdup(source);
+							f->cache_name = xxstrdup(cache_name);
+							f->type = type;
+						} else {
+							/* If a mount entry is specified in the mountfile and logged in a log file at the same time, they must not conflict with each other. */
+							/* If a mount entry is logged in a log file multiple times deliberately or not, they must not conflict with each other. */
+							if(makeflow_mount_check_consistency(mount_file, f->source, source, d->cache_dir, cache_name)) {
+								free(line);
+								return -1;
+							}
+						}
 					}
 				}
-				free(line);
-				continue;
-			}
-			if(line[0] == '#') {
-				free(line);
 				continue;
 			}
-			if(sscanf(line, "%" SCNu64 " %d %d %d", &previous_completion_time, &nodeid, &state, &jobid) == 4) {
+
+			if(makeflow_log_parse_node(line, &previous_completion_time, &nodeid, &state, &jobid)) {
 				n = itable_lookup(d->node_table, nodeid);
 				if(n) {
 					n->state = state;
 					n->jobid = jobid;
 					/* Log timestamp is in microseconds, we need seconds for diff. */
 					n->previous_completion = (time_t) (previous_completion_time / 1000000);
-					free(line);
 					continue;
 				}
 			}
 
-			fprintf(stderr, "makeflow: %s appears to be corrupted on line %d\n", filename, linenum);
+			if(offset > 0) {
+				fprintf(stderr, "makeflow: %s appears to be corrupted on line %d after offset %" PRIu64 "\n", filename, linenum, offset);
+			} else {
+				fprintf(stderr, "makeflow: %s appears to be corrupted on line %d\n", filename, linenum);
+			}
 			free(line);
 			exit(1);
 		}
+		free(line);
 		fclose(d->logfile);
+	} else {
+		/* A snapshot left without its log describes some other run. */
+		unlink(makeflow_snapshot_filename);
 	}
 
-	d->logfile = fopen(filename, "a");
+	/* The log is also read back when a snapshot is taken. */
+	d->logfile = fopen(filename, "a+");
 	if(!d->logfile) {
 		fprintf(stderr, "makeflow: couldn't open logfile %s: %s\n", filename, strerror(errno));
 		exit(1);
@@ -416,21 +852,45 @@ int makeflow_log_recover(struct dag *d, const char *filename, int verbose_mode,
 
 	// Check for log consistency
 	if(!first_run && !skip_file_check) {
+		int size = hash_table_size(d->files) + 1;
+		struct dag_file **files = xxmalloc(size * sizeof(*files));
+		const char **paths = xxmalloc(size * sizeof(*paths));
+		struct stat *bufs = xxmalloc(size * sizeof(*bufs));
+		int *results = xxmalloc(size * sizeof(*results));
+		int count = 0;
+		int i;
+
 		hash_table_firstkey(d->files);
 		while(hash_table_nextkey(d->files, &name, (void **) &f)) {
-			if(dag_file_should_exist(f) && !dag_file_is_source(f) && !(batch_fs_stat(queue, f->filename, &buf) >= 0)){
+			if(dag_file_should_exist(f) && !dag_file_is_source(f)) {
+				files[count] = f;
+				paths[count] = f->filename;
+				count++;
+			}
+		}
+
+		batch_fs_stat_many(queue, count, paths, bufs, results, stat_procs);
+
+		for(i = 0; i < count; i++) {
+			f = files[i];
+			if(results[i] < 0) {
 				fprintf(stderr, "makeflow: %s is reported as existing, but does not exist.\n", f->filename);
 				makeflow_log_file_state_change(d, f, DAG_FILE_STATE_UNKNOWN);
 				continue;
 			}
-			if(S_ISDIR(buf.st_mode))
+			if(S_ISDIR(bufs[i].st_mode))
 				continue;
-			if(dag_file_should_exist(f) && !dag_file_is_source(f) && difftime(buf.st_mtime, f->creation_logged) > 0) {
-				fprintf(stderr, "makeflow: %s is reported as existing, but has been modified (%" SCNu64 " ,%" SCNu64 ").\n", f->filename, (uint64_t)buf.st_mtime, (uint64_t)f->creation_logged);
+			if(difftime(bufs[i].st_mtime, f->creation_logged) > 0) {
+				fprintf(stderr, "makeflow: %s is reported as existing, but has been modified (%" SCNu64 " ,%" SCNu64 ").\n", f->filename, (uint64_t)bufs[i].st_mtime, (uint64_t)f->creation_logged);
 				makeflow_clean_file(d, queue, f);
 				makeflow_log_file_state_change(d, f, DAG_FILE_STATE_UNKNOWN);
 			}
 		}
+
+		free(files);
+		free(paths);
+		free(bufs);
+		free(results);
 	}
 
 	int silent = 0;
@@ -35,8 +35,27 @@ void makeflow_log_alloc_event( struct dag *d, struct makeflow_alloc *alloc );
 void makeflow_log_gc_event( struct dag *d, int collected, timestamp_t elapsed, int total_collected );
 void makeflow_log_close(struct dag *d );
 
-/* return 0 on success, return non-zero on failure. */
-int makeflow_log_recover( struct dag *d, const char *filename, int verbose_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode, int skip_file_check );
+/*
+While defer is set, events are left in the stdio buffer instead of being
+flushed one at a time, so that a batch of events costs a single write.
+Clearing defer flushes the events written in the meantime.
+*/
+void makeflow_log_defer_sync( struct dag *d, int defer );
+
+/* return 0 on success, return non-zero on failure.
+ * Files are checked against the log with up to stat_procs processes. (see batch_fs_stat_many) */
+int makeflow_log_recover( struct dag *d, const char *filename, int verbose_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode, int skip_file_check, int stat_procs );
+
+/*
+Every interval seconds, and when the log is closed, a binary snapshot of
+the state of the workflow is written beside the log, so that recovery need
+only replay the part of the log written after the snapshot.  This must be
+called before makeflow_log_recover.  An interval of zero disables snapshots.
+*/
+void makeflow_log_set_snapshot_interval( int interval );
+
+/* Remove the snapshot of the log, and take no more snapshots. */
+void makeflow_log_snapshot_discard();
 
 /* write the info of a dependency specified in the mountfile into the logging system
  * @param d: a dag structure
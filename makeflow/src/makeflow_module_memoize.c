@@ -0,0 +1,885 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+The memoize module skips any rule whose results are already in a cache directory.
+
+A rule is identified by a key: the sha1 of the command it runs, its
+environment, the contents of its inputs, and the names of its outputs.
+After a rule succeeds, its outputs are stored in the cache by content,
+along with a record from the key to those outputs.  Before a rule is
+submitted, its key is computed again, and if a record is found, the
+outputs are put back in place and the rule is not run.
+
+Because the key depends only on what the rule would do, the cache is
+not tied to one workflow: an unchanged rule in an edited workflow is
+still found, and so is a rule run by another makeflow sharing the
+same directory, possibly from another machine.
+
+The cache directory is laid out as:
+	dir/objects/ab/ab01...   output files, named by the sha1 of their contents
+	dir/tasks/cd/cd23...     one JX record per key, naming the objects of each output
+
+Objects are placed into and out of the cache as copy-on-write clones
+where the filesystem supports them, and copied otherwise.  They are
+never hard linked: a link would share one inode, and so one mode and
+one set of contents, between the cache and the workflow, which may
+later write its outputs in place.  Objects are read only, while the
+files restored from them are writable like any other output.
+
+Hashing the contents of every input would make each run as slow as
+reading all of its data, so the sha1 of each file is remembered in
+DAGFILE.makeflowhashes together with its device, inode, size and
+modification time, and is only computed again when one of these
+changes.  At startup, the source files of the workflow are checked
+and hashed by several processes at once.
+*/
+
+#include "makeflow_hook.h"
+
+#include "batch_task.h"
+#include "batch_file.h"
+#include "copy_stream.h"
+#include "create_dir.h"
+#include "debug.h"
+#include "hash_table.h"
+#include "itable.h"
+#include "jx.h"
+#include "jx_parse.h"
+#include "jx_print.h"
+#include "list.h"
+#include "sha1.h"
+#include "stringtools.h"
+#include "timestamp.h"
+#include "xxmalloc.h"
+
+#include "dag.h"
+#include "dag_file.h"
+#include "dag_node.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#ifdef CCTOOLS_OPSYS_LINUX
+#include <linux/fs.h>
+#endif
+
+#define MEMOIZE_HASH_SUFFIX ".makeflowhashes"
+
+/* Below this number of source files, forking costs more than it saves. */
+#define MEMOIZE_PARALLEL_MIN 64
+#define MEMOIZE_PARALLEL_MAX 16
+
+#define MEMOIZE_ID_LENGTH (SHA1_DIGEST_LENGTH * 2)
+
+struct memoize_hash {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	long mtime_nsec;
+	char id[MEMOIZE_ID_LENGTH + 1];
+};
+
+struct memoize_instance {
+	char *dir;
+	char *hash_filename;
+	struct hash_table *hashes;  /* Maps a file name to the last struct memoize_hash seen. */
+	int hashes_changed;
+	struct itable *task_keys;   /* Maps the id of a task not found in the cache to its key. */
+	struct batch_task *restored_task;
+	int found_restored_job;
+	int hits;
+	int misses;
+	int stored;
+};
+
+static long memoize_mtime_nsec(struct stat *buf)
+{
+#if defined(CCTOOLS_OPSYS_DARWIN)
+	return buf->st_mtimespec.tv_nsec;
+#else
+	return buf->st_mtim.tv_nsec;
+#endif
+}
+
+static int memoize_hash_matches(struct memoize_hash *h, struct stat *buf)
+{
+	return h->dev == buf->st_dev && h->ino == buf->st_ino && h->size == buf->st_size && h->mtime == buf->st_mtime && h->mtime_nsec == memoize_mtime_nsec(buf);
+}
+
+static void memoize_hash_remember(struct memoize_instance *a, const char *path, struct stat *buf, const char *id)
+{
+	struct memoize_hash *h = hash_table_lookup(a->hashes, path);
+	if(!h) {
+		h = xxmalloc(sizeof(*h));
+		hash_table_insert(a->hashes, path, h);
+	} else if(memoize_hash_matches(h, buf) && !strcmp(h->id, id)) {
+		return;
+	}
+
+	h->dev = buf->st_dev;
+	h->ino = buf->st_ino;
+	h->size = buf->st_size;
+	h->mtime = buf->st_mtime;
+	h->mtime_nsec = memoize_mtime_nsec(buf);
+	strcpy(h->id, id);
+
+	a->hashes_changed = 1;
+}
+
+static int memoize_file_id(struct memoize_instance *a, const char *path, char *id);
+
+/*
+A directory is identified by the names and ids of its entries, in order.
+*/
+
+static int memoize_dir_id(struct memoize_instance *a, const char *path, char *id)
+{
+	struct dirent **entries;
+	int count = scandir(path, &entries, 0, alphasort);
+	if(count < 0)
+		return 0;
+
+	sha1_context_t context;
+	sha1_init(&context);
+
+	int ok = 1;
+	int i;
+	for(i = 0; i < count; i++) {
+		const char *name = entries[i]->d_name;
+		if(ok && strcmp(name, ".") && strcmp(name, "..")) {
+			char entry_id[MEMOIZE_ID_LENGTH + 1];
+			char *entry_path = string_format("%s/%s", path, name);
+			ok = memoize_file_id(a, entry_path, entry_id);
+			free(entry_path);
+
+			if(ok) {
+				sha1_update(&context, name, strlen(name) + 1);
+				sha1_update(&context, entry_id, MEMOIZE_ID_LENGTH);
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+
+	if(ok) {
+		unsigned char digest[SHA1_DIGEST_LENGTH];
+		sha1_final(digest, &context);
+		strcpy(id, sha1_string(digest));
+	}
+
+	return ok;
+}
+
+/*
+Get the content id of a file, hashing it only if it changed since it was last seen.
+@return One on success, zero if the file could not be read.
+*/
+
+static int memoize_file_id(struct memoize_instance *a, const char *path, char *id)
+{
+	struct stat buf;
+	if(stat(path, &buf) < 0)
+		return 0;
+
+	if(S_ISDIR(buf.st_mode))
+		return memoize_dir_id(a, path, id);
+
+	struct memoize_hash *h = hash_table_lookup(a->hashes, path);
+	if(h && memoize_hash_matches(h, &buf)) {
+		strcpy(id, h->id);
+		return 1;
+	}
+
+	unsigned char digest[SHA1_DIGEST_LENGTH];
+	if(!sha1_file(path, digest))
+		return 0;
+
+	strcpy(id, sha1_string(digest));
+	memoize_hash_remember(a, path, &buf, id);
+
+	return 1;
+}
+
+static void memoize_hash_load(struct memoize_instance *a)
+{
+	FILE *file = fopen(a->hash_filename, "r");
+	if(!file)
+		return;
+
+	char line[PATH_MAX + 256];
+	while(fgets(line, sizeof(line), file)) {
+		struct memoize_hash h;
+		unsigned long long dev, ino;
+		long long size, mtime;
+		int n = 0;
+
+		string_chomp(line);
+		if(sscanf(line, "%40s %llu %llu %lld %lld %ld %n", h.id, &dev, &ino, &size, &mtime, &h.mtime_nsec, &n) != 6 || !n || !line[n])
+			continue;
+
+		h.dev = dev;
+		h.ino = ino;
+		h.size = size;
+		h.mtime = mtime;
+
+		struct memoize_hash *old = hash_table_remove(a->hashes, &line[n]);
+		free(old);
+		struct memoize_hash *copy = xxmalloc(sizeof(*copy));
+		*copy = h;
+		hash_table_insert(a->hashes, &line[n], copy);
+	}
+
+	fclose(file);
+
+	debug(D_MAKEFLOW_HOOK, "loaded %d file hashes from %s", hash_table_size(a->hashes), a->hash_filename);
+}
+
+static void memoize_hash_save(struct memoize_instance *a)
+{
+	if(!a->hashes_changed)
+		return;
+
+	char *tmp = string_format("%s.tmp", a->hash_filename);
+	FILE *file = fopen(tmp, "w");
+	if(!file) {
+		debug(D_MAKEFLOW_HOOK, "couldn't write %s: %s", tmp, strerror(errno));
+		free(tmp);
+		return;
+	}
+
+	char *path;
+	struct memoize_hash *h;
+	hash_table_firstkey(a->hashes);
+	while(hash_table_nextkey(a->hashes, &path, (void **) &h)) {
+		if(strchr(path, '\n'))
+			continue;
+		fprintf(file, "%s %llu %llu %lld %lld %ld %s\n", h->id, (unsigned long long) h->dev, (unsigned long long) h->ino, (long long) h->size, (long long) h->mtime, h->mtime_nsec, path);
+	}
+
+	if(fclose(file) == 0 && rename(tmp, a->hash_filename) == 0) {
+		a->hashes_changed = 0;
+	} else {
+		debug(D_MAKEFLOW_HOOK, "couldn't write %s: %s", a->hash_filename, strerror(errno));
+		unlink(tmp);
+	}
+
+	free(tmp);
+}
+
+struct memoize_hash_result {
+	int result;
+	struct stat buf;
+	char id[MEMOIZE_ID_LENGTH + 1];
+};
+
+/*
+Check and hash many files at once.  As in batch_fs_stat_many,
+each of nprocs children takes an interleaved share of the files
+and writes its results into a shared mapping.  The children see
+the hashes already known, so unchanged files are only stat'ed.
+Directories are left to be hashed when first needed.
+*/
+
+static void memoize_hash_many(struct memoize_instance *a, int count, const char **paths, int nprocs)
+{
+	int i, p;
+	size_t length = count * sizeof(struct memoize_hash_result);
+
+	struct memoize_hash_result *shared = mmap(0, length, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED)
+		return;
+
+	pid_t *pids = xxmalloc(nprocs * sizeof(pid_t));
+	int started = 0;
+
+	for(p = 0; p < nprocs; p++) {
+		pid_t pid = fork();
+		if(pid == 0) {
+			for(i = p; i < count; i += nprocs) {
+				struct memoize_hash_result *r = &shared[i];
+				r->result = 0;
+				if(stat(paths[i], &r->buf) < 0 || !S_ISREG(r->buf.st_mode))
+					continue;
+
+				struct memoize_hash *h = hash_table_lookup(a->hashes, paths[i]);
+				if(h && memoize_hash_matches(h, &r->buf)) {
+					strcpy(r->id, h->id);
+					r->result = 1;
+				} else {
+					unsigned char digest[SHA1_DIGEST_LENGTH];
+					if(sha1_file(paths[i], digest)) {
+						strcpy(r->id, sha1_string(digest));
+						r->result = 1;
+					}
+				}
+			}
+			_exit(0);
+		} else if(pid < 0) {
+			break;
+		}
+		pids[started++] = pid;
+	}
+
+	int ok = started == nprocs;
+	for(p = 0; p < started; p++) {
+		int status;
+		while(waitpid(pids[p], &status, 0) < 0 && errno == EINTR) {
+		}
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ok = 0;
+	}
+	free(pids);
+
+	if(ok) {
+		for(i = 0; i < count; i++) {
+			if(shared[i].result)
+				memoize_hash_remember(a, paths[i], &shared[i].buf, shared[i].id);
+		}
+	} else {
+		debug(D_MAKEFLOW_HOOK, "couldn't hash files in parallel, will hash them as needed");
+	}
+
+	munmap(shared, length);
+}
+
+static void memoize_hash_sources(struct memoize_instance *a, struct dag *d)
+{
+	const char **paths = xxmalloc(hash_table_size(d->files) * sizeof(*paths));
+	int count = 0;
+
+	char *name;
+	struct dag_file *f;
+	hash_table_firstkey(d->files);
+	while(hash_table_nextkey(d->files, &name, (void **) &f)) {
+		if(!f->created_by && f->needed_by && list_size(f->needed_by) > 0)
+			paths[count++] = f->filename;
+	}
+
+	long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nprocs < 1)
+		nprocs = 1;
+	if(nprocs > MEMOIZE_PARALLEL_MAX)
+		nprocs = MEMOIZE_PARALLEL_MAX;
+
+	if(count >= MEMOIZE_PARALLEL_MIN && nprocs > 1) {
+		timestamp_t start = timestamp_get();
+		memoize_hash_many(a, count, paths, nprocs);
+		debug(D_MAKEFLOW_HOOK, "checked %d source files with %ld processes in %.3lfs", count, nprocs, (timestamp_get() - start) / 1000000.0);
+	}
+
+	free(paths);
+}
+
+static int memoize_file_compare(const void *a, const void *b)
+{
+	const struct batch_file *x = *(const struct batch_file **) a;
+	const struct batch_file *y = *(const struct batch_file **) b;
+	return strcmp(x->inner_name, y->inner_name);
+}
+
+static struct batch_file **memoize_sorted_files(struct list *files, int *count)
+{
+	*count = list_size(files);
+	struct batch_file **array = xxmalloc((*count + 1) * sizeof(*array));
+
+	int i = 0;
+	struct batch_file *f;
+	list_first_item(files);
+	while((f = list_next_item(files)))
+		array[i++] = f;
+
+	qsort(array, *count, sizeof(*array), memoize_file_compare);
+	return array;
+}
+
+static int memoize_string_compare(const void *a, const void *b)
+{
+	return strcmp(*(const char **) a, *(const char **) b);
+}
+
+static void memoize_hash_environment(sha1_context_t *context, struct jx *envlist)
+{
+	if(!jx_istype(envlist, JX_OBJECT))
+		return;
+
+	int count = 0;
+	const char *key;
+	void *i = NULL;
+	while(jx_iterate_keys(envlist, &i))
+		count++;
+
+	const char **keys = xxmalloc((count + 1) * sizeof(*keys));
+	count = 0;
+	i = NULL;
+	while((key = jx_iterate_keys(envlist, &i)))
+		keys[count++] = key;
+
+	qsort(keys, count, sizeof(*keys), memoize_string_compare);
+
+	int k;
+	for(k = 0; k < count; k++) {
+		struct jx *value = jx_lookup(envlist, keys[k]);
+		char *str = jx_istype(value, JX_STRING) ? xxstrdup(value->u.string_value) : jx_print_string(value);
+		sha1_update(context, "E", 1);
+		sha1_update(context, keys[k], strlen(keys[k]) + 1);
+		sha1_update(context, str, strlen(str) + 1);
+		free(str);
+	}
+
+	free(keys);
+}
+
+/*
+Compute the key of a task from its command, environment, inputs and outputs.
+@return One on success, zero if an input could not be read.
+*/
+
+static int memoize_task_key(struct memoize_instance *a, struct batch_task *t, char *key)
+{
+	sha1_context_t context;
+	sha1_init(&context);
+
+	sha1_update(&context, "C", 1);
+	sha1_update(&context, t->command, strlen(t->command) + 1);
+
+	memoize_hash_environment(&context, t->envlist);
+
+	int ok = 1;
+	int count, i;
+	struct batch_file **files = memoize_sorted_files(t->input_files, &count);
+	for(i = 0; i < count; i++) {
+		char id[MEMOIZE_ID_LENGTH + 1];
+		if(!memoize_file_id(a, files[i]->outer_name, id)) {
+			debug(D_MAKEFLOW_HOOK, "couldn't hash input %s of task %d: %s", files[i]->outer_name, t->taskid, strerror(errno));
+			ok = 0;
+			break;
+		}
+		sha1_update(&context, "I", 1);
+		sha1_update(&context, files[i]->inner_name, strlen(files[i]->inner_name) + 1);
+		sha1_update(&context, id, MEMOIZE_ID_LENGTH);
+	}
+	free(files);
+
+	files = memoize_sorted_files(t->output_files, &count);
+	for(i = 0; i < count; i++) {
+		sha1_update(&context, "O", 1);
+		sha1_update(&context, files[i]->inner_name, strlen(files[i]->inner_name) + 1);
+	}
+	free(files);
+
+	if(ok) {
+		unsigned char digest[SHA1_DIGEST_LENGTH];
+		sha1_final(digest, &context);
+		strcpy(key, sha1_string(digest));
+	}
+
+	return ok;
+}
+
+static char *memoize_object_path(struct memoize_instance *a, const char *id)
+{
+	return string_format("%s/objects/%.2s/%s", a->dir, id, id);
+}
+
+static char *memoize_task_path(struct memoize_instance *a, const char *key)
+{
+	return string_format("%s/tasks/%.2s/%s", a->dir, key, key);
+}
+
+/* Make the empty file out a copy-on-write clone of in, if the filesystem supports it. */
+
+static int memoize_clone(int in, int out)
+{
+#if defined(CCTOOLS_OPSYS_LINUX) && defined(FICLONE)
+	return ioctl(out, FICLONE, in) == 0;
+#else
+	return 0;
+#endif
+}
+
+/*
+Create a temporary file beside path, to be renamed over it.  The cache
+may be shared by makeflows on many hosts, whose pids may be the same,
+so the name is made unique by mkstemp rather than by the pid.  The file
+gets the mode that creat would give it, not the 0600 of mkstemp.
+@return The open file, or -1 on failure, with the name in *tmp.
+*/
+
+static int memoize_tmpfile(const char *path, char **tmp)
+{
+	*tmp = string_format("%s.memoize.XXXXXX", path);
+	int fd = mkstemp(*tmp);
+	if(fd < 0) {
+		debug(D_MAKEFLOW_HOOK, "couldn't create a temporary file for %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	mode_t mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
+
+	return fd;
+}
+
+/*
+Place a file at dst with the same contents as src and the mode bits in mode,
+replacing dst atomically.
+@return One on success, zero on failure.
+*/
+
+static int memoize_place(const char *src, const char *dst, mode_t mode)
+{
+	char *tmp;
+	int out = memoize_tmpfile(dst, &tmp);
+	if(out < 0) {
+		free(tmp);
+		return 0;
+	}
+
+	const char *how = "couldn't copy";
+	int ok = 0;
+
+	int in = open(src, O_RDONLY);
+	if(in >= 0) {
+		if(memoize_clone(in, out)) {
+			how = "cloned";
+			ok = 1;
+		} else if(copy_fd_to_fd(in, out) >= 0) {
+			how = "copied";
+			ok = 1;
+		}
+		close(in);
+	}
+
+	if(ok)
+		ok = fchmod(out, mode) == 0;
+	if(close(out) < 0)
+		ok = 0;
+
+	if(ok && rename(tmp, dst) < 0)
+		ok = 0;
+
+	if(!ok)
+		unlink(tmp);
+
+	if(ok) {
+		debug(D_MAKEFLOW_HOOK, "%s %s to %s", how, src, dst);
+	} else {
+		debug(D_MAKEFLOW_HOOK, "couldn't place %s at %s: %s", src, dst, strerror(errno));
+	}
+
+	free(tmp);
+	return ok;
+}
+
+/*
+Put the outputs named by a task record back in place.
+@return One if every output was restored, zero otherwise.
+*/
+
+static int memoize_restore(struct memoize_instance *a, struct batch_task *t, struct jx *record)
+{
+	struct jx *outputs = jx_lookup(record, "outputs");
+	if(!jx_istype(outputs, JX_OBJECT))
+		return 0;
+
+	int ok = 1;
+	struct batch_file *f;
+	list_first_item(t->output_files);
+	while(ok && (f = list_next_item(t->output_files))) {
+		const char *id = jx_lookup_string(outputs, f->inner_name);
+		if(!id || strlen(id) != MEMOIZE_ID_LENGTH) {
+			ok = 0;
+			break;
+		}
+
+		char *object = memoize_object_path(a, id);
+		struct stat buf;
+		if(stat(object, &buf) < 0) {
+			debug(D_MAKEFLOW_HOOK, "object %s for %s is missing from the cache", id, f->outer_name);
+			ok = 0;
+		} else {
+			if(!create_dir_parents(f->outer_name, 0777) && errno != EEXIST) {
+				ok = 0;
+			} else {
+				ok = memoize_place(object, f->outer_name, (buf.st_mode & 07777) | S_IWUSR);
+			}
+		}
+		free(object);
+
+		if(ok && stat(f->outer_name, &buf) == 0)
+			memoize_hash_remember(a, f->outer_name, &buf, id);
+	}
+
+	return ok;
+}
+
+/*
+Store the outputs of a successful task and the record naming them.
+@return One if the task was stored, zero if it could not be.
+*/
+
+static int memoize_store(struct memoize_instance *a, struct batch_task *t, const char *key)
+{
+	struct jx *outputs = jx_object(0);
+
+	int ok = 1;
+	struct batch_file *f;
+	list_first_item(t->output_files);
+	while(ok && (f = list_next_item(t->output_files))) {
+		struct stat buf;
+		char id[MEMOIZE_ID_LENGTH + 1];
+
+		if(stat(f->outer_name, &buf) < 0 || !S_ISREG(buf.st_mode)) {
+			debug(D_MAKEFLOW_HOOK, "task %d will not be memoized as output %s is not a file", t->taskid, f->outer_name);
+			ok = 0;
+			break;
+		}
+
+		if(!memoize_file_id(a, f->outer_name, id)) {
+			ok = 0;
+			break;
+		}
+
+		char *object = memoize_object_path(a, id);
+		if(access(object, F_OK) < 0) {
+			char *object_dir = string_format("%s/objects/%.2s", a->dir, id);
+			if(!create_dir(object_dir, 0777) && errno != EEXIST) {
+				ok = 0;
+			} else {
+				ok = memoize_place(f->outer_name, object, buf.st_mode & 07555);
+			}
+			free(object_dir);
+		}
+		free(object);
+
+		jx_insert(outputs, jx_string(f->inner_name), jx_string(id));
+	}
+
+	if(!ok) {
+		jx_delete(outputs);
+		return 0;
+	}
+
+	struct jx *record = jx_object(0);
+	jx_insert(record, jx_string("command"), jx_string(t->command));
+	jx_insert(record, jx_string("outputs"), outputs);
+
+	char *task_dir = string_format("%s/tasks/%.2s", a->dir, key);
+	char *task_path = memoize_task_path(a, key);
+	char *tmp = 0;
+
+	int fd = -1;
+	if(create_dir(task_dir, 0777) || errno == EEXIST)
+		fd = memoize_tmpfile(task_path, &tmp);
+
+	FILE *file = 0;
+	if(fd >= 0) {
+		file = fdopen(fd, "w");
+		if(!file)
+			close(fd);
+	}
+
+	if(file) {
+		jx_print_stream(record, file);
+		ok = fclose(file) == 0 && rename(tmp, task_path) == 0;
+	} else {
+		ok = 0;
+	}
+
+	if(!ok) {
+		debug(D_MAKEFLOW_HOOK, "couldn't write %s: %s", task_path, strerror(errno));
+		if(fd >= 0)
+			unlink(tmp);
+	}
+
+	free(tmp);
+	free(task_path);
+	free(task_dir);
+	jx_delete(record);
+
+	return ok;
+}
+
+static int create( void ** instance_struct, struct jx *hook_args )
+{
+	struct memoize_instance *a = calloc(1, sizeof(*a));
+	*instance_struct = a;
+
+	a->dir = xxstrdup(jx_lookup_string(hook_args, "memoize_dir"));
+	a->hashes = hash_table_create(0, 0);
+	a->task_keys = itable_create(0);
+
+	const char *subdirs[] = { "", "/objects", "/tasks" };
+	unsigned i;
+	for(i = 0; i < sizeof(subdirs) / sizeof(subdirs[0]); i++) {
+		char *path = string_format("%s%s", a->dir, subdirs[i]);
+		if(!create_dir(path, 0777) && errno != EEXIST) {
+			debug(D_ERROR|D_MAKEFLOW_HOOK, "could not create memoize directory %s: %s", path, strerror(errno));
+			free(path);
+			return MAKEFLOW_HOOK_FAILURE;
+		}
+		free(path);
+	}
+
+	return MAKEFLOW_HOOK_SUCCESS;
+}
+
+static int destroy( void * instance_struct, struct dag *d )
+{
+	struct memoize_instance *a = (struct memoize_instance*)instance_struct;
+	if(!a)
+		return MAKEFLOW_HOOK_SUCCESS;
+
+	if(a->hash_filename) {
+		memoize_hash_save(a);
+		debug(D_MAKEFLOW_HOOK, "memoize: %d tasks restored, %d not found, %d stored", a->hits, a->misses, a->stored);
+	}
+
+	char *path;
+	void *value;
+	hash_table_firstkey(a->hashes);
+	while(hash_table_nextkey(a->hashes, &path, &value))
+		free(value);
+	hash_table_delete(a->hashes);
+
+	UINT64_T taskid;
+	itable_firstkey(a->task_keys);
+	while(itable_nextkey(a->task_keys, &taskid, &value))
+		free(value);
+	itable_delete(a->task_keys);
+
+	free(a->hash_filename);
+	free(a->dir);
+	free(a);
+
+	return MAKEFLOW_HOOK_SUCCESS;
+}
+
+static int dag_clean( void * instance_struct, struct dag *d )
+{
+	char *hash_filename = string_format("%s" MEMOIZE_HASH_SUFFIX, d->filename);
+	unlink(hash_filename);
+	free(hash_filename);
+	return MAKEFLOW_HOOK_SUCCESS;
+}
+
+static int dag_start( void * instance_struct, struct dag *d )
+{
+	struct memoize_instance *a = (struct memoize_instance*)instance_struct;
+
+	a->hash_filename = string_format("%s" MEMOIZE_HASH_SUFFIX, d->filename);
+	memoize_hash_load(a);
+	memoize_hash_sources(a, d);
+
+	return MAKEFLOW_HOOK_SUCCESS;
+}
+
+static int dag_loop( void * instance_struct, struct dag *d )
+{
+	struct memoize_instance *a = (struct memoize_instance*)instance_struct;
+
+	/* Restored tasks never enter a job table, so the ready tasks
+	   they released must be dispatched by another pass of the loop. */
+	if(a->found_restored_job) {
+		a->found_restored_job = 0;
+		return MAKEFLOW_HOOK_SUCCESS;
+	}
+	return MAKEFLOW_HOOK_END;
+}
+
+static int batch_submit( void * instance_struct, struct batch_task *t )
+{
+	struct memoize_instance *a = (struct memoize_instance*)instance_struct;
+
+	free(itable_remove(a->task_keys, t->taskid));
+
+	char key[MEMOIZE_ID_LENGTH + 1];
+	if(!memoize_task_key(a, t, key))
+		return MAKEFLOW_HOOK_SUCCESS;
+
+	char *task_path = memoize_task_path(a, key);
+	struct jx *record = jx_parse_file(task_path);
+	free(task_path);
+
+	if(record && memoize_restore(a, t, record)) {
+		jx_delete(record);
+		t->info->exited_normally = 1;
+		t->info->exit_code = 0;
+		a->restored_task = t;
+		a->found_restored_job = 1;
+		a->hits++;
+		printf("task %d was restored from cache %.8s\n", t->taskid, key);
+		return MAKEFLOW_HOOK_SKIP;
+	}
+	jx_delete(record);
+
+	a->misses++;
+	debug(D_MAKEFLOW_HOOK, "task %d is not in the cache as %s", t->taskid, key);
+
+	itable_insert(a->task_keys, t->taskid, xxstrdup(key));
+
+	return MAKEFLOW_HOOK_SUCCESS;
+}
+
+static int batch_retrieve( void * instance_struct, struct batch_task *t )
+{
+	struct memoize_instance *a = (struct memoize_instance*)instance_struct;
+
+	if(t == a->restored_task) {
+		a->restored_task = 0;
+		return MAKEFLOW_HOOK_RUN;
+	}
+	return MAKEFLOW_HOOK_SUCCESS;
+}
+
+static int node_success( void * instance_struct, struct dag_node *n, struct batch_task *t )
+{
+	struct memoize_instance *a = (struct memoize_instance*)instance_struct;
+
+	char *key = itable_remove(a->task_keys, t->taskid);
+	if(!key)
+		return MAKEFLOW_HOOK_SUCCESS;
+
+	/* A failure to store only costs a later run, so it is not fatal. */
+	if(memoize_store(a, t, key)) {
+		a->stored++;
+		debug(D_MAKEFLOW_HOOK, "task %d stored in the cache as %s", t->taskid, key);
+	}
+
+	free(key);
+	return MAKEFLOW_HOOK_SUCCESS;
+}
+
+struct makeflow_hook makeflow_hook_memoize = {
+	.module_name = "Memoize",
+	.create = create,
+	.destroy = destroy,
+
+	.dag_clean = dag_clean,
+	.dag_start = dag_start,
+	.dag_loop = dag_loop,
+
+	.batch_submit = batch_submit,
+	.batch_retrieve = batch_retrieve,
+
+	.node_success = node_success,
+};
+
+/* vim: set noexpandtab tabstop=4: */
@@ -27,7 +27,7 @@ clean()
 {
 	rm -f $TEST_INPUT
 	rm -f out.all
-	rm -f syntax/export.external.makeflow.makeflowlog
+	rm -f syntax/export.external.makeflow.makeflowlog syntax/export.external.makeflow.makeflowlog.snapshot
 	exit 0
 }
 
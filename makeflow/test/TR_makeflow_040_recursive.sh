@@ -58,6 +58,7 @@ run()
 clean()
 {
 	rm -f $MAKE_FILE $PORT_FILE $WORKER_LOG input.txt out.1 out.2 out.actual out.expected
+	rm -f toplevel.makeflow.makeflowlog.snapshot sublevel.makeflow.makeflowlog.snapshot
 }
 
 dispatch "$@"
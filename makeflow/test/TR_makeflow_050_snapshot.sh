@@ -0,0 +1,60 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+cat > Makeflow <<EOF
+a:
+	echo a > a
+b: a
+	cat a > b
+c: b
+	cat b > c
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+
+	# The first run writes a snapshot when it closes the log.
+	../../src/makeflow Makeflow || exit 1
+	[ -f Makeflow.makeflowlog.snapshot ] || exit 1
+
+	# A restart recovers from the snapshot, and still notices a missing output.
+	rm c
+	../../src/makeflow Makeflow > output 2>&1 || exit 1
+	grep -q "recovering from snapshot" output || exit 1
+	grep -q "submitting job: cat b > c" output || exit 1
+	grep -q "submitting job: cat a > b" output && exit 1
+
+	# A snapshot of a different workflow is ignored.
+	echo "d: c" >> Makeflow
+	echo "	cat c > d" >> Makeflow
+	../../src/makeflow Makeflow > output 2>&1 || exit 1
+	grep -q "recovering from log file" output || exit 1
+	grep -q "submitting job: cat c > d" output || exit 1
+	grep -q "submitting job: cat b > c" output && exit 1
+
+	# Cleaning the workflow removes the snapshot.
+	../../src/makeflow -c Makeflow || exit 1
+	[ -f Makeflow.makeflowlog.snapshot ] && exit 1
+
+	exit 0
+}
+
+clean()
+{
+	rm -fr $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -0,0 +1,59 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+cat > Makeflow <<EOF
+leaf1:
+	echo leaf1 > leaf1
+leaf2:
+	echo leaf2 > leaf2
+leaf3:
+	echo leaf3 > leaf3
+chain1:
+	echo chain1 > chain1
+chain2: chain1
+	cat chain1 > chain2
+chain3: chain2
+	cat chain2 > chain3
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+
+	# With one job at a time, the chain must run ahead of the leaves.
+	../../src/makeflow -j 1 --dispatch-order=critical-path Makeflow > output 2>&1 || exit 1
+	grep "submitting job" output > order
+	head -1 order | grep -q "echo chain1 > chain1" || exit 1
+	head -2 order | tail -1 | grep -q "cat chain1 > chain2" || exit 1
+	[ -f chain3 ] || exit 1
+
+	../../src/makeflow -c Makeflow || exit 1
+	../../src/makeflow -j 1 --dispatch-order=critical-path-runtime Makeflow > output 2>&1 || exit 1
+	grep "submitting job" output > order
+	head -1 order | grep -q "echo chain1 > chain1" || exit 1
+	[ -f chain3 ] || exit 1
+
+	../../src/makeflow -c Makeflow || exit 1
+	../../src/makeflow --dispatch-order=unknown Makeflow && exit 1
+
+	exit 0
+}
+
+clean()
+{
+	rm -fr $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
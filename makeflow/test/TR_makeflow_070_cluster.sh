@@ -0,0 +1,66 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+
+	# A scheduler that runs each job in the background right away.
+cat > submit.sh <<EOF
+#!/bin/sh
+id=\$(( \$(cat counter 2>/dev/null || echo 0) + 1 ))
+echo \$id > counter
+for wrapper; do true; done
+JOB_ID=\$id sh \$wrapper > /dev/null 2>&1 &
+echo \$id
+EOF
+	chmod 755 submit.sh
+
+cat > Makeflow <<EOF
+a:
+	echo a > a
+b: a
+	cat a > b
+c: a
+	false
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+
+	export BATCH_QUEUE_CLUSTER_NAME=fake
+	export BATCH_QUEUE_CLUSTER_SUBMIT_COMMAND=./submit.sh
+	export BATCH_QUEUE_CLUSTER_REMOVE_COMMAND=true
+	export BATCH_QUEUE_CLUSTER_SUBMIT_OPTIONS=""
+	export BATCH_QUEUE_CLUSTER_SUBMIT_JOBNAME_VAR="-N"
+
+	# A wrapper left by an older version is replaced.
+	echo "exit 0" > fake.wrapper
+	chmod 755 fake.wrapper
+
+	../../src/makeflow -T cluster Makeflow > output 2>&1
+	grep -q "false failed with exit code 1" output || exit 1
+	[ "`cat b`" = a ] || exit 1
+
+	# Every status file was collected.
+	[ -z "`ls -A fake.status`" ] || exit 1
+
+	exit 0
+}
+
+clean()
+{
+	rm -fr $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
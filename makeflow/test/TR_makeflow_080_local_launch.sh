@@ -0,0 +1,66 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+
+	# A script without #! must still run, through the shell.
+	echo "touch script.out" > script
+	chmod 755 script
+
+	# A script run directly sees the exported variables.
+	printf '#!/bin/sh\nprintenv $1 > env.out\n' > check
+	chmod 755 check
+
+cat > Makeflow <<EOF
+MYVAR=launched
+export MYVAR
+
+direct.out:
+	touch direct.out
+script.out:
+	./script
+shell.out:
+	echo \$MYVAR > shell.out
+env.out:
+	./check MYVAR
+EOF
+
+cat > Missing <<EOF
+never:
+	no_such_program_anywhere
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+
+	../../src/makeflow Makeflow > output 2>&1 || exit 1
+	for f in direct.out script.out; do
+		[ -f $f ] || exit 1
+	done
+	[ "`cat env.out`" = launched ] || exit 1
+	[ "`cat shell.out`" = launched ] || exit 1
+
+	../../src/makeflow Missing > output 2>&1
+	grep -q "failed with exit code 127" output || exit 1
+
+	exit 0
+}
+
+clean()
+{
+	rm -fr $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -0,0 +1,86 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+	echo hello > input
+cat > Makeflow <<EOF
+a: input
+	cat input > a; echo a >> runs
+b: a
+	tr a-z A-Z < a > b; echo b >> runs
+c: b
+	wc -c b > c; echo c >> runs
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+	umask 022
+
+	# The first run fills the cache, leaving no temporary files,
+	# and records that other users can read.
+	../../src/makeflow --memoize=cache Makeflow || exit 1
+	[ "`cat runs`" = "`printf 'a\nb\nc'`" ] || exit 1
+	[ -f Makeflow.makeflowhashes ] || exit 1
+	[ -z "`find cache -name '*.memoize.*'`" ] || exit 1
+	[ "`find cache/tasks -type f ! -perm -444`" = "" ] || exit 1
+
+	# Outputs share nothing with the cache, and stay writable.
+	for f in a b c; do
+		[ "`stat -c %h $f`" = 1 ] || exit 1
+		stat -c %A $f | grep -q '^-rw' || exit 1
+	done
+
+	# After cleaning, every rule is restored without running.
+	../../src/makeflow -c Makeflow || exit 1
+	rm -f runs
+	../../src/makeflow --memoize=cache Makeflow > output 2>&1 || exit 1
+	[ -f runs ] && exit 1
+	grep -q "task 2 was restored from cache" output || exit 1
+	[ "`cat b`" = HELLO ] || exit 1
+	[ "`stat -c %h b`" = 1 ] || exit 1
+	stat -c %A b | grep -q '^-rw' || exit 1
+
+	# A changed command only runs the rules it affects.
+	../../src/makeflow -c Makeflow || exit 1
+	sed 's/wc -c/wc -l/' Makeflow > Makeflow.new && mv Makeflow.new Makeflow
+	../../src/makeflow --memoize=cache Makeflow || exit 1
+	[ "`cat runs`" = c ] || exit 1
+
+	# A changed input runs everything downstream of it,
+	# without writing through the outputs restored from the cache,
+	# and leaves alone the other links to an output.
+	rm -f Makeflow.makeflowlog* runs
+	ln b b.link
+	echo goodbye > input
+	../../src/makeflow --memoize=cache Makeflow || exit 1
+	[ "`cat runs`" = "`printf 'a\nb\nc'`" ] || exit 1
+	[ "`cat b`" = GOODBYE ] || exit 1
+	[ "`stat -c %h b`" = 2 ] || exit 1
+	grep -rqx HELLO cache/objects || exit 1
+
+	# Cleaning with the cache enabled removes the remembered hashes.
+	../../src/makeflow -c --memoize=cache Makeflow || exit 1
+	[ -f Makeflow.makeflowhashes ] && exit 1
+
+	exit 0
+}
+
+clean()
+{
+	chmod -R u+w $test_dir 2>/dev/null
+	rm -fr $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
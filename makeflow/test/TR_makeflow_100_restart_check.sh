@@ -0,0 +1,83 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+
+# Enough files that startup checks them with several processes.
+count=1100
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+
+	inputs=""
+	outputs=""
+	i=0
+	while [ $i -lt $count ]; do
+		touch in.$i
+		inputs="$inputs in.$i"
+		outputs="$outputs out.$i"
+		i=$((i+1))
+	done
+
+cat > Makeflow <<EOF
+${outputs# }:$inputs
+	touch$outputs
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+
+	# A missing input is found whether the files are checked serially or in parallel.
+	mv in.1050 saved
+	for procs in 1 4; do
+		../../src/makeflow --stat-procs $procs Makeflow > output 2>&1 && exit 1
+		grep -q "in.1050 does not exist" output || exit 1
+		[ `grep -c "does not exist" output` = 1 ] || exit 1
+	done
+	mv saved in.1050
+
+	../../src/makeflow --stat-procs 4 -d batch -o debug Makeflow > output 2>&1 || exit 1
+	grep -q "checking $count files with 4 processes" debug || exit 1
+
+	# Recovering from the log alone, a restart has nothing to do.
+	rm -f Makeflow.makeflowlog.snapshot
+	../../src/makeflow --stat-procs 4 Makeflow > output 2>&1 || exit 1
+	grep -q "recovering from log file" output || exit 1
+	grep -q "submitting job" output && exit 1
+
+	# Missing and modified outputs are found by the parallel check of the inputs and the log.
+	rm -f Makeflow.makeflowlog.snapshot debug
+	rm out.900
+	touch -d "+1 hour" out.1090
+	../../src/makeflow --stat-procs 4 -d batch -o debug Makeflow > output 2>&1 || exit 1
+	[ `grep -c "checking $count files with 4 processes" debug` = 2 ] || exit 1
+	grep -q "out.900 is reported as existing, but does not exist" output || exit 1
+	grep -q "out.1090 is reported as existing, but has been modified" output || exit 1
+	grep -q "submitting job" output || exit 1
+	[ -f out.900 ] || exit 1
+
+	# A corrupted record is reported with its line number.
+	rm -f Makeflow.makeflowlog.snapshot
+	lines=`wc -l < Makeflow.makeflowlog`
+	echo "garbage" >> Makeflow.makeflowlog
+	../../src/makeflow Makeflow > output 2>&1 && exit 1
+	grep -q "corrupted on line $((lines+1))" output || exit 1
+
+	exit 0
+}
+
+clean()
+{
+	rm -fr $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -50,7 +50,7 @@ run()
 
 clean()
 {
-	rm -f $MAKE_FILE $STATUS_FILE $PORT_FILE $WORKER_LOG out.1 out.2 out.actual out.expected
+	rm -f $MAKE_FILE $STATUS_FILE $PORT_FILE $WORKER_LOG out.1 out.2 out.actual out.expected $MAKE_FILE.makeflowlog.snapshot
 }
 
 dispatch "$@"
@@ -0,0 +1,112 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Measure the throughput of reading a whole file sequentially, for a
+range of read sizes, to compare native reads with reads served by
+Parrot from local, cached, or remote files:
+
+	parrot_read_benchmark /tmp/bigfile
+	parrot_run parrot_read_benchmark /tmp/bigfile
+	parrot_run parrot_read_benchmark /http/server/bigfile 4K 1M
+
+Each size reads the file from start to end the given number of times
+(default 1) into a buffer that is touched first, so that only the cost
+of moving the data is measured.
+*/
+
+#include "stringtools.h"
+#include "timestamp.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *default_sizes[] = {"4K", "64K", "256K", "1M", "4M", "16M", 0};
+
+static int benchmark(const char *path, INT64_T size, int passes)
+{
+	INT64_T total = 0;
+	int i;
+
+	char *buffer = malloc(size);
+	if(!buffer) {
+		fprintf(stderr, "couldn't allocate %lld bytes\n", (long long)size);
+		return 0;
+	}
+	memset(buffer, 0, size);
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		fprintf(stderr, "couldn't open %s: %s\n", path, strerror(errno));
+		free(buffer);
+		return 0;
+	}
+
+	timestamp_t start = timestamp_get();
+	for(i = 0; i < passes; i++) {
+		ssize_t n;
+		lseek(fd, 0, SEEK_SET);
+		while((n = read(fd, buffer, size)) > 0) {
+			total += n;
+		}
+		if(n < 0) {
+			fprintf(stderr, "couldn't read %s: %s\n", path, strerror(errno));
+			break;
+		}
+	}
+	timestamp_t elapsed = timestamp_get() - start;
+
+	close(fd);
+	free(buffer);
+
+	printf("%10lld bytes/read %12lld bytes %10.3fs %10.1f MB/s\n",
+		(long long)size, (long long)total, elapsed / 1000000.0,
+		elapsed ? total / (elapsed / 1000000.0) / 1048576.0 : 0);
+
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	int passes = 1;
+	int i;
+
+	if(argc < 2) {
+		fprintf(stderr, "use: %s <file> [read size ...]\n", argv[0]);
+		fprintf(stderr, "set PARROT_READ_BENCHMARK_PASSES to read the file more than once.\n");
+		return 1;
+	}
+
+	const char *s = getenv("PARROT_READ_BENCHMARK_PASSES");
+	if(s && atoi(s) > 0)
+		passes = atoi(s);
+
+	if(argc < 3) {
+		for(i = 0; default_sizes[i]; i++) {
+			if(!benchmark(argv[1], string_metric_parse(default_sizes[i]), passes))
+				return 1;
+		}
+	} else {
+		for(i = 2; i < argc; i++) {
+			INT64_T size = string_metric_parse(argv[i]);
+			if(size <= 0) {
+				fprintf(stderr, "invalid read size: %s\n", argv[i]);
+				return 1;
+			}
+			if(!benchmark(argv[1], size, passes))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -0,0 +1,194 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Measure the rate of some system call heavy workloads, to compare
+the cost of running them natively, under Parrot tracing every
+system call, and under Parrot with the seccomp filter:
+
+	parrot_syscall_benchmark 100000
+	parrot_run parrot_syscall_benchmark 100000
+	parrot_run --seccomp parrot_syscall_benchmark 100000
+
+The workloads range from calls that Parrot never looks at, through
+I/O on pipes, which Parrot leaves to the kernel, and on files, which
+Parrot serves itself, to calls on paths that Parrot must resolve.
+Give workload names after the count to run only those.
+*/
+
+#include "timestamp.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char path[] = "/tmp/parrot_syscall_benchmark.XXXXXX";
+static int fd = -1;
+static int pipefd[2];
+
+static void do_getppid(int i)
+{
+	syscall(SYS_getppid);
+}
+
+static void do_sigprocmask(int i)
+{
+	sigset_t set;
+	sigprocmask(SIG_BLOCK, 0, &set);
+}
+
+static void do_mmap(int i)
+{
+	void *p = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(p != MAP_FAILED)
+		munmap(p, 4096);
+}
+
+static void do_pread(int i)
+{
+	char c;
+	pread(fd, &c, 1, i % 4096);
+}
+
+static void do_pipe(int i)
+{
+	char c = 0;
+	write(pipefd[1], &c, 1);
+	read(pipefd[0], &c, 1);
+}
+
+static void do_fstat(int i)
+{
+	struct stat buf;
+	fstat(fd, &buf);
+}
+
+static void do_stat(int i)
+{
+	struct stat buf;
+	stat(path, &buf);
+}
+
+static void do_open(int i)
+{
+	int f = open(path, O_RDONLY);
+	if(f >= 0)
+		close(f);
+}
+
+static void do_fork(int i)
+{
+	pid_t pid = fork();
+	if(pid == 0) {
+		_exit(0);
+	} else if(pid > 0) {
+		waitpid(pid, 0, 0);
+	}
+}
+
+static struct workload {
+	const char *name;
+	void (*run)(int i);
+	int scale;
+} workloads[] = {
+	{"getppid", do_getppid, 1},
+	{"sigprocmask", do_sigprocmask, 1},
+	{"mmap", do_mmap, 1},
+	{"pread", do_pread, 1},
+	{"pipe", do_pipe, 1},
+	{"fstat", do_fstat, 1},
+	{"stat", do_stat, 1},
+	{"open", do_open, 1},
+	{"fork", do_fork, 100},
+	{0, 0, 0}
+};
+
+static void benchmark(struct workload *w, int count)
+{
+	int i;
+
+	count = count / w->scale;
+	if(count < 1)
+		count = 1;
+
+	timestamp_t start = timestamp_get();
+	for(i = 0; i < count; i++) {
+		w->run(i);
+	}
+	timestamp_t elapsed = timestamp_get() - start;
+
+	printf("%-12s %10d ops %10.3fs %12.0f ops/s\n",
+		w->name, count, elapsed / 1000000.0,
+		elapsed ? count / (elapsed / 1000000.0) : 0);
+}
+
+static int selected(struct workload *w, int argc, char *argv[])
+{
+	int i;
+
+	if(argc < 3)
+		return 1;
+
+	for(i = 2; i < argc; i++) {
+		if(!strcmp(argv[i], w->name))
+			return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct workload *w;
+	char block[4096];
+
+	if(argc < 2) {
+		fprintf(stderr, "use: %s <count> [workload ...]\n", argv[0]);
+		fprintf(stderr, "workloads are:");
+		for(w = workloads; w->name; w++)
+			fprintf(stderr, " %s", w->name);
+		fprintf(stderr, "\n");
+		return 1;
+	}
+
+	int count = atoi(argv[1]);
+
+	fd = mkstemp(path);
+	if(fd < 0) {
+		fprintf(stderr, "couldn't create %s\n", path);
+		return 1;
+	}
+	memset(block, 1, sizeof(block));
+	write(fd, block, sizeof(block));
+
+	if(pipe(pipefd) < 0) {
+		fprintf(stderr, "couldn't create a pipe\n");
+		return 1;
+	}
+
+	for(w = workloads; w->name; w++) {
+		if(selected(w, argc, argv))
+			benchmark(w, count);
+	}
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+	close(fd);
+	unlink(path);
+
+	return 0;
+}
+
+/* vim: set noexpandtab tabstop=4: */
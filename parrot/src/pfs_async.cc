@@ -0,0 +1,231 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "pfs_async.h"
+#include "pfs_table.h"
+
+extern "C" {
+#include "debug.h"
+}
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include <list>
+
+int pfs_io_threads = 0;
+
+/*
+Reads wait in the queue for a thread, then in the completed list for
+the main thread.  The outstanding list, which only the main thread uses,
+has every read not yet completed.  Threads wake the main thread through
+an eventfd, and SIGCHLD arrives on a signalfd, so that the main thread
+can wait for a read and for its processes at once.  With its default
+disposition, an unblocked SIGCHLD is discarded and never reaches the
+signalfd, so the main thread blocks it.  wait4 is not affected.
+*/
+
+static std::list<struct pfs_async_read *> queue;
+static std::list<struct pfs_async_read *> completed;
+static std::list<struct pfs_async_read *> outstanding;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static int wake_fd = -1;
+static int signal_fd = -1;
+
+static void wake()
+{
+	uint64_t one = 1;
+	ssize_t result = write(wake_fd,&one,sizeof(one));
+	(void)result;
+}
+
+static void * pfs_async_thread( void *arg )
+{
+	while(1) {
+		struct pfs_async_read *r;
+
+		pthread_mutex_lock(&mutex);
+		while(queue.empty()) pthread_cond_wait(&queue_cond,&mutex);
+		r = queue.front();
+		queue.pop_front();
+		pthread_mutex_unlock(&mutex);
+
+		do {
+			errno = 0;
+			r->result = r->pointer->file->read(r->buffer,r->length,r->offset);
+		} while(r->result<0 && errno==EINTR);
+		r->error = errno;
+
+		pthread_mutex_lock(&mutex);
+		completed.push_back(r);
+		pthread_mutex_unlock(&mutex);
+
+		wake();
+	}
+	return 0;
+}
+
+int pfs_async_init( int nthreads )
+{
+	sigset_t chld, all, old, unblocked;
+	int i;
+
+	wake_fd = eventfd(0,EFD_CLOEXEC|EFD_NONBLOCK);
+	if(wake_fd<0) return -1;
+
+	sigemptyset(&chld);
+	sigaddset(&chld,SIGCHLD);
+	if(sigprocmask(SIG_BLOCK,&chld,&unblocked)<0) return -1;
+	signal_fd = signalfd(-1,&chld,SFD_CLOEXEC|SFD_NONBLOCK);
+	if(signal_fd<0) {
+		sigprocmask(SIG_SETMASK,&unblocked,0);
+		return -1;
+	}
+
+	/* Signals are for the main thread alone. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK,&all,&old);
+
+	for(i=0;i<nthreads;i++) {
+		pthread_t thread;
+		if(pthread_create(&thread,0,pfs_async_thread,0)!=0) break;
+		pthread_detach(thread);
+	}
+
+	pthread_sigmask(SIG_SETMASK,&old,0);
+
+	if(i==0) {
+		sigprocmask(SIG_SETMASK,&unblocked,0);
+		return -1;
+	}
+
+	debug(D_PROCESS,"started %d I/O threads",i);
+	return i;
+}
+
+static void enqueue( struct pfs_async_read *r )
+{
+	if(r->advance) r->offset = r->pointer->tell();
+	r->queued = 1;
+
+	pthread_mutex_lock(&mutex);
+	queue.push_back(r);
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+/* Find the first read waiting for an advancing read on the same pointer. */
+
+static struct pfs_async_read * next_on_pointer( pfs_pointer *pointer )
+{
+	for(std::list<struct pfs_async_read *>::iterator it = outstanding.begin(); it != outstanding.end(); ++it) {
+		struct pfs_async_read *r = *it;
+		if(r->pointer==pointer && r->advance && !r->queued) return r;
+	}
+	return 0;
+}
+
+void pfs_async_read( struct pfs_async_read *r )
+{
+	int wait = 0;
+
+	if(r->advance) {
+		for(std::list<struct pfs_async_read *>::iterator it = outstanding.begin(); it != outstanding.end(); ++it) {
+			if((*it)->pointer==r->pointer && (*it)->advance) wait = 1;
+		}
+	}
+
+	debug(D_PROCESS,"pid %d reads %lld bytes on an I/O thread%s",r->p->pid,(long long)r->length,wait ? " after others" : "");
+
+	r->queued = 0;
+	outstanding.push_back(r);
+	if(!wait) enqueue(r);
+}
+
+int pfs_async_pending()
+{
+	return !outstanding.empty();
+}
+
+void pfs_async_wait()
+{
+	struct pollfd pfd[2];
+	struct signalfd_siginfo info;
+	uint64_t count;
+	ssize_t result;
+
+	pfd[0].fd = wake_fd;
+	pfd[0].events = POLLIN;
+	pfd[0].revents = 0;
+	pfd[1].fd = signal_fd;
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+
+	poll(pfd,2,-1);
+
+	result = read(wake_fd,&count,sizeof(count));
+	do {
+		result = read(signal_fd,&info,sizeof(info));
+	} while(result==sizeof(info));
+}
+
+void pfs_async_complete()
+{
+	std::list<struct pfs_async_read *> finished;
+
+	pthread_mutex_lock(&mutex);
+	finished.swap(completed);
+	pthread_mutex_unlock(&mutex);
+
+	for(std::list<struct pfs_async_read *>::iterator it = finished.begin(); it != finished.end(); ++it) {
+		struct pfs_async_read *r = *it;
+
+		outstanding.remove(r);
+
+		if(r->result>0) {
+			if(r->advance) r->pointer->bump(r->result);
+			r->pointer->file->set_last_offset(r->offset+r->result);
+		}
+
+		if(r->p) {
+			struct pfs_process *oldcurrent = pfs_current;
+			pfs_current = r->p;
+			r->done(r);
+			pfs_current = oldcurrent;
+		}
+
+		if(r->advance) {
+			struct pfs_async_read *next = next_on_pointer(r->pointer);
+			if(next) enqueue(next);
+		}
+
+		pfs_table::release(r->pointer);
+		free(r->buffer);
+		delete r;
+	}
+}
+
+void pfs_async_cancel( struct pfs_process *p )
+{
+	for(std::list<struct pfs_async_read *>::iterator it = outstanding.begin(); it != outstanding.end(); ++it) {
+		if((*it)->p == p) {
+			debug(D_PROCESS,"pid %d exited with a read outstanding",p->pid);
+			(*it)->p = 0;
+		}
+	}
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -0,0 +1,49 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef PFS_ASYNC_H
+#define PFS_ASYNC_H
+
+#include "pfs_pointer.h"
+#include "pfs_process.h"
+
+/*
+A read from a remote file may take a long time.  With I/O threads, the
+dispatcher hands such a read to a thread and leaves the calling process
+stopped, while Parrot goes on serving the others.  Once the read is
+done, pfs_async_complete calls done on the main thread to finish the
+system call and continue the process.  A read that advances the file
+pointer starts from wherever the reads before it on the same pointer
+left off.  A read outstanding for a process that has since exited is
+simply dropped.
+*/
+
+struct pfs_async_read {
+	struct pfs_process *p;
+	pfs_pointer *pointer;
+	char *buffer;
+	pfs_size_t length;
+	pfs_off_t offset;
+	int advance;
+	int queued;
+	pfs_ssize_t result;
+	int error;
+	void *uaddr;
+	void (*done)( struct pfs_async_read *r );
+};
+
+extern int pfs_io_threads;
+
+int  pfs_async_init( int nthreads );
+void pfs_async_read( struct pfs_async_read *r );
+int  pfs_async_pending();
+void pfs_async_wait();
+void pfs_async_complete();
+void pfs_async_cancel( struct pfs_process *p );
+
+#endif
+
+/* vim: set noexpandtab tabstop=4: */
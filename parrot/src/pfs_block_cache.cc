@@ -0,0 +1,480 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "pfs_block_cache.h"
+#include "pfs_service.h"
+
+extern "C" {
+#include "create_dir.h"
+#include "debug.h"
+#include "full_io.h"
+#include "hash_table.h"
+#include "macros.h"
+#include "md5.h"
+}
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern char pfs_temp_dir[];
+extern pfs_size_t pfs_sparse_cache_block_size;
+extern int pfs_sparse_cache_readahead;
+extern pfs_size_t pfs_sparse_cache_limit;
+
+/*
+A remote file is cached in two files in the blocks directory of the
+cache: a sparse data file of the same size as the remote file, which
+holds only the blocks that have been read so far, and a map file,
+which describes the remote file and has a bitmap of the blocks that
+are present.  The map records the inode of its data file, so that a
+map is never trusted with a data file that was replaced under it.
+Several Parrots may share the cache: at worst, one forgets a block
+that another fetched, and fetches it again.
+*/
+
+#define BLOCK_MAP_MAGIC "pfsblk1"
+
+struct block_map_header {
+	char magic[8];
+	INT64_T block_size;
+	INT64_T size;
+	INT64_T mtime;
+	INT64_T data_ino;
+};
+
+static char block_dir[PFS_PATH_MAX] = "";
+
+/* Data files open in this process, which eviction must leave alone. */
+static struct hash_table *open_files = 0;
+
+/* Bytes held by the block cache, or -1 if not yet measured. */
+static pfs_size_t block_bytes_used = -1;
+
+/* Blocks may be fetched on I/O threads. */
+static pthread_mutex_t block_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct block_entry {
+	time_t mtime;
+	pfs_size_t bytes;
+	std::string name;
+
+	bool operator<( const block_entry &other ) const {
+		return mtime < other.mtime;
+	}
+};
+
+/*
+Measure the space used by the block cache and, if it is over the
+limit, delete the least recently filled files that are not in use
+until it is comfortably under.  Returns the space still in use.
+*/
+
+static pfs_size_t block_cache_evict( pfs_size_t limit )
+{
+	std::vector<block_entry> entries;
+	pfs_size_t total = 0;
+
+	DIR *dir = opendir(block_dir);
+	if(!dir) return 0;
+
+	struct dirent *d;
+	while((d = readdir(dir))) {
+		/* Maps and files being created have a dot in the name. */
+		if(strchr(d->d_name,'.')) continue;
+
+		char path[PFS_PATH_MAX];
+		struct stat64 info;
+		if(snprintf(path,sizeof(path),"%s/%s",block_dir,d->d_name)>=(int)sizeof(path)) continue;
+		if(::stat64(path,&info)!=0) continue;
+
+		block_entry e;
+		e.mtime = info.st_mtime;
+		e.bytes = (pfs_size_t) info.st_blocks * 512;
+		e.name = path;
+		entries.push_back(e);
+		total += e.bytes;
+	}
+	closedir(dir);
+
+	if(total <= limit) return total;
+
+	std::sort(entries.begin(),entries.end());
+
+	for(std::vector<block_entry>::iterator it = entries.begin(); it != entries.end() && total > limit - limit/10; ++it) {
+		if(hash_table_lookup(open_files,it->name.c_str())) continue;
+
+		std::string map = it->name + ".map";
+		debug(D_CACHE,"evicting %s (%lld bytes)",it->name.c_str(),(long long)it->bytes);
+		::unlink(map.c_str());
+		::unlink(it->name.c_str());
+		total -= it->bytes;
+	}
+
+	return total;
+}
+
+static void block_cache_account( pfs_size_t bytes )
+{
+	if(pfs_sparse_cache_limit<=0) return;
+
+	pthread_mutex_lock(&block_mutex);
+	if(block_bytes_used<0) {
+		block_bytes_used = block_cache_evict(pfs_sparse_cache_limit);
+	} else {
+		block_bytes_used += bytes;
+		if(block_bytes_used > pfs_sparse_cache_limit) {
+			block_bytes_used = block_cache_evict(pfs_sparse_cache_limit);
+		}
+	}
+	pthread_mutex_unlock(&block_mutex);
+}
+
+class pfs_file_block_cached : public pfs_file
+{
+private:
+	int fd;
+	int mapfd;
+	char lpath[PFS_PATH_MAX];
+	pfs_file *rfile;
+	pfs_off_t roffset;
+	int seekable;
+	pfs_size_t size;
+	pfs_size_t block_size;
+	pfs_size_t nblocks;
+	unsigned char *bitmap;
+	time_t ctime;
+	ino_t inode;
+	pthread_mutex_t mutex;
+
+	int present( pfs_size_t b ) {
+		return bitmap[b/8] & (1<<(b%8));
+	}
+
+	void mark( pfs_size_t b ) {
+		bitmap[b/8] |= (1<<(b%8));
+		::full_pwrite64(mapfd,&bitmap[b/8],1,sizeof(struct block_map_header)+b/8);
+	}
+
+	pfs_ssize_t read_remote( char *buffer, pfs_size_t length, pfs_off_t offset ) {
+		pfs_size_t total = 0;
+		while(total<length) {
+			pfs_ssize_t actual = rfile->read(buffer+total,length-total,offset+total);
+			if(actual<=0) break;
+			total += actual;
+		}
+		return total;
+	}
+
+	void close_remote() {
+		if(rfile) {
+			rfile->close();
+			delete rfile;
+			rfile = 0;
+		}
+	}
+
+	/*
+	Fetch blocks first through last.  A service that can only stream
+	delivers everything from the start of the file, so we keep its
+	stream open, store every block that passes by, and start over
+	only to go backwards.
+	*/
+
+	int fetch( pfs_size_t first, pfs_size_t last ) {
+		if(rfile && !seekable && first*block_size < roffset) {
+			close_remote();
+		}
+		if(!rfile) {
+			rfile = name.service->open(&name,O_RDONLY,0);
+			if(!rfile) return -1;
+			roffset = 0;
+			seekable = rfile->is_seekable();
+		}
+
+		pfs_off_t start = seekable ? first*block_size : roffset;
+		pfs_off_t end = MIN((last+1)*block_size,size);
+		pfs_size_t fetched = 0;
+
+		char *buffer = (char*) malloc(block_size);
+		if(!buffer) return -1;
+
+		for(pfs_off_t offset=start; offset<end; offset+=block_size) {
+			pfs_size_t b = offset/block_size;
+			pfs_size_t length = MIN(block_size,size-offset);
+
+			if(read_remote(buffer,length,offset)!=(pfs_ssize_t)length) {
+				debug(D_CACHE,"couldn't fetch block %lld of %s",(long long)b,name.path);
+				close_remote();
+				free(buffer);
+				if(errno==0) errno = EIO;
+				return -1;
+			}
+			roffset = offset+length;
+
+			if(!present(b)) {
+				if(::full_pwrite64(fd,buffer,length,offset)!=(pfs_ssize_t)length) {
+					free(buffer);
+					return -1;
+				}
+				mark(b);
+				fetched += length;
+			}
+		}
+
+		free(buffer);
+
+		debug(D_CACHE,"fetched blocks %lld-%lld of %s",(long long)(start/block_size),(long long)last,name.path);
+		block_cache_account(fetched);
+		return 0;
+	}
+
+	/* Make blocks first through last present, reading ahead past a miss at the end. */
+
+	int load( pfs_size_t first, pfs_size_t last ) {
+		for(pfs_size_t b=first; b<=last; b++) {
+			if(present(b)) continue;
+
+			pfs_size_t end = b;
+			while(end<last && !present(end+1)) end++;
+			if(end==last) {
+				pfs_size_t ahead = MIN(nblocks-1,last+pfs_sparse_cache_readahead);
+				while(end<ahead && !present(end+1)) end++;
+			}
+
+			if(fetch(b,end)<0) return -1;
+			b = end;
+		}
+		return 0;
+	}
+
+public:
+	pfs_file_block_cached( pfs_name *n, int f, int mf, const char *lp, unsigned char *bm, struct pfs_stat *buf ) : pfs_file(n) {
+		fd = f;
+		mapfd = mf;
+		strcpy(lpath,lp);
+		rfile = 0;
+		roffset = 0;
+		seekable = 0;
+		size = buf->st_size;
+		block_size = pfs_sparse_cache_block_size;
+		nblocks = (size+block_size-1)/block_size;
+		bitmap = bm;
+		ctime = buf->st_ctime;
+		inode = buf->st_ino;
+
+		pthread_mutex_init(&mutex,0);
+
+		pthread_mutex_lock(&block_mutex);
+		void *count = hash_table_remove(open_files,lpath);
+		hash_table_insert(open_files,lpath,(void*)((intptr_t)count+1));
+		pthread_mutex_unlock(&block_mutex);
+	}
+
+	virtual ~pfs_file_block_cached() {
+		pthread_mutex_destroy(&mutex);
+	}
+
+	virtual int close() {
+		pthread_mutex_lock(&block_mutex);
+		intptr_t count = (intptr_t) hash_table_remove(open_files,lpath);
+		if(count>1) hash_table_insert(open_files,lpath,(void*)(count-1));
+		pthread_mutex_unlock(&block_mutex);
+		close_remote();
+		free(bitmap);
+		::close(mapfd);
+		::close(fd);
+		return 0;
+	}
+
+	virtual pfs_ssize_t read( void *d, pfs_size_t length, pfs_off_t offset ) {
+		if(offset>=size || length<=0) return 0;
+		length = MIN(length,size-offset);
+
+		pthread_mutex_lock(&mutex);
+		int result = load(offset/block_size,(offset+length-1)/block_size);
+		pthread_mutex_unlock(&mutex);
+		if(result<0) return -1;
+
+		return ::full_pread64(fd,d,length,offset);
+	}
+
+	virtual int fstat( struct pfs_stat *buf ) {
+		int result;
+		struct stat64 lbuf;
+		result = ::fstat64(fd,&lbuf);
+		if(result>=0) {
+			COPY_STAT(lbuf,*buf);
+			buf->st_ctime = ctime;
+			buf->st_ino = inode;
+		}
+		return result;
+	}
+
+	virtual int fstatfs( struct pfs_statfs *buf ) {
+		struct statfs64 lbuf;
+		int result = ::fstatfs64(fd,&lbuf);
+		if(result>=0) COPY_STATFS(lbuf,*buf);
+		return result;
+	}
+
+	virtual pfs_ssize_t get_size() {
+		return size;
+	}
+
+	/* Programs to be executed must be complete on local disk. */
+
+	virtual int get_local_name( char *n ) {
+		pthread_mutex_lock(&mutex);
+		int result = nblocks>0 ? load(0,nblocks-1) : 0;
+		pthread_mutex_unlock(&mutex);
+		if(result<0) return -1;
+		strcpy(n,lpath);
+		return 0;
+	}
+
+	virtual int is_seekable() {
+		return 1;
+	}
+
+	virtual int is_threadsafe() {
+		return name.service->is_threadsafe();
+	}
+};
+
+static int read_map( int fd, int mapfd, struct pfs_stat *buf, unsigned char *bitmap, size_t bitmap_size )
+{
+	struct block_map_header header;
+	struct stat64 info;
+
+	if(::full_pread64(mapfd,&header,sizeof(header),0)!=sizeof(header)) return 0;
+	if(::fstat64(fd,&info)!=0) return 0;
+
+	if(memcmp(header.magic,BLOCK_MAP_MAGIC,sizeof(header.magic))) return 0;
+	if(header.block_size!=pfs_sparse_cache_block_size) return 0;
+	if(header.size!=buf->st_size || header.mtime!=buf->st_mtime) return 0;
+	if(header.data_ino!=(INT64_T)info.st_ino) return 0;
+
+	if(::full_pread64(mapfd,bitmap,bitmap_size,sizeof(header))!=(pfs_ssize_t)bitmap_size) return 0;
+
+	return 1;
+}
+
+/*
+Replace the data and map files with empty ones, renaming them
+into place so that others still using the old ones are unaffected.
+*/
+
+static int create_map( const char *lpath, const char *mpath, int *fd, int *mapfd, struct pfs_stat *buf, size_t bitmap_size )
+{
+	char dtmp[PFS_PATH_MAX];
+	char mtmp[PFS_PATH_MAX];
+	struct block_map_header header;
+	struct stat64 info;
+
+	snprintf(dtmp,sizeof(dtmp),"%s.XXXXXX",lpath);
+	snprintf(mtmp,sizeof(mtmp),"%s.XXXXXX",mpath);
+
+	*fd = mkstemp(dtmp);
+	if(*fd<0) return -1;
+
+	*mapfd = mkstemp(mtmp);
+	if(*mapfd<0) {
+		::close(*fd);
+		::unlink(dtmp);
+		return -1;
+	}
+
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,BLOCK_MAP_MAGIC,sizeof(header.magic));
+	header.block_size = pfs_sparse_cache_block_size;
+	header.size = buf->st_size;
+	header.mtime = buf->st_mtime;
+
+	if(::fchmod(*fd,0700)==0
+	&& ::ftruncate64(*fd,buf->st_size)==0
+	&& ::fstat64(*fd,&info)==0
+	&& (header.data_ino = info.st_ino, ::full_pwrite64(*mapfd,&header,sizeof(header),0)==sizeof(header))
+	&& ::ftruncate64(*mapfd,sizeof(header)+bitmap_size)==0
+	&& ::rename(dtmp,lpath)==0
+	&& ::rename(mtmp,mpath)==0) {
+		return 0;
+	}
+
+	int save_errno = errno;
+	::close(*fd);
+	::close(*mapfd);
+	::unlink(dtmp);
+	::unlink(mtmp);
+	errno = save_errno;
+	return -1;
+}
+
+pfs_file * pfs_block_cache_open( pfs_name *name, struct pfs_stat *buf )
+{
+	char lpath[PFS_PATH_MAX];
+	char mpath[PFS_PATH_MAX];
+	unsigned char digest[MD5_DIGEST_LENGTH];
+	int fd, mapfd;
+
+	if(S_ISDIR(buf->st_mode)) {
+		errno = EISDIR;
+		return 0;
+	}
+
+	if(!block_dir[0]) {
+		snprintf(block_dir,sizeof(block_dir),"%s/blocks",pfs_temp_dir);
+		if(!create_dir(block_dir,0777)) {
+			block_dir[0] = 0;
+			return 0;
+		}
+		open_files = hash_table_create(0,0);
+	}
+
+	md5_buffer(name->path,strlen(name->path),digest);
+	if(snprintf(lpath,sizeof(lpath),"%s/%s",block_dir,md5_string(digest))>=(int)sizeof(lpath) ||
+	   snprintf(mpath,sizeof(mpath),"%s.map",lpath)>=(int)sizeof(mpath)) {
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+
+	pfs_size_t nblocks = (buf->st_size+pfs_sparse_cache_block_size-1)/pfs_sparse_cache_block_size;
+	size_t bitmap_size = (nblocks+7)/8;
+	unsigned char *bitmap = (unsigned char *) calloc(bitmap_size+1,1);
+	if(!bitmap) return 0;
+
+	fd = ::open(lpath,O_RDWR);
+	mapfd = ::open(mpath,O_RDWR);
+
+	if(fd>=0 && mapfd>=0 && read_map(fd,mapfd,buf,bitmap,bitmap_size)) {
+		debug(D_CACHE,"hit %s %s",name->path,lpath);
+	} else {
+		if(fd>=0) ::close(fd);
+		if(mapfd>=0) ::close(mapfd);
+		memset(bitmap,0,bitmap_size);
+		debug(D_CACHE,"miss %s %s",name->path,lpath);
+		if(create_map(lpath,mpath,&fd,&mapfd,buf,bitmap_size)<0) {
+			debug(D_CACHE,"couldn't create %s: %s",lpath,strerror(errno));
+			free(bitmap);
+			return 0;
+		}
+	}
+
+	return new pfs_file_block_cached(name,fd,mapfd,lpath,bitmap,buf);
+}
+
+/* vim: set noexpandtab tabstop=4: */
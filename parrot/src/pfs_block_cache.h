@@ -0,0 +1,14 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef PFS_BLOCK_CACHE_H
+#define PFS_BLOCK_CACHE_H
+
+#include "pfs_file.h"
+
+pfs_file * pfs_block_cache_open( pfs_name *name, struct pfs_stat *buf );
+
+#endif
@@ -102,13 +102,14 @@ int pfs_dir::append( const struct dirent *d )
 	return 1;
 }
 
-int pfs_dir::append (const char *name)
+int pfs_dir::append (const char *name, unsigned char type)
 {
 	debug(D_DEBUG, "append `%s'", name);
 	const char *s;
 	struct dirent d;
 	memset(&d, 0, sizeof(d));
 	strncpy(d.d_name, name, sizeof(d.d_name)-1);
+	d.d_type = type;
 
 	/* Clean up the insane names that systems give us */
 	string_chomp(d.d_name);
@@ -13,6 +13,8 @@ See the file COPYING for details.
 #include "pfs_service.h"
 #include "pfs_file.h"
 
+#include <dirent.h>
+
 #include <vector>
 
 class pfs_dir : public pfs_file {
@@ -24,7 +26,7 @@ public:
 	virtual int fchmod( mode_t mode );
 	virtual int fchown( uid_t uid, gid_t gid );
 
-	virtual int append( const char *name );
+	virtual int append( const char *name, unsigned char type = DT_UNKNOWN );
 	virtual int append( const struct dirent *d );
 	virtual struct dirent * fdreaddir( pfs_off_t offset, pfs_off_t *next_offset );
 
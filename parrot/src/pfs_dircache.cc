@@ -14,6 +14,7 @@ extern "C" {
 #include "xxmalloc.h"
 }
 
+#include <dirent.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -69,7 +70,7 @@ void pfs_dircache::insert( const char *name, struct pfs_stat *buf, pfs_dir *dir
 
 	if (!dircache_table) dircache_table = hash_table_create(0, 0);
 
-	dir->append(name);
+	dir->append(name, IFTODT(buf->st_mode));
 
 	copy = (struct pfs_stat *)xxmalloc(sizeof(struct pfs_stat));
 	*copy = *buf;
@@ -10,6 +10,7 @@ See the file COPYING for details.
 #include "pfs_dispatch.h"
 #include "pfs_pointer.h"
 #include "pfs_process.h"
+#include "pfs_profile.h"
 #include "pfs_service.h"
 #include "pfs_sys.h"
 #include "pfs_sysdeps.h"
@@ -3600,9 +3601,13 @@ void pfs_dispatch32( struct pfs_process *p )
 	switch(p->state) {
 		case PFS_PROCESS_STATE_KERNEL:
 			decode_syscall(p,0);
+			if(pfs_profile_enabled && p->state == PFS_PROCESS_STATE_USER)
+				pfs_profile_syscall_exit(p);
 			break;
 		case PFS_PROCESS_STATE_USER:
 			p->nsyscalls += 1;
+			if(pfs_profile_enabled)
+				pfs_profile_syscall_enter(p);
 			decode_syscall(p,1);
 			break;
 		default:
@@ -3612,7 +3617,7 @@ void pfs_dispatch32( struct pfs_process *p )
 	switch(p->state) {
 		case PFS_PROCESS_STATE_KERNEL:
 		case PFS_PROCESS_STATE_USER:
-			tracer_continue(p->tracer,0);
+			pfs_process_continue(p,0);
 			break;
 		default:
 			assert(0);
@@ -20,10 +20,12 @@ int pfs_dispatch64( struct pfs_process *p )
 #include "pfs_sysdeps64.h"
 
 #include "linux-version.h"
+#include "pfs_async.h"
 #include "pfs_channel.h"
 #include "pfs_dispatch.h"
 #include "pfs_pointer.h"
 #include "pfs_process.h"
+#include "pfs_profile.h"
 #include "pfs_service.h"
 #include "pfs_sys.h"
 #include "pfs_time.h"
@@ -137,6 +139,7 @@ extern INT64_T pfs_write_count;
 
 extern int parrot_dir_fd;
 extern int *pfs_syscall_totals64;
+extern int pfs_trace_seccomp;
 
 int pfs_dispatch_prepexe (struct pfs_process *p, char exe[PATH_MAX], const char *physical_name);
 int pfs_dispatch_isexe( const char *path, uid_t *uid, gid_t *gid );
@@ -250,6 +253,183 @@ the same as read, but only the first chunk is actually
 read.  The caller must examine the result and then keep reading.
 */
 
+/*
+Deliver the result of a read in p->syscall_result, with the data in buf,
+to the process that asked for length bytes at uaddr.
+*/
+
+static void read_finish( struct pfs_process *p, void *uaddr, size_t length, char *buf )
+{
+	if (p->syscall_result >= 0) {
+		if (p->syscall_result == 0) {
+			divert_to_dummy(p, 0);
+		}
+		ssize_t count = tracer_copy_out(p->tracer, buf, uaddr, p->syscall_result, TRACER_O_ATOMIC|TRACER_O_FAST);
+		if (count == p->syscall_result) {
+			divert_to_dummy(p, p->syscall_result);
+		} else if (count == -1 && errno != ENOSYS) {
+			debug(D_DEBUG, "tracer memory write failed: %s", strerror(errno));\
+			divert_to_dummy(p, -errno);
+		} else if(pfs_channel_alloc(0,length,&p->io_channel_offset)) {
+			char *local_addr = pfs_channel_base() + p->io_channel_offset;
+			memcpy(local_addr, buf, p->syscall_result);
+			p->diverted_length = 0;
+			divert_to_channel(p,SYSCALL64_pread64,uaddr,p->syscall_result,p->io_channel_offset);
+			pfs_read_count += p->syscall_result;
+		} else {
+			divert_to_dummy(p,-ENOMEM);
+		}
+	} else {
+		divert_to_dummy(p,-errno);
+	}
+}
+
+static void decode_read_done( struct pfs_async_read *r )
+{
+	struct pfs_process *p = r->p;
+
+	debug(D_LIBCALL,"= %d [async read]",(int)r->result);
+
+	p->state = PFS_PROCESS_STATE_KERNEL;
+	p->syscall_result = r->result;
+	errno = r->error ? r->error : ENOENT;
+	read_finish(p,r->uaddr,r->length,r->buffer);
+	pfs_process_continue(p,0);
+}
+
+/*
+A read from a remote file that is safe to read from another thread
+goes to an I/O thread, leaving the process stopped until it is done.
+*/
+
+static int decode_read_async( struct pfs_process *p, INT64_T syscall, int fd, void *uaddr, size_t length, pfs_off_t offset )
+{
+	if(!pfs_io_threads || length==0 || !p->table->isparrot(fd)) return 0;
+
+	pfs_pointer *pointer = p->table->hold(fd);
+	if(!pointer) return 0;
+
+	pfs_file *file = pointer->file;
+	if(file->get_name()->is_local || !file->is_threadsafe() || !file->is_seekable()) {
+		pfs_table::release(pointer);
+		return 0;
+	}
+
+	char *buffer = (char *) malloc(length);
+	if(!buffer) {
+		pfs_table::release(pointer);
+		return 0;
+	}
+
+	debug(D_LIBCALL,"%s %d %p %lld [async]",syscall==SYSCALL64_read ? "read" : "pread",fd,uaddr,(long long)length);
+
+	struct pfs_async_read *r = new struct pfs_async_read;
+	r->p = p;
+	r->pointer = pointer;
+	r->buffer = buffer;
+	r->length = length;
+	r->offset = offset;
+	r->advance = (syscall==SYSCALL64_read);
+	r->uaddr = uaddr;
+	r->done = decode_read_done;
+
+	p->state = PFS_PROCESS_STATE_WAITREAD;
+	pfs_async_read(r);
+	return 1;
+}
+
+/*
+A large read from a file that has a local descriptor behind it, such
+as a local or cached file, is copied to the process straight from a
+mapping of that file, just as often as a native read would copy it.
+If the file shrinks under the mapping, the copy fails rather than
+faulting, and the read is done the ordinary way.  Smaller reads are
+cheaper to copy through the channel than to map.
+*/
+
+#define MAPPED_READ_MIN (512*1024)
+
+static int decode_read_mapped( struct pfs_process *p, INT64_T syscall, int fd, void *uaddr, size_t length, pfs_off_t offset )
+{
+	static long page_size = 0;
+	struct stat64 buf;
+	int result = 0;
+
+	if(!p->table->isparrot(fd)) return 0;
+
+	pfs_pointer *pointer = p->table->hold(fd);
+	if(!pointer) return 0;
+
+	int rfd = pointer->file->get_real_fd();
+	if(rfd<0 || (pointer->flags&O_ACCMODE)==O_WRONLY) goto out;
+	if(::fstat64(rfd,&buf)<0 || !S_ISREG(buf.st_mode)) goto out;
+
+	if(syscall==SYSCALL64_read) offset = pointer->tell();
+	if(offset<0) goto out;
+
+	if(offset>=buf.st_size) {
+		divert_to_dummy(p,0);
+		result = 1;
+	} else {
+		if(!page_size) page_size = sysconf(_SC_PAGE_SIZE);
+
+		size_t count = MIN((pfs_off_t)length,buf.st_size-offset);
+		pfs_off_t start = offset - offset%page_size;
+		size_t maplength = count + (offset-start);
+
+		void *map = ::mmap(0,maplength,PROT_READ,MAP_SHARED,rfd,start);
+		if(map==MAP_FAILED) goto out;
+
+		ssize_t actual = tracer_copy_out(p->tracer,(char *)map+(offset-start),uaddr,count,TRACER_O_ATOMIC|TRACER_O_FAST);
+		::munmap(map,maplength);
+
+		if(actual==(ssize_t)count) {
+			debug(D_LIBCALL,"%s %d %p %lld = %lld [mapped]",syscall==SYSCALL64_read ? "read" : "pread",fd,uaddr,(long long)length,(long long)actual);
+			if(syscall==SYSCALL64_read) pointer->bump(actual);
+			pfs_read_count += actual;
+			divert_to_dummy(p,actual);
+			result = 1;
+		}
+	}
+
+out:
+	pfs_table::release(pointer);
+	return result;
+}
+
+/*
+A read too large for the stack buffer goes straight into the channel,
+and the process then picks up the data with a pread from the channel,
+so that it is copied once on each side and never through a buffer
+that must be allocated and faulted in for this call alone.
+*/
+
+static int decode_read_channel( struct pfs_process *p, INT64_T syscall, int fd, void *uaddr, size_t length, pfs_off_t offset )
+{
+	pfs_size_t channel_offset;
+
+	if(!pfs_channel_alloc(0,length,&channel_offset)) return 0;
+
+	char *buf = pfs_channel_base() + channel_offset;
+
+	if(syscall==SYSCALL64_read) {
+		p->syscall_result = pfs_read(fd,buf,length);
+	} else if(syscall==SYSCALL64_pread64) {
+		p->syscall_result = pfs_pread(fd,buf,length,offset);
+	} else assert(0);
+
+	if(p->syscall_result>0) {
+		p->io_channel_offset = channel_offset;
+		divert_to_channel(p,SYSCALL64_pread64,uaddr,p->syscall_result,channel_offset);
+		pfs_read_count += p->syscall_result;
+	} else {
+		pfs_channel_free(channel_offset);
+		divert_to_dummy(p,p->syscall_result==0 ? 0 : -errno);
+	}
+
+	return 1;
+}
+
 static void decode_read( struct pfs_process *p, int entering, INT64_T syscall, const INT64_T *args )
 {
 	int fd = args[0];
@@ -262,6 +442,10 @@ static void decode_read( struct pfs_process *p, int entering, INT64_T syscall, c
 		char *buf = NULL;
 		size_t l;
 
+		if(decode_read_async(p,syscall,fd,uaddr,length,offset)) return;
+		if(length >= MAPPED_READ_MIN && decode_read_mapped(p,syscall,fd,uaddr,length,offset)) return;
+		if(length > sizeof(_buf) && decode_read_channel(p,syscall,fd,uaddr,length,offset)) return;
+
 		if (length > sizeof(_buf)) {
 			buf = (char *)malloc(length);
 			l = length;
@@ -277,28 +461,7 @@ static void decode_read( struct pfs_process *p, int entering, INT64_T syscall, c
 			p->syscall_result = pfs_pread(fd,buf,l,offset);
 		} else assert(0);
 
-		if (p->syscall_result >= 0) {
-			if (p->syscall_result == 0) {
-				divert_to_dummy(p, 0);
-			}
-			ssize_t count = tracer_copy_out(p->tracer, buf, uaddr, p->syscall_result, TRACER_O_ATOMIC|TRACER_O_FAST);
-			if (count == p->syscall_result) {
-				divert_to_dummy(p, p->syscall_result);
-			} else if (count == -1 && errno != ENOSYS) {
-				debug(D_DEBUG, "tracer memory write failed: %s", strerror(errno));\
-				divert_to_dummy(p, -errno);
-			} else if(pfs_channel_alloc(0,length,&p->io_channel_offset)) {
-				char *local_addr = pfs_channel_base() + p->io_channel_offset;
-				memcpy(local_addr, buf, p->syscall_result);
-				p->diverted_length = 0;
-				divert_to_channel(p,SYSCALL64_pread64,uaddr,p->syscall_result,p->io_channel_offset);
-				pfs_read_count += p->syscall_result;
-			} else {
-				divert_to_dummy(p,-ENOMEM);
-			}
-		} else {
-			divert_to_dummy(p,-errno);
-		}
+		read_finish(p,uaddr,length,buf);
 
 		if (buf != _buf) {
 			free(buf);
@@ -2648,19 +2811,28 @@ static void decode_syscall( struct pfs_process *p, int entering )
 			break;
 
 		case SYSCALL64_newfstatat:
-			if (entering && p->table->isnative(args[0])) {
-				/* The only way a process has a native fd directory is it it
-				 * receives it from an external process not being traced, via
-				 * recvmsg. This is not allowed.
-				 */
-				divert_to_dummy(p, -ENOTDIR);
-				break;
-			}
 			if(entering) {
 				struct pfs_stat lbuf;
 				struct pfs_kernel_stat kbuf;
 
 				TRACER_MEM_OP(tracer_copy_in_string(p->tracer,path,POINTER(args[1]),sizeof(path),0));
+
+				/* Recent versions of glibc implement fstat this way. */
+				int empty_path = (args[3] & AT_EMPTY_PATH) && path[0] == 0;
+
+				if (p->table->isnative(args[0])) {
+					if (empty_path) {
+						debug(D_DEBUG, "fallthrough %s(%" PRId64 ", \"\", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[2], args[3]);
+						break;
+					}
+					/* The only way a process has a native fd directory is it it
+					 * receives it from an external process not being traced, via
+					 * recvmsg. This is not allowed.
+					 */
+					divert_to_dummy(p, -ENOTDIR);
+					break;
+				}
+
 				p->syscall_result = pfs_fstatat(args[0],path,&lbuf,args[3]);
 				if(p->syscall_result<0) {
 					p->syscall_result = -errno;
@@ -3257,6 +3429,40 @@ done:
 	}
 }
 
+/*
+With the seccomp filter, the filter cannot tell a native fd from a
+Parrot fd, so all I/O on descriptors stops on the way in.  When the
+fd turns out to be native, the call goes through untouched and there
+is nothing to do on the way out, so we need not stop there either.
+*/
+
+static int native_fd_syscall( struct pfs_process *p )
+{
+	if(p->syscall_dummy || p->syscall_args_changed)
+		return 0;
+
+	switch(p->syscall) {
+		case SYSCALL64_read:
+		case SYSCALL64_pread64:
+		case SYSCALL64_write:
+		case SYSCALL64_pwrite64:
+		case SYSCALL64_readv:
+		case SYSCALL64_writev:
+		case SYSCALL64_lseek:
+		case SYSCALL64_ftruncate:
+		case SYSCALL64_fstat:
+		case SYSCALL64_fstatfs:
+		case SYSCALL64_flock:
+		case SYSCALL64_fsync:
+		case SYSCALL64_fdatasync:
+		case SYSCALL64_getdents:
+		case SYSCALL64_getdents64:
+			return p->table->isnative(p->syscall_args[0]);
+		default:
+			return 0;
+	}
+}
+
 void pfs_dispatch64( struct pfs_process *p )
 {
 	struct pfs_process *oldcurrent = pfs_current;
@@ -3265,10 +3471,19 @@ void pfs_dispatch64( struct pfs_process *p )
 	switch(p->state) {
 		case PFS_PROCESS_STATE_KERNEL:
 			decode_syscall(p,0);
+			if(pfs_profile_enabled && p->state == PFS_PROCESS_STATE_USER)
+				pfs_profile_syscall_exit(p);
 			break;
 		case PFS_PROCESS_STATE_USER:
 			p->nsyscalls += 1;
+			if(pfs_profile_enabled)
+				pfs_profile_syscall_enter(p);
 			decode_syscall(p,1);
+			if(pfs_trace_seccomp && p->state == PFS_PROCESS_STATE_KERNEL && native_fd_syscall(p)) {
+				p->state = PFS_PROCESS_STATE_USER;
+				if(pfs_profile_enabled)
+					pfs_profile_syscall_exit(p);
+			}
 			break;
 		default:
 			assert(0);
@@ -3277,7 +3492,10 @@ void pfs_dispatch64( struct pfs_process *p )
 	switch(p->state) {
 		case PFS_PROCESS_STATE_KERNEL:
 		case PFS_PROCESS_STATE_USER:
-			tracer_continue(p->tracer,0);
+			pfs_process_continue(p,0);
+			break;
+		case PFS_PROCESS_STATE_WAITREAD:
+			/* Continued by decode_read_done. */
 			break;
 		default:
 			assert(0);
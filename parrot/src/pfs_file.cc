@@ -174,4 +174,14 @@ int pfs_file::is_seekable()
 	return name.service->is_seekable();
 }
 
+/*
+A file is thread safe if read may run on an I/O thread while the
+main thread goes on using this and other files.
+*/
+
+int pfs_file::is_threadsafe()
+{
+	return 0;
+}
+
 /* vim: set noexpandtab tabstop=4: */
@@ -7,7 +7,9 @@ See the file COPYING for details.
 
 #include "pfs_file.h"
 #include "pfs_file_cache.h"
+#include "pfs_block_cache.h"
 #include "pfs_service.h"
+#include "pfs_writeback.h"
 
 extern "C" {
 #include "debug.h"
@@ -16,6 +18,7 @@ extern "C" {
 #include "file_cache.h"
 #include "full_io.h"
 #include "hash_table.h"
+#include "macros.h"
 }
 
 #include <unistd.h>
@@ -32,8 +35,7 @@ extern "C" {
 extern struct file_cache *pfs_file_cache;
 extern int pfs_session_cache;
 extern int pfs_master_timeout;
-
-static struct hash_table * not_found_table = 0;
+extern int pfs_sparse_cache;
 
 #define BUFFER_SIZE 65536
 
@@ -55,6 +57,68 @@ static pfs_ssize_t copy_fd_to_file( int fd, pfs_file *file )
 	}
 }
 
+static pfs_ssize_t copy_range_to_file( int fd, pfs_file *file, pfs_off_t offset, pfs_off_t end )
+{
+	pfs_ssize_t ractual, wactual;
+	char buffer[BUFFER_SIZE];
+
+	while(offset<end) {
+		ractual = full_pread64(fd,buffer,MIN((pfs_off_t)sizeof(buffer),end-offset),offset);
+		if(ractual<=0) return ractual;
+
+		wactual = file->write(buffer,ractual,offset);
+		if(wactual>=0) {
+			offset += wactual;
+		} else {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+Store a cached file back to its service.  If the service can write at
+an offset, and the remote file already holds everything outside of the
+range from start to end, only that range is sent.  Otherwise, or if
+that fails, the file is stored whole.
+*/
+
+int pfs_cache_store( pfs_name *name, int fd, mode_t mode, pfs_off_t start, pfs_off_t end )
+{
+	pfs_file *wfile;
+	int result;
+
+	if(start<end) {
+		debug(D_CACHE,"storing %lld bytes at %lld of %s",(long long)(end-start),(long long)start,name->path);
+		wfile = name->service->open(name,O_WRONLY,mode);
+		if(wfile) {
+			result = copy_range_to_file(fd,wfile,start,end);
+			if(wfile->close()<0) result = -1;
+			delete wfile;
+			if(result==0) return 0;
+		}
+		debug(D_CACHE,"couldn't store part of %s, storing it whole",name->path);
+	}
+
+	debug(D_CACHE,"storing %s",name->path);
+	wfile = name->service->open(name,O_WRONLY|O_CREAT|O_TRUNC,mode);
+	if(wfile) {
+		if(copy_fd_to_file(fd,wfile)==0) {
+			result = 0;
+		} else {
+			result = -1;
+		}
+		/* The service may only find out at close that the data was lost. */
+		if(wfile->close()<0) result = -1;
+		delete wfile;
+	} else {
+		result = -1;
+	}
+
+	return result;
+}
+
 static pfs_ssize_t copy_file_to_fd( pfs_file *file, int fd )
 {
 	pfs_ssize_t ractual, wactual, offset = 0;
@@ -82,31 +146,48 @@ private:
 	time_t ctime;
 	ino_t inode;
 
+	/*
+	The range written since the file was last stored, and whether the
+	remote file still holds the rest of it, so that only the range
+	need be sent.
+	*/
+	pfs_off_t dirty_start;
+	pfs_off_t dirty_end;
+	int partial;
+
+	int store() {
+		pfs_off_t start = 0, end = 0;
+		if(partial && dirty_start<dirty_end) {
+			start = dirty_start;
+			end = dirty_end;
+		}
+
+		if(pfs_write_back) {
+			char local[PFS_PATH_MAX];
+			if(file_cache_contains(pfs_file_cache,name.path,local)==0 && pfs_writeback_queue(&name,local,mode,start,end)==0) {
+				return 0;
+			}
+			debug(D_CACHE,"couldn't queue %s for upload: %s",name.path,strerror(errno));
+		}
+
+		return pfs_cache_store(&name,fd,mode,start,end);
+	}
+
 public:
-	pfs_file_cached( pfs_name *n, int f, int m, time_t c, ino_t i ) : pfs_file(n) {
+	pfs_file_cached( pfs_name *n, int f, int m, time_t c, ino_t i, int p ) : pfs_file(n) {
 		fd = f;
 		mode = m;
 		changed = 0;
 		ctime = c;
 		inode = i;
+		dirty_start = dirty_end = 0;
+		partial = p;
 	}
 
 	virtual int close() {
 		int result = -1;
 		if(changed) {
-			debug(D_CACHE,"storing %s",name.path);
-			pfs_file *wfile = name.service->open(&name,O_WRONLY|O_CREAT|O_TRUNC,mode);
-			if(wfile) {
-				if(copy_fd_to_file(fd,wfile)==0) {
-					result = 0;
-				} else {
-					result = -1;
-				}
-				wfile->close();
-				delete wfile;
-			} else {
-				result = -1;
-			}
+			result = store();
 		} else {
 			result = 0;
 		}
@@ -117,13 +198,43 @@ public:
 		return result;
 	}
 
+	/*
+	In write-back mode, the data is durable once any upload queued
+	at an earlier close is done, and the changes since are stored.
+	*/
+	virtual int fsync() {
+		if(!pfs_write_back) return 0;
+
+		pfs_writeback_wait(name.path);
+		if(!changed) return 0;
+
+		int result = pfs_cache_store(&name,fd,mode,partial ? dirty_start : 0,partial ? dirty_end : 0);
+		pfs_service_invalidate(&name);
+		if(result==0) {
+			changed = 0;
+			dirty_start = dirty_end = 0;
+			partial = name.service->is_seekable();
+		}
+		return result;
+	}
+
 	virtual pfs_ssize_t read( void *d, pfs_size_t length, pfs_off_t offset ) {
 		return ::full_pread64(fd,d,length,offset);
 	}
 
 	virtual pfs_ssize_t write( const void *d, pfs_size_t length, pfs_off_t offset ) {
+		pfs_ssize_t result = ::full_pwrite64(fd,d,length,offset);
+		if(result>0) {
+			if(dirty_start<dirty_end) {
+				dirty_start = MIN(dirty_start,offset);
+				dirty_end = MAX(dirty_end,offset+result);
+			} else {
+				dirty_start = offset;
+				dirty_end = offset+result;
+			}
+		}
 		changed = 1;
-		return ::full_pwrite64(fd,d,length,offset);
+		return result;
 	}
 
 	virtual int fstat( struct pfs_stat *buf ) {
@@ -147,6 +258,7 @@ public:
 
 	virtual int ftruncate( pfs_size_t length ) {
 		changed = 1;
+		partial = 0;
 		return ::ftruncate64(fd,length);
 	}
 
@@ -163,6 +275,10 @@ public:
 		return file_cache_contains(pfs_file_cache,name.path,n);
 	}
 
+	virtual int get_real_fd() {
+		return fd;
+	}
+
 	virtual int is_seekable() {
 		return 1;
 	}
@@ -176,6 +292,10 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 	struct pfs_file *rfile, *result = NULL;
 	struct utimbuf ut;
 	int sleep_time = 1;
+	int partial = name->service->is_seekable() && !(flags&O_TRUNC);
+
+	/* An upload still under way would race with the cached copy. */
+	pfs_writeback_wait(name->path);
 
 	retry:
 
@@ -183,17 +303,8 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 	buf.st_size = 0;
 	buf.st_ino = hash_string(name->rest);
 
-	if(pfs_session_cache) {
-		if(!not_found_table) not_found_table = hash_table_create(0,0);
-
-		if(!(flags&O_CREAT)) {
-			if(hash_table_lookup(not_found_table,name->path)) {
-				errno = ENOENT;
-				return 0;
-			}
-		}
-	} else {
-		if(name->service->stat(name,&buf)!=0) {
+	if(!pfs_session_cache) {
+		if(pfs_service_stat(name,&buf)!=0) {
 			if(flags&O_CREAT && errno==ENOENT) {
 				buf.st_mtime = 0;
 				buf.st_size = 0;
@@ -203,11 +314,23 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 		}
 	}
 
+	/*
+	A file opened only for reading may be cached block by block,
+	so that only the parts actually read are fetched.
+	*/
+
+	if(pfs_sparse_cache && (flags&O_ACCMODE)==O_RDONLY && !(flags&(O_CREAT|O_TRUNC))) {
+		if(pfs_session_cache && pfs_service_stat(name,&buf)!=0) {
+			return 0;
+		}
+		return pfs_block_cache_open(name,&buf);
+	}
 
 	fd = file_cache_open(pfs_file_cache,name->path,flags,txn,buf.st_size,0);
 	if(fd>=0) {
 		if(flags&O_TRUNC) ftruncate(fd,0);
-		return new pfs_file_cached(name,fd,mode,buf.st_ctime,buf.st_ino);
+		/* Without a stat, the remote file may not match the cache. */
+		return new pfs_file_cached(name,fd,mode,buf.st_ctime,buf.st_ino,partial && !pfs_session_cache);
 	} else {
 		debug(D_DEBUG, "file cache lookup failed: %s", strerror(errno));
 	}
@@ -247,7 +370,7 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 				ut.modtime = buf.st_mtime;
 				::utime(txn,&ut);
 				if(file_cache_commit(pfs_file_cache,name->path,txn)==0) {
-					result = new pfs_file_cached(name,fd,mode,buf.st_ctime,buf.st_ino);
+					result = new pfs_file_cached(name,fd,mode,buf.st_ctime,buf.st_ino,partial);
 				} else {
 					result = 0;
 				}
@@ -261,10 +384,13 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 		delete rfile;
 		errno = save_errno;
 	} else if(ok_to_fail) {
-		result = name->service->open(name,flags,mode);
-		if(result) {
-			result->close();
-			result = new pfs_file_cached(name,fd,mode,buf.st_ctime,buf.st_ino);
+		rfile = name->service->open(name,flags,mode);
+		if(rfile) {
+			rfile->close();
+			delete rfile;
+			/* Otherwise the abandoned transaction stalls the next lookup. */
+			file_cache_commit(pfs_file_cache,name->path,txn);
+			result = new pfs_file_cached(name,fd,mode,buf.st_ctime,buf.st_ino,0);
 			if(result) result->ftruncate(0);
 		}
 	} else {
@@ -276,9 +402,6 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 	} else {
 		close(fd);
 		file_cache_abort(pfs_file_cache,name->path,txn);
-		if(pfs_session_cache && errno==ENOENT) {
-			hash_table_insert(not_found_table,name->path,(void*)1);
-		}
 		return 0;
 	}
 }
@@ -286,10 +409,7 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 int pfs_cache_invalidate( pfs_name *name )
 {
 	if(!name->is_local) {
-		if(pfs_session_cache) {
-			if(!not_found_table) not_found_table = hash_table_create(0,0);
-			hash_table_remove(not_found_table,name->path);
-		}
+		pfs_service_invalidate(name);
 		return file_cache_delete(pfs_file_cache,name->path);
 	} else {
 		return 0;
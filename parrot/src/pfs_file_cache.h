@@ -12,5 +12,6 @@ See the file COPYING for details.
 
 pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode );
 int        pfs_cache_invalidate( pfs_name *name );
+int        pfs_cache_store( pfs_name *name, int fd, mode_t mode, pfs_off_t start, pfs_off_t end );
 
 #endif
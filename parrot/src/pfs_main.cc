@@ -6,6 +6,10 @@ See the file COPYING for details.
 */
 
 #include "linux-version.h"
+#include "pfs_async.h"
+#include "pfs_prefetch.h"
+#include "pfs_profile.h"
+#include "pfs_writeback.h"
 #include "pfs_channel.h"
 #include "pfs_critical.h"
 #include "pfs_dispatch.h"
@@ -19,6 +23,7 @@ See the file COPYING for details.
 extern "C" {
 #include "parrot_client.h"
 #include "pfs_resolve.h"
+#include "pfs_seccomp.h"
 #include "pfs_mountfile.h"
 }
 
@@ -104,6 +109,11 @@ int pfs_enable_small_file_optimizations = 1;
 int set_foreground = 1;
 int pfs_syscall_disable_debug = 0;
 int pfs_allow_dynamic_mounts = 0;
+int pfs_trace_seccomp = 0;
+int pfs_sparse_cache = 0;
+pfs_size_t pfs_sparse_cache_block_size = 1024*1024;
+int pfs_sparse_cache_readahead = 2;
+pfs_size_t pfs_sparse_cache_limit = 0;
 
 char sys_temp_dir[PATH_MAX] = "/tmp";
 char pfs_temp_dir[PATH_MAX];
@@ -178,6 +188,19 @@ enum {
 	LONG_OPT_DISABLE_SERVICE,
 	LONG_OPT_NO_FLOCK,
 	LONG_OPT_EXT_IMAGE,
+	LONG_OPT_SECCOMP,
+	LONG_OPT_SPARSE_CACHE,
+	LONG_OPT_SPARSE_CACHE_BLOCK_SIZE,
+	LONG_OPT_SPARSE_CACHE_READAHEAD,
+	LONG_OPT_SPARSE_CACHE_LIMIT,
+	LONG_OPT_IO_THREADS,
+	LONG_OPT_METADATA_CACHE,
+	LONG_OPT_PREFETCH_LIST,
+	LONG_OPT_PREFETCH_JOBS,
+	LONG_OPT_PROFILE,
+	LONG_OPT_WRITE_BACK,
+	LONG_OPT_WRITE_BACK_JOBS,
+	LONG_OPT_WRITE_BACK_QUEUE,
 };
 
 static void get_linux_version(const char *cmd)
@@ -287,6 +310,19 @@ static void show_help( const char *cmd )
 	printf( " %-30s Enable automatic decompression on .gz files.\n", "-Z,--auto-decompress");
 	printf( " %-30s Disable the given service.\n", "--disable-service");
 	printf( " %-30s Make flock a no-op.\n", "--no-flock");
+	printf( " %-30s Stop only for system calls that need Parrot.     (PARROT_SECCOMP)\n", "   --seccomp");
+	printf( " %-30s Cache remote files by blocks, fetching only what is read.\n", "   --sparse-cache");
+	printf( " %-30s Size of a cached block. (default 1M)\n", "   --sparse-cache-block-size=<bytes>");
+	printf( " %-30s Blocks to read ahead after a miss. (default 2)\n", "   --sparse-cache-readahead=<num>");
+	printf( " %-30s Evict blocks beyond this much space. (default unlimited)\n", "   --sparse-cache-limit=<bytes>");
+	printf( " %-30s Read remote files on this many threads.  (PARROT_IO_THREADS)\n", "   --io-threads=<num>");
+	printf( " %-30s Keep remote stat results this long.  (PARROT_METADATA_CACHE)\n", "   --metadata-cache=[<service>:]<secs>");
+	printf( " %-30s Prefetch the remote files in this list, then record this run's. (PARROT_PREFETCH_LIST)\n", "   --prefetch-list=<file>");
+	printf( " %-30s Number of processes prefetching files. (default 8)\n", "   --prefetch-jobs=<num>");
+	printf( " %-30s Profile system calls into this file, also on SIGUSR2. (PARROT_PROFILE)\n", "   --profile=<file>");
+	printf( " %-30s Store written files in the background.  (PARROT_WRITE_BACK)\n", "   --write-back");
+	printf( " %-30s Number of processes storing files. (default 4)\n", "   --write-back-jobs=<num>");
+	printf( " %-30s Wait at close beyond this many uploads. (default 32)\n", "   --write-back-queue=<num>");
 	printf("\n");
 	printf("Filesystem Options:\n");
 	printf( " %-30s Mount a read-only ext[234] disk image.\n", "--ext <image>=<mountpoint>");
@@ -389,13 +425,18 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 
 	p = pfs_process_lookup(pid);
 	if(!p) {
-		debug(D_PROCESS,"ignoring event %d for unknown pid %d",status,pid);
+		if(!pfs_prefetch_exited(pid) && !pfs_writeback_exited(pid))
+			debug(D_PROCESS,"ignoring event %d for unknown pid %d",status,pid);
 		return;
 	}
 
 	if (WIFSTOPPED(status) && WSTOPSIG(status) == (SIGTRAP|0x80)) {
 		/* The common case, a syscall delivery stop. */
 		pfs_dispatch(p);
+	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP<<8))) {
+		/* The seccomp filter stops in place of the syscall-entry stop. */
+		assert(p->state == PFS_PROCESS_STATE_USER);
+		pfs_dispatch(p);
 	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_CLONE<<8)) || status>>8 == (SIGTRAP | (PTRACE_EVENT_FORK<<8)) || status>>8 == (SIGTRAP | (PTRACE_EVENT_VFORK<<8))) {
 		pid_t cpid;
 		struct pfs_process *child;
@@ -414,11 +455,11 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 		}
 		child = pfs_process_create(cpid,p,p->syscall_args[0]&CLONE_THREAD,clone_files);
 		child->syscall_result = 0;
-		if (tracer_continue(p->tracer,0) == -1) /* child starts stopped. */
+		if (pfs_process_continue(p,0) == -1) /* child starts stopped. */
 			return;
 	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_EXEC<<8))) {
 		pfs_process_exec(p);
-		if (tracer_continue(p->tracer,0) == -1)
+		if (pfs_process_continue(p,0) == -1)
 			return;
 	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_EXIT<<8)) || WIFEXITED(status) || WIFSIGNALED(status)) {
 		/* In my own testing, if we use PTRACE_O_TRACEEXIT then we never get
@@ -460,7 +501,7 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 			 *     PTRACE_SEIZE was used.
 			 */
 			debug(D_DEBUG, "%d received PTRACE_EVENT_STOP, continuing...", (int)pid);
-			if (tracer_continue(p->tracer, 0) == -1)
+			if (pfs_process_continue(p, 0) == -1)
 				return;
 		} else if((linux_available(3,4,0) && ((status>>16) == PTRACE_EVENT_STOP)) || (!linux_available(3,4,0) && SIG_ISSTOP(signum) && ptrace(PTRACE_GETSIGINFO, pid, 0, &info) == -1 && errno == EINVAL)) {
 			/* group-stop, `man ptrace` for more information */
@@ -514,7 +555,7 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 					break;
 				}
 			}
-			if (tracer_continue(p->tracer,signum) == -1) /* deliver (or not) the signal */
+			if (pfs_process_continue(p,signum) == -1) /* deliver (or not) the signal */
 				return;
 		}
 	} else {
@@ -740,6 +781,24 @@ int main( int argc, char *argv[] )
 	s = getenv("PARROT_FORCE_SYNC");
 	if(s) pfs_force_sync = 1;
 
+	s = getenv("PARROT_SECCOMP");
+	if(s) pfs_trace_seccomp = 1;
+
+	s = getenv("PARROT_SPARSE_CACHE");
+	if(s) pfs_sparse_cache = 1;
+
+	s = getenv("PARROT_IO_THREADS");
+	if(s) pfs_io_threads = atoi(s);
+
+	s = getenv("PARROT_METADATA_CACHE");
+	if(s) pfs_service_set_metadata_ttl(0,atoi(s));
+
+	const char *prefetch_list = getenv("PARROT_PREFETCH_LIST");
+	const char *profile_file = getenv("PARROT_PROFILE");
+
+	s = getenv("PARROT_WRITE_BACK");
+	if(s) pfs_write_back = 1;
+
 	s = getenv("PARROT_LDSO_PATH");
 	if(s) snprintf(pfs_ldso_path, sizeof(pfs_ldso_path), "%s", s);
 
@@ -837,6 +896,11 @@ int main( int argc, char *argv[] )
 		{"help", no_argument, 0, 'h'},
 		{"helper", no_argument, 0, LONG_OPT_HELPER},
 		{"hostname", required_argument, 0, 'N'},
+		{"io-threads", required_argument, 0, LONG_OPT_IO_THREADS},
+		{"metadata-cache", required_argument, 0, LONG_OPT_METADATA_CACHE},
+		{"prefetch-list", required_argument, 0, LONG_OPT_PREFETCH_LIST},
+		{"prefetch-jobs", required_argument, 0, LONG_OPT_PREFETCH_JOBS},
+		{"profile", required_argument, 0, LONG_OPT_PROFILE},
 		{"ld-path", required_argument, 0, 'l'},
 		{"mount", required_argument, 0, 'M'},
 		{"name-list", required_argument, 0, 'n'},
@@ -853,6 +917,11 @@ int main( int argc, char *argv[] )
 		{"pid-warp", no_argument, 0, LONG_OPT_PID_WARP},
 		{"proxy", required_argument, 0, 'p'},
 		{"root-checksum", required_argument, 0, 'R'},
+		{"seccomp", no_argument, 0, LONG_OPT_SECCOMP},
+		{"sparse-cache", no_argument, 0, LONG_OPT_SPARSE_CACHE},
+		{"sparse-cache-block-size", required_argument, 0, LONG_OPT_SPARSE_CACHE_BLOCK_SIZE},
+		{"sparse-cache-limit", required_argument, 0, LONG_OPT_SPARSE_CACHE_LIMIT},
+		{"sparse-cache-readahead", required_argument, 0, LONG_OPT_SPARSE_CACHE_READAHEAD},
 		{"session-caching", no_argument, 0, 'S'},
 		{"stats-file", required_argument, 0, LONG_OPT_STATS_FILE},
 		{"status-file", required_argument, 0, 'c'},
@@ -874,6 +943,9 @@ int main( int argc, char *argv[] )
 		{"with-checksums", no_argument, 0, 'K'},
 		{"with-snapshots", no_argument, 0, 'F'},
 		{"work-dir", required_argument, 0, 'w'},
+		{"write-back", no_argument, 0, LONG_OPT_WRITE_BACK},
+		{"write-back-jobs", required_argument, 0, LONG_OPT_WRITE_BACK_JOBS},
+		{"write-back-queue", required_argument, 0, LONG_OPT_WRITE_BACK_QUEUE},
 		{0,0,0,0}
 	};
 
@@ -1128,6 +1200,56 @@ int main( int argc, char *argv[] )
 		case LONG_OPT_NO_FLOCK:
 			pfs_no_flock = 1;
 			break;
+		case LONG_OPT_SECCOMP:
+			pfs_trace_seccomp = 1;
+			break;
+		case LONG_OPT_SPARSE_CACHE:
+			pfs_sparse_cache = 1;
+			break;
+		case LONG_OPT_SPARSE_CACHE_BLOCK_SIZE:
+			pfs_sparse_cache_block_size = string_metric_parse(optarg);
+			if(pfs_sparse_cache_block_size<=0) fatal("--sparse-cache-block-size must be positive");
+			break;
+		case LONG_OPT_SPARSE_CACHE_READAHEAD:
+			pfs_sparse_cache_readahead = atoi(optarg);
+			break;
+		case LONG_OPT_SPARSE_CACHE_LIMIT:
+			pfs_sparse_cache_limit = string_metric_parse(optarg);
+			break;
+		case LONG_OPT_IO_THREADS:
+			pfs_io_threads = atoi(optarg);
+			break;
+		case LONG_OPT_METADATA_CACHE: {
+			char *colon = strrchr(optarg,':');
+			if(colon) {
+				*colon = 0;
+				pfs_service_set_metadata_ttl(optarg,atoi(colon+1));
+			} else {
+				pfs_service_set_metadata_ttl(0,atoi(optarg));
+			}
+			break;
+		}
+		case LONG_OPT_PREFETCH_LIST:
+			prefetch_list = optarg;
+			break;
+		case LONG_OPT_PREFETCH_JOBS:
+			pfs_prefetch_jobs = atoi(optarg);
+			if(pfs_prefetch_jobs<1) fatal("--prefetch-jobs must be at least 1");
+			break;
+		case LONG_OPT_PROFILE:
+			profile_file = optarg;
+			break;
+		case LONG_OPT_WRITE_BACK:
+			pfs_write_back = 1;
+			break;
+		case LONG_OPT_WRITE_BACK_JOBS:
+			pfs_writeback_jobs = atoi(optarg);
+			if(pfs_writeback_jobs<1) fatal("--write-back-jobs must be at least 1");
+			break;
+		case LONG_OPT_WRITE_BACK_QUEUE:
+			pfs_writeback_queue_max = atoi(optarg);
+			if(pfs_writeback_queue_max<1) fatal("--write-back-queue must be at least 1");
+			break;
 		case LONG_OPT_EXT_IMAGE: {
 			char service[128];
 			char image[PATH_MAX] = {0};
@@ -1198,6 +1320,19 @@ int main( int argc, char *argv[] )
 
 	get_linux_version(argv[0]);
 
+	if (pfs_trace_seccomp) {
+		/* Before 4.8, the seccomp stop came after the syscall-entry stop, and
+		 * a tracer could not change the system call from there.
+		 */
+		if (!linux_available(4,8,0)) {
+			debug(D_NOTICE, "seccomp filtering requires kernel 4.8 or later, tracing every system call instead");
+			pfs_trace_seccomp = 0;
+		} else if (valgrind) {
+			debug(D_NOTICE, "seccomp filtering is not available with --valgrind, tracing every system call instead");
+			pfs_trace_seccomp = 0;
+		}
+	}
+
 	if (envlist[0]) {
 		extern char **environ;
 		if(access(envlist, F_OK) == 0)
@@ -1264,6 +1399,10 @@ int main( int argc, char *argv[] )
 		close(fd);
 	}
 
+	if(prefetch_list) pfs_prefetch_start(prefetch_list);
+	if(pfs_write_back) pfs_writeback_start();
+	if(profile_file) pfs_profile_start(profile_file,argc-optind,&argv[optind]);
+
 	pid_t pfs_watchdog_pid = -2;
 	if (pfs_paranoid_mode) {
 		pfs_watchdog_pid = pfs_paranoia_setup();
@@ -1332,6 +1471,11 @@ int main( int argc, char *argv[] )
 			signal(SIGUSR1, set_attached_and_ready);
 			raise(SIGSTOP); /* synchronize with parent, above */
 			while (!attached_and_ready) ; /* spin waiting to be traced (NO SLEEPING/STOPPING) */
+			if (pfs_trace_seccomp && pfs_seccomp_install() == -1) {
+				fprintf(stderr, "unable to install seccomp filter: %s\n", strerror(errno));
+				fflush(stderr);
+				_exit(1);
+			}
 			execvp(argv[optind],&argv[optind]);
 		}
 		fprintf(stderr, "unable to execute %s: %s\n", argv[optind], strerror(errno));
@@ -1352,7 +1496,7 @@ int main( int argc, char *argv[] )
 
 	root_pid = pid;
 	debug(D_PROCESS,"attaching to pid %d",pid);
-	if (tracer_attach(pid) == -1) {
+	if (tracer_attach(pid, pfs_trace_seccomp) == -1) {
 		if (errno == EPERM) {
 			fprintf(stderr,
 				"The `ptrace` system call appears to be disabled.\n"
@@ -1375,6 +1519,13 @@ int main( int argc, char *argv[] )
 
 	snprintf(p->name,sizeof(p->name),"%s",argv[optind]);
 
+	if(pfs_io_threads>0 && pfs_async_init(pfs_io_threads)<0) {
+		debug(D_NOTICE,"unable to start I/O threads: %s",strerror(errno));
+		pfs_io_threads = 0;
+	} else if(pfs_io_threads<0) {
+		pfs_io_threads = 0;
+	}
+
 	/* We perform wait4 until there are no tracees left to wait for.
 	 * Previously, we would wait for a process, handle the event, then repeat.
 	 * This caused problems with Java where threads would get stuck in a race
@@ -1392,11 +1543,20 @@ int main( int argc, char *argv[] )
 		std::vector<struct pfswait> pevents;
 		struct pfswait p;
 
-		while (pfswait(&p, -1, !pevents.size())) {
+		/* Reads on I/O threads may finish while we wait for processes. */
+		while (pfswait(&p, -1, !pevents.size() && !pfs_async_pending())) {
 			pevents.push_back(p);
 		}
-		if (pevents.size() == 0)
-			break;
+		if (pevents.size() == 0) {
+			/* A request to write the profile interrupts the wait. */
+			if (pfs_profile_poll())
+				continue;
+			if (!pfs_async_pending())
+				break;
+			pfs_async_wait();
+			pfs_async_complete();
+			continue;
+		}
 
 		for (std::vector<struct pfswait>::iterator it = pevents.begin(); it != pevents.end(); ++it) {
 			if(it->pid == pfs_watchdog_pid) {
@@ -1413,6 +1573,16 @@ int main( int argc, char *argv[] )
 				} while (wait_barrier && pfswait(&p, it->pid, 1));
 			}
 		}
+
+		if (pfs_async_pending())
+			pfs_async_complete();
+
+		pfs_profile_poll();
+	}
+
+	/* The program has not really succeeded until its output is stored. */
+	if(pfs_writeback_finish()>0 && WIFEXITED(root_exitstatus) && WEXITSTATUS(root_exitstatus)==0) {
+		root_exitstatus = W_EXITCODE(1,0);
 	}
 
 	for (std::vector<pfs_service *>::iterator it = service_instances.begin(); it != service_instances.end(); ++it) {
@@ -1446,6 +1616,9 @@ int main( int argc, char *argv[] )
 
 	if(pfs_paranoid_mode) pfs_paranoia_cleanup();
 
+	pfs_prefetch_finish();
+	pfs_profile_finish();
+
 	delete_dir(pfs_temp_per_instance_dir);
 
 	if(namelist_table && namelist_file) {
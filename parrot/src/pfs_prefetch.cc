@@ -0,0 +1,192 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "pfs_prefetch.h"
+#include "pfs_file.h"
+#include "pfs_name.h"
+#include "pfs_table.h"
+
+extern "C" {
+#include "debug.h"
+#include "hash_table.h"
+#include "macros.h"
+#include "stringtools.h"
+#include "timestamp.h"
+}
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include <list>
+#include <string>
+#include <vector>
+
+extern int pfs_force_cache;
+extern char pfs_temp_per_instance_dir[PATH_MAX];
+extern char pfs_cvmfs_locks_dir[PATH_MAX];
+extern bool pfs_cvmfs_enable_alien;
+
+int pfs_prefetch_jobs = 8;
+
+static char *list_path = 0;
+static std::vector<std::string> prefetch_names;
+static std::list<pid_t> workers;
+
+static struct hash_table *trace_table = 0;
+static std::vector<std::string> trace_names;
+
+static void prefetch_worker( int slot, pid_t parent )
+{
+	struct pfs_name pname;
+	pfs_table *table;
+	int count = 0;
+
+	prctl(PR_SET_PDEATHSIG,SIGKILL);
+	if(getppid()!=parent) _exit(0);
+
+	signal(SIGTERM,SIG_DFL);
+	signal(SIGINT,SIG_DFL);
+	signal(SIGHUP,SIG_DFL);
+
+	/* Only the Parrot tracing the program records what it opens. */
+	trace_table = 0;
+
+	/*
+	Each CVMFS instance needs its own lock directory.  Without the
+	alien cache, the lock is on the cache itself, which this worker
+	must then leave to Parrot.
+	*/
+	if(pfs_cvmfs_enable_alien) {
+		if(snprintf(pfs_cvmfs_locks_dir,PATH_MAX,"%s/cvmfs_locks_XXXXXX",pfs_temp_per_instance_dir)>=PATH_MAX || !mkdtemp(pfs_cvmfs_locks_dir)) {
+			debug(D_NOTICE,"prefetch worker %d couldn't make a cvmfs lock directory, skipping cvmfs",slot);
+			pfs_cvmfs_enable_alien = false;
+		}
+	}
+
+	table = new pfs_table;
+
+	for(size_t i=slot;i<prefetch_names.size();i+=pfs_prefetch_jobs) {
+		const char *name = prefetch_names[i].c_str();
+
+		if(!table->resolve_name(0,name,&pname,R_OK)) continue;
+		if(pname.is_local) continue;
+		if(!strcmp(pname.service_name,"cvmfs") && !pfs_cvmfs_enable_alien) continue;
+
+		timestamp_t start = timestamp_get();
+		pfs_file *file = table->open_object(name,O_RDONLY,0,pfs_force_cache);
+		if(file) {
+			debug(D_CACHE,"prefetched %s in %.3fs",name,(timestamp_get()-start)/1000000.0);
+			file->close();
+			delete file;
+			count++;
+		} else {
+			debug(D_CACHE,"couldn't prefetch %s: %s",name,strerror(errno));
+		}
+	}
+
+	debug(D_CACHE,"prefetch worker %d done with %d files",slot,count);
+	_exit(0);
+}
+
+int pfs_prefetch_start( const char *path )
+{
+	char line[PFS_PATH_MAX];
+	FILE *file;
+	int i;
+
+	list_path = strdup(path);
+	trace_table = hash_table_create(0,0);
+
+	file = fopen(path,"r");
+	if(!file) {
+		if(errno!=ENOENT) debug(D_NOTICE,"couldn't open prefetch list %s: %s",path,strerror(errno));
+		return 0;
+	}
+
+	while(fgets(line,sizeof(line),file)) {
+		string_chomp(line);
+		if(line[0]=='/') prefetch_names.push_back(line);
+	}
+	fclose(file);
+
+	if(prefetch_names.empty()) return 0;
+
+	int jobs = MIN((size_t)pfs_prefetch_jobs,prefetch_names.size());
+	pid_t parent = getpid();
+
+	for(i=0;i<jobs;i++) {
+		pid_t pid = fork();
+		if(pid==0) {
+			prefetch_worker(i,parent);
+		} else if(pid>0) {
+			workers.push_back(pid);
+		} else {
+			debug(D_NOTICE,"couldn't start prefetch worker: %s",strerror(errno));
+			break;
+		}
+	}
+
+	debug(D_CACHE,"prefetching %d files from %s with %d workers",(int)prefetch_names.size(),path,(int)workers.size());
+	return workers.size();
+}
+
+int pfs_prefetch_exited( pid_t pid )
+{
+	for(std::list<pid_t>::iterator it = workers.begin(); it != workers.end(); ++it) {
+		if(*it==pid) {
+			workers.erase(it);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void pfs_prefetch_record( const char *name )
+{
+	if(!trace_table) return;
+	if(hash_table_lookup(trace_table,name)) return;
+	hash_table_insert(trace_table,name,(void*)1);
+	trace_names.push_back(name);
+}
+
+void pfs_prefetch_finish()
+{
+	if(!list_path) return;
+
+	/* Whatever is left to fetch is no longer needed. */
+	for(std::list<pid_t>::iterator it = workers.begin(); it != workers.end(); ++it) {
+		kill(*it,SIGKILL);
+		waitpid(*it,0,0);
+	}
+	workers.clear();
+
+	char *tmp = string_format("%s.%d",list_path,(int)getpid());
+	FILE *file = fopen(tmp,"w");
+	if(file) {
+		for(size_t i=0;i<trace_names.size();i++) {
+			fprintf(file,"%s\n",trace_names[i].c_str());
+		}
+		if(fclose(file)==0 && rename(tmp,list_path)==0) {
+			debug(D_CACHE,"recorded %d remote files in %s",(int)trace_names.size(),list_path);
+		} else {
+			debug(D_NOTICE,"couldn't write prefetch list %s: %s",list_path,strerror(errno));
+			unlink(tmp);
+		}
+	} else {
+		debug(D_NOTICE,"couldn't write prefetch list %s: %s",list_path,strerror(errno));
+	}
+	free(tmp);
+}
+
+/* vim: set noexpandtab tabstop=4: */
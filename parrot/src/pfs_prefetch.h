@@ -0,0 +1,33 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef PFS_PREFETCH_H
+#define PFS_PREFETCH_H
+
+#include <sys/types.h>
+
+/*
+A program started from CVMFS or another remote filesystem opens its
+libraries and data files one at a time, each waiting for a fetch.
+Given a prefetch list, Parrot starts a few worker processes before the
+program that open the remote files named in the list, in order, so that
+they land in the caches on disk that Parrot itself reads: the file
+cache, the block cache, and the CVMFS alien cache.  Each worker has its
+own connections and takes every Nth name.  As the program runs, Parrot
+records the remote files it opens for reading, in the order first
+opened, and at exit replaces the list with them for the next run.
+*/
+
+extern int pfs_prefetch_jobs;
+
+int  pfs_prefetch_start( const char *path );
+int  pfs_prefetch_exited( pid_t pid );
+void pfs_prefetch_record( const char *name );
+void pfs_prefetch_finish();
+
+#endif
+
+/* vim: set noexpandtab tabstop=4: */
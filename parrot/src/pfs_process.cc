@@ -5,6 +5,7 @@ This software is distributed under the GNU General Public License.
 See the file COPYING for details.
 */
 
+#include "pfs_async.h"
 #include "pfs_channel.h"
 #include "pfs_paranoia.h"
 #include "pfs_process.h"
@@ -45,7 +46,7 @@ extern uid_t pfs_uid;
 extern gid_t pfs_gid;
 extern int pfs_fake_setuid;
 extern int pfs_fake_setgid;
-
+extern int pfs_trace_seccomp;
 
 struct pfs_process * pfs_process_lookup( pid_t pid )
 {
@@ -250,6 +251,8 @@ struct pfs_process * pfs_process_create( pid_t pid, struct pfs_process *parent,
 	/* to prevent accidental copy out */
 	child->did_stream_warning = 0;
 	child->nsyscalls = 0;
+	child->profile_start = 0;
+	child->profile_service = -1;
 	child->completing_execve = 0;
 	child->exefd = -1;
 	child->ns = NULL;
@@ -313,8 +316,23 @@ void pfs_process_exec( struct pfs_process *p )
 	p->table->close_on_exec();
 }
 
+/*
+Resume a stopped process.  Ordinarily, the process stops again at the
+next system call entry or exit.  With the seccomp filter in place, the
+filter stops it at the entry of the system calls we want to see, so it
+only needs to stop at the exit of a call it is in the middle of.
+*/
+
+int pfs_process_continue( struct pfs_process *p, int signum )
+{
+	int syscall_stop = !pfs_trace_seccomp || p->state == PFS_PROCESS_STATE_KERNEL;
+	return tracer_continue(p->tracer, signum, syscall_stop);
+}
+
 static void pfs_process_delete( struct pfs_process *p )
 {
+	if(pfs_io_threads)
+		pfs_async_cancel(p);
 	if(p->table) {
 		p->table->delref();
 		if(!p->table->refs()) delete p->table;
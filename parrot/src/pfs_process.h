@@ -42,6 +42,7 @@ enum {
 enum pfs_process_state {
 	PFS_PROCESS_STATE_KERNEL,
 	PFS_PROCESS_STATE_USER,
+	PFS_PROCESS_STATE_WAITREAD,
 };
 
 #define PFS_SCRATCH_SPACE (8*4096)
@@ -58,6 +59,8 @@ struct pfs_process {
 
 	enum pfs_process_state state;
 	uint64_t nsyscalls;
+	uint64_t profile_start;
+	int profile_service;
 	pfs_table *table;
 	struct tracer *tracer;
 
@@ -81,6 +84,7 @@ struct pfs_process {
 
 struct pfs_process * pfs_process_create( pid_t pid, struct pfs_process *parent, int thread, int share_table );
 void pfs_process_exec( struct pfs_process *p );
+int  pfs_process_continue( struct pfs_process *p, int signum );
 void pfs_process_stop( struct pfs_process *p, int status, struct rusage *usage );
 
 extern "C" int pfs_process_getpid();
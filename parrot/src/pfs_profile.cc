@@ -0,0 +1,332 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "pfs_profile.h"
+#include "pfs_process.h"
+
+extern "C" {
+#include "buffer.h"
+#include "debug.h"
+#include "jx.h"
+#include "jx_pretty_print.h"
+#include "macros.h"
+#include "stringtools.h"
+#include "timestamp.h"
+#include "tracer.h"
+#include "tracer.table.h"
+#include "tracer.table64.h"
+}
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+/*
+Bin 0 counts calls that took no time at all, and bin i counts calls
+that took from 2^(i-1) to 2^i-1 microseconds, so percentiles are given
+as the upper end of their bin, within a factor of two.
+*/
+
+#define PROFILE_BINS 40
+#define PROFILE_SERVICES_MAX 32
+
+enum profile_kind {
+	PROFILE_UNKNOWN = 0,
+	PROFILE_NO_BYTES,
+	PROFILE_BYTES_READ,
+	PROFILE_BYTES_WRITTEN,
+};
+
+struct profile_counter {
+	enum profile_kind kind;
+	UINT64_T count;
+	UINT64_T bytes;
+	UINT64_T time;
+	UINT64_T max;
+	UINT64_T bins[PROFILE_BINS];
+};
+
+int pfs_profile_enabled = 0;
+
+static char *profile_path = 0;
+static char *profile_command = 0;
+static timestamp_t profile_start_time = 0;
+
+static struct profile_counter *syscalls32 = 0;
+static struct profile_counter *syscalls64 = 0;
+
+static struct profile_counter services[PROFILE_SERVICES_MAX];
+static char *service_names[PROFILE_SERVICES_MAX];
+static int service_count = 0;
+
+static volatile sig_atomic_t dump_requested = 0;
+
+static const char *read_calls[] = { "read", "pread", "pread64", "readv", "preadv", "preadv2", "recvfrom", "recvmsg", 0 };
+static const char *write_calls[] = { "write", "pwrite", "pwrite64", "writev", "pwritev", "pwritev2", "sendto", "sendmsg", "sendfile", "sendfile64", 0 };
+
+static int name_in_list( const char *name, const char **list )
+{
+	for(int i=0;list[i];i++) {
+		if(!strcmp(name,list[i])) return 1;
+	}
+	return 0;
+}
+
+static void counter_add( struct profile_counter *c, UINT64_T latency, UINT64_T bytes )
+{
+	int bin = 0;
+	while(bin<PROFILE_BINS-1 && (latency>>bin)) bin++;
+
+	c->count++;
+	c->bytes += bytes;
+	c->time += latency;
+	c->max = MAX(c->max,latency);
+	c->bins[bin]++;
+}
+
+static UINT64_T counter_percentile( struct profile_counter *c, double fraction )
+{
+	UINT64_T rank = MAX((UINT64_T)(fraction*c->count+0.5),1);
+	UINT64_T seen = 0;
+
+	for(int bin=0;bin<PROFILE_BINS;bin++) {
+		seen += c->bins[bin];
+		if(seen>=rank) {
+			UINT64_T upper = bin ? ((UINT64_T)1<<bin)-1 : 0;
+			return MIN(upper,c->max);
+		}
+	}
+	return c->max;
+}
+
+static void handle_dump_signal( int sig )
+{
+	dump_requested = 1;
+}
+
+void pfs_profile_start( const char *path, int argc, char **argv )
+{
+	struct sigaction s;
+	buffer_t B;
+
+	syscalls32 = (struct profile_counter *) calloc(SYSCALL32_MAX,sizeof(struct profile_counter));
+	syscalls64 = (struct profile_counter *) calloc(SYSCALL64_MAX,sizeof(struct profile_counter));
+	if(!syscalls32 || !syscalls64) fatal("couldn't allocate profile: %s",strerror(errno));
+
+	profile_path = strdup(path);
+	profile_start_time = timestamp_get();
+
+	buffer_init(&B);
+	for(int i=0;i<argc;i++) {
+		buffer_printf(&B,"%s%s",i ? " " : "",argv[i]);
+	}
+	profile_command = strdup(buffer_tostring(&B));
+	buffer_free(&B);
+
+	s.sa_handler = handle_dump_signal;
+	sigfillset(&s.sa_mask);
+	s.sa_flags = 0;
+	sigaction(SIGUSR2,&s,0);
+
+	pfs_profile_enabled = 1;
+	debug(D_PROCESS,"profiling system calls into %s",path);
+}
+
+void pfs_profile_syscall_enter( struct pfs_process *p )
+{
+	p->profile_start = timestamp_get();
+	p->profile_service = -1;
+}
+
+void pfs_profile_syscall_exit( struct pfs_process *p )
+{
+	struct profile_counter *c;
+	const char *name;
+
+	if(!p->profile_start) return;
+
+	UINT64_T latency = timestamp_get()-p->profile_start;
+	p->profile_start = 0;
+
+	INT64_T n = p->syscall_original;
+	if(tracer_is_64bit(p->tracer)) {
+		if(n<0 || n>=SYSCALL64_MAX) return;
+		c = &syscalls64[n];
+		name = tracer_syscall64_name(n);
+	} else {
+		if(n<0 || n>=SYSCALL32_MAX) return;
+		c = &syscalls32[n];
+		name = tracer_syscall32_name(n);
+	}
+
+	if(c->kind==PROFILE_UNKNOWN) {
+		if(name_in_list(name,read_calls)) {
+			c->kind = PROFILE_BYTES_READ;
+		} else if(name_in_list(name,write_calls)) {
+			c->kind = PROFILE_BYTES_WRITTEN;
+		} else {
+			c->kind = PROFILE_NO_BYTES;
+		}
+	}
+
+	UINT64_T bytes = (c->kind!=PROFILE_NO_BYTES && p->syscall_result>0) ? p->syscall_result : 0;
+
+	counter_add(c,latency,bytes);
+	if(p->profile_service>=0) counter_add(&services[p->profile_service],latency,bytes);
+}
+
+void pfs_profile_service( const char *name )
+{
+	int i;
+
+	if(!pfs_profile_enabled || !pfs_current) return;
+
+	for(i=0;i<service_count;i++) {
+		if(!strcmp(service_names[i],name)) break;
+	}
+
+	if(i==service_count) {
+		if(service_count==PROFILE_SERVICES_MAX) return;
+		service_names[service_count++] = strdup(name);
+	}
+
+	pfs_current->profile_service = i;
+}
+
+/* Objects print their fields last inserted first, so insert them in reverse. */
+
+static struct jx * counter_to_json( const char *name, struct profile_counter *c )
+{
+	struct jx *j = jx_object(0);
+	struct jx *bins = jx_array(0);
+	int last;
+
+	for(last=PROFILE_BINS-1;last>0 && !c->bins[last];last--) {}
+	for(int bin=0;bin<=last;bin++) {
+		jx_array_append(bins,jx_integer(c->bins[bin]));
+	}
+
+	jx_insert(j,jx_string("histogram"),bins);
+	jx_insert_integer(j,"max_us",c->max);
+	jx_insert_integer(j,"p99_us",counter_percentile(c,0.99));
+	jx_insert_integer(j,"p90_us",counter_percentile(c,0.90));
+	jx_insert_integer(j,"p50_us",counter_percentile(c,0.50));
+	jx_insert_integer(j,"total_us",c->time);
+	jx_insert_integer(j,"bytes",c->bytes);
+	jx_insert_integer(j,"count",c->count);
+	jx_insert_string(j,"name",name);
+
+	return j;
+}
+
+static struct jx * measure( struct jx *value, const char *unit )
+{
+	struct jx *j = jx_array(0);
+	jx_array_append(j,value);
+	jx_array_append(j,jx_string(unit));
+	return j;
+}
+
+struct profile_entry {
+	const char *name;
+	struct profile_counter *counter;
+};
+
+static bool by_time( const struct profile_entry &a, const struct profile_entry &b )
+{
+	return a.counter->time > b.counter->time;
+}
+
+static void add_syscalls( std::vector<struct profile_entry> &entries, struct profile_counter *table, int max, const char * (*name)( int ) )
+{
+	for(int i=0;i<max;i++) {
+		if(table[i].count) {
+			struct profile_entry e = { name(i), &table[i] };
+			entries.push_back(e);
+		}
+	}
+}
+
+static void profile_write()
+{
+	std::vector<struct profile_entry> calls;
+	std::vector<struct profile_entry> servs;
+	UINT64_T bytes_read = 0;
+	UINT64_T bytes_written = 0;
+	timestamp_t now = timestamp_get();
+
+	add_syscalls(calls,syscalls32,SYSCALL32_MAX,tracer_syscall32_name);
+	add_syscalls(calls,syscalls64,SYSCALL64_MAX,tracer_syscall64_name);
+	std::sort(calls.begin(),calls.end(),by_time);
+
+	for(int i=0;i<service_count;i++) {
+		struct profile_entry e = { service_names[i], &services[i] };
+		servs.push_back(e);
+	}
+	std::sort(servs.begin(),servs.end(),by_time);
+
+	struct jx *jcalls = jx_array(0);
+	for(size_t i=0;i<calls.size();i++) {
+		if(calls[i].counter->kind==PROFILE_BYTES_READ) bytes_read += calls[i].counter->bytes;
+		if(calls[i].counter->kind==PROFILE_BYTES_WRITTEN) bytes_written += calls[i].counter->bytes;
+		jx_array_append(jcalls,counter_to_json(calls[i].name,calls[i].counter));
+	}
+
+	struct jx *jservs = jx_array(0);
+	for(size_t i=0;i<servs.size();i++) {
+		jx_array_append(jservs,counter_to_json(servs[i].name,servs[i].counter));
+	}
+
+	struct jx *j = jx_object(0);
+	jx_insert(j,jx_string("services"),jservs);
+	jx_insert(j,jx_string("syscalls"),jcalls);
+	jx_insert(j,jx_string("bytes_written"),measure(jx_double(bytes_written/1048576.0),"MB"));
+	jx_insert(j,jx_string("bytes_read"),measure(jx_double(bytes_read/1048576.0),"MB"));
+	jx_insert(j,jx_string("wall_time"),measure(jx_double((now-profile_start_time)/1000000.0),"s"));
+	jx_insert(j,jx_string("end"),measure(jx_integer(now),"us"));
+	jx_insert(j,jx_string("start"),measure(jx_integer(profile_start_time),"us"));
+	jx_insert_string(j,"command",profile_command);
+	jx_insert_string(j,"category","parrot");
+
+	char *tmp = string_format("%s.%d",profile_path,(int)getpid());
+	FILE *file = fopen(tmp,"w");
+	if(file) {
+		jx_pretty_print_stream(j,file);
+		fprintf(file,"\n");
+		if(fclose(file)==0 && rename(tmp,profile_path)==0) {
+			debug(D_PROCESS,"wrote profile of %d system calls to %s",(int)calls.size(),profile_path);
+		} else {
+			debug(D_NOTICE,"couldn't write profile %s: %s",profile_path,strerror(errno));
+			unlink(tmp);
+		}
+	} else {
+		debug(D_NOTICE,"couldn't write profile %s: %s",profile_path,strerror(errno));
+	}
+	free(tmp);
+	jx_delete(j);
+}
+
+int pfs_profile_poll()
+{
+	if(!dump_requested) return 0;
+	dump_requested = 0;
+	profile_write();
+	return 1;
+}
+
+void pfs_profile_finish()
+{
+	if(!pfs_profile_enabled) return;
+	profile_write();
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -0,0 +1,34 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef PFS_PROFILE_H
+#define PFS_PROFILE_H
+
+struct pfs_process;
+
+/*
+A profile counts each system call that Parrot traces, with the bytes it
+moved and the time from entry to exit, both by system call and by the
+service that handled it.  Latencies are kept in histograms with bins of
+doubling width, so all the counters are allocated once when profiling
+starts, and each call costs a clock read and a few additions.  The
+profile is written as JSON at exit, or whenever Parrot gets SIGUSR2.
+The top level fields are those of a resource summary, so that tools
+that read rmsummary files can read the profile too.
+*/
+
+extern int pfs_profile_enabled;
+
+void pfs_profile_start( const char *path, int argc, char **argv );
+void pfs_profile_syscall_enter( struct pfs_process *p );
+void pfs_profile_syscall_exit( struct pfs_process *p );
+void pfs_profile_service( const char *name );
+int  pfs_profile_poll();
+void pfs_profile_finish();
+
+#endif
+
+/* vim: set noexpandtab tabstop=4: */
@@ -0,0 +1,151 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "pfs_seccomp.h"
+#include "tracer.table64.h"
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include <errno.h>
+#include <stddef.h>
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#	define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+#if defined(__x86_64__)
+
+/*
+These are the calls that pfs_dispatch64 passes along to the kernel
+without looking at them, on the way in or on the way out.  Anything
+that touches a path, a file descriptor, an identity, or the time
+of day is left out, as are the calls that create processes, because the
+dispatcher needs to see their arguments.
+*/
+
+static const int native_syscalls[] = {
+	SYSCALL64_alarm,
+	SYSCALL64_arch_prctl,
+	SYSCALL64_brk,
+	SYSCALL64_capget,
+	SYSCALL64_clock_getres,
+	SYSCALL64_clock_nanosleep,
+	SYSCALL64_exit,
+	SYSCALL64_exit_group,
+	SYSCALL64_futex,
+	SYSCALL64_get_robust_list,
+	SYSCALL64_get_thread_area,
+	SYSCALL64_getcpu,
+	SYSCALL64_getitimer,
+	SYSCALL64_getpgid,
+	SYSCALL64_getpgrp,
+	SYSCALL64_getppid,
+	SYSCALL64_getpriority,
+	SYSCALL64_getrandom,
+	SYSCALL64_getrlimit,
+	SYSCALL64_getrusage,
+	SYSCALL64_getsid,
+	SYSCALL64_gettid,
+	SYSCALL64_madvise,
+	SYSCALL64_membarrier,
+	SYSCALL64_mincore,
+	SYSCALL64_mlock,
+	SYSCALL64_mprotect,
+	SYSCALL64_mremap,
+	SYSCALL64_msync,
+	SYSCALL64_munlock,
+	SYSCALL64_nanosleep,
+	SYSCALL64_pause,
+	SYSCALL64_poll,
+	SYSCALL64_ppoll,
+	SYSCALL64_prlimit64,
+	SYSCALL64_pselect6,
+	SYSCALL64_restart_syscall,
+	SYSCALL64_rt_sigaction,
+	SYSCALL64_rt_sigpending,
+	SYSCALL64_rt_sigprocmask,
+	SYSCALL64_rt_sigreturn,
+	SYSCALL64_rt_sigsuspend,
+	SYSCALL64_rt_sigtimedwait,
+	SYSCALL64_sched_get_priority_max,
+	SYSCALL64_sched_get_priority_min,
+	SYSCALL64_sched_getaffinity,
+	SYSCALL64_sched_getparam,
+	SYSCALL64_sched_getscheduler,
+	SYSCALL64_sched_setaffinity,
+	SYSCALL64_sched_yield,
+	SYSCALL64_select,
+	SYSCALL64_set_robust_list,
+	SYSCALL64_set_tid_address,
+	SYSCALL64_setitimer,
+	SYSCALL64_setpgid,
+	SYSCALL64_setrlimit,
+	SYSCALL64_setsid,
+	SYSCALL64_sigaltstack,
+	SYSCALL64_sysinfo,
+	SYSCALL64_timer_create,
+	SYSCALL64_timer_delete,
+	SYSCALL64_timer_getoverrun,
+	SYSCALL64_timer_gettime,
+	SYSCALL64_timer_settime,
+	SYSCALL64_wait4,
+	SYSCALL64_waitid,
+};
+
+#define SECCOMP_ARG_LO(n) (offsetof(struct seccomp_data, args) + (n) * sizeof(__u64))
+
+int pfs_seccomp_install( void )
+{
+	struct sock_filter filter[9 + 2 * (sizeof(native_syscalls) / sizeof(native_syscalls[0]))];
+	struct sock_filter *f = filter;
+	size_t i;
+
+	/* Other ABIs, such as 32-bit programs, always stop. */
+	*f++ = (struct sock_filter) BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, arch));
+	*f++ = (struct sock_filter) BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, AUDIT_ARCH_X86_64, 1, 0);
+	*f++ = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_TRACE);
+	*f++ = (struct sock_filter) BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, nr));
+
+	for(i = 0; i < sizeof(native_syscalls) / sizeof(native_syscalls[0]); i++) {
+		*f++ = (struct sock_filter) BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, native_syscalls[i], 0, 1);
+		*f++ = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW);
+	}
+
+	/* Anonymous memory never involves a Parrot file. */
+	*f++ = (struct sock_filter) BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, SYSCALL64_mmap, 0, 3);
+	*f++ = (struct sock_filter) BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SECCOMP_ARG_LO(3));
+	*f++ = (struct sock_filter) BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, MAP_ANONYMOUS, 0, 1);
+	*f++ = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW);
+
+	*f++ = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_TRACE);
+
+	struct sock_fprog prog = {
+		.len = (unsigned short) (f - filter),
+		.filter = filter,
+	};
+
+	if(prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1)
+		return -1;
+
+	return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog, 0, 0);
+}
+
+#else
+
+int pfs_seccomp_install( void )
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
+
+/* vim: set noexpandtab tabstop=4: */
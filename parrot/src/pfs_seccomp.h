@@ -0,0 +1,28 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef PFS_SECCOMP_H
+#define PFS_SECCOMP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Install a seccomp filter in the calling process, which must already
+be traced with PTRACE_O_TRACESECCOMP.  System calls that Parrot never
+changes run natively, and every other call stops the process with
+PTRACE_EVENT_SECCOMP instead of a syscall-entry stop.  Returns zero
+on success, or -1 and sets errno if the kernel refused the filter.
+*/
+
+int pfs_seccomp_install( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
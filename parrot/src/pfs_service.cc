@@ -8,15 +8,21 @@ See the file COPYING for details.
 
 #include "pfs_service.h"
 #include "pfs_dir.h"
+#include "pfs_dircache.h"
 #include "pfs_process.h"
 #include "pfs_search.h"
 
 extern "C" {
 #include "chirp_reli.h"
+#include "debug.h"
 #include "hash_table.h"
+#include "macros.h"
+#include "path.h"
 #include "stringtools.h"
+#include "xxmalloc.h"
 }
 
+#include <stdint.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
@@ -51,6 +57,16 @@ int pfs_service::is_local()
 	return 0;
 }
 
+/*
+A service is thread safe if its files may be opened and read by an
+I/O thread while Parrot goes on with other calls on the main thread.
+*/
+
+int pfs_service::is_threadsafe()
+{
+	return 0;
+}
+
 pfs_file * pfs_service::open( pfs_name *name, int flags, mode_t mode )
 {
 	errno = ENOENT;
@@ -63,6 +79,21 @@ pfs_dir * pfs_service::getdir( pfs_name *name )
 	return 0;
 }
 
+/*
+A service that learns the attributes of the entries of a directory in
+the same request as their names, as a long listing does, implements
+getlongdir to insert each entry into the given cache with its lstat
+attributes.  The stat of each entry that usually follows, as in ls -l,
+find, or du, is then answered from the cache, so that walking a tree
+costs one request per directory rather than one per file.  An entry is
+given out once, and the cache holds one directory at a time.
+*/
+
+pfs_dir * pfs_service::getlongdir( pfs_name *name, pfs_dircache *cache )
+{
+	return getdir(name);
+}
+
 int pfs_service::stat( pfs_name *name, struct pfs_stat *buf )
 {
 	pfs_service_emulate_stat(name,buf);
@@ -463,4 +494,307 @@ void pfs_service_disconnect_cache( pfs_name *name, void *cxn, int invalidate )
 	errno = save_errno;
 }
 
+/*
+The metadata cache keeps the results of stat, lstat, and readlink on
+remote services for a time to live set for each service, so that a
+program probing the same names over and over, like the dynamic linker
+searching a library path or Python searching sys.path, does not go
+back to the service every time.  Names found not to exist are kept as
+well, and in session caching mode they are kept for the whole session.
+Whatever Parrot itself changes is dropped at once, along with the
+directory holding it.  The table is only used from the main thread.
+*/
+
+#define METADATA_CACHE_MAX 65536
+
+struct metadata_entry {
+	time_t expires;
+	int error;
+	struct pfs_stat buf;
+	char *link;
+	pfs_ssize_t link_length;
+};
+
+extern int pfs_session_cache;
+
+static struct hash_table *metadata_table = 0;
+static struct hash_table *metadata_ttls = 0;
+static int metadata_default_ttl = 0;
+
+void pfs_service_set_metadata_ttl( const char *service_name, int ttl )
+{
+	if(service_name) {
+		if(!metadata_ttls) metadata_ttls = hash_table_create(0,0);
+		/* Store ttl+1, so that a ttl of zero is not taken for a missing entry. */
+		hash_table_remove(metadata_ttls,service_name);
+		hash_table_insert(metadata_ttls,service_name,(void*)(intptr_t)(ttl+1));
+	} else {
+		metadata_default_ttl = ttl;
+	}
+}
+
+static int metadata_ttl( pfs_name *name )
+{
+	if(metadata_ttls) {
+		intptr_t ttl = (intptr_t)hash_table_lookup(metadata_ttls,name->service_name);
+		if(ttl) return ttl-1;
+	}
+	return metadata_default_ttl;
+}
+
+static int metadata_cacheable( pfs_name *name )
+{
+	return !name->is_local && name->service && !name->service->is_local();
+}
+
+/*
+The directory cache holds the entries of the last remote directory
+listed with getlongdir, until each is looked up once, or until anything
+is changed through Parrot.
+*/
+
+extern int pfs_enable_small_file_optimizations;
+
+static pfs_dircache dircache;
+
+pfs_dir * pfs_service_getdir( pfs_name *name )
+{
+	pfs_dir *dir;
+
+	if(!pfs_enable_small_file_optimizations || !metadata_cacheable(name)) {
+		return name->service->getdir(name);
+	}
+
+	dircache.begin(name->path);
+	dir = name->service->getlongdir(name,&dircache);
+	if(!dir) dircache.invalidate();
+
+	return dir;
+}
+
+void pfs_service_invalidate_dircache()
+{
+	dircache.invalidate();
+}
+
+static int dircache_stat( char kind, pfs_name *name, struct pfs_stat *buf )
+{
+	if(!dircache.lookup(name->path,buf)) return 0;
+
+	/* The listing says what lstat would, so stat must follow a link itself. */
+	if(kind=='s' && S_ISLNK(buf->st_mode)) return 0;
+
+	debug(D_CACHE,"%s %s [directory cache]",kind=='s' ? "stat" : "lstat",name->path);
+	return 1;
+}
+
+static void metadata_entry_delete( struct metadata_entry *e )
+{
+	free(e->link);
+	free(e);
+}
+
+void pfs_service_invalidate_all()
+{
+	char *key;
+	void *value;
+
+	dircache.invalidate();
+
+	if(!metadata_table) return;
+
+	hash_table_firstkey(metadata_table);
+	while(hash_table_nextkey(metadata_table,&key,&value)) {
+		metadata_entry_delete((struct metadata_entry *)hash_table_remove(metadata_table,key));
+	}
+}
+
+static struct metadata_entry * metadata_lookup( char kind, const char *path )
+{
+	char key[PFS_PATH_MAX+2];
+	struct metadata_entry *e;
+
+	if(!metadata_table) return 0;
+
+	snprintf(key,sizeof(key),"%c%s",kind,path);
+	e = (struct metadata_entry *)hash_table_lookup(metadata_table,key);
+	if(e && e->expires && e->expires<time(0)) {
+		hash_table_remove(metadata_table,key);
+		metadata_entry_delete(e);
+		e = 0;
+	}
+
+	return e;
+}
+
+static void metadata_remove( char kind, const char *path )
+{
+	char key[PFS_PATH_MAX+2];
+	struct metadata_entry *e;
+
+	snprintf(key,sizeof(key),"%c%s",kind,path);
+	e = (struct metadata_entry *)hash_table_remove(metadata_table,key);
+	if(e) metadata_entry_delete(e);
+}
+
+static void metadata_insert( char kind, pfs_name *name, int error, struct pfs_stat *buf, const char *link, pfs_ssize_t link_length )
+{
+	char key[PFS_PATH_MAX+2];
+	int ttl = metadata_ttl(name);
+
+	if(ttl<=0 && !(error && pfs_session_cache)) return;
+
+	if(!metadata_table) metadata_table = hash_table_create(0,0);
+	if(hash_table_size(metadata_table)>=METADATA_CACHE_MAX) pfs_service_invalidate_all();
+
+	struct metadata_entry *e = (struct metadata_entry *)xxcalloc(1,sizeof(*e));
+	e->expires = ttl>0 ? time(0)+ttl : 0;
+	e->error = error;
+	if(buf) e->buf = *buf;
+	if(link) {
+		e->link = (char *)xxmalloc(link_length);
+		memcpy(e->link,link,link_length);
+		e->link_length = link_length;
+	}
+
+	snprintf(key,sizeof(key),"%c%s",kind,name->path);
+	metadata_remove(kind,name->path);
+	hash_table_insert(metadata_table,key,e);
+}
+
+int pfs_service_is_missing( pfs_name *name )
+{
+	struct metadata_entry *e;
+
+	if(!metadata_cacheable(name)) return 0;
+
+	e = metadata_lookup('s',name->path);
+	if(e && e->error==ENOENT) return 1;
+
+	/* If not even a link is there, neither is anything it would point to. */
+	e = metadata_lookup('l',name->path);
+	if(e && e->error==ENOENT) return 1;
+
+	return 0;
+}
+
+void pfs_service_set_missing( pfs_name *name )
+{
+	if(metadata_cacheable(name)) metadata_insert('s',name,ENOENT,0,0,0);
+}
+
+static int metadata_stat( char kind, pfs_name *name, struct pfs_stat *buf )
+{
+	struct metadata_entry *e = metadata_lookup(kind,name->path);
+	if(e) {
+		debug(D_CACHE,"%s %s [metadata cache]",kind=='s' ? "stat" : "lstat",name->path);
+		if(e->error) {
+			errno = e->error;
+			return -1;
+		}
+		*buf = e->buf;
+		return 0;
+	}
+
+	int result;
+	if(dircache_stat(kind,name,buf)) {
+		result = 0;
+	} else if(kind=='s') {
+		if(pfs_service_is_missing(name)) return (errno = ENOENT, -1);
+		result = name->service->stat(name,buf);
+	} else {
+		result = name->service->lstat(name,buf);
+	}
+
+	if(result==0) {
+		metadata_insert(kind,name,0,buf,0,0);
+	} else if(errno==ENOENT || errno==ENOTDIR) {
+		int save_errno = errno;
+		metadata_insert(kind,name,errno,0,0,0);
+		errno = save_errno;
+	}
+
+	return result;
+}
+
+int pfs_service_stat( pfs_name *name, struct pfs_stat *buf )
+{
+	if(!metadata_cacheable(name)) return name->service->stat(name,buf);
+	return metadata_stat('s',name,buf);
+}
+
+int pfs_service_lstat( pfs_name *name, struct pfs_stat *buf )
+{
+	if(!metadata_cacheable(name)) return name->service->lstat(name,buf);
+	return metadata_stat('l',name,buf);
+}
+
+int pfs_service_access( pfs_name *name, mode_t mode )
+{
+	if(!metadata_cacheable(name)) return name->service->access(name,mode);
+
+	if(pfs_service_is_missing(name)) return (errno = ENOENT, -1);
+
+	if(mode==F_OK) {
+		struct metadata_entry *e = metadata_lookup('s',name->path);
+		if(e && !e->error) return 0;
+	}
+
+	int result = name->service->access(name,mode);
+	if(result<0 && errno==ENOENT) {
+		pfs_service_set_missing(name);
+		errno = ENOENT;
+	}
+
+	return result;
+}
+
+int pfs_service_readlink( pfs_name *name, char *buf, pfs_size_t size )
+{
+	if(!metadata_cacheable(name)) return name->service->readlink(name,buf,size);
+
+	struct metadata_entry *e = metadata_lookup('r',name->path);
+	if(e) {
+		if(e->error) {
+			errno = e->error;
+			return -1;
+		}
+		pfs_ssize_t length = MIN(e->link_length,size);
+		memcpy(buf,e->link,length);
+		return length;
+	}
+
+	if(pfs_service_is_missing(name)) return (errno = ENOENT, -1);
+
+	int result = name->service->readlink(name,buf,size);
+	if(result>=0 && result<size) {
+		/* Only a link that was not cut short can be given out again. */
+		metadata_insert('r',name,0,0,buf,result);
+	} else if(result<0 && (errno==EINVAL || errno==ENOENT || errno==ENOTDIR)) {
+		int save_errno = errno;
+		metadata_insert('r',name,errno,0,0,0);
+		errno = save_errno;
+	}
+
+	return result;
+}
+
+void pfs_service_invalidate( pfs_name *name )
+{
+	if(!metadata_cacheable(name)) return;
+
+	dircache.invalidate();
+
+	if(!metadata_table) return;
+
+	char dir[PFS_PATH_MAX];
+	path_dirname(name->path,dir);
+
+	metadata_remove('s',name->path);
+	metadata_remove('l',name->path);
+	metadata_remove('r',name->path);
+	metadata_remove('s',dir);
+	metadata_remove('l',dir);
+}
+
 /* vim: set noexpandtab tabstop=4: */
@@ -14,6 +14,8 @@ See the file COPYING for details.
 #include "pfs_location.h"
 #include "pfs_search.h"
 
+class pfs_dircache;
+
 class pfs_service {
 public:
 	virtual ~pfs_service() {};
@@ -25,9 +27,11 @@ public:
 	virtual int tilde_is_special();
 	virtual int is_seekable() = 0;
 	virtual int is_local();
+	virtual int is_threadsafe();
 
 	virtual pfs_file * open( pfs_name *name, int flags, mode_t mode );
 	virtual pfs_dir * getdir( pfs_name *name );
+	virtual pfs_dir * getlongdir( pfs_name *name, pfs_dircache *cache );
 
 	virtual int stat( pfs_name *name, struct pfs_stat *buf );
 	virtual int statfs( pfs_name *name, struct pfs_statfs *buf );
@@ -90,4 +94,17 @@ int  pfs_service_get_block_size();
 void * pfs_service_connect_cache( pfs_name *name );
 void pfs_service_disconnect_cache( pfs_name *name, void *cxn, int invalidate );
 
+void pfs_service_set_metadata_ttl( const char *service_name, int ttl );
+
+pfs_dir * pfs_service_getdir( pfs_name *name );
+int  pfs_service_stat( pfs_name *name, struct pfs_stat *buf );
+int  pfs_service_lstat( pfs_name *name, struct pfs_stat *buf );
+int  pfs_service_access( pfs_name *name, mode_t mode );
+int  pfs_service_readlink( pfs_name *name, char *buf, pfs_size_t size );
+int  pfs_service_is_missing( pfs_name *name );
+void pfs_service_set_missing( pfs_name *name );
+void pfs_service_invalidate( pfs_name *name );
+void pfs_service_invalidate_all();
+void pfs_service_invalidate_dircache();
+
 #endif
@@ -7,6 +7,7 @@ See the file COPYING for details.
 
 #include "pfs_table.h"
 #include "pfs_service.h"
+#include "pfs_dircache.h"
 #include "pfs_location.h"
 
 extern "C" {
@@ -36,72 +37,23 @@ extern int pfs_enable_small_file_optimizations;
 
 char chirp_rootpath[] = "/";
 
-static struct hash_table * chirp_dircache = 0;
-static char * chirp_dircache_path = 0;
-
-static void chirp_dircache_invalidate()
-{
-	char *key;
-	void *value;
-
-	if(chirp_dircache) {
-		hash_table_firstkey(chirp_dircache);
-		while(hash_table_nextkey(chirp_dircache,&key,&value)) {
-			hash_table_remove(chirp_dircache,key);
-			free(value);
-		}
-	}
-
-	if(chirp_dircache_path) {
-		free(chirp_dircache_path);
-		chirp_dircache_path = 0;
-	}
-}
-
-static void chirp_dircache_begin( const char *path )
-{
-	chirp_dircache_invalidate();
-	chirp_dircache_path = xxstrdup(path);
-}
-
-static void chirp_dircache_insert( const char *name, struct chirp_stat *info, void *arg )
+static void add_to_dir( const char *name, void *arg )
 {
-	char path[CHIRP_PATH_MAX];
-
-	if(!chirp_dircache) chirp_dircache = hash_table_create(0,0);
-
 	pfs_dir *dir = (pfs_dir *)arg;
 	dir->append(name);
-
-	struct chirp_stat *copy_info = (struct chirp_stat *)malloc(sizeof(*info));
-	*copy_info = *info;
-
-	sprintf(path,"%s/%s",chirp_dircache_path,name);
-
-	hash_table_insert(chirp_dircache,path,copy_info);
 }
 
-static int chirp_dircache_lookup( const char *path, struct chirp_stat *info )
-{
-	struct chirp_stat *value;
-
-	if(!chirp_dircache) chirp_dircache = hash_table_create(0,0);
-
-	value = (struct chirp_stat*) hash_table_lookup(chirp_dircache,path);
-	if(value) {
-		*info = *value;
-		hash_table_remove(chirp_dircache,path);
-		free(value);
-		return 1;
-	} else {
-		return 0;
-	}
-}
+struct longdir_args {
+	pfs_dir *dir;
+	pfs_dircache *cache;
+};
 
-static void add_to_dir( const char *name, void *arg )
+static void add_to_longdir( const char *name, struct chirp_stat *info, void *arg )
 {
-	pfs_dir *dir = (pfs_dir *)arg;
-	dir->append(name);
+	struct longdir_args *args = (struct longdir_args *)arg;
+	struct pfs_stat buf;
+	COPY_CSTAT(*info,buf);
+	args->cache->insert(name,&buf,args->dir);
 }
 
 class pfs_file_chirp : public pfs_file
@@ -123,7 +75,7 @@ public:
 	}
 
 	virtual pfs_ssize_t write( const void *data, pfs_size_t length, pfs_off_t offset ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_pwrite(file,data,length,offset,time(0)+pfs_master_timeout);
 	}
 
@@ -144,17 +96,17 @@ public:
 	}
 
 	virtual int ftruncate( pfs_size_t length ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_ftruncate(file,length,time(0)+pfs_master_timeout);
 	}
 
 	virtual int fchmod( mode_t mode ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_fchmod(file,mode,time(0)+pfs_master_timeout);
 	}
 
 	virtual int fchown( uid_t uid, gid_t gid ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_fchown(file,uid,gid,time(0)+pfs_master_timeout);
 	}
 
@@ -175,7 +127,7 @@ public:
 	}
 
 	virtual int fsync() {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_flush(file,time(0)+pfs_master_timeout)>=0 ? 0 : -1;
 	}
 
@@ -200,7 +152,7 @@ class pfs_service_chirp : public pfs_service {
 public:
 	virtual pfs_file * open( pfs_name *name, int flags, mode_t mode ) {
 		struct chirp_file *file;
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		file = chirp_global_open(name->hostport,name->rest,flags,mode,time(0)+pfs_master_timeout);
 		if(file) {
 			return new pfs_file_chirp(name,file);
@@ -289,28 +241,30 @@ public:
 	}
 
 	virtual pfs_dir * getdir( pfs_name *name ) {
-		int result=-1;
 		pfs_dir *dir = new pfs_dir(name);
-
-		if(pfs_enable_small_file_optimizations) {
-			chirp_dircache_begin(name->path);
-			result = chirp_global_getlongdir(name->hostport,name->rest,chirp_dircache_insert,dir,time(0)+pfs_master_timeout);
+		if(chirp_global_getdir(name->hostport,name->rest,add_to_dir,dir,time(0)+pfs_master_timeout)>=0) {
+			return dir;
 		} else {
-			result = -1;
-			errno = EINVAL;
+			delete dir;
+			return 0;
 		}
+	}
 
-		if(result<0 && (errno==EINVAL||errno==ENOSYS)) {
-			chirp_dircache_invalidate();
-			result = chirp_global_getdir(name->hostport,name->rest,add_to_dir,dir,time(0)+pfs_master_timeout);
+	virtual pfs_dir * getlongdir( pfs_name *name, pfs_dircache *cache ) {
+		struct longdir_args args;
+		args.dir = new pfs_dir(name);
+		args.cache = cache;
+
+		if(chirp_global_getlongdir(name->hostport,name->rest,add_to_longdir,&args,time(0)+pfs_master_timeout)>=0) {
+			return args.dir;
 		}
 
-		if(result>=0) {
-			return dir;
-		} else {
-			delete dir;
-			return 0;
+		delete args.dir;
+		if(errno==EINVAL||errno==ENOSYS) {
+			cache->invalidate();
+			return getdir(name);
 		}
+		return 0;
 	}
 
 	virtual int statfs( pfs_name *name, struct pfs_statfs *buf ) {
@@ -324,12 +278,6 @@ public:
 	virtual int stat( pfs_name *name, struct pfs_stat *buf ) {
 		struct chirp_stat cbuf;
 		int result;
-		if(chirp_dircache_lookup(name->path,&cbuf)) {
-			if(!S_ISLNK(cbuf.cst_mode)) {
-				COPY_CSTAT(cbuf,*buf);
-				return 0;
-			}
-		}
 		result = chirp_global_stat(name->hostport,name->rest,&cbuf,time(0)+pfs_master_timeout); /* BUG: was _lstat */
 		if(result==0) COPY_CSTAT(cbuf,*buf);
 		return result;
@@ -338,10 +286,6 @@ public:
 	virtual int lstat( pfs_name *name, struct pfs_stat *buf ) {
 		struct chirp_stat cbuf;
 		int result;
-		if(chirp_dircache_lookup(name->path,&cbuf)) {
-			COPY_CSTAT(cbuf,*buf);
-			return 0;
-		}
 		result = chirp_global_lstat(name->hostport,name->rest,&cbuf,time(0)+pfs_master_timeout);
 		if(result==0) COPY_CSTAT(cbuf,*buf);
 		return result;
@@ -349,7 +293,7 @@ public:
 
 	virtual int unlink( pfs_name *name ) {
 		int result;
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		if(pfs_enable_small_file_optimizations) {
 			result = chirp_global_rmall(name->hostport,name->rest,time(0)+pfs_master_timeout);
 			if(result<0 && errno==ENOSYS) {
@@ -367,22 +311,22 @@ public:
 	}
 
 	virtual int chmod( pfs_name *name, mode_t mode ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_chmod(name->hostport,name->rest,mode,time(0)+pfs_master_timeout);
 	}
 
 	virtual int chown( pfs_name *name, uid_t uid, gid_t gid ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_chown(name->hostport,name->rest,uid,gid,time(0)+pfs_master_timeout);
 	}
 
 	virtual int lchown( pfs_name *name, uid_t uid, gid_t gid ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_lchown(name->hostport,name->rest,uid,gid,time(0)+pfs_master_timeout);
 	}
 
 	virtual int truncate( pfs_name *name, pfs_off_t length ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_truncate(name->hostport,name->rest,length,time(0)+pfs_master_timeout);
 	}
 
@@ -394,7 +338,7 @@ public:
 		INT64_T result;
 		time_t stoptime = time(0) + pfs_master_timeout;
 
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 
 		if(!strcmp(name->hostport,newname->hostport)) {
 			result = chirp_global_rename(name->hostport,name->rest,newname->rest,stoptime);
@@ -467,12 +411,12 @@ public:
 	}
 
 	virtual int link( pfs_name *name, pfs_name *newname ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_link(name->hostport,name->rest,newname->rest,time(0)+pfs_master_timeout);
 	}
 
 	virtual int symlink( const char *linkname, pfs_name *newname ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_symlink(newname->hostport,linkname,newname->rest,time(0)+pfs_master_timeout);
 	}
 
@@ -481,13 +425,13 @@ public:
 	}
 
 	virtual int mkdir( pfs_name *name, mode_t mode ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_mkdir(name->hostport,name->rest,mode,time(0)+pfs_master_timeout);
 	}
 
 	virtual int rmdir( pfs_name *name ) {
 		int result;
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		if(pfs_enable_small_file_optimizations) {
 			result = chirp_global_rmall(name->hostport,name->rest,time(0)+pfs_master_timeout);
 			if(result<0 && errno==ENOSYS) {
@@ -500,12 +444,12 @@ public:
 	}
 
 	virtual int mkalloc( pfs_name *name, pfs_ssize_t size, mode_t mode ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_mkalloc(name->hostport,name->rest,size,mode,time(0)+pfs_master_timeout);
 	}
 
 	virtual int lsalloc( pfs_name *name, char *alloc_name, pfs_ssize_t *size, pfs_ssize_t *inuse ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_lsalloc(name->hostport,name->rest,alloc_name,size,inuse,time(0)+pfs_master_timeout);
 	}
 
@@ -515,7 +459,7 @@ public:
 		FILE *sourcefile;
 		pfs_ssize_t result;
 
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 
 		sourcefile = fopen(source->logical_name,"r");
 		if(!sourcefile) return -1;
@@ -540,7 +484,7 @@ public:
 		pfs_ssize_t result;
 		int save_errno;
 
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 
 		targetfile = fopen(target->logical_name,"w");
 		if(!targetfile) return -1;
@@ -559,7 +503,7 @@ public:
 	{
 		pfs_ssize_t result;
 
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 
 		result = chirp_global_thirdput(source->hostport,source->rest,target->hostport,target->rest,time(0)+pfs_master_timeout);
 		if(result>=0) {
@@ -571,26 +515,26 @@ public:
 
 	virtual int md5( pfs_name *path, unsigned char *digest )
 	{
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_md5(path->hostport,path->rest,digest,time(0)+pfs_master_timeout);
 	}
 
 	virtual int whoami( pfs_name *name, char *buf, int size ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_whoami(name->hostport,name->rest,buf,size,time(0)+pfs_master_timeout);
 	}
 
 	virtual int getacl( pfs_name *name, char *buf, int size ) {
 		int result;
 		buf[0] = 0;
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		result = chirp_global_getacl(name->hostport,name->rest,add_to_acl,buf,time(0)+pfs_master_timeout);
 		if(result==0) result = strlen(buf);
 		return result;
 	}
 
 	virtual int setacl( pfs_name *name, const char *subject, const char *rights ) {
-		chirp_dircache_invalidate();
+		pfs_service_invalidate_dircache();
 		return chirp_global_setacl(name->hostport,name->rest,subject,rights,time(0)+pfs_master_timeout);
 	}
 
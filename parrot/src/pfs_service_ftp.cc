@@ -34,18 +34,23 @@ class pfs_file_ftp : public pfs_file
 private:
 	FILE *stream;
 	struct ftp_lite_server *server;
+	int written;
 
 public:
 	pfs_file_ftp( pfs_name *n, FILE *s, struct ftp_lite_server *sr ) : pfs_file(n) {
 		stream = s;
 		server = sr;
+		written = 0;
 	}
 
 	virtual int close() {
-		fclose(stream);
-		ftp_lite_done(server);
-		pfs_service_disconnect_cache(&name,server,0);
-		return 0;
+		/* A write is only complete once the server confirms the transfer. */
+		int ok = fclose(stream)==0;
+		ok = ftp_lite_done(server) && ok;
+		pfs_service_disconnect_cache(&name,server,!ok);
+		if(ok || !written) return 0;
+		errno = EIO;
+		return -1;
 	}
 
 	virtual pfs_ssize_t read( void *d, pfs_size_t length, pfs_off_t offset ) {
@@ -53,6 +58,7 @@ public:
 	}
 
 	virtual pfs_ssize_t write( const void *d, pfs_size_t length, pfs_off_t offset ) {
+		written = 1;
 		return ::full_fwrite(stream,d,length);
 	}
 };
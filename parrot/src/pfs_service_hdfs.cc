@@ -27,7 +27,6 @@ extern "C" {
 #include <grp.h>
 #include <sys/statfs.h>
 
-extern int pfs_enable_small_file_optimizations;
 extern const char *pfs_username;
 
 #define HDFS_DEFAULT_PORT 9100
@@ -39,8 +38,6 @@ extern const char *pfs_username;
 
 #define HDFS_END debug(D_HDFS,"= %d %s",(int)result,((result>=0) ? "" : strerror(errno))); return result;
 
-static pfs_dircache hdfs_dircache;
-
 class pfs_file_hdfs : public pfs_file
 {
 private:
@@ -65,7 +62,7 @@ public:
 	virtual int fsync() {
 		int result;
 
-		hdfs_dircache.invalidate();
+		pfs_service_invalidate_dircache();
 
 		debug(D_HDFS, "flushing file %s ", name.rest);
 		result = hdfs->flush(fs, handle);
@@ -83,7 +80,7 @@ public:
 	virtual pfs_ssize_t write( const void *data, pfs_size_t length, pfs_off_t offset ) {
 		pfs_ssize_t result;
 
-		hdfs_dircache.invalidate();
+		pfs_service_invalidate_dircache();
 
 		/* Ignore offset since HDFS does not support seekable writes. */
 		debug(D_HDFS, "writing to file %s ", name.rest);
@@ -225,7 +222,7 @@ public:
 		HDFS_CHECK_INIT(0)
 		HDFS_CHECK_FS(0)
 
-		hdfs_dircache.invalidate();
+		pfs_service_invalidate_dircache();
 
 		switch (flags&O_ACCMODE) {
 			case O_RDONLY:
@@ -271,6 +268,14 @@ public:
 	}
 
 	virtual pfs_dir * getdir( pfs_name *name ) {
+		return this->_getdir(name, 0);
+	}
+
+	virtual pfs_dir * getlongdir( pfs_name *name, pfs_dircache *cache ) {
+		return this->_getdir(name, cache);
+	}
+
+	virtual pfs_dir * _getdir( pfs_name *name, pfs_dircache *cache ) {
 		pfs_dir *dir = new pfs_dir(name);
 
 		hdfsFileInfo *file_list = 0;
@@ -280,10 +285,6 @@ public:
 		HDFS_CHECK_INIT(0)
 		HDFS_CHECK_FS(0)
 
-		if (pfs_enable_small_file_optimizations) {
-			hdfs_dircache.begin(name->path);
-		}
-
 		debug(D_HDFS, "checking if directory %s exists", name->rest);
 		if (hdfs->exists(fs, name->rest) < 0) {
 			errno = EINVAL;
@@ -296,9 +297,10 @@ public:
 		struct pfs_stat buf;
 		if (file_list != NULL) {
 			for (int i = 0; i < num_entries; i++) {
-				if (pfs_enable_small_file_optimizations) {
+				if (cache) {
 					hdfs_copy_fileinfo(name, &file_list[i], &buf);
-					hdfs_dircache.insert(file_list[i].mName, &buf, dir);
+					buf.st_mode |= (S_IXUSR | S_IXGRP);
+					cache->insert(file_list[i].mName, &buf, dir);
 				} else {
 					dir->append(file_list[i].mName);
 				}
@@ -345,19 +347,15 @@ public:
 		int result;
 		hdfsFileInfo *file_info = 0;
 
-		if (hdfs_dircache.lookup(name->rest, buf)) {
+		file_info = hdfs->stat(fs, name->rest);
+
+		if (file_info != NULL) {
+			hdfs_copy_fileinfo(name, file_info, buf);
+			hdfs->free_stat(file_info, 1);
 			result = 0;
 		} else {
-			file_info = hdfs->stat(fs, name->rest);
-
-			if (file_info != NULL) {
-				hdfs_copy_fileinfo(name, file_info, buf);
-				hdfs->free_stat(file_info, 1);
-				result = 0;
-			} else {
-				errno = ENOENT;
-				result = -1;
-			}
+			errno = ENOENT;
+			result = -1;
 		}
 
 		HDFS_END
@@ -407,7 +405,7 @@ public:
 		HDFS_CHECK_INIT(-1)
 		HDFS_CHECK_FS(-1)
 
-		hdfs_dircache.invalidate();
+		pfs_service_invalidate_dircache();
 
 		debug(D_HDFS, "mkdir %s", name->rest);
 		result = hdfs->mkdir(fs, name->rest);
@@ -423,7 +421,7 @@ public:
 		HDFS_CHECK_INIT(-1)
 		HDFS_CHECK_FS(-1)
 
-		hdfs_dircache.invalidate();
+		pfs_service_invalidate_dircache();
 
 		debug(D_HDFS, "rmdir %s", name->rest);
 		result = hdfs->unlink(fs, name->rest,1);
@@ -439,7 +437,7 @@ public:
 		HDFS_CHECK_INIT(-1)
 		HDFS_CHECK_FS(-1)
 
-		hdfs_dircache.invalidate();
+		pfs_service_invalidate_dircache();
 
 		debug(D_HDFS, "unlink %s", name->rest);
 		result = hdfs->unlink(fs, name->rest,0);
@@ -455,7 +453,7 @@ public:
 		HDFS_CHECK_INIT(-1)
 		HDFS_CHECK_FS(-1)
 
-		hdfs_dircache.invalidate();
+		pfs_service_invalidate_dircache();
 
 		debug(D_HDFS, "rename %s to %s", name->rest, newname->rest);
 		result = hdfs->rename(fs, name->rest, newname->rest);
@@ -6,6 +6,8 @@ See the file COPYING for details.
 */
 
 #include "pfs_service.h"
+#include "pfs_dir.h"
+#include "pfs_dircache.h"
 
 extern "C" {
 #include "debug.h"
@@ -14,7 +16,10 @@ extern "C" {
 #include "link.h"
 #include "file_cache.h"
 #include "full_io.h"
+#include "hash_table.h"
 #include "http_query.h"
+#include "macros.h"
+#include "url_encode.h"
 }
 
 #include <unistd.h>
@@ -23,47 +28,283 @@ extern "C" {
 #include <fcntl.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
 #include <sys/stat.h>
 #include <sys/statfs.h>
 
 #define HTTP_LINE_MAX 4096
 #define HTTP_PORT 80
 #define HTTP_FILE_MODE (S_IFREG | 0555)
+#define HTTP_DIR_MODE (S_IFDIR | 0555)
 
 extern int pfs_master_timeout;
 
-static struct link * http_fetch( pfs_name *name, const char *action, INT64_T *size )
-{
-	char url[HTTP_LINE_MAX];
+/*
+A file is read with range requests over connections that are kept open
+between them.  Each request asks for a window beyond the bytes wanted:
+the window doubles while the file is read in sequence, up to a limit,
+and starts again from the minimum after a seek.
+*/
 
+#define HTTP_READAHEAD_MIN (64*1024)
+#define HTTP_READAHEAD_MAX (16*1024*1024)
+
+static int http_url( pfs_name *name, char *url )
+{
 	if(!name->host[0]) {
 		errno = ENOENT;
 		return 0;
 	}
 
 	sprintf(url,"http://%s:%d%s",name->host,name->port,name->rest);
-	return http_query_size(url,action,size,time(0)+pfs_master_timeout,0);
+	return 1;
+}
+
+/*
+A directory on a web server is a path that the server redirects to the
+same path with a slash, where it serves an index page linking to each
+entry.  An entry is any link to a name within the directory, and is a
+directory itself if the link ends with a slash.  The index pages made by
+Apache and nginx also give the time of each entry and often its exact
+size, which are then kept to answer a stat without asking again.
+*/
+
+#define HTTP_INDEX_MAX (16*1024*1024)
+
+static int http_is_dir_location( pfs_name *name, const char *location )
+{
+	const char *host = strstr(location,"://");
+	const char *path = host ? strchr(host+3,'/') : 0;
+	size_t length = strlen(name->rest);
+
+	return path && !strncmp(path,name->rest,length) && !strcmp(path+length,"/");
+}
+
+/*
+Read a body in chunked transfer coding, up to the empty chunk that ends
+it and any trailer after, so that the connection may be used again.
+Returns the length of the data, or -1 on failure.
+*/
+
+static INT64_T http_read_chunked( struct link *link, char *data, INT64_T max, time_t stoptime )
+{
+	char line[HTTP_LINE_MAX];
+	INT64_T length = 0;
+
+	while(1) {
+		if(!link_readline(link,line,sizeof(line),stoptime)) return (errno = ECONNRESET, -1);
+		INT64_T chunk = strtoll(line,0,16);
+		if(chunk<0) return (errno = EIO, -1);
+		if(chunk==0) break;
+		if(chunk>max-length) return (errno = EFBIG, -1);
+		if(link_read(link,data+length,chunk,stoptime)!=chunk) return (errno = ECONNRESET, -1);
+		length += chunk;
+		if(!link_readline(link,line,sizeof(line),stoptime)) return (errno = ECONNRESET, -1);
+	}
+
+	while(link_readline(link,line,sizeof(line),stoptime)) {
+		string_chomp(line);
+		if(!line[0]) return length;
+	}
+
+	return (errno = ECONNRESET, -1);
+}
+
+/*
+Read the time and size that follow a link on the same line, with any
+markup between them removed.  The size counts only if it is in bytes.
+*/
+
+static int http_parse_attributes( const char *text, int is_dir, struct pfs_stat *buf )
+{
+	static const char *formats[] = { "%d-%b-%Y %H:%M", "%Y-%m-%d %H:%M", 0 };
+	char plain[HTTP_LINE_MAX];
+	char size[HTTP_LINE_MAX];
+	struct tm tm;
+	size_t n = 0;
+	int in_tag = 0;
+	int i;
+
+	for(;*text && *text!='\n' && n<sizeof(plain)-1;text++) {
+		if(*text=='<') {
+			if(!strncasecmp(text,"<a ",3)) break;
+			in_tag = 1;
+		} else if(*text=='>') {
+			in_tag = 0;
+			plain[n++] = ' ';
+		} else if(!in_tag) {
+			plain[n++] = *text;
+		}
+	}
+	plain[n] = 0;
+
+	const char *s = plain;
+	while(*s==' ' || *s=='\t') s++;
+
+	for(i=0;formats[i];i++) {
+		memset(&tm,0,sizeof(tm));
+		const char *rest = strptime(s,formats[i],&tm);
+		if(!rest) continue;
+
+		buf->st_mtime = buf->st_ctime = buf->st_atime = timegm(&tm);
+		if(is_dir) {
+			buf->st_mode = HTTP_DIR_MODE;
+			buf->st_size = 0;
+			return 1;
+		}
+		if(sscanf(rest," %s",size)==1 && strspn(size,"0123456789")==strlen(size)) {
+			buf->st_mode = HTTP_FILE_MODE;
+			buf->st_size = strtoll(size,0,10);
+			return 1;
+		}
+		return 0;
+	}
+
+	return 0;
+}
+
+static void http_parse_index( pfs_name *name, char *page, pfs_dir *dir, pfs_dircache *cache )
+{
+	struct hash_table *seen = hash_table_create(0,0);
+	char href[PFS_PATH_MAX];
+	char entry[PFS_PATH_MAX];
+	char path[PFS_PATH_MAX];
+	struct pfs_stat buf;
+	char *s = page;
+
+	while((s = strcasestr(s,"href=\""))) {
+		s += 6;
+		char *end = strchr(s,'"');
+		if(!end) break;
+		size_t length = end-s;
+		const char *text = s = end+1;
+		if(length==0 || length>=sizeof(href)) continue;
+		memcpy(href,end-length,length);
+		href[length] = 0;
+
+		/* Links to queries, other directories, or other servers are not entries. */
+		if(strchr("?#/",href[0]) || strchr(href,':')) continue;
+
+		url_decode(href,entry,sizeof(entry));
+		char *e = entry;
+		if(!strncmp(e,"./",2)) e += 2;
+		length = strlen(e);
+		int is_dir = length>0 && e[length-1]=='/';
+		if(is_dir) e[--length] = 0;
+		if(length==0 || strchr(e,'/') || !strcmp(e,".") || !strcmp(e,"..")) continue;
+
+		if(hash_table_lookup(seen,e)) continue;
+		hash_table_insert(seen,e,(void*)1);
+
+		const char *close = strstr(text,"</a>");
+		const char *line = strchr(text,'\n');
+		if(close && (!line || close<line)) text = close+4;
+
+		pfs_service_emulate_stat(name,&buf);
+		if(cache && http_parse_attributes(text,is_dir,&buf)) {
+			size_t base = strlen(name->rest);
+			if(base>0 && name->rest[base-1]=='/') base--;
+			string_nformat(path,sizeof(path),"%.*s/%s",(int)base,name->rest,e);
+			buf.st_ino = hash_string(path);
+			cache->insert(e,&buf,dir);
+		} else {
+			dir->append(e,is_dir ? DT_DIR : DT_REG);
+		}
+	}
+
+	hash_table_delete(seen);
 }
 
 class pfs_file_http : public pfs_file
 {
 private:
+	char url[HTTP_LINE_MAX];
 	struct link *link;
+	pfs_off_t link_offset;
+	INT64_T link_remaining;
+	pfs_off_t last_end;
+	pfs_size_t window;
 	INT64_T size;
+	pthread_mutex_t mutex;
+
+	void release() {
+		if(link) {
+			http_query_release(link,link_remaining==0);
+			link = 0;
+		}
+	}
+
+	pfs_ssize_t read_locked( char *d, pfs_size_t length, pfs_off_t offset ) {
+		/* Skip short gaps in the current response rather than ask again. */
+		if(link && offset>link_offset && offset-link_offset<MIN(link_remaining,HTTP_READAHEAD_MIN)) {
+			INT64_T skip = offset-link_offset;
+			if(link_soak(link,skip,time(0)+pfs_master_timeout)==skip) {
+				link_offset += skip;
+				link_remaining -= skip;
+			} else {
+				link_remaining = -1;
+				release();
+			}
+		}
+
+		if(link && offset!=link_offset) release();
+
+		if(!link) {
+			if(offset==last_end) {
+				window = MIN(window*2,HTTP_READAHEAD_MAX);
+			} else {
+				window = HTTP_READAHEAD_MIN;
+			}
+			pfs_size_t request = MIN(MAX(length,window),size-offset);
+			link = http_query_range(url,"GET",offset,request,&link_remaining,0,time(0)+pfs_master_timeout,0,0);
+			if(!link) return -1;
+			link_offset = offset;
+		}
+
+		pfs_ssize_t actual = link_read(link,d,MIN(length,link_remaining),LINK_FOREVER);
+		if(actual>0) {
+			link_offset += actual;
+			link_remaining -= actual;
+			last_end = offset+actual;
+		} else {
+			link_remaining = -1;
+		}
+		if(link_remaining<=0) release();
+
+		return actual;
+	}
 
 public:
-	pfs_file_http( pfs_name *n, struct link *l, INT64_T s ) : pfs_file(n) {
+	pfs_file_http( pfs_name *n, const char *u, struct link *l, INT64_T length, INT64_T s ) : pfs_file(n) {
+		strcpy(url,u);
 		link = l;
+		link_offset = 0;
+		link_remaining = length;
+		last_end = 0;
+		window = HTTP_READAHEAD_MIN;
 		size = s;
+		pthread_mutex_init(&mutex,0);
+	}
+
+	virtual ~pfs_file_http() {
+		pthread_mutex_destroy(&mutex);
 	}
 
 	virtual int close() {
-		link_close(link);
+		release();
 		return 0;
 	}
 
 	virtual pfs_ssize_t read( void *d, pfs_size_t length, pfs_off_t offset ) {
-		return link_read(link,(char*)d,length,LINK_FOREVER);
+		if(offset>=size || length<=0) return 0;
+		length = MIN(length,size-offset);
+
+		pthread_mutex_lock(&mutex);
+		pfs_ssize_t result = read_locked((char*)d,length,offset);
+		pthread_mutex_unlock(&mutex);
+		return result;
 	}
 
 	virtual int fstat( struct pfs_stat *buf ) {
@@ -77,6 +318,14 @@ public:
 		return size;
 	}
 
+	virtual int is_seekable() {
+		return 1;
+	}
+
+	virtual int is_threadsafe() {
+		return 1;
+	}
+
 };
 
 class pfs_service_http : public pfs_service {
@@ -86,32 +335,101 @@ public:
 	}
 
 	virtual pfs_file * open( pfs_name *name, int flags, mode_t mode ) {
+		char url[HTTP_LINE_MAX];
 		struct link *link;
-		INT64_T size;
+		INT64_T length, total;
 
 		if((flags&O_ACCMODE)!=O_RDONLY) {
 			errno = EROFS;
 			return 0;
 		}
 
-		link = http_fetch(name,"GET",&size);
+		if(!http_url(name,url)) return 0;
+
+		link = http_query_range(url,"GET",0,HTTP_READAHEAD_MIN,&length,&total,time(0)+pfs_master_timeout,0,0);
 		if(link) {
-			return new pfs_file_http(name,link,size);
+			return new pfs_file_http(name,url,link,length,total>=0 ? total : length);
+		} else {
+			return 0;
+		}
+	}
+
+	virtual pfs_dir * getdir( pfs_name *name ) {
+		return getlongdir(name,0);
+	}
+
+	virtual pfs_dir * getlongdir( pfs_name *name, pfs_dircache *cache ) {
+		char url[HTTP_LINE_MAX];
+		struct link *link;
+		INT64_T actual;
+		char *page;
+
+		/* Left alone when the page runs to the end of the connection. */
+		INT64_T size = -2;
+
+		if(!http_url(name,url)) return 0;
+		if(url[strlen(url)-1]!='/') strcat(url,"/");
+
+		time_t stoptime = time(0)+pfs_master_timeout;
+		link = http_query_range(url,"GET",-1,-1,&size,0,stoptime,0,0);
+		if(!link) return 0;
+
+		if(size>HTTP_INDEX_MAX) {
+			http_query_release(link,0);
+			errno = EFBIG;
+			return 0;
+		}
+
+		page = (char*) malloc((size>=0 ? size : HTTP_INDEX_MAX)+1);
+		if(!page) {
+			http_query_release(link,0);
+			errno = ENOMEM;
+			return 0;
+		}
+
+		if(size==-1) {
+			actual = http_read_chunked(link,page,HTTP_INDEX_MAX,stoptime);
+			http_query_release(link,actual>=0);
 		} else {
+			actual = link_read(link,page,size>=0 ? size : HTTP_INDEX_MAX,stoptime);
+			http_query_release(link,size>=0 && actual==size);
+		}
+		if(actual<0) {
+			free(page);
 			return 0;
 		}
+		page[actual] = 0;
+
+		pfs_dir *dir = new pfs_dir(name);
+		http_parse_index(name,page,dir,cache);
+		free(page);
+		return dir;
 	}
 
 	virtual int stat( pfs_name *name, struct pfs_stat *buf ) {
+		char url[HTTP_LINE_MAX];
+		char location[HTTP_LINE_MAX];
 		struct link *link;
 		INT64_T size;
 
-		link = http_fetch(name,"HEAD",&size);
+		if(!http_url(name,url)) return -1;
+
+		if(!strcmp(name->rest,"") || !strcmp(name->rest,"/")) {
+			pfs_service_emulate_stat(name,buf);
+			buf->st_mode = HTTP_DIR_MODE;
+			return 0;
+		}
+
+		link = http_query_range(url,"HEAD",-1,-1,&size,0,time(0)+pfs_master_timeout,0,location);
 		if(link) {
-			link_close(link);
+			http_query_release(link,1);
 			pfs_service_emulate_stat(name,buf);
-			buf->st_mode = HTTP_FILE_MODE;
-			buf->st_size = size;
+			if(location[0] && http_is_dir_location(name,location)) {
+				buf->st_mode = HTTP_DIR_MODE;
+			} else {
+				buf->st_mode = HTTP_FILE_MODE;
+				buf->st_size = MAX(size,0);
+			}
 			return 0;
 		} else {
 			return -1;
@@ -125,6 +443,10 @@ public:
 	virtual int is_seekable (void) {
 		return 0;
 	}
+
+	virtual int is_threadsafe() {
+		return 1;
+	}
 };
 
 static pfs_service_http pfs_service_http_instance;
@@ -9,6 +9,7 @@ Theory of Operation:
 */
 
 #include "pfs_service.h"
+#include "pfs_dircache.h"
 
 extern "C" {
 #include "debug.h"
@@ -223,6 +224,15 @@ public:
 	}
 
 	pfs_dir * getdir( pfs_name *name ) {
+		return _getdir(name, 0);
+	}
+
+	/* A bucket listing carries the size and time of every object. */
+	virtual pfs_dir * getlongdir( pfs_name *name, pfs_dircache *cache ) {
+		return _getdir(name, cache);
+	}
+
+	pfs_dir * _getdir( pfs_name *name, pfs_dircache *cache ) {
 		struct list *dirents;
 		struct s3_dirent_object *d;
 		char bucket[PFS_PATH_MAX];
@@ -245,7 +255,13 @@ public:
 		}
 
 		while( (d = (struct s3_dirent_object*)list_pop_head(dirents)) ) {
-			dir->append(d->key);
+			if(cache) {
+				struct pfs_stat buf;
+				s3_dirent_to_stat(d,&buf);
+				cache->insert(d->key,&buf,dir);
+			} else {
+				dir->append(d->key);
+			}
 			free(d);
 		}
 		list_delete(dirents);
@@ -669,6 +669,11 @@ int pfs_utimensat( int dirfd, const char *path, const struct timespec times[2],
 int pfs_fstatat( int dirfd, const char *path, struct pfs_stat *buf, int flags )
 {
 	char newpath[PFS_PATH_MAX];
+#ifdef AT_EMPTY_PATH
+	if((flags&AT_EMPTY_PATH) && path[0] == 0 && dirfd != AT_FDCWD) {
+		return pfs_fstat(dirfd,buf);
+	}
+#endif
 	if (pfs_current->table->complete_at_path(dirfd,path,newpath) == -1) return -1;
 #ifdef AT_SYMLINK_NOFOLLOW
 	if(flags&AT_SYMLINK_NOFOLLOW) {
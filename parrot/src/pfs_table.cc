@@ -18,6 +18,9 @@ See the file COPYING for details.
 #include "pfs_process.h"
 #include "pfs_file_cache.h"
 #include "pfs_resolve.h"
+#include "pfs_prefetch.h"
+#include "pfs_profile.h"
+#include "pfs_writeback.h"
 
 extern "C" {
 #include "pfs_channel.h"
@@ -87,6 +90,8 @@ static const int _SENTINEL2 = 0;
 	do {\
 		if (!PARROT_FD(fd))\
 			return (errno = EBADF, -1);\
+		if (pfs_profile_enabled)\
+			pfs_profile_service(pointers[fd]->file->get_name()->service_name);\
 	} while (0)
 
 pfs_table::pfs_table()
@@ -400,7 +405,7 @@ void pfs_table::follow_symlink( struct pfs_name *pname, mode_t mode, int depth )
 
 	if (string_prefix_is(pname->path, "/proc/")) in_proc = true;
 
-	int rlres = new_pname.service->readlink(pname,link_target,PFS_PATH_MAX-1);
+	int rlres = pfs_service_readlink(pname,link_target,PFS_PATH_MAX-1);
 	if (rlres > 0) {
 		/* readlink does not NULL-terminate */
 		link_target[rlres] = '\000';
@@ -511,6 +516,9 @@ int pfs_table::resolve_name(int is_special_syscall, const char *cname, struct pf
 		char tmp[PFS_PATH_MAX];
 		path_split(pname->path,pname->service_name,tmp);
 		pname->service = pfs_service_lookup(pname->service_name);
+		if(pfs_profile_enabled) pfs_profile_service(pname->service ? pname->service_name : "local");
+		/* Anything done to a file must wait for its upload. */
+		if(pfs_writeback_pending && pname->service) pfs_writeback_wait(pname->path);
 		if(!pname->service) {
 			pname->service = pfs_service_lookup_default();
 			strcpy(pname->service_name,"local");
@@ -599,7 +607,7 @@ pfs_dir * pfs_table::open_directory(pfs_name *pname, int flags)
 		errno = EISDIR;
 		file = 0;
 	} else {
-		file = pname->service->getdir(pname);
+		file = pfs_service_getdir(pname);
 	}
 	return file;
 }
@@ -642,10 +650,10 @@ pfs_file * pfs_table::open_object( const char *lname, int flags, mode_t mode, in
 
 	// Hack: Disable caching when doing plain old file copies.
 
-		if(
+		if(pfs_current && (
 				!strcmp(pfs_current->name,"cp") ||
 				!strcmp(string_back(pfs_current->name,3),"/cp")
-		) {
+		)) {
 				force_stream = 1;
 		}
 
@@ -663,6 +671,10 @@ pfs_file * pfs_table::open_object( const char *lname, int flags, mode_t mode, in
 	// on the parent directory. However, this seems to cause problems if
 	// system directories (or the filesystem root) are marked RO.
 	if(resolve_name(1,lname,&pname,open_mode)) {
+		if(!(flags&O_CREAT) && pfs_service_is_missing(&pname)) {
+			errno = ENOENT;
+			return 0;
+		}
 		if((flags&O_CREAT) && (flags&O_DIRECTORY)) {
 			// Linux ignores O_DIRECTORY in this combination
 			flags &= ~O_DIRECTORY;
@@ -754,6 +766,15 @@ pfs_file * pfs_table::open_object( const char *lname, int flags, mode_t mode, in
 			}
 		}
 		free(pid);
+
+		if(!file && errno==ENOENT) {
+			pfs_service_set_missing(&pname);
+			errno = ENOENT;
+		} else if((flags&O_ACCMODE)!=O_RDONLY || (flags&(O_CREAT|O_TRUNC))) {
+			pfs_service_invalidate(&pname);
+		} else if(file && !pname.is_local && !(flags&O_DIRECTORY)) {
+			pfs_prefetch_record(pname.logical_name);
+		}
 	} else {
 		file = 0;
 	}
@@ -850,23 +871,12 @@ int pfs_table::close( int fd )
 		CHECK_FD(fd);
 
 		debug(D_DEBUG, "closing parrot fd %d", fd);
-		pfs_pointer *p = pointers[fd];
-		pfs_file *f = p->file;
 
-		int result = 0;
-
-		if(f->refs()==1) {
-			result = f->close();
-			delete f;
-		} else {
-			f->delref();
-		}
+		/* A cached file is written back on close, changing it again. */
+		if((pointers[fd]->flags&O_ACCMODE)!=O_RDONLY)
+			pfs_service_invalidate(pointers[fd]->file->get_name());
 
-		if(p->refs()==1) {
-			delete p;
-		} else {
-			p->delref();
-		}
+		int result = release(pointers[fd]);
 
 		pointers[fd]=0;
 		fd_flags[fd]=0;
@@ -874,6 +884,44 @@ int pfs_table::close( int fd )
 	}
 }
 
+/*
+Take references to the pointer and file behind fd, as dup does,
+so that they outlive a close of fd until given back with release.
+*/
+
+pfs_pointer * pfs_table::hold( int fd )
+{
+	if(!PARROT_FD(fd)) {
+		errno = EBADF;
+		return 0;
+	}
+
+	pointers[fd]->addref();
+	pointers[fd]->file->addref();
+	return pointers[fd];
+}
+
+int pfs_table::release( pfs_pointer *p )
+{
+	pfs_file *f = p->file;
+	int result = 0;
+
+	if(f->refs()==1) {
+		result = f->close();
+		delete f;
+	} else {
+		f->delref();
+	}
+
+	if(p->refs()==1) {
+		delete p;
+	} else {
+		p->delref();
+	}
+
+	return result;
+}
+
 pfs_ssize_t pfs_table::read( int fd, void *data, pfs_size_t nbyte )
 {
 	pfs_ssize_t result = -1;
@@ -955,6 +1003,7 @@ pfs_ssize_t pfs_table::pwrite( int fd, const void *data, pfs_size_t nbyte, pfs_o
 		} else {
 			result = f->write( data, nbyte, offset );
 			if(result>0) f->set_last_offset(offset+result);
+			pfs_service_invalidate(f->get_name());
 		}
 	}
 
@@ -1062,6 +1111,7 @@ int pfs_table::ftruncate( int fd, pfs_off_t size )
 		result = 0;
 	} else {
 		result = pointers[fd]->file->ftruncate(size);
+		pfs_service_invalidate(pointers[fd]->file->get_name());
 	}
 
 	return result;
@@ -1193,6 +1243,7 @@ int pfs_table::fchmod( int fd, mode_t mode )
 {
 	CHECK_FD(fd);
 
+	pfs_service_invalidate(pointers[fd]->file->get_name());
 	return pointers[fd]->file->fchmod(mode);
 }
 
@@ -1201,6 +1252,7 @@ int pfs_table::fchown( int fd, struct pfs_process *p, uid_t uid, gid_t gid )
 	CHECK_FD(fd);
 
 	int result = pointers[fd]->file->fchown(uid,gid);
+	pfs_service_invalidate(pointers[fd]->file->get_name());
 
 	/*
 	If the service doesn't implement it, but its our own uid,
@@ -1276,7 +1328,7 @@ int pfs_table::access( const char *n, mode_t mode )
 	int result = -1;
 
 	if(resolve_name(0,n,&pname,X_OK | mode)) {
-		result = pname.service->access(&pname,mode);
+		result = pfs_service_access(&pname,mode);
 	}
 
 	return result;
@@ -1289,6 +1341,7 @@ int pfs_table::chmod( const char *n, mode_t mode )
 
 	if(resolve_name(0,n,&pname,W_OK)) {
 		result = pname.service->chmod(&pname,mode);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -1301,6 +1354,7 @@ int pfs_table::chown( const char *n, struct pfs_process *p, uid_t uid, gid_t gid
 
 	if(resolve_name(0,n,&pname,W_OK)) {
 		result = pname.service->chown(&pname,uid,gid);
+		pfs_service_invalidate(&pname);
 	}
 
 	/*
@@ -1322,6 +1376,7 @@ int pfs_table::lchown( const char *n, uid_t uid, gid_t gid )
 
 	if(resolve_name(0,n,&pname,W_OK,false)) {
 		result = pname.service->lchown(&pname,uid,gid);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -1334,6 +1389,7 @@ int pfs_table::truncate( const char *n, pfs_off_t offset )
 
 	if(resolve_name(1,n,&pname,W_OK)) {
 		result = pname.service->truncate(&pname,offset);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -1470,6 +1526,7 @@ int pfs_table::utime( const char *n, struct utimbuf *buf )
 
 	if(resolve_name(0,n,&pname,W_OK)) {
 		result = pname.service->utime(&pname,buf);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -1482,6 +1539,7 @@ int pfs_table::utimens( const char *n, const struct timespec times[2] )
 
 	if(resolve_name(0,n,&pname,W_OK)) {
 		result = pname.service->utimens(&pname,times);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -1494,6 +1552,7 @@ int pfs_table::lutimens( const char *n, const struct timespec times[2] )
 
 	if(resolve_name(0,n,&pname,W_OK,false)) {
 		result = pname.service->lutimens(&pname,times);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -1523,7 +1582,7 @@ int pfs_table::stat( const char *n, struct pfs_stat *b )
 
 	/* You don't need to have read permission on a file to stat it. */
 	if(resolve_name(0,n,&pname,F_OK)) {
-		result = pname.service->stat(&pname,b);
+		result = pfs_service_stat(&pname,b);
 		if(result>=0) {
 			b->st_blksize = pname.service->get_block_size();
 		} else if(errno==ENOENT && !pname.hostport[0]) {
@@ -1556,7 +1615,7 @@ int pfs_table::lstat( const char *n, struct pfs_stat *b )
 
 	/* You don't need to have read permission on a file to stat it. */
 	if(resolve_name(0,n,&pname,F_OK,false)) {
-		result = pname.service->lstat(&pname,b);
+		result = pfs_service_lstat(&pname,b);
 		if(result>=0) {
 			b->st_blksize = pname.service->get_block_size();
 		} else if(errno==ENOENT && !pname.hostport[0]) {
@@ -1576,7 +1635,11 @@ int pfs_table::rename( const char *n1, const char *n2 )
 
 	if(resolve_name(0,n1,&p1,E_OK,false) && resolve_name(0,n2,&p2,E_OK,false)) {
 		if(p1.service==p2.service) {
+			/* A renamed directory may hold files still being uploaded. */
+			pfs_writeback_flush();
 			result = p1.service->rename(&p1,&p2);
+			/* Everything under a renamed directory moves with it. */
+			pfs_service_invalidate_all();
 			if(result==0) {
 				pfs_cache_invalidate(&p1);
 				pfs_cache_invalidate(&p2);
@@ -1600,6 +1663,8 @@ int pfs_table::link( const char *n1, const char *n2 )
 	if(resolve_name(0,n1,&p1,W_OK,false) && resolve_name(0,n2,&p2,E_OK,false)) {
 		if(p1.service==p2.service) {
 			result = p1.service->link(&p1,&p2);
+			pfs_service_invalidate(&p1);
+			pfs_service_invalidate(&p2);
 		} else {
 			errno = EXDEV;
 		}
@@ -1624,6 +1689,7 @@ int pfs_table::symlink( const char *target, const char *path )
 
 	if(resolve_name(0,path,&pname,E_OK,false)) {
 		result = pname.service->symlink(target,&pname);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -1669,10 +1735,10 @@ int pfs_table::readlink( const char *n, char *buf, pfs_size_t size )
 				memcpy(buf,path,count);
 				result = (int)count;
 			} else {
-				result = pname.service->readlink(&pname,buf,size);
+				result = pfs_service_readlink(&pname,buf,size);
 			}
 		} else {
-			result = pname.service->readlink(&pname,buf,size);
+			result = pfs_service_readlink(&pname,buf,size);
 		}
 		free(pid);
 		free(fd);
@@ -1691,6 +1757,7 @@ int pfs_table::mknod( const char *n, mode_t mode, dev_t dev )
 
 	if(resolve_name(0,n,&pname,E_OK)) {
 		result = pname.service->mknod(&pname,mode,dev);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -1703,6 +1770,7 @@ int pfs_table::mkdir( const char *n, mode_t mode )
 
 	if(resolve_name(0,n,&pname,E_OK)) {
 		result = pname.service->mkdir(&pname,mode);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -1715,6 +1783,7 @@ int pfs_table::rmdir( const char *n )
 
 	if(resolve_name(0,n,&pname,E_OK,false)) {
 		result = pname.service->rmdir(&pname);
+		pfs_service_invalidate_all();
 	}
 
 	return result;
@@ -1741,6 +1810,7 @@ int pfs_table::mkalloc( const char *n, pfs_ssize_t size, mode_t mode )
 
 	if(resolve_name(0,n,&pname,E_OK)) {
 		result = pname.service->mkalloc(&pname,size,mode);
+		pfs_service_invalidate(&pname);
 	}
 
 	return result;
@@ -47,6 +47,8 @@ public:
 
 	/* operations on open files */
 	int		close( int fd );
+	pfs_pointer *	hold( int fd );
+	static int	release( pfs_pointer *p );
 	pfs_ssize_t	read( int fd, void *data, pfs_size_t length );
 	pfs_ssize_t	write( int fd, const void *data, pfs_size_t length );
 	pfs_ssize_t	pread( int fd, void *data, pfs_size_t length, pfs_off_t offset );
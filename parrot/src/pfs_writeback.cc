@@ -0,0 +1,373 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "pfs_writeback.h"
+#include "pfs_file_cache.h"
+#include "pfs_service.h"
+
+extern "C" {
+#include "debug.h"
+#include "full_io.h"
+#include "hash_table.h"
+#include "itable.h"
+#include "timestamp.h"
+}
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <vector>
+
+/*
+The services are not safe to use from more than one thread, so each
+upload worker is a process forked before any connections are made.
+Parrot sends each worker its requests over its own socket, and all of
+them answer on a single pipe, with results small enough to be written
+atomically.
+*/
+
+struct writeback_request {
+	int id;
+	mode_t mode;
+	pfs_off_t start;
+	pfs_off_t end;
+	char local[PFS_PATH_MAX];
+	struct pfs_name name;
+};
+
+struct writeback_result {
+	int id;
+	int result;
+	int error;
+};
+
+struct writeback_pending {
+	struct writeback_request request;
+	int worker;
+	timestamp_t start;
+};
+
+struct writeback_worker {
+	pid_t pid;
+	int fd;
+	int busy;
+};
+
+int pfs_write_back = 0;
+int pfs_writeback_jobs = 4;
+int pfs_writeback_queue_max = 32;
+int pfs_writeback_pending = 0;
+
+static std::vector<struct writeback_worker> workers;
+static int result_fd = -1;
+static int next_id = 1;
+static int failures = 0;
+
+static struct itable *pending_table = 0;
+static struct hash_table *pending_paths = 0;
+
+static void writeback_worker( int in, int out, pid_t parent )
+{
+	struct writeback_request request;
+	struct writeback_result result;
+
+	prctl(PR_SET_PDEATHSIG,SIGKILL);
+	if(getppid()!=parent) _exit(0);
+
+	signal(SIGTERM,SIG_DFL);
+	signal(SIGINT,SIG_DFL);
+	signal(SIGHUP,SIG_DFL);
+
+	while(full_read(in,&request,sizeof(request))==sizeof(request)) {
+		result.id = request.id;
+		int fd = open(request.local,O_RDONLY);
+		if(fd>=0) {
+			result.result = pfs_cache_store(&request.name,fd,request.mode,request.start,request.end);
+			result.error = errno;
+			close(fd);
+		} else {
+			result.result = -1;
+			result.error = errno;
+		}
+		if(full_write(out,&result,sizeof(result))!=sizeof(result)) break;
+	}
+
+	_exit(0);
+}
+
+int pfs_writeback_start()
+{
+	int fds[2];
+
+	if(pipe(fds)<0) {
+		debug(D_NOTICE,"couldn't start upload workers: %s",strerror(errno));
+		pfs_write_back = 0;
+		return 0;
+	}
+
+	result_fd = fds[0];
+	pid_t parent = getpid();
+
+	for(int i=0;i<pfs_writeback_jobs;i++) {
+		int sv[2];
+		if(socketpair(AF_UNIX,SOCK_STREAM,0,sv)<0) {
+			debug(D_NOTICE,"couldn't start upload worker: %s",strerror(errno));
+			break;
+		}
+
+		pid_t pid = fork();
+		if(pid==0) {
+			close(sv[0]);
+			close(result_fd);
+			for(size_t j=0;j<workers.size();j++) close(workers[j].fd);
+			writeback_worker(sv[1],fds[1],parent);
+		} else if(pid>0) {
+			struct writeback_worker w = { pid, sv[0], 0 };
+			close(sv[1]);
+			fcntl(sv[0],F_SETFD,FD_CLOEXEC);
+			workers.push_back(w);
+		} else {
+			debug(D_NOTICE,"couldn't start upload worker: %s",strerror(errno));
+			close(sv[0]);
+			close(sv[1]);
+			break;
+		}
+	}
+
+	close(fds[1]);
+	fcntl(result_fd,F_SETFD,FD_CLOEXEC);
+
+	if(workers.empty()) {
+		close(result_fd);
+		result_fd = -1;
+		pfs_write_back = 0;
+		return 0;
+	}
+
+	pending_table = itable_create(0);
+	pending_paths = hash_table_create(0,0);
+
+	debug(D_CACHE,"writing back files with %d workers",(int)workers.size());
+	return workers.size();
+}
+
+static void writeback_done( const struct writeback_result *result )
+{
+	struct writeback_pending *p = (struct writeback_pending *) itable_remove(pending_table,result->id);
+	if(!p) return;
+
+	const char *path = p->request.name.path;
+	intptr_t count = (intptr_t) hash_table_remove(pending_paths,path);
+	if(count>1) hash_table_insert(pending_paths,path,(void*)(count-1));
+
+	workers[p->worker].busy--;
+	pfs_writeback_pending--;
+
+	/* The worker changed the file behind the back of the metadata cache. */
+	pfs_service_invalidate(&p->request.name);
+
+	if(result->result==0) {
+		debug(D_CACHE,"stored %s in the background in %.3fs",path,(timestamp_get()-p->start)/1000000.0);
+	} else {
+		debug(D_NOTICE,"couldn't store %s: %s",path,strerror(result->error));
+		failures++;
+	}
+
+	delete p;
+}
+
+static void worker_lost( int slot )
+{
+	struct writeback_worker *w = &workers[slot];
+	std::vector<int> lost;
+	UINT64_T key;
+	void *value;
+
+	if(!w->pid) return;
+
+	debug(D_NOTICE,"upload worker %d exited unexpectedly",(int)w->pid);
+	close(w->fd);
+	w->pid = 0;
+	w->fd = -1;
+
+	itable_firstkey(pending_table);
+	while(itable_nextkey(pending_table,&key,&value)) {
+		if(((struct writeback_pending *)value)->worker==slot) lost.push_back(key);
+	}
+
+	for(size_t i=0;i<lost.size();i++) {
+		struct writeback_result result = { lost[i], -1, EIO };
+		writeback_done(&result);
+	}
+}
+
+/*
+Process the results that are ready, waiting up to timeout milliseconds
+for the first.  While waiting, Parrot is not reaping its children, so
+check on the workers here too.
+*/
+
+static void writeback_collect( int timeout )
+{
+	struct pollfd pfd;
+	struct writeback_result result;
+
+	while(pfs_writeback_pending>0) {
+		pfd.fd = result_fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		int n = poll(&pfd,1,timeout);
+		if(n>0) {
+			if(full_read(result_fd,&result,sizeof(result))==sizeof(result)) {
+				writeback_done(&result);
+				timeout = 0;
+				continue;
+			}
+			for(size_t i=0;i<workers.size();i++) worker_lost(i);
+			return;
+		} else if(n<0 && errno==EINTR) {
+			continue;
+		} else if(timeout==0) {
+			return;
+		}
+
+		for(size_t i=0;i<workers.size();i++) {
+			if(workers[i].pid && waitpid(workers[i].pid,0,WNOHANG)!=0) worker_lost(i);
+		}
+	}
+}
+
+static int send_request( int fd, const struct writeback_request *request )
+{
+	const char *data = (const char *) request;
+	size_t length = sizeof(*request);
+
+	while(length>0) {
+		ssize_t n = send(fd,data,length,MSG_NOSIGNAL);
+		if(n<0) {
+			if(errno==EINTR) continue;
+			return -1;
+		}
+		data += n;
+		length -= n;
+	}
+
+	return 0;
+}
+
+int pfs_writeback_queue( pfs_name *name, const char *local, mode_t mode, pfs_off_t start, pfs_off_t end )
+{
+	if(!pfs_write_back) return (errno = ENOSYS, -1);
+
+	writeback_collect(0);
+
+	/* Uploads of the same file must not overtake each other. */
+	pfs_writeback_wait(name->path);
+
+	while(pfs_writeback_pending>=pfs_writeback_queue_max) {
+		writeback_collect(1000);
+	}
+
+	int slot = -1;
+	for(size_t i=0;i<workers.size();i++) {
+		if(workers[i].pid && (slot<0 || workers[i].busy<workers[slot].busy)) slot = i;
+	}
+	if(slot<0) return (errno = ECHILD, -1);
+
+	struct writeback_pending *p = new writeback_pending;
+	p->request.id = next_id++;
+	p->request.mode = mode;
+	p->request.start = start;
+	p->request.end = end;
+	strncpy(p->request.local,local,sizeof(p->request.local)-1);
+	p->request.local[sizeof(p->request.local)-1] = 0;
+	p->request.name = *name;
+	p->worker = slot;
+	p->start = timestamp_get();
+
+	if(send_request(workers[slot].fd,&p->request)<0) {
+		int save_errno = errno;
+		delete p;
+		worker_lost(slot);
+		return (errno = save_errno, -1);
+	}
+
+	itable_insert(pending_table,p->request.id,p);
+	intptr_t count = (intptr_t) hash_table_remove(pending_paths,name->path);
+	hash_table_insert(pending_paths,name->path,(void*)(count+1));
+	workers[slot].busy++;
+	pfs_writeback_pending++;
+
+	debug(D_CACHE,"queued %s for upload by worker %d",name->path,(int)workers[slot].pid);
+	return 0;
+}
+
+void pfs_writeback_wait( const char *path )
+{
+	if(!pfs_writeback_pending) return;
+
+	writeback_collect(0);
+
+	if(hash_table_lookup(pending_paths,path)) {
+		debug(D_CACHE,"waiting for upload of %s",path);
+		while(hash_table_lookup(pending_paths,path)) {
+			writeback_collect(1000);
+		}
+	}
+}
+
+void pfs_writeback_flush()
+{
+	if(!pfs_writeback_pending) return;
+
+	debug(D_CACHE,"waiting for %d uploads",pfs_writeback_pending);
+	while(pfs_writeback_pending>0) {
+		writeback_collect(1000);
+	}
+}
+
+int pfs_writeback_exited( pid_t pid )
+{
+	for(size_t i=0;i<workers.size();i++) {
+		if(workers[i].pid==pid) {
+			worker_lost(i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int pfs_writeback_finish()
+{
+	if(workers.empty()) return 0;
+
+	pfs_writeback_flush();
+
+	for(size_t i=0;i<workers.size();i++) {
+		if(!workers[i].pid) continue;
+		close(workers[i].fd);
+		kill(workers[i].pid,SIGKILL);
+		waitpid(workers[i].pid,0,0);
+	}
+	workers.clear();
+
+	close(result_fd);
+	result_fd = -1;
+
+	if(failures) debug(D_NOTICE,"%d files could not be stored",failures);
+	return failures;
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -0,0 +1,42 @@
+/*
+Copyright (C) 2026- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef PFS_WRITEBACK_H
+#define PFS_WRITEBACK_H
+
+#include "pfs_name.h"
+
+#include <sys/types.h>
+
+/*
+A remote file written through the file cache is normally stored back
+whole when it is closed, and close does not return to the program until
+the service has it all.  In write-back mode, close instead queues the
+file for one of a few worker processes, started along with Parrot, that
+read it from the cache and store it with their own connections, so the
+program goes on while the upload proceeds.  The queue is bounded, so a
+close waits once too many uploads are outstanding.  Any use of a name
+that still has an upload pending waits for it to finish, as does fsync
+and a rename, and Parrot waits for all of them before it exits.  An
+upload that fails is reported at exit, and makes Parrot exit with an
+error if the program itself succeeded.
+*/
+
+extern int pfs_write_back;
+extern int pfs_writeback_jobs;
+extern int pfs_writeback_queue_max;
+extern int pfs_writeback_pending;
+
+int  pfs_writeback_start();
+int  pfs_writeback_queue( pfs_name *name, const char *local, mode_t mode, pfs_off_t start, pfs_off_t end );
+void pfs_writeback_wait( const char *path );
+void pfs_writeback_flush();
+int  pfs_writeback_exited( pid_t pid );
+int  pfs_writeback_finish();
+
+#endif
+
+/* vim: set noexpandtab tabstop=4: */
@@ -88,10 +88,13 @@ struct tracer {
 	int has_args5_bug;
 };
 
-int tracer_attach (pid_t pid)
+int tracer_attach (pid_t pid, int seccomp)
 {
 	intptr_t options = PTRACE_O_TRACESYSGOOD|PTRACE_O_TRACEEXEC|PTRACE_O_TRACEEXIT|PTRACE_O_TRACECLONE|PTRACE_O_TRACEFORK|PTRACE_O_TRACEVFORK;
 
+	if (seccomp)
+		options |= PTRACE_O_TRACESECCOMP;
+
 	if (linux_available(3,8,0))
 		options |= PTRACE_O_EXITKILL;
 	assert(linux_available(2,5,60));
@@ -192,7 +195,7 @@ void tracer_detach( struct tracer *t )
 	free(t);
 }
 
-int tracer_continue( struct tracer *t, int signum )
+int tracer_continue( struct tracer *t, int signum, int syscall_stop )
 {
 	t->gotregs = 0;
 	if(t->setregs) {
@@ -200,7 +203,7 @@ int tracer_continue( struct tracer *t, int signum )
 			return -1;
 		t->setregs = 0;
 	}
-	if (ptrace(PTRACE_SYSCALL,t->pid,0,signum) == -1)
+	if (ptrace(syscall_stop ? PTRACE_SYSCALL : PTRACE_CONT,t->pid,0,signum) == -1)
 		ERROR;
 	return 0;
 }
@@ -0,0 +1,90 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+test_dir=http_dir.dir
+server=http_dir
+chunked=http_dir_chunked
+script=http_dir.py
+out=http_dir.out
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	mkdir -p $test_dir/www/top/sub
+	for f in one two three; do echo $f > $test_dir/www/top/$f; done
+	echo four > $test_dir/www/top/sub/four
+
+	http_server_start $test_dir/www $server || return 1
+
+	# Like nginx and Apache, list directories in chunks over a connection kept open.
+	cat > $script <<EOF
+import http.server, os, sys
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	def list_directory(self, path):
+		page = "".join('<a href="%s">%s</a> 19-Oct-2026 12:00 -\\n' % (n, n) for n in sorted(os.listdir(path))).encode()
+		self.send_response(200)
+		self.send_header("Content-Type", "text/html")
+		self.send_header("Transfer-Encoding", "chunked")
+		self.end_headers()
+		if self.command == "HEAD":
+			return None
+		half = len(page) // 2
+		for chunk in (page[:half], page[half:], b""):
+			self.wfile.write(b"%x\\r\\n%s\\r\\n" % (len(chunk), chunk))
+		return None
+
+	def log_message(self, format, *args):
+		sys.stderr.write("%s %s\\n" % (self.client_address[1], format % args))
+
+os.chdir(sys.argv[1])
+s = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+open(sys.argv[2], "w").write(str(s.server_port))
+s.serve_forever()
+EOF
+
+	http_server_start $test_dir/www $chunked $script
+}
+
+run()
+{
+	url=/http/127.0.0.1:$(cat $server.port)
+
+	parrot find $url/top | sort > $out || return 1
+	printf "$url/top\n$url/top/one\n$url/top/sub\n$url/top/sub/four\n$url/top/three\n$url/top/two\n" | diff - $out || return 1
+
+	# Each directory is listed with one request, and entries are typed without asking for each.
+	[ "$(grep -c '"GET /top/ ' $server.log)" = 1 ] || return 1
+	[ "$(grep -c '"GET /top/sub/ ' $server.log)" = 1 ] || return 1
+	grep -q '"HEAD /top/\(one\|two\|three\|sub/four\) ' $server.log && return 1
+
+	parrot test -d $url/top/sub || return 1
+	parrot test -f $url/top/one || return 1
+
+	# A chunked listing ends at its last chunk, not when the server gives up on the connection.
+	url=/http/127.0.0.1:$(cat $chunked.port)
+	timeout 30 ../src/parrot_run -T 60 ls $url/top $url/top/sub > $out || return 1
+	printf "$url/top:\none\nsub\nthree\ntwo\n\n$url/top/sub:\nfour\n" | diff - $out || return 1
+	[ "$(grep -c '"GET /top/\(sub/\)\? ' $chunked.log)" = 2 ] || return 1
+	# Each listing leaves its connection ready for the next request.
+	[ "$(grep -A1 '"GET /top/ ' $chunked.log | cut -d' ' -f1 | uniq | wc -l)" = 1 ] || return 1
+}
+
+clean()
+{
+	http_server_stop $server
+	http_server_stop $chunked
+	rm -rf $test_dir $script $out
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
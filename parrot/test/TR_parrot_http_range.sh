@@ -0,0 +1,82 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+test_dir=http_range.dir
+server=http_range
+script=http_range.py
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	mkdir -p $test_dir
+	dd if=/dev/urandom of=$test_dir/data bs=1024 count=4096 2>/dev/null
+
+	# A server for simple byte ranges over persistent connections, logging each request.
+	cat > $script <<EOF
+import http.server, os, re, sys
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	def send_head(self):
+		f = open(self.translate_path(self.path), "rb")
+		size = os.fstat(f.fileno()).st_size
+		start, end = 0, size - 1
+		m = re.match(r"bytes=(\d+)-(\d*)", self.headers.get("Range", ""))
+		if m:
+			start = int(m.group(1))
+			end = min(int(m.group(2) or end), end)
+			self.send_response(206)
+			self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, size))
+		else:
+			self.send_response(200)
+		self.remaining = end - start + 1
+		self.send_header("Content-Length", str(self.remaining))
+		self.end_headers()
+		f.seek(start)
+		return f
+
+	def copyfile(self, src, dst):
+		dst.write(src.read(self.remaining))
+
+	def log_message(self, format, *args):
+		sys.stderr.write("%s %s\n" % (self.client_address[1], format % args))
+
+os.chdir(sys.argv[1])
+s = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+open(sys.argv[2], "w").write(str(s.server_port))
+s.serve_forever()
+EOF
+
+	http_server_start $test_dir $server $script
+}
+
+run()
+{
+	url=/http/127.0.0.1:$(cat $server.port)/data
+
+	# Without caching, reads at any offset are served by range requests.
+	expected=$(dd if=$test_dir/data bs=1000 skip=3000 count=5 2>/dev/null | md5sum)
+	[ "$(parrot -s sh -c "dd if=$url bs=1000 skip=3000 count=5 2>/dev/null | md5sum")" = "$expected" ] || return 1
+	grep -q '"GET /data HTTP/1.1" 206' $server.log || return 1
+	parrot -s cmp $url $test_dir/data || return 1
+
+	# Sequential reads ask for growing windows over a single connection.
+	[ $(grep 'GET /data' $server.log | tail -n 5 | cut -d' ' -f1 | sort -u | wc -l) -eq 1 ] || return 1
+}
+
+clean()
+{
+	http_server_stop $server
+	rm -rf $test_dir $script
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
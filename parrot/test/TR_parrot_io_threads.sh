@@ -0,0 +1,93 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+test_dir=io_threads.dir
+server=io_threads
+slow=io_threads.slow
+script=io_threads.py
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	mkdir -p $test_dir
+	dd if=/dev/urandom of=$test_dir/one bs=1024 count=4096 2>/dev/null
+	dd if=/dev/urandom of=$test_dir/two bs=1024 count=1024 2>/dev/null
+
+	http_server_start $test_dir $server || return 1
+
+	# Serves ranges, those after the start of a file only after a few seconds.
+	cat > $script <<EOF
+import http.server, os, re, sys, time
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	def send_head(self):
+		f = open(self.translate_path(self.path), "rb")
+		size = os.fstat(f.fileno()).st_size
+		start, end = 0, size - 1
+		m = re.match(r"bytes=(\d+)-(\d*)", self.headers.get("Range", ""))
+		if m:
+			start = int(m.group(1))
+			end = min(int(m.group(2) or end), end)
+			if start > 0:
+				time.sleep(5)
+			self.send_response(206)
+			self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, size))
+		else:
+			self.send_response(200)
+		self.remaining = end - start + 1
+		self.send_header("Content-Length", str(self.remaining))
+		self.end_headers()
+		f.seek(start)
+		return f
+
+	def copyfile(self, src, dst):
+		dst.write(src.read(self.remaining))
+
+	def log_message(self, format, *args):
+		pass
+
+os.chdir(sys.argv[1])
+s = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+open(sys.argv[2], "w").write(str(s.server_port))
+s.serve_forever()
+EOF
+
+	http_server_start $test_dir $slow $script
+}
+
+run()
+{
+	url=/http/127.0.0.1:$(cat $server.port)
+
+	# Processes reading at once through the I/O threads each see their own data.
+	parrot -s --io-threads=2 sh -c "cmp $url/one $test_dir/one & a=\$!; cmp $url/two $test_dir/two & b=\$!; wait \$a && wait \$b" || return 1
+
+	# Reads that move the file pointer still follow one another.
+	expected=$(dd if=$test_dir/one bs=1000 skip=3000 count=5 2>/dev/null | md5sum)
+	[ "$(parrot -s --io-threads=2 sh -c "dd if=$url/one bs=1000 skip=3000 count=5 2>/dev/null | md5sum")" = "$expected" ] || return 1
+	[ "$(parrot --io-threads=2 sh -c "dd if=$url/one bs=1000 skip=3000 count=5 2>/dev/null | md5sum")" = "$expected" ] || return 1
+
+	# Other processes go on while a read waits.
+	url=/http/127.0.0.1:$(cat $slow.port)
+	parrot -s --io-threads=2 sh -c "dd if=$url/two of=$test_dir/read bs=1000 skip=500 count=1 2>/dev/null & sleep 1; touch $test_dir/other; wait" || return 1
+	[ $(($(stat -c %Y $test_dir/read) - $(stat -c %Y $test_dir/other))) -ge 3 ] || return 1
+}
+
+clean()
+{
+	http_server_stop $server
+	http_server_stop $slow
+	rm -rf $test_dir $script
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
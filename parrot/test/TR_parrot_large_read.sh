@@ -0,0 +1,31 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+data=large_read.data
+
+prepare()
+{
+	dd if=/dev/urandom of=$data bs=1048576 count=16 2>/dev/null
+}
+
+run()
+{
+	# Reads of every size, from the stack buffer through the channel
+	# to a mapping of the file, see the same data at the same offsets.
+	for bs in 4096 262144 1048576 3000000; do
+		expected=$(dd if=$data bs=$bs skip=2 count=3 2>/dev/null | md5sum)
+		[ "$(parrot dd if=$data bs=$bs skip=2 count=3 2>/dev/null | md5sum)" = "$expected" ] || return 1
+		[ "$(parrot sh -c "dd if=$data bs=$bs 2>/dev/null | md5sum")" = "$(md5sum < $data)" ] || return 1
+	done
+}
+
+clean()
+{
+	rm -f $data
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
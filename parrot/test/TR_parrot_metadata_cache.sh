@@ -0,0 +1,59 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+test_dir=metadata_cache.dir
+server=metadata_cache
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	mkdir -p $test_dir
+	echo hello > $test_dir/data
+
+	http_server_start $test_dir $server
+}
+
+requests()
+{
+	grep -c '"\(GET\|HEAD\) ' $server.log
+}
+
+run()
+{
+	url=/http/127.0.0.1:$(cat $server.port)
+	probe="for i in 1 2 3 4 5 6 7 8 9 10; do stat $url/data >/dev/null; test -e $url/missing; cat $url/missing 2>/dev/null; done; cat $url/data"
+
+	# Without the cache, every probe goes to the server.
+	before=$(requests)
+	[ "$(parrot sh -c "$probe")" = hello ] || return 1
+	uncached=$(($(requests) - before))
+
+	# With it, each name is looked up once, found or not.
+	before=$(requests)
+	[ "$(parrot --metadata-cache=60 sh -c "$probe")" = hello ] || return 1
+	cached=$(($(requests) - before))
+
+	echo "$uncached requests without the metadata cache, $cached with it"
+	[ $cached -lt 10 ] && [ $uncached -gt 20 ] || return 1
+
+	# A time to live of zero for the service turns it off.
+	before=$(requests)
+	parrot --metadata-cache=60 --metadata-cache=http:0 sh -c "$probe" > /dev/null
+	[ $(($(requests) - before)) -gt 20 ] || return 1
+}
+
+clean()
+{
+	http_server_stop $server
+	rm -rf $test_dir
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -0,0 +1,49 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+test_dir=prefetch.dir
+server=prefetch
+list=prefetch.list
+debug=prefetch.debug
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	mkdir -p $test_dir/www
+	for f in one two three; do echo $f > $test_dir/www/$f; done
+
+	http_server_start $test_dir/www $server
+}
+
+run()
+{
+	url=/http/127.0.0.1:$(cat $server.port)
+
+	# The first run records the remote files it opens, in order, and nothing local.
+	rm -f $list
+	[ "$(parrot -t $test_dir/cache1 --prefetch-list $list sh -c "cat $url/two $url/one $url/two $url/three")" = "$(printf 'two\none\ntwo\nthree')" ] || return 1
+	printf "$url/two\n$url/one\n$url/three\n" | diff - $list || return 1
+
+	# The next run fetches them all into an empty cache, and records only what it opens.
+	[ "$(../src/parrot_run -d cache -o $debug -t $test_dir/cache2 --prefetch-list $list --prefetch-jobs 2 sh -c "sleep 2; cat $url/three")" = three ] || return 1
+	for f in one two three; do
+		grep -q "prefetched $url/$f" $debug || return 1
+	done
+	echo "$url/three" | diff - $list || return 1
+}
+
+clean()
+{
+	http_server_stop $server
+	rm -rf $test_dir $list $debug
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
\ No newline at end of file
@@ -0,0 +1,44 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+data=profile.data
+profile=profile.json
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	dd if=/dev/zero of=$data bs=4096 count=16 2>/dev/null
+}
+
+run()
+{
+	parrot --profile $profile dd if=$data of=/dev/null bs=4096 2>/dev/null || return 1
+
+	# Every read is counted with its bytes and latency, under the system call and the service.
+	python3 - $profile <<'PYTHON' || return 1
+import json, sys
+p = json.load(open(sys.argv[1]))
+assert p["command"].startswith("dd ")
+assert p["wall_time"][1] == "s" and p["bytes_read"][1] == "MB"
+read = [s for s in p["syscalls"] if s["name"] == "read"][0]
+assert read["count"] >= 17 and read["bytes"] >= 65536
+assert sum(read["histogram"]) == read["count"]
+assert read["p50_us"] <= read["p90_us"] <= read["p99_us"] <= read["max_us"]
+assert [s for s in p["services"] if s["name"] == "local"][0]["count"] > 0
+PYTHON
+}
+
+clean()
+{
+	rm -f $data $profile
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -0,0 +1,32 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+test_dir=seccomp.dir
+
+prepare()
+{
+	mkdir -p $test_dir
+	echo hello > $test_dir/file
+}
+
+run()
+{
+	# Paths, Parrot fds, and pipes between processes are all still virtualized.
+	[ "$(parrot --seccomp -M /seccomp=$PWD/$test_dir sh -c 'cat /seccomp/file | tr a-z A-Z')" = HELLO ] || return 1
+	[ "$(parrot --seccomp -M /seccomp=$PWD/$test_dir sh -c 'echo goodbye > /seccomp/new; cat /seccomp/new')" = goodbye ] || return 1
+	[ "$(cat $test_dir/new)" = goodbye ] || return 1
+
+	# As are identities.
+	[ "$(parrot --seccomp -U 1234 id -u)" = 1234 ] || return 1
+}
+
+clean()
+{
+	rm -rf $test_dir
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
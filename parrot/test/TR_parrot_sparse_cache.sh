@@ -0,0 +1,59 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+test_dir=sparse_cache.dir
+tmp_dir=sparse_cache.tmp
+server_pid=sparse_cache.pid
+server_log=sparse_cache.log
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	mkdir -p $test_dir
+	dd if=/dev/urandom of=$test_dir/data bs=1024 count=4096 2>/dev/null
+
+	python3 -u -m http.server 0 --bind 127.0.0.1 --directory $test_dir > $server_log 2>&1 &
+	echo $! > $server_pid
+
+	for i in 1 2 3 4 5; do
+		grep -q port $server_log && return 0
+		sleep 1
+	done
+	return 1
+}
+
+run()
+{
+	port=$(sed -n 's/.*port \([0-9]*\).*/\1/p' $server_log | head -1)
+	url=/http/127.0.0.1:$port/data
+	options="-t $PWD/$tmp_dir --sparse-cache --sparse-cache-block-size=64K --sparse-cache-readahead=1"
+
+	# Reading a little from the start of the file fetches only a few blocks.
+	expected=$(dd if=$test_dir/data bs=1000 skip=10 count=1 2>/dev/null | md5sum)
+	[ "$(parrot $options sh -c "dd if=$url bs=1000 skip=10 count=1 2>/dev/null | md5sum")" = "$expected" ] || return 1
+	[ $(du -k $tmp_dir/blocks | tail -1 | cut -f1) -lt 1024 ] || return 1
+
+	# Later reads see the same data, whether cached or not.
+	parrot $options cmp $url $test_dir/data || return 1
+
+	# A limit evicts files not in use.
+	cp $test_dir/data $test_dir/other
+	parrot $options --sparse-cache-limit=6M cmp $(dirname $url)/other $test_dir/other || return 1
+	[ $(ls $tmp_dir/blocks | wc -l) -eq 2 ] || return 1
+}
+
+clean()
+{
+	[ -f $server_pid ] && kill $(cat $server_pid)
+	rm -rf $test_dir $tmp_dir $server_pid $server_log
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
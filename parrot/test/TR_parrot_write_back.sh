@@ -0,0 +1,123 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+test_dir=write_back.dir
+server=write_back.py
+server_pid=write_back.pid
+server_log=write_back.log
+port_file=write_back.port
+debug=write_back.debug
+
+check_needed()
+{
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	mkdir -p $test_dir/root
+
+	# Just enough of an anonymous FTP server to store and fetch files.
+	cat > $server <<EOF
+import os, socket, socketserver, sys
+
+root = sys.argv[1]
+
+class Handler(socketserver.StreamRequestHandler):
+	def reply(self, line):
+		self.wfile.write((line + "\r\n").encode())
+		self.wfile.flush()
+
+	def handle(self):
+		self.reply("220 ready")
+		data = None
+		for line in self.rfile:
+			command, _, arg = line.decode().rstrip("\r\n").partition(" ")
+			command = command.upper()
+			path = os.path.join(root, arg.lstrip("/"))
+			if command == "USER":
+				self.reply("331 password")
+			elif command in ("PASS", "TYPE"):
+				self.reply("230 ok")
+			elif command == "SIZE" and os.path.isfile(path):
+				self.reply("213 %d" % os.path.getsize(path))
+			elif command == "PASV":
+				data = socket.socket()
+				data.bind(("127.0.0.1", 0))
+				data.listen(1)
+				port = data.getsockname()[1]
+				self.reply("227 Entering Passive Mode (127,0,0,1,%d,%d)" % (port // 256, port % 256))
+			elif command in ("RETR", "STOR") and (command == "STOR" or os.path.isfile(path)):
+				self.reply("150 transferring")
+				conn, _ = data.accept()
+				data.close()
+				if command == "RETR":
+					conn.sendall(open(path, "rb").read())
+				else:
+					contents = b""
+					while True:
+						block = conn.recv(65536)
+						if not block:
+							break
+						contents += block
+				conn.close()
+				try:
+					if command == "STOR":
+						open(path, "wb").write(contents)
+					self.reply("226 done")
+				except OSError:
+					self.reply("550 failed")
+			elif command == "QUIT":
+				self.reply("221 bye")
+				return
+			else:
+				self.reply("550 no")
+
+class Server(socketserver.ThreadingMixIn, socketserver.TCPServer):
+	daemon_threads = True
+
+s = Server(("127.0.0.1", 0), Handler)
+open(sys.argv[2], "w").write(str(s.server_address[1]))
+s.serve_forever()
+EOF
+
+	python3 -u $server $test_dir/root $PWD/$port_file > $server_log 2>&1 &
+	echo $! > $server_pid
+
+	for i in 1 2 3 4 5; do
+		[ -s $port_file ] && return 0
+		sleep 1
+	done
+	return 1
+}
+
+run()
+{
+	url=/anonftp/127.0.0.1:$(cat $port_file)
+	root=$test_dir/root
+
+	# Files written are uploaded by the workers, and can be read back at once.
+	[ "$(../src/parrot_run -d cache -o $debug -t $test_dir/cache --write-back --write-back-jobs 2 sh -c "for f in one two three; do echo \$f > $url/\$f; done; echo more >> $url/one; cat $url/one")" = "$(printf 'one\nmore')" ] || return 1
+	for f in two three; do
+		[ "$(cat $root/$f)" = $f ] || return 1
+		grep -q "stored $url/$f in the background" $debug || return 1
+	done
+	[ "$(cat $root/one)" = "$(printf 'one\nmore')" ] || return 1
+
+	# An upload that fails after the program closed the file makes Parrot fail.
+	mkdir $root/gone
+	../src/parrot_run -t $test_dir/cache --write-back sh -c "exec 3>$url/gone/file; rm -rf $PWD/$root/gone; echo lost >&3; exec 3>&-" && return 1
+	return 0
+}
+
+clean()
+{
+	[ -f $server_pid ] && kill $(cat $server_pid)
+	rm -rf $test_dir $server $server_pid $server_log $port_file $debug
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
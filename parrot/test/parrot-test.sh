@@ -11,4 +11,37 @@ parrot() {
 	fi
 }
 
+# Serve a directory over HTTP on a free port of the loopback interface.
+# The pid, log, and port of the server are written to NAME.pid, NAME.log,
+# and NAME.port.  The server is python's http.server, or the given script,
+# which is passed the directory and the port file to write.
+http_server_start() {
+	http_dir=$1
+	http_name=$2
+	http_script=$3
+
+	rm -f "$http_name.port"
+	if [ -n "$http_script" ]; then
+		python3 -u "$http_script" "$http_dir" "$PWD/$http_name.port" > "$http_name.log" 2>&1 &
+	else
+		python3 -u -m http.server 0 --bind 127.0.0.1 --directory "$http_dir" > "$http_name.log" 2>&1 &
+	fi
+	echo $! > "$http_name.pid"
+
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		if [ -z "$http_script" ]; then
+			sed -n 's/.*port \([0-9]*\).*/\1/p' "$http_name.log" | head -1 > "$http_name.port"
+		fi
+		[ -s "$http_name.port" ] && return 0
+		sleep 1
+	done
+	return 1
+}
+
+# Stop a server started by http_server_start, and remove its files.
+http_server_stop() {
+	[ -f "$1.pid" ] && kill $(cat "$1.pid")
+	rm -f "$1.pid" "$1.log" "$1.port"
+}
+
 # vim: set noexpandtab tabstop=4: